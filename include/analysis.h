@@ -0,0 +1,61 @@
+// Cached analyses of a function.
+//
+// Several passes need the dominator tree (and some the dominance frontiers or the loops)
+// of the function they transform. AnalysisCache computes each analysis the first time it
+// is asked for, and keeps it until it is invalidated, so a pipeline of passes which do not
+// change the CFG builds the dominator tree once.
+//
+// Invalidation is explicit. All of the cached analyses depend only on the CFG, so a pass
+// which changes the CFG (adds, removes or renumbers blocks, or changes edges) must call
+// invalidate() before asking for an analysis again - and before it returns, unless its
+// PassManager entry says that it may change the CFG (see passes.h). Changing instructions
+// alone does not invalidate anything.
+//
+// The time spent computing each analysis, and the number of times it was computed, are
+// recorded for the pass timing report.
+
+#ifndef ANALYSIS_H_
+#define ANALYSIS_H_
+
+#include <memory>
+
+#include "dominators.h"
+#include "ir.h"
+#include "loops.h"
+
+enum class Analysis
+{
+    DOMINATORS, FRONTIERS, LOOPS
+};
+const int AnalysisCount = 3;
+
+const char * analysis_str(Analysis);
+
+class AnalysisCache
+{
+    private:
+        const IrFunction& function;
+        std::unique_ptr<DominatorTree> tree;
+        std::unique_ptr<DominanceFrontiers> frontier_sets;
+        std::unique_ptr<LoopInfo> loop_info;
+
+        int counts[AnalysisCount] = {};
+        double times[AnalysisCount] = {};
+
+    public:
+        explicit AnalysisCache(const IrFunction&);
+
+        const DominatorTree& dominators();
+        const DominanceFrontiers& frontiers();
+        const LoopInfo& loops();
+
+        // Forget every analysis (the CFG has changed).
+        void invalidate();
+
+        // Number of times an analysis has been computed, and the total time taken
+        // (seconds).
+        inline int computed(Analysis analysis) const { return counts[static_cast<int>(analysis)]; }
+        inline double seconds(Analysis analysis) const { return times[static_cast<int>(analysis)]; }
+};
+
+#endif
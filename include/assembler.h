@@ -0,0 +1,155 @@
+// In-memory x86-64 assembler.
+//
+// Assembler encodes the code which AsmEmitter builds into machine code, so a module can be
+// run without an external assembler and linker (see Jit). The emitter gives it the
+// instructions of each function as it builds them, without writing them out as text. It
+// also assembles text, in the dialect of GNU
+// assembler syntax - AT&T operand order, size suffixes - rather than all of it: the general
+// purpose instructions the emitter uses, and the SSE2 ones of its vector operations, with
+// register, immediate and memory operands (base, index, scale and displacement, or a
+// symbol relative to rip), labels, and the directives for sections and data (.text, .data,
+// .bss, .section, .globl, .balign, .ascii, .zero, .byte, .word, .long, .quad; .type and
+// .size are ignored): each line is parsed into a MachineInstr (see machine.h), and encoded
+// as the emitter's are.
+//
+// Instructions are encoded as GNU as encodes them (the same choice of opcode, immediate
+// size and displacement size), so the code can be compared byte for byte with its output.
+// A section is built as a list of fragments, each a run of bytes ending in at most one
+// jump: a new fragment starts at each label. Jumps to a label in the same section start in
+// their short form (rel8), and are lengthened (rel32) until every displacement fits.
+//
+// References which cannot be resolved here - to other sections, global symbols, and
+// undefined symbols - are left as relocations (with zero in the field, as in an ELF object
+// with explicit addends).
+
+#ifndef ASSEMBLER_H_
+#define ASSEMBLER_H_
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "machine.h"
+
+class AssemblerError : public std::runtime_error
+{
+    public:
+        int line;
+
+        AssemblerError(const std::string& errmsg, int line)
+          : std::runtime_error(errmsg)
+          , line(line) { }
+};
+
+// A field to be set to the address of a symbol plus an addend: 64 bits, or 32 bits
+// relative to the field's own address (the addend accounts for the distance to the end of
+// the instruction).
+struct AsmRelocation
+{
+    size_t offset;
+    int symbol;
+    int64_t addend;
+    bool relative;
+};
+
+struct AsmSection
+{
+    std::vector<uint8_t> bytes;
+    std::vector<AsmRelocation> relocations;
+    size_t align = 1;
+};
+
+// Symbol, and where it is defined (or section -1).
+struct AsmSymbol
+{
+    std::string name;
+    int section = -1;
+    size_t offset = 0;
+    bool global = false;
+};
+
+class Assembler
+{
+    public:
+        enum SectionId
+        {
+            TEXT, DATA, BSS,
+
+            // (Sections other than these are parsed, and dropped.)
+            OTHER
+        };
+        static const int SectionCount = 3;
+
+    private:
+        struct Fragment
+        {
+            std::vector<uint8_t> bytes;
+            std::vector<AsmRelocation> relocations;
+
+            // Jump at the end (jmp, or the condition code of a jcc), to a symbol.
+            int target = -1;
+            int condition = -1;
+            bool wide = false;
+
+            // Alignment of the start.
+            size_t align = 1;
+            size_t address = 0;
+        };
+
+        std::vector<Fragment> fragments[SectionCount + 1];
+        AsmSection sections[SectionCount];
+        std::vector<AsmSymbol> symbol_table;
+        std::unordered_map<std::string, int> names;
+
+        // Fragment which starts at each label.
+        std::vector<size_t> label_fragments;
+        int current = TEXT;
+
+        // Line of the text being assembled (for errors), or -1.
+        int line = -1;
+
+        int symbol(const std::string&);
+
+        // Symbol referenced by an operand (without the '@PLT' of a call).
+        int reference(const std::string&);
+        Fragment& fragment() { return fragments[current].back(); }
+        void byte(uint8_t b) { fragment().bytes.push_back(b); }
+        void bytes(uint64_t value, int size);
+
+        void label(const std::string&);
+        void directive(const std::string& name, const std::string& arguments);
+        void instruction(const std::string& mnemonic, const std::vector<MachineOperand>&);
+
+        // Encode an instruction with a ModRM operand. 'reg' is a register or an opcode
+        // extension, 'rm' a register or memory operand.
+        void encode(const std::vector<uint8_t>& opcode, int width, int reg, bool reg_is_byte,
+            const MachineOperand& rm, int immediate_size = 0, int64_t immediate = 0);
+        void jump(int condition, const MachineOperand& target);
+        void layout(int section);
+
+        void add(const MachineInstr&);
+
+    public:
+        Assembler();
+
+        // Parse assembly into instructions, labels and directives.
+        static std::vector<MachineInstr> parse(const std::string& text);
+
+        // Encode instructions, labels and directives (DELETED ones are skipped), and lay out
+        // the sections once they have all been added. (An Assembler is used once.)
+        void add(const std::vector<MachineInstr>&);
+        void finish();
+
+        // Assemble a file, and lay out its sections.
+        void assemble(const std::string& text);
+
+        inline const AsmSection& section(int id) const { return sections[id]; }
+        inline const std::vector<AsmSymbol>& symbols() const { return symbol_table; }
+
+        // Index of a symbol, or -1.
+        int find(const std::string&) const;
+};
+
+#endif
@@ -4,16 +4,24 @@
 //
 // This file provides class declarations for AST node types, AstBuilder class, and AstVisitor 
 // base class. AstBuilder builds an AST representation from a parse tree. AstVisitor provides
-// abstract methods for walking an AST.
+// abstract methods for walking an AST, and AstWalker visits every node in a tree.
+//
+// Building, walking, and destroying an AST use explicit stacks rather than recursion, so
+// deeply nested expressions cannot overflow the call stack. The nesting depth is limited
+// (see DefaultAstDepthLimit), for passes which do recurse.
 
 #ifndef AST_H_ 
 #define AST_H_
 
 #include <memory>
 #include <list>
+#include <vector>
+#include <stdexcept>
+#include <string>
 
 #include "token.h"
 #include "parser.h"
+#include "type.h"
 
 class PrimaryExprAstNode;
 class BinaryExprAstNode;
@@ -24,6 +32,16 @@ class AssignExprAstNode;
 class ExprAstNode;
 class AstNode;
 class DeclAstNode;
+class StmtAstNode;
+class CompoundStmtAstNode;
+class ExprStmtAstNode;
+class ReturnStmtAstNode;
+class IterationStmtAstNode;
+class SwitchStmtAstNode;
+class CaseStmtAstNode;
+class JumpStmtAstNode;
+class FunctionDefAstNode;
+class TranslationUnitAstNode;
 
 // AST visitor abstract base class.
 class AstVisitor
@@ -37,29 +55,148 @@ class AstVisitor
         virtual void visit(AssignExprAstNode&) = 0;
         virtual void visit(ExprAstNode&) = 0;
         virtual void visit(DeclAstNode&) = 0;
+        virtual void visit(CompoundStmtAstNode&) = 0;
+        virtual void visit(ExprStmtAstNode&) = 0;
+        virtual void visit(ReturnStmtAstNode&) = 0;
+        virtual void visit(IterationStmtAstNode&) = 0;
+        virtual void visit(SwitchStmtAstNode&) = 0;
+        virtual void visit(CaseStmtAstNode&) = 0;
+        virtual void visit(JumpStmtAstNode&) = 0;
+        virtual void visit(FunctionDefAstNode&) = 0;
+        virtual void visit(TranslationUnitAstNode&) = 0;
+};
+
+// Default maximum AST nesting depth.
+const int DefaultAstDepthLimit = 10000;
+
+// Error building or walking an AST (i.e., nesting depth limit exceeded, or an invalid
+// declaration).
+class AstError : public std::runtime_error
+{
+    public:
+        int line;
+        int position;
+
+        AstError(const std::string& errmsg, int line, int position)
+          : std::runtime_error(errmsg)
+          , line(line)
+          , position(position) { }
 };
 
 // AST builder class
 //
-// This class creates an AST representation from a parse tree.
+// This class creates an AST representation from a parse tree. Parse nodes are expanded
+// onto a work stack, and AST nodes are built from a value stack once their operands are
+// complete.
+//
+// Declaration types are interned in a TypeContext - either the builder's own, or one
+// shared with later passes.
 class AstBuilder
 {
     private:
-        std::shared_ptr<ExprAstNode> expr(const ParseNode&);
-        std::shared_ptr<ExprAstNode> postfix(const ParseNode&);
-        std::shared_ptr<ExprAstNode> unary(const ParseNode&);
-        std::shared_ptr<ExprAstNode> cast(const ParseNode&);
-        std::shared_ptr<ExprAstNode> binary(const ParseNode&);
-        std::shared_ptr<ExprAstNode> tertiary(const ParseNode&);
-        std::shared_ptr<ExprAstNode> assignment(const ParseNode&);
-        std::shared_ptr<DeclAstNode> declaration(const ParseNode&);
+        struct Work
+        {
+            const ParseNode * node;
+            int depth;
+            bool reduce;
+        };
+        std::vector<Work> work;
+        std::vector<std::shared_ptr<ExprAstNode>> values;
+        TypeContext own_context;
+        TypeContext& context;
+        const int depth_limit;
+
+        // Number of iteration and switch statements enclosing the statement being built.
+        int loops = 0;
+        int switches = 0;
+
+        void check_depth(const ParseNode&, int);
+        void expand(const ParseNode&, int);
+        void reduce(const ParseNode&);
+        std::shared_ptr<ExprAstNode> expr(const ParseNode&, int depth = 0);
+        void postfix(const ParseNode&);
+        void unary(const ParseNode&);
+        void binary(const ParseNode&);
+        void tertiary(const ParseNode&);
+        void assignment(const ParseNode&);
+
+        std::shared_ptr<CType> specifiers(const ParseNode&);
+        std::shared_ptr<CType> pointer(const ParseNode&, std::shared_ptr<CType>);
+        std::shared_ptr<CType> direct_declarator(
+            const ParseNode&,
+            std::shared_ptr<CType>,
+            int,
+            std::list<std::shared_ptr<DeclAstNode>> * = nullptr);
+        std::list<std::shared_ptr<DeclAstNode>> parameters(const ParseNode&, int);
+        std::shared_ptr<DeclAstNode> declarator(
+            const ParseNode&,
+            std::shared_ptr<CType>,
+            const ParseNode *,
+            int,
+            std::list<std::shared_ptr<DeclAstNode>> * = nullptr);
+        void init_declarators(
+            const ParseNode&, std::shared_ptr<CType>, int, std::list<std::shared_ptr<AstNode>>&);
+        void declaration(const ParseNode&, int, std::list<std::shared_ptr<AstNode>>&);
+        std::shared_ptr<StmtAstNode> statement(const ParseNode&, int);
+        std::shared_ptr<StmtAstNode> labeled(const ParseNode&, int);
+        std::shared_ptr<StmtAstNode> selection(const ParseNode&, int);
+        std::shared_ptr<StmtAstNode> iteration(const ParseNode&, int);
+        std::shared_ptr<StmtAstNode> jump(const ParseNode&, int);
+        std::shared_ptr<CompoundStmtAstNode> compound(const ParseNode&, int);
+        void external_declaration(const ParseNode&, std::list<std::shared_ptr<AstNode>>&);
+        std::shared_ptr<TranslationUnitAstNode> translation_unit(const ParseNode&);
     public:
+        explicit AstBuilder(int depth_limit = DefaultAstDepthLimit);
+        explicit AstBuilder(TypeContext&, int depth_limit = DefaultAstDepthLimit);
         std::shared_ptr<AstNode> build(const ParseNode&);
 };
 
+// Iterative post-order AST walker.
+//
+// Calls accept() on every node in the tree, after all of its children. Visitors used with
+// the walker should not visit child nodes themselves.
+class AstWalker
+{
+    private:
+        struct Frame
+        {
+            std::shared_ptr<AstNode> node;
+            int depth;
+            bool expanded;
+        };
+        std::vector<Frame> stack;
+        std::shared_ptr<AstNode> visiting;
+        const int depth_limit;
+
+    public:
+        explicit AstWalker(int depth_limit = DefaultAstDepthLimit);
+        void walk(const std::shared_ptr<AstNode>&, AstVisitor&);
+
+        // The node currently being visited.
+        inline const std::shared_ptr<AstNode>& current() const { return visiting; }
+};
+
+// Get the child nodes of an AST node, in evaluation order.
+std::vector<std::shared_ptr<AstNode>> ast_children(AstNode&);
+
+// Get the labels of a switch statement ('case' and 'default' labels in its body, but not
+// in a nested switch), in source order.
+std::vector<CaseStmtAstNode *> switch_labels(SwitchStmtAstNode&);
+
 // AST node base class.
 class AstNode
 {
+    protected:
+        // Release a child node from a destructor. Children are destroyed iteratively, so
+        // that destroying a deep tree does not recurse. (Members are no longer const once
+        // destruction has started.)
+        template<typename T>
+        static inline void release(const std::shared_ptr<T>& child)
+        {
+            release_node(std::move(const_cast<std::shared_ptr<T>&>(child)));
+        }
+        static void release_node(std::shared_ptr<AstNode>);
+
     public:
         virtual void accept(AstVisitor&) = 0;
         virtual ~AstNode();
@@ -68,6 +205,9 @@ class AstNode
 // Expression node (should not be instantiated directly)
 class ExprAstNode : public AstNode
 {
+    public:
+        // Expression type (set by semantic analysis).
+        std::shared_ptr<CType> ctype;
 };
 
 class PrimaryExprAstNode : public ExprAstNode
@@ -75,6 +215,9 @@ class PrimaryExprAstNode : public ExprAstNode
     public:
         const std::shared_ptr<Token> token;
 
+        // Declaration of an identifier (set by NameResolver).
+        DeclAstNode * declaration = nullptr;
+
         explicit inline PrimaryExprAstNode(std::shared_ptr<Token> t) : token(t) {}
 
         virtual void accept(AstVisitor&) override;
@@ -116,6 +259,7 @@ class PostfixExprAstNode : public ExprAstNode
         ) : type(type)
           , left(left)
           , right(right) {}
+        ~PostfixExprAstNode();
 
         virtual void accept(AstVisitor&) override;
 };
@@ -136,6 +280,7 @@ class UnaryExprAstNode : public ExprAstNode
             std::shared_ptr<ExprAstNode> right
         ) : type(type)
           , right(right) {}
+        ~UnaryExprAstNode();
 
         virtual void accept(AstVisitor&) override;
 };
@@ -162,6 +307,7 @@ class BinaryExprAstNode : public ExprAstNode
         ) : left(left)
           , right(right)
           , op(op) {}
+        ~BinaryExprAstNode();
 
         virtual void accept(AstVisitor&) override;
 };
@@ -179,6 +325,7 @@ class TertiaryExprAstNode : public ExprAstNode
         ) : conditional(conditional)
         , left(left)
         , right(right) {}
+        ~TertiaryExprAstNode();
 
         virtual void accept(AstVisitor&) override;
 };
@@ -202,14 +349,216 @@ class AssignExprAstNode : public ExprAstNode
         ) : type(type)
           , left(left)
           , right(right) {}
+        ~AssignExprAstNode();
 
         virtual void accept(AstVisitor&) override;
 };
 
 // Declaration
+//
+// Each declarator in a declaration is a separate DeclAstNode ('int a, *b = 0;' declares
+// two). The identifier is null for parameters declared without one ('int f(char *);').
 class DeclAstNode : public AstNode
 {
     public:
+        const std::shared_ptr<CType> type;
+        const std::shared_ptr<Token> identifier;
+        const std::shared_ptr<ExprAstNode> initializer;
+
+        inline DeclAstNode(
+            std::shared_ptr<CType> type,
+            std::shared_ptr<Token> identifier,
+            std::shared_ptr<ExprAstNode> initializer = nullptr
+        ) : type(type)
+          , identifier(identifier)
+          , initializer(initializer) {}
+        ~DeclAstNode();
+
+        virtual void accept(AstVisitor&) override;
+};
+
+// Statement node (should not be instantiated directly)
+class StmtAstNode : public AstNode
+{
+};
+
+// Compound statement (block). Items are DeclAstNodes and StmtAstNodes, in source order.
+class CompoundStmtAstNode : public StmtAstNode
+{
+    public:
+        const std::list<std::shared_ptr<AstNode>> items;
+
+        explicit inline CompoundStmtAstNode(
+            std::list<std::shared_ptr<AstNode>>&& items
+        ) : items(std::move(items)) {}
+        ~CompoundStmtAstNode();
+
+        virtual void accept(AstVisitor&) override;
+};
+
+// Expression statement. The expression is null for an empty statement (';').
+class ExprStmtAstNode : public StmtAstNode
+{
+    public:
+        const std::shared_ptr<ExprAstNode> expr;
+
+        explicit inline ExprStmtAstNode(
+            std::shared_ptr<ExprAstNode> expr
+        ) : expr(expr) {}
+        ~ExprStmtAstNode();
+
+        virtual void accept(AstVisitor&) override;
+};
+
+// Return statement. The expression is null for 'return;'.
+class ReturnStmtAstNode : public StmtAstNode
+{
+    public:
+        const std::shared_ptr<Token> token;
+        const std::shared_ptr<ExprAstNode> expr;
+
+        inline ReturnStmtAstNode(
+            std::shared_ptr<Token> token,
+            std::shared_ptr<ExprAstNode> expr
+        ) : token(token)
+          , expr(expr) {}
+        ~ReturnStmtAstNode();
+
+        virtual void accept(AstVisitor&) override;
+};
+
+enum class IterationType
+{
+    WHILE, DO, FOR
+};
+
+// Iteration statement. The first clause of a 'for' (init) is either its declarations
+// (DeclAstNodes), or an ExprStmtAstNode; it is empty for 'while' and 'do'. The condition
+// is null if it is omitted from a 'for' (which then loops until a 'break'), and so is the
+// step.
+class IterationStmtAstNode : public StmtAstNode
+{
+    public:
+        const IterationType type;
+        const std::shared_ptr<Token> token;
+        const std::list<std::shared_ptr<AstNode>> init;
+        const std::shared_ptr<ExprAstNode> condition, step;
+        const std::shared_ptr<StmtAstNode> body;
+
+        inline IterationStmtAstNode(
+            IterationType type,
+            std::shared_ptr<Token> token,
+            std::list<std::shared_ptr<AstNode>>&& init,
+            std::shared_ptr<ExprAstNode> condition,
+            std::shared_ptr<ExprAstNode> step,
+            std::shared_ptr<StmtAstNode> body
+        ) : type(type)
+          , token(token)
+          , init(std::move(init))
+          , condition(condition)
+          , step(step)
+          , body(body) {}
+        ~IterationStmtAstNode();
+
+        virtual void accept(AstVisitor&) override;
+};
+
+// Switch statement. Its body is an ordinary statement: control jumps to the label
+// (CaseStmtAstNode) which matches the value of the condition - see switch_labels.
+class SwitchStmtAstNode : public StmtAstNode
+{
+    public:
+        const std::shared_ptr<Token> token;
+        const std::shared_ptr<ExprAstNode> condition;
+        const std::shared_ptr<StmtAstNode> body;
+
+        inline SwitchStmtAstNode(
+            std::shared_ptr<Token> token,
+            std::shared_ptr<ExprAstNode> condition,
+            std::shared_ptr<StmtAstNode> body
+        ) : token(token)
+          , condition(condition)
+          , body(body) {}
+        ~SwitchStmtAstNode();
+
+        virtual void accept(AstVisitor&) override;
+};
+
+// 'case' or 'default' label (which the builder only accepts inside a switch), and the
+// statement it labels. The value is null for 'default'.
+class CaseStmtAstNode : public StmtAstNode
+{
+    public:
+        const std::shared_ptr<Token> token;
+        const std::shared_ptr<ExprAstNode> value;
+        const std::shared_ptr<StmtAstNode> body;
+
+        inline CaseStmtAstNode(
+            std::shared_ptr<Token> token,
+            std::shared_ptr<ExprAstNode> value,
+            std::shared_ptr<StmtAstNode> body
+        ) : token(token)
+          , value(value)
+          , body(body) {}
+        ~CaseStmtAstNode();
+
+        virtual void accept(AstVisitor&) override;
+};
+
+enum class JumpType
+{
+    BREAK, CONTINUE
+};
+
+// 'break' or 'continue' statement (which the builder only accepts inside a loop, or for
+// 'break', a switch).
+class JumpStmtAstNode : public StmtAstNode
+{
+    public:
+        const JumpType type;
+        const std::shared_ptr<Token> token;
+
+        inline JumpStmtAstNode(
+            JumpType type,
+            std::shared_ptr<Token> token
+        ) : type(type)
+          , token(token) {}
+
+        virtual void accept(AstVisitor&) override;
+};
+
+// Function definition. Parameters are in scope in the body (which is the same block scope
+// - 6.2.1, 4).
+class FunctionDefAstNode : public AstNode
+{
+    public:
+        const std::shared_ptr<DeclAstNode> decl;
+        const std::list<std::shared_ptr<DeclAstNode>> parameters;
+        const std::shared_ptr<CompoundStmtAstNode> body;
+
+        inline FunctionDefAstNode(
+            std::shared_ptr<DeclAstNode> decl,
+            std::list<std::shared_ptr<DeclAstNode>>&& parameters,
+            std::shared_ptr<CompoundStmtAstNode> body
+        ) : decl(decl)
+          , parameters(std::move(parameters))
+          , body(body) {}
+        ~FunctionDefAstNode();
+
+        virtual void accept(AstVisitor&) override;
+};
+
+// Translation unit. Items are DeclAstNodes and FunctionDefAstNodes, in source order.
+class TranslationUnitAstNode : public AstNode
+{
+    public:
+        const std::list<std::shared_ptr<AstNode>> items;
+
+        explicit inline TranslationUnitAstNode(
+            std::list<std::shared_ptr<AstNode>>&& items
+        ) : items(std::move(items)) {}
+        ~TranslationUnitAstNode();
+
         virtual void accept(AstVisitor&) override;
 };
 
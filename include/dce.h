@@ -0,0 +1,24 @@
+// Dead code elimination.
+//
+// Instructions are presumed dead until they are proved live (so cycles of phis which only
+// feed each other are removed, unlike with use counting). Stores, calls and terminators
+// are live, as is every operand of a live instruction; everything else is removed in one
+// sweep. Loads have no side effects: a load which would trap is undefined behaviour, so it
+// can be removed too.
+//
+// Branches are always live. A branch whose two sides have become empty is removed by
+// CfgSimplifier instead, which makes its condition dead in turn - see clean_up().
+
+#ifndef DCE_H_
+#define DCE_H_
+
+#include "ir.h"
+
+class DeadCodeElimination
+{
+    public:
+        // Returns true if any instructions were removed.
+        bool run(IrFunction&);
+};
+
+#endif
@@ -0,0 +1,92 @@
+// Dominator tree and dominance frontiers.
+//
+// Block a dominates block b if every path from the entry block to b passes through a. The
+// immediate dominators are computed with either:
+//  - the iterative algorithm of Cooper, Harvey and Kennedy ("A Simple, Fast Dominance
+//    Algorithm"), which walks the blocks in reverse postorder until the dominators stop
+//    changing. It is fast for the (mostly reducible, shallow) CFGs produced from C.
+//  - the Lengauer-Tarjan algorithm (with path compression), which is O(E log V) for any
+//    CFG, so it is used for large functions.
+//
+// Both use explicit stacks, so deep CFGs do not overflow the call stack. Once the tree is
+// built, it is numbered in preorder and postorder, so dominance queries are O(1).
+//
+// Only blocks which are reachable from the entry block are in the tree.
+
+#ifndef DOMINATORS_H_
+#define DOMINATORS_H_
+
+#include <vector>
+
+#include "ir.h"
+
+const IrBlockId IrNoBlock = UINT32_MAX;
+
+class DominatorTree
+{
+    public:
+        enum class Algorithm
+        {
+            // Lengauer-Tarjan for functions with more than LargeFunctionBlocks blocks,
+            // otherwise Cooper-Harvey-Kennedy.
+            AUTO, ITERATIVE, LENGAUER_TARJAN
+        };
+        static const size_t LargeFunctionBlocks = 4096;
+
+    private:
+        std::vector<IrBlockId> idoms;
+        std::vector<IrBlockId> order;
+
+        // Children of each block (CSR), and preorder/postorder numbers in the tree.
+        std::vector<uint32_t> child_offsets;
+        std::vector<IrBlockId> child_list;
+        std::vector<uint32_t> pre, post;
+        std::vector<IrBlockId> tree_order;
+
+        void iterative(const IrFunction&);
+        void lengauer_tarjan(const IrFunction&);
+        void build_tree();
+
+    public:
+        explicit DominatorTree(const IrFunction&, Algorithm = Algorithm::AUTO);
+
+        // Immediate dominator (the entry block's is itself; IrNoBlock if unreachable).
+        inline IrBlockId idom(IrBlockId block) const { return idoms[block]; }
+        inline bool reachable(IrBlockId block) const { return idoms[block] != IrNoBlock; }
+
+        // Does a dominate b? (Every block dominates itself.)
+        inline bool dominates(IrBlockId a, IrBlockId b) const
+        {
+            return reachable(a) && reachable(b) && pre[a] <= pre[b] && post[b] <= post[a];
+        }
+
+        inline IrRange children(IrBlockId block) const
+        {
+            return IrRange{child_list.data() + child_offsets[block], child_list.data() + child_offsets[block + 1]};
+        }
+
+        // Reachable blocks in reverse postorder of the CFG (entry block first).
+        inline const std::vector<IrBlockId>& reverse_postorder() const { return order; }
+
+        // Reachable blocks in preorder of the dominator tree.
+        inline const std::vector<IrBlockId>& preorder() const { return tree_order; }
+};
+
+// Dominance frontier of each block: the blocks where its dominance ends, i.e. the blocks
+// b which it does not strictly dominate, but which have a predecessor which it dominates.
+// (Computed from the join points, following Cooper, Harvey and Kennedy.)
+class DominanceFrontiers
+{
+    private:
+        std::vector<std::vector<IrBlockId>> frontiers;
+
+    public:
+        DominanceFrontiers(const IrFunction&, const DominatorTree&);
+
+        inline const std::vector<IrBlockId>& frontier(IrBlockId block) const { return frontiers[block]; }
+};
+
+// Reverse postorder of the blocks reachable from the entry block.
+std::vector<IrBlockId> reverse_postorder(const IrFunction&);
+
+#endif
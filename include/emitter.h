@@ -0,0 +1,194 @@
+// x86-64 assembly emission (System V ABI, GNU assembler syntax).
+//
+// AsmEmitter selects instructions for each function (see InstructionSelector), allocates
+// registers for them (see LinearScan), and expands each tile to a short fixed sequence of
+// instructions on the allocated locations. Values in registers are used directly; spilled
+// values are read from their stack slot, and constants are used as immediates. rax and r11
+// are scratch: results which do not go straight to a register are computed in rax, and
+// memory and large operands are put in r11. The parallel moves which the allocator places
+// between instructions are sequenced so that no source is overwritten before it is read
+// (cycles are broken through rax).
+//
+// Memory operands use the x86 addressing modes: base + index * scale + displacement (a
+// stack object is rbp plus its offset), or a symbol relative to rip. A base or index which
+// is not in a register is put in r11 (if both are not, the whole address is computed in
+// r11).
+//
+// Calls follow the System V calling convention: the first six arguments in rdi, rsi, rdx,
+// rcx, r8 and r9, the rest on the stack, and the result in rax. al is zeroed before each
+// call, so variadic functions (printf) can be called.
+//
+// The prologue only does what the function needs. A function with no stack objects, spill
+// slots or stack arguments has no frame pointer; it pushes the callee-saved registers
+// which it uses, and (if it calls anything) keeps the stack 16-byte aligned. Otherwise rbp
+// is the frame pointer, and stack objects and spill slots are addressed from it.
+//
+// Jumps to the next block are omitted. A select is a move and a cmov, on the flags of its
+// condition (so 'a < b ? x : y' is a cmp, a mov and a cmovl).
+//
+// A switch is tested as SwitchPlan decides: by a tree of comparisons, down to range checks,
+// bit tests (bt, against a mask of the cases which go to each target) and jump tables. A
+// jump table is an array of the addresses of the targets, emitted to .data after the
+// function (not .rodata, which would need relocations in read-only data in a PIE).
+//
+// A function's code is built as an array of MachineInstr (see machine.h), which (above
+// -O0) a PeepholeOptimizer rewrites to clean up the seams between tiles (see peephole.h),
+// and it is then written out, or given straight to an Assembler (see jit.h).
+//
+// Vector operations (SSE2, which every x86-64 processor has) load their operands into xmm0
+// and xmm1, and store the result from xmm0; no other code uses the xmm registers.
+//
+// File-scope objects are emitted to .data (or .bss, without an initializer). Symbols are
+// global, except for string literals and static locals, which are local to the file.
+
+#ifndef EMITTER_H_
+#define EMITTER_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ir.h"
+#include "machine.h"
+#include "regalloc.h"
+#include "switch.h"
+#include "writer.h"
+
+class Assembler;
+
+// Memory operand: base + index * scale + displacement, or a symbol plus a displacement.
+// The base and index are the locations of values (see AsmEmitter::prepare).
+struct AsmAddress
+{
+    Location base, index;
+    int scale = 1;
+    int64_t displacement = 0;
+    int symbol = -1;
+};
+
+// Operand of an arithmetic instruction or a comparison: a value, or memory.
+struct AsmOperand
+{
+    bool memory = false;
+    Location location;
+    AsmAddress address;
+};
+
+class AsmEmitter
+{
+    private:
+        // Where the code goes: a file, or an assembler.
+        BufferedWriter * file = nullptr;
+        Assembler * assembler = nullptr;
+        const IrModule& module;
+        int level;
+        int functions = 0;
+
+        // Code being emitted, which write_code passes on to the file or the assembler
+        // (through a PeepholeOptimizer, for a function's above -O0).
+        std::vector<MachineInstr> code;
+        void write_code(bool optimize);
+        void append(std::string mnemonic, std::vector<MachineOperand> operands = {});
+        void define(std::string name);
+        void directive(std::string name, std::string arguments = "");
+
+        // Function being emitted, and the tile being emitted.
+        const IrFunction * function = nullptr;
+        const InstructionSelector * selector = nullptr;
+        const LinearScan * allocation = nullptr;
+        IrValue root = IrNone;
+        std::vector<Register> saved;
+        bool frame = false;
+        bool padded = false;
+        int32_t slot_base = 0;
+        std::vector<int32_t> frame_offsets;
+
+        // Jump tables of the function (emitted after it), and its labels in switches.
+        std::vector<std::vector<IrBlockId>> tables;
+        int switch_labels = 0;
+
+        void prologue(uint32_t frame_size);
+        void epilogue();
+        std::string label(IrBlockId) const;
+        const std::string& symbol(int) const;
+
+        MachineOperand memory(const Location&) const;
+        MachineOperand source(const Location&, int width) const;
+        int64_t constant(const Location&) const;
+        bool immediate(const Location&) const;
+
+        // Make an operand usable as an instruction's source: addresses of stack objects and
+        // constants which do not fit in 32 bits are put in a scratch register.
+        Location operand(const Location&, Register scratch);
+
+        // Load a value into a register, and store a register to a location.
+        void load(const Location&, Register, int width);
+        void store(Register, const Location&, int width);
+        void move(const Location& from, const Location& to);
+        void parallel_move(std::vector<std::pair<Location, Location>>&);
+        void moves(IrValue gap);
+
+        // Tile rooted at the current root: the rule at a node, the rule's leaves, and the
+        // location of a leaf.
+        int rule(IrValue, IselNonTerminal) const;
+        std::vector<IselKid> kids(IrValue, IselNonTerminal) const;
+        Location leaf(IrValue) const;
+
+        // Memory operand for a node matched as an 'addr' (or 'index'), and an 'operand'.
+        AsmAddress address(IrValue);
+        void address(IrValue, IselNonTerminal, AsmAddress&);
+        AsmOperand use(IrValue);
+
+        // Put the base and index of an address in registers (r11, if they are not in one),
+        // and the operand for it.
+        void prepare(AsmAddress&);
+        MachineOperand indirect(const AsmAddress&) const;
+
+        void load_value(IrValue);
+        void store_value(IrValue);
+        void update(IrValue);
+        void binary(IrValue);
+        void lea(IrValue);
+        void divide(IrValue);
+        void shift(IrValue);
+
+        // Set the flags for a 'cond', and return the comparison to test them with.
+        IrOp flags(IrValue);
+        IrOp compare(IrValue);
+        IrOp test(IrValue);
+        void set(IrValue);
+        void select(IrValue);
+
+        void extend(IrValue);
+        void vector(IrValue);
+        void call(IrValue);
+        void branch(IrValue, IrBlockId next);
+
+        // Switch on a value in a register: the decision tree, and the clusters of one of its
+        // leaves (the last one emitted is given the next block).
+        void dispatch(IrValue, IrBlockId next);
+        void test_clusters(IrValue, const SwitchPlan&, const SwitchNode&, Register, int width, IrBlockId next);
+        std::string switch_label(int) const;
+        void compare_case(Register, int width, int64_t);
+        void jump_case(const char * condition, IrBlockId);
+
+        // Emit a tile, and an instruction on its own (with its operands in registers).
+        void tile(IrValue, IrBlockId next);
+        void instruction(IrValue, IrBlockId next);
+
+    public:
+        // (The peephole optimizer runs above optimization level 0.)
+        AsmEmitter(BufferedWriter&, const IrModule&, int level = 2);
+        AsmEmitter(Assembler&, const IrModule&, int level = 2);
+
+        // Emit a function. (Its registers are allocated, which splits its critical edges.)
+        void emit(IrFunction&);
+
+        // Emit the module's objects.
+        void emit_data();
+
+        // Emit the functions and objects of a module (the one given to the constructor).
+        void emit_module(IrModule&);
+};
+
+#endif
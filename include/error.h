@@ -4,6 +4,8 @@
 #define ERROR_H_
 
 #include <string>
+#include <utility>
+#include <vector>
 
 // Error handler class.
 // 'report_error' is a virtual methods, so subclasses can implement
@@ -15,4 +17,14 @@ class ErrorReporter
         virtual void report_error(int, const std::string&);
 };
 
+// Collect errors, to be reported later (e.g., errors from passes running in parallel,
+// which should be reported in a deterministic order).
+class DiagnosticBuffer : public ErrorReporter
+{
+    public:
+        std::vector<std::pair<int, std::string>> errors;
+
+        virtual void report_error(int, const std::string&) override;
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,90 @@
+// Constant folding and algebraic simplification.
+//
+// ConstantFolder rewrites an AST bottom-up, replacing integer constant subexpressions with a
+// single constant, and applying value-preserving identities (x * 1, x | 0, !!(a < b), etc.).
+// AST nodes are immutable, so folding returns a new tree. Unchanged subtrees are shared with
+// the original.
+//
+// Folding runs before type checking, so it must not change the type of an expression, or
+// make an rvalue an lvalue: an identity keeps its other operand under a unary + (x * 1 is
+// +x), and a conditional is only folded if both its operands are constants.
+
+#ifndef FOLD_H_
+#define FOLD_H_
+
+#include <memory>
+#include <list>
+#include <string>
+#include <cstdint>
+#include <vector>
+
+#include "ast.h"
+
+// Integer constant value (int, or unsigned int - 6.4.4.1).
+struct IntegerConstant
+{
+    uint32_t bits;
+    bool is_unsigned;
+
+    inline int32_t as_signed() const { return static_cast<int32_t>(bits); }
+    inline bool is_zero() const { return bits == 0; }
+};
+
+// Read the value of an integer constant lexeme (decimal, octal, or hex, with an optional
+// 'u' suffix). Folded constants may also carry a leading '-'. Returns false if the value
+// does not fit in int/unsigned int.
+bool parse_integer_constant(const std::string&, IntegerConstant&);
+
+// Read the characters of a string literal lexeme (with its quotes), decoding its escape
+// sequences (6.4.4.4): simple ones ('\n', '\"', ...), octal (one to three digits) and
+// hexadecimal. (An unknown escape sequence is the character after the backslash.)
+std::string parse_string_literal(const std::string&);
+
+// Folding is a post-order walk. Each visit method pops the folded operands of its node from
+// the value stack, and pushes the folded node.
+class ConstantFolder : public AstVisitor
+{
+    private:
+        AstWalker walker;
+        std::vector<std::shared_ptr<AstNode>> values;
+
+        std::shared_ptr<ExprAstNode> pop_expr();
+
+        // Pop the folded nodes for a list of children, and note whether any of them changed.
+        template<typename T>
+        std::list<std::shared_ptr<T>> pop_list(const std::list<std::shared_ptr<T>>& original, bool& changed)
+        {
+            std::list<std::shared_ptr<T>> folded;
+            for(auto item = original.rbegin();item != original.rend();item++)
+            {
+                folded.push_front(std::static_pointer_cast<T>(values.back()));
+                values.pop_back();
+                changed = changed || (folded.front() != *item);
+            }
+            return folded;
+        }
+
+    public:
+        explicit ConstantFolder(int depth_limit = DefaultAstDepthLimit);
+        std::shared_ptr<AstNode> fold(std::shared_ptr<AstNode>);
+
+        virtual void visit(PrimaryExprAstNode&) override;
+        virtual void visit(BinaryExprAstNode&) override;
+        virtual void visit(UnaryExprAstNode&) override;
+        virtual void visit(TertiaryExprAstNode&) override;
+        virtual void visit(PostfixExprAstNode&) override;
+        virtual void visit(AssignExprAstNode&) override;
+        virtual void visit(ExprAstNode&) override;
+        virtual void visit(DeclAstNode&) override;
+        virtual void visit(CompoundStmtAstNode&) override;
+        virtual void visit(ExprStmtAstNode&) override;
+        virtual void visit(ReturnStmtAstNode&) override;
+        virtual void visit(IterationStmtAstNode&) override;
+        virtual void visit(SwitchStmtAstNode&) override;
+        virtual void visit(CaseStmtAstNode&) override;
+        virtual void visit(JumpStmtAstNode&) override;
+        virtual void visit(FunctionDefAstNode&) override;
+        virtual void visit(TranslationUnitAstNode&) override;
+};
+
+#endif
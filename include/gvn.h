@@ -0,0 +1,34 @@
+// Global value numbering (hash-based, over the dominator tree).
+//
+// Two instructions with the same operation, type, immediate and operands compute the same
+// value, so the second is redundant if the first dominates it. The pass walks the dominator
+// tree in preorder with a scoped hash table of the expressions available in the current
+// block (entries are removed when the walk leaves the block which defined them, like
+// SymbolTable's scopes), and replaces each redundant instruction with the earlier one.
+//
+// Before an instruction is looked up, its operands are replaced with their value numbers,
+// and it is put in a canonical form: commutative operands are ordered (constants last),
+// and 'a > b' is written 'b < a'. So 'a + b' and 'b + a' are found to be equal, as are
+// repeated array index and address computations. Phis are only equal to phis in the same block, and a phi
+// whose operands are all the same value is that value. A comparison result tested against
+// zero ('ne c, 0', as conditions are lowered) is the comparison result itself.
+//
+// Memory is handled conservatively, as there is no alias information: a load is only
+// redundant if an identical load comes earlier in the same block, with no store or call in
+// between.
+
+#ifndef GVN_H_
+#define GVN_H_
+
+#include "analysis.h"
+#include "ir.h"
+
+class ValueNumbering
+{
+    public:
+        // Returns true if any instructions were removed.
+        bool run(IrFunction&);
+        bool run(IrFunction&, AnalysisCache&);
+};
+
+#endif
@@ -0,0 +1,63 @@
+// If-conversion.
+//
+// A conditional expression or a short-circuit operator is generated as a diamond: a branch
+// to one or two small blocks, which join again at a phi. When the condition is hard to
+// predict, the branch costs a misprediction (15 to 20 cycles) about half the time; computing
+// both sides and choosing between them costs a few instructions every time. IfConverter
+// rewrites such a diamond as straight-line code:
+//
+//     header:  c = slt a, b; branch c           ->  then, join
+//     then:    t = add a, 1; jump               ->  join
+//     join:    x = phi(t, b)
+//
+// becomes
+//
+//     header:  c = slt a, b; t = add a, 1; x = select c, t, b; jump  ->  join
+//
+// Each side of the branch either goes straight to the join, or through an arm: a block
+// with no other predecessors and no phis, which only computes values which can be
+// speculated (IrFunction::speculatable: no loads, stores or calls, and nothing which could
+// trap) and jumps to the join. The instructions of the arms are moved into the header, and
+// each phi of the join becomes a select of its two operands. A select of booleans is an
+// and or an or of the condition: 'a && b' is 'and (ne a, 0), (ne b, 0)', and 'a || b' an
+// or. The emitter lowers the rest to cmov, and comparisons to setcc.
+//
+// The cost of a diamond is the instructions moved (a multiplication counts 3, a division
+// 20) and the selects added; it is only converted if that is at most IfConvertLimit, about
+// half a misprediction. A join which is left with only the header as its predecessor is
+// merged into it. Blocks are visited in order, so a chain of diamonds is converted from the
+// top, and each join is appended to the header once. A diamond nested in an arm of another
+// is converted after the outer one is first tried; then the arm is straight-line code, so
+// the outer header is tried again, and the inner diamond's cost counts towards its own.
+
+#ifndef IFCONVERT_H_
+#define IFCONVERT_H_
+
+#include <vector>
+
+#include "ir.h"
+
+class IfConverter
+{
+    private:
+        IrFunction * function = nullptr;
+
+        // Phis removed by merging joins (replaced at the end).
+        std::vector<IrValue> replacements;
+
+        bool arm(IrBlockId, IrBlockId header, int& cost) const;
+        IrValue resolve(IrValue) const;
+        bool boolean(IrValue) const;
+        IrValue choose(IrBlockId header, IrValue condition, IrValue a, IrValue b);
+        bool convert(IrBlockId);
+        void merge(IrBlockId header, IrBlockId join);
+
+    public:
+        // Maximum cost of a converted diamond.
+        static const int IfConvertLimit = 6;
+
+        // Returns true if any branches were removed (which changes the CFG).
+        bool run(IrFunction&);
+};
+
+#endif
@@ -0,0 +1,35 @@
+// Induction variables and strength reduction.
+//
+// A basic induction variable of a loop is a phi in its header which is incremented by a
+// constant on the back edge: 'i = phi(init, i + step)'. Array indexing in the loop
+// computes addresses 'base + sext(i + k) * size' (see IrGenerator::offset), where base is
+// loop-invariant. Each such address is also an induction variable, which changes by
+// 'step * size' each iteration, so it is replaced with a new phi:
+//
+//     preheader:  p0 = base + (sext(init) + k) * size
+//     header:     p = phi(p0, p + step * size)
+//
+// which removes the extension, multiplication and addition from the loop. Addresses with
+// the same base, variable, offset and size share one phi. (The variable itself is left
+// alone - it is usually still needed for the loop's condition.)
+//
+// Only sign-extended variables are handled: signed overflow is undefined, so sext(i + k)
+// is sext(i) + k. (Unsigned variables are zero-extended, and they may wrap.) The pass needs
+// loops with preheaders and a single back edge, so it runs after LoopInvariantCodeMotion,
+// which also moves base addresses out of inner loops.
+
+#ifndef INDUCTION_H_
+#define INDUCTION_H_
+
+#include "analysis.h"
+#include "ir.h"
+
+class StrengthReduction
+{
+    public:
+        // Returns true if any addresses were replaced.
+        bool run(IrFunction&);
+        bool run(IrFunction&, AnalysisCache&);
+};
+
+#endif
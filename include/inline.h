@@ -0,0 +1,55 @@
+// Function inlining.
+//
+// Inliner replaces direct calls to functions defined in the module with copies of their
+// bodies. Functions are visited bottom-up over the call graph - callees before their
+// callers, one strongly connected component at a time - so a callee is copied after calls
+// inside it have been inlined, and calls within a component (recursion) are left alone.
+//
+// Whether a call is inlined is decided by a cost model. The cost of a callee is the number
+// of instructions it would add to the caller (constants, parameters, globals and stack
+// slots are free). The benefit of inlining a call is the call itself - moving arguments,
+// saving registers and the jump - plus a bonus for each constant argument, which SCCP can
+// then fold into the copy. A call is inlined if its cost less its benefit is at most
+// 'threshold', or at most 'single_call_threshold' if it is the only call to the callee in
+// the module (a function called once costs little to copy). Callers stop growing once they
+// reach 'caller_limit' instructions.
+//
+// The callee's instructions and operands are copied into the caller's arena in bulk (they
+// are appended to the caller's arrays, and their indices shifted), so inlining a call
+// allocates per block, not per instruction. The call's block is split at the call: the
+// first half jumps to the copy of the callee's entry block, and each return jumps to the
+// second half, where a phi merges the returned values. Stack slots of the callee are moved
+// to the caller's entry block. The callee itself is kept, since it may be called from
+// other modules.
+//
+// Inlined code is not simplified here, so the pass runs between the per-function passes
+// which tidy up the callees (mem2reg, sccp, clean-up) and those which benefit from the
+// larger functions it creates.
+
+#ifndef INLINE_H_
+#define INLINE_H_
+
+#include "ir.h"
+
+struct InlineParams
+{
+    int threshold = 40;
+    int single_call_threshold = 400;
+    int call_benefit = 5;
+    int constant_benefit = 5;
+    int caller_limit = 5000;
+};
+
+class Inliner
+{
+    private:
+        InlineParams params;
+
+    public:
+        explicit Inliner(const InlineParams& params = InlineParams()) : params(params) {}
+
+        // Returns true if any calls were inlined.
+        bool run(IrModule&);
+};
+
+#endif
@@ -0,0 +1,110 @@
+// IR interpreter.
+//
+// Interpreter runs the functions of a module directly, without an assembler or linker:
+// e.g. a test program's main, at each optimization level or after each pass, to check
+// that the optimizer does not change its result.
+//
+// Each function is decoded once, when the interpreter is created, into an array of
+// fixed-size instructions (InterpOp) whose operands are register numbers. A function's
+// registers are its IR values, so results need no allocation. Constants and the addresses
+// of symbols are put in the function's initial register file, which is copied in at each
+// call, so they cost nothing to execute. Phis are replaced by parallel copies on the edges
+// into their block (after a jump's predecessor, or in a stub after the function's code for
+// a branch or switch). Where the width of a type matters, instructions are specialised for
+// I32 and I64 (other widths fall back to ir_evaluate). Dispatch is threaded: each handler
+// jumps straight to the next through a table of label addresses (GCC's computed goto),
+// rather than returning to a loop with a switch.
+//
+// Calls do not recurse in C++: frames are pushed onto an explicit stack, and the registers
+// of each frame are a window of one array. Stack objects (ALLOCA) are on a separate byte
+// stack, and file-scope objects in one block laid out when the interpreter is created, so
+// pointers are real addresses: LOAD and STORE access memory directly, and pointers can be
+// passed to library functions. Functions and objects which are not defined in the module
+// are looked up in the running process (dlsym); such functions are called natively, with
+// up to six arguments. The address of a defined function is that of its decoded form, so
+// calls through pointers work, but such a pointer cannot be called by library code.
+//
+// Undefined behaviour which the interpreter can see - division by zero, signed division
+// overflow, shifts out of range - throws InterpreterError, as do undefined symbols, and
+// running out of stack. Objects keep their values from one run to the next.
+
+#ifndef INTERP_H_
+#define INTERP_H_
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ir.h"
+
+class InterpreterError : public std::runtime_error
+{
+    public:
+        explicit InterpreterError(const std::string& errmsg)
+          : std::runtime_error(errmsg) { }
+};
+
+// Decoded instruction: 'code' is the handler, 'd' the result register, 'a' and 'b' the
+// operand registers, and 'imm' a constant, a jump target or a callee (see interp.cpp).
+struct InterpOp
+{
+    uint8_t code;
+    IrType type;
+    uint32_t d, a, b;
+    int64_t imm;
+};
+
+struct InterpFunction
+{
+    std::string name;
+    std::vector<InterpOp> code;
+
+    // Initial registers: constants and addresses (one more register than the function has
+    // values, for breaking cycles of phi copies).
+    std::vector<int64_t> registers;
+
+    // Register of each parameter, and the argument registers of each call.
+    std::vector<uint32_t> params;
+    std::vector<uint32_t> arguments;
+};
+
+class Interpreter
+{
+    private:
+        struct Frame
+        {
+            const InterpFunction * function;
+            const InterpOp * pc;
+            size_t base;
+            size_t top;
+            uint32_t result;
+        };
+
+        std::vector<InterpFunction> functions;
+        std::unordered_map<std::string, size_t> names;
+        std::unique_ptr<char[]> objects;
+
+        std::vector<int64_t> registers;
+        std::vector<Frame> frames;
+        std::unique_ptr<char[]> stack;
+
+        void decode(const IrModule&, const IrFunction&, const std::vector<int64_t>& addresses,
+            InterpFunction&);
+        int64_t execute(const InterpFunction&, const std::vector<int64_t>& args);
+
+    public:
+        // Size of the stack for stack objects, and the deepest call allowed.
+        static const size_t StackSize = 8 << 20;
+        static const size_t MaxDepth = 100000;
+
+        explicit Interpreter(const IrModule&);
+
+        // Call a function defined in the module, and return its result (sign-extended from
+        // its type; 0 for void).
+        int64_t run(const std::string& name, const std::vector<int64_t>& args = {});
+};
+
+#endif
@@ -0,0 +1,318 @@
+// SSA linear intermediate representation (IR).
+//
+// A function is a list of basic blocks, and each block is a list of instructions ending in
+// a terminator (jump, branch, switch or return). Each instruction defines at most one value, which
+// is named by the instruction's index (IrValue), so the IR is in SSA form by construction:
+// values are never reassigned. Local variables start out in memory (ALLOCA, LOAD and
+// STORE), until they are promoted to values.
+//
+// Nothing in the IR is a pointer. Instructions, operands and blocks are stored in
+// contiguous arrays owned by their function (the function's arena), and refer to each other
+// by 32-bit index. Operands of all instructions share one array, so a pass which scans
+// every operand reads a single block of memory. Users of each value are computed on demand
+// as a dense (CSR) table - see IrUses - rather than maintained as linked lists.
+//
+// Integer values have the width of their C type (I8, I16 or I32). Arithmetic is only done
+// on I32 and I64 values, so narrow values are extended (and truncated before they are
+// stored), matching C's integer promotions. Pointers are I64.
+
+#ifndef IR_H_
+#define IR_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef uint32_t IrValue;
+typedef uint32_t IrBlockId;
+
+// No value (e.g., 'ret' without a result).
+const IrValue IrNone = UINT32_MAX;
+
+enum class IrType : uint8_t
+{
+    VOID, I8, I16, I32, I64
+};
+
+enum class IrOp : uint8_t
+{
+    // Values. CONST: imm is the value (sign-extended from the type's width). PARAM: imm is
+    // the parameter index. GLOBAL: address of module symbol imm. ALLOCA: address of imm
+    // bytes of stack, naturally aligned (for the largest power of two, up to 8, which
+    // divides the size).
+    CONST, PARAM, GLOBAL, ALLOCA,
+
+    // Binary arithmetic (operands have the same type as the result).
+    ADD, SUB, MUL, SDIV, UDIV, SREM, UREM, AND, OR, XOR, SHL, SAR, SHR,
+
+    // Unary arithmetic.
+    NEG, NOT,
+
+    // Comparisons. The result is I32 0 or 1.
+    EQ, NE, SLT, SLE, SGT, SGE, ULT, ULE, UGT, UGE,
+
+    // Conversions to a wider (SEXT, ZEXT) or narrower (TRUNC) type.
+    SEXT, ZEXT, TRUNC,
+
+    // SELECT condition, a, b: a if the condition is non-zero, otherwise b (a and b have the
+    // type of the result).
+    SELECT,
+
+    // LOAD address. STORE address, value.
+    LOAD, STORE,
+
+    // Vector arithmetic on 16 bytes of memory: VADD destination, a, b (addresses) sets each
+    // element of the destination to the sum of the elements of a and b. imm is the element
+    // type (I8, I16 or I32). There are no vector values: operands are in memory, so
+    // registers are only allocated for scalars (see LoopVectorizer).
+    VADD, VSUB, VAND, VOR, VXOR,
+
+    // CALL callee, arguments...
+    CALL,
+
+    // PHI: one operand per predecessor of the block, in the same order.
+    PHI,
+
+    // Copy of a value (e.g., a value which has been replaced).
+    COPY,
+
+    // Terminators. JUMP to successor 0. BRANCH condition: to successor 0 if it is non-zero,
+    // otherwise successor 1. SWITCH value, cases...: to successor i + 1 if the value equals
+    // case i (a CONST of the value's type; the cases are distinct), otherwise successor 0.
+    // RET [value].
+    JUMP, BRANCH, SWITCH, RET
+};
+
+const char * ir_op_str(IrOp);
+const char * ir_type_str(IrType);
+
+// Size of a type in bytes.
+int ir_type_size(IrType);
+
+inline bool ir_is_terminator(IrOp op)
+{
+    return op == IrOp::JUMP || op == IrOp::BRANCH || op == IrOp::SWITCH || op == IrOp::RET;
+}
+
+inline bool ir_is_comparison(IrOp op)
+{
+    return op >= IrOp::EQ && op <= IrOp::UGE;
+}
+
+inline bool ir_is_vector(IrOp op)
+{
+    return op >= IrOp::VADD && op <= IrOp::VXOR;
+}
+
+// Scalar operation of a vector operation.
+inline IrOp ir_vector_scalar(IrOp op)
+{
+    static const IrOp scalar[] = {IrOp::ADD, IrOp::SUB, IrOp::AND, IrOp::OR, IrOp::XOR};
+    return scalar[static_cast<int>(op) - static_cast<int>(IrOp::VADD)];
+}
+
+// Wrap a value to the width of a type (and sign-extend it, as for CONST).
+int64_t ir_wrap(IrType, int64_t);
+
+// Evaluate an arithmetic, comparison or conversion instruction with constant operands (as
+// CONST values of operand_type; b is ignored by unary operations). Results wrap to the
+// width of the type, as C's unsigned arithmetic does, and as signed arithmetic does on the
+// targets we support. Returns false if the result is undefined: division by zero, signed
+// division overflow, or a shift by the width of the type or more.
+bool ir_evaluate(IrOp, IrType type, IrType operand_type, int64_t a, int64_t b, int64_t& result);
+
+// Instruction. Instructions which do not define a value have type VOID.
+struct IrInstr
+{
+    IrOp op;
+    IrType type;
+    IrBlockId block;
+
+    // Operands are operand_pool[first] ... operand_pool[first + count - 1].
+    uint32_t first;
+    uint32_t count;
+
+    int64_t imm;
+};
+
+// Basic block. 'code' lists its instructions in order: phis first, then the body, then the
+// terminator. Phi operands follow the order of 'preds'.
+// The entry block (b0) has no predecessors.
+struct IrBlock
+{
+    std::vector<IrValue> code;
+    std::vector<IrBlockId> preds;
+    std::vector<IrBlockId> succs;
+};
+
+// Contiguous range of values (operands, users, block code).
+struct IrRange
+{
+    const IrValue * first;
+    const IrValue * last;
+
+    inline const IrValue * begin() const { return first; }
+    inline const IrValue * end() const { return last; }
+    inline size_t size() const { return last - first; }
+    inline IrValue operator[](size_t i) const { return first[i]; }
+};
+
+class IrFunction
+{
+    public:
+        std::string name;
+        IrType result = IrType::VOID;
+        std::vector<IrType> params;
+
+        // Module symbol of this function.
+        int symbol = -1;
+
+        // Arena. Block 0 is the entry block.
+        std::vector<IrInstr> instrs;
+        std::vector<IrValue> operand_pool;
+        std::vector<IrBlock> blocks;
+
+        IrBlockId add_block();
+        void add_edge(IrBlockId from, IrBlockId to);
+
+        // Remove predecessor 'index' of a block, and the corresponding phi operands. (The
+        // edge must also be removed from the predecessor's successors.)
+        void remove_pred(IrBlockId, size_t index);
+
+        // Replace a block's terminator (a branch or switch) with a jump to successor
+        // 'taken', and remove its other edges. (The k-th edge from a block to a successor
+        // matches the k-th time the block appears in the successor's predecessors.)
+        void fold_terminator(IrBlockId, size_t taken);
+
+        // Empty the blocks which cannot be reached from the entry block, and remove their
+        // edges. Returns true if any were removed.
+        bool remove_unreachable();
+
+        // Put a new block (containing only a jump) on each edge from a block with several
+        // successors to a block with several predecessors, so there is a block in which to
+        // put code which should only run along that edge (edges of a switch to one block, with
+        // the same phi operands, share it). Returns true if any were added.
+        bool split_critical_edges();
+
+        // Create an instruction (not yet in any block).
+        IrValue create(IrOp, IrType, const std::vector<IrValue>& operands = {}, int64_t imm = 0);
+
+        // Create an instruction, and append it to a block.
+        IrValue append(
+            IrBlockId, IrOp, IrType, const std::vector<IrValue>& operands = {}, int64_t imm = 0);
+
+        inline IrRange operands(IrValue value) const
+        {
+            const IrInstr& instr = instrs[value];
+            const IrValue * first = operand_pool.data() + instr.first;
+            return IrRange{first, first + instr.count};
+        }
+        inline IrValue operand(IrValue value, int i) const
+        {
+            return operand_pool[instrs[value].first + i];
+        }
+        inline void set_operand(IrValue value, int i, IrValue operand)
+        {
+            operand_pool[instrs[value].first + i] = operand;
+        }
+
+        // Replace the operands of an instruction. (If there are more than before, the
+        // operands are moved to the end of the pool.)
+        void set_operands(IrValue, const std::vector<IrValue>&);
+
+        inline IrValue terminator(IrBlockId block) const
+        {
+            return blocks[block].code.back();
+        }
+
+        // Rewrite every operand v to replacements[v] (where it is not IrNone), in one pass
+        // over the operand pool. Replacements are followed transitively.
+        void replace_uses(std::vector<IrValue>& replacements);
+
+        // Renumber the instructions in block order, dropping instructions which are not in
+        // any block, and rebuild the operand pool in the same order. Afterwards, a pass
+        // which walks the blocks in order reads 'instrs' and 'operand_pool' sequentially.
+        // Empty blocks (other than the entry block) are dropped, and the rest renumbered.
+        void compact();
+
+        // Can an instruction be computed where it would not have been (earlier, or on a path
+        // which did not compute it), with no effect other than its result? Division is only
+        // speculated by a constant other than 0 and -1, and a shift by a constant less than
+        // the width of the type (so the interpreter cannot trap on it).
+        bool speculatable(IrValue) const;
+
+        // Check structural invariants (terminators, CFG edges, phi operand counts, operand
+        // definitions). Returns an empty string, or a description of the first problem.
+        std::string verify() const;
+};
+
+// Users of each value, stored densely: the users of value v are
+// list[offsets[v]] ... list[offsets[v + 1] - 1], in block order. An instruction which
+// uses a value more than once is listed once per use. Only instructions in blocks are
+// counted. (The table is a snapshot; it is not updated as the function changes.)
+class IrUses
+{
+    private:
+        std::vector<uint32_t> offsets;
+        std::vector<IrValue> list;
+
+    public:
+        explicit IrUses(const IrFunction&);
+
+        inline IrRange users(IrValue value) const
+        {
+            return IrRange{list.data() + offsets[value], list.data() + offsets[value + 1]};
+        }
+        inline uint32_t count(IrValue value) const
+        {
+            return offsets[value + 1] - offsets[value];
+        }
+};
+
+// Module-level symbol (function or object with static storage duration).
+struct IrSymbol
+{
+    std::string name;
+    bool function = false;
+    bool defined = false;
+
+    // Objects: size and alignment in bytes, and initial contents (zero-filled up to
+    // 'size'). A pointer initializer holds the address of symbol 'reference', instead.
+    int size = 0;
+    int align = 1;
+    std::string data;
+    int reference = -1;
+};
+
+class IrModule
+{
+    private:
+        std::unordered_map<std::string, int> names;
+
+    public:
+        std::vector<IrSymbol> symbols;
+        std::vector<std::unique_ptr<IrFunction>> functions;
+
+        // Get the index of the symbol with a given name, adding it if it doesn't exist.
+        int symbol(const std::string&);
+
+        // Get the index of a symbol, or -1.
+        int find(const std::string&) const;
+};
+
+// Text form of a function, e.g.:
+//
+//   function i32 f(i32, i32)
+//   b0:
+//       %0 = param i32 0
+//       ...
+//       ret %5
+//
+// Blocks are followed by their predecessors ('b2 <- b0 b1:'). Symbol names are printed if a
+// module is given.
+std::string ir_str(const IrFunction&, const IrModule * = nullptr);
+std::string ir_str(const IrModule&);
+
+#endif
@@ -0,0 +1,126 @@
+// IR generation.
+//
+// IrGenerator lowers a checked AST (see SemanticAnalyser) to IR. File-scope objects and
+// string literals become module symbols, and each function definition becomes an
+// IrFunction.
+//
+// Every local variable and parameter is given a stack slot (ALLOCA in the entry block),
+// and is read and written with LOAD and STORE; promoting them to SSA values is left to
+// later passes. The operands of '&&', '||' and '?:' are evaluated in their own blocks, and
+// joined with a phi. A loop's condition is tested in a header block, which is its only
+// entry. A switch is a single SWITCH instruction, with an edge to a block for each label
+// (how it is tested is left to the back end).
+//
+// Integer values are lowered to I32 (their promoted type), and pointers to I64. Narrow
+// values are extended when they are loaded, and truncated when they are stored. Function
+// parameters and results are passed as promoted values.
+//
+// Lowering uses an explicit stack of frames, so deeply nested expressions and statements
+// do not recurse. Each visit method advances the state of the frame on top of the stack:
+// it may push frames for its children (whose values are pushed to the value stack as they
+// finish), and it pops its own frame when it is done. Lvalues are lowered to their address,
+// and loaded as soon as they are finished, unless the parent needs the address.
+
+#ifndef IRGEN_H_
+#define IRGEN_H_
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.h"
+#include "ir.h"
+#include "layout.h"
+#include "type.h"
+
+class IrGenerator : public AstVisitor
+{
+    private:
+        struct Frame
+        {
+            AstNode * node;
+
+            // Whether the parent needs the value of an expression (rather than the address
+            // of an lvalue).
+            bool value;
+            int state;
+            IrBlockId blocks[3];
+            IrValue saved;
+        };
+
+        // Targets of 'break' and 'continue' in a loop. (In a switch, 'break' leaves the
+        // switch, and 'continue' has the enclosing loop's target.)
+        struct Loop
+        {
+            IrBlockId exit;
+            IrBlockId next;
+        };
+        IrModule& module;
+        LayoutEngine layout;
+        std::vector<Frame> frames;
+        std::vector<IrValue> values;
+        int strings = 0;
+
+        // Function being lowered.
+        IrFunction * function = nullptr;
+        IrBlockId block = 0;
+        std::shared_ptr<CType> result;
+        std::vector<IrValue> allocas;
+        std::unordered_map<const DeclAstNode *, IrValue> locals;
+        std::vector<Loop> loops;
+        std::unordered_map<const CaseStmtAstNode *, IrBlockId> labels;
+        int statics = 0;
+
+        void push(AstNode *, bool value = true);
+        void finish(IrValue);
+        IrValue pop();
+
+        IrValue emit(IrOp, IrType, const std::vector<IrValue>& = {}, int64_t imm = 0);
+        IrValue constant(IrType, int64_t);
+        void jump(IrBlockId);
+        void branch(IrValue, IrBlockId, IrBlockId);
+
+        IrValue rvalue(ExprAstNode&, IrValue);
+        IrValue load(IrValue, const std::shared_ptr<CType>&);
+        IrValue assign(IrValue, IrValue, const std::shared_ptr<CType>&, const std::shared_ptr<CType>&);
+        IrValue widen(IrValue, const std::shared_ptr<CType>&, const std::shared_ptr<CType>&);
+        IrValue convert(IrValue, const std::shared_ptr<CType>&, const std::shared_ptr<CType>&);
+        IrValue truth(IrValue, const std::shared_ptr<CType>&);
+        IrValue offset(IrValue, const std::shared_ptr<CType>&, const std::shared_ptr<CType>&);
+        IrValue arithmetic(
+            BinaryType,
+            IrValue,
+            IrValue,
+            const std::shared_ptr<CType>&,
+            const std::shared_ptr<CType>&);
+        IrValue step(ExprAstNode&, IrValue, bool increment, bool prefix);
+
+        int object(const DeclAstNode&, const std::string&);
+        int string_literal(const Token&);
+
+    public:
+        explicit IrGenerator(IrModule&);
+
+        // Lower a translation unit into the module.
+        void generate(TranslationUnitAstNode&);
+
+        virtual void visit(PrimaryExprAstNode&) override;
+        virtual void visit(BinaryExprAstNode&) override;
+        virtual void visit(UnaryExprAstNode&) override;
+        virtual void visit(TertiaryExprAstNode&) override;
+        virtual void visit(PostfixExprAstNode&) override;
+        virtual void visit(AssignExprAstNode&) override;
+        virtual void visit(ExprAstNode&) override;
+        virtual void visit(DeclAstNode&) override;
+        virtual void visit(CompoundStmtAstNode&) override;
+        virtual void visit(ExprStmtAstNode&) override;
+        virtual void visit(ReturnStmtAstNode&) override;
+        virtual void visit(IterationStmtAstNode&) override;
+        virtual void visit(SwitchStmtAstNode&) override;
+        virtual void visit(CaseStmtAstNode&) override;
+        virtual void visit(JumpStmtAstNode&) override;
+        virtual void visit(FunctionDefAstNode&) override;
+        virtual void visit(TranslationUnitAstNode&) override;
+};
+
+#endif
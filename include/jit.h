@@ -0,0 +1,70 @@
+// In-process loader for compiled modules.
+//
+// Jit runs a module's code in the compiler's own process, without an external assembler or
+// linker: the module is emitted as for a file (AsmEmitter), but its instructions are
+// encoded in memory as they are built (Assembler) rather than written out as text, and the
+// sections are copied into one mapping - text, then data and bss on pages of their own - and
+// relocated there. The text pages are then made read-only and executable.
+//
+// Symbols which the module does not define are looked up in the running process (dlsym),
+// so library functions such as printf can be called. A call to one which is too far from
+// the mapping for a 32-bit displacement goes through a stub after the text (an indirect
+// jump through an address stored with it); other references must be in range.
+//
+// A Jit owns its mapping: the addresses it returns are valid until it is destroyed. The
+// code runs natively, so a program which crashes takes the compiler with it, unless it is
+// run with run_guarded (as the REPL does), which turns a trap into a JitError.
+
+#ifndef JIT_H_
+#define JIT_H_
+
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include "assembler.h"
+#include "ir.h"
+
+class JitError : public std::runtime_error
+{
+    public:
+        explicit JitError(const std::string& errmsg)
+          : std::runtime_error(errmsg) { }
+};
+
+class Jit
+{
+    private:
+        char * memory = nullptr;
+        size_t size = 0;
+        std::unordered_map<std::string, void *> addresses;
+
+        void load(const Assembler&);
+
+    public:
+        // Size of a stub for a distant function.
+        static const size_t StubSize = 16;
+
+        // Load a module (its registers are allocated, as for AsmEmitter, at an optimization
+        // level), or assembly.
+        explicit Jit(IrModule&, int level = 2);
+        explicit Jit(const std::string& assembly);
+        ~Jit();
+
+        Jit(const Jit&) = delete;
+        Jit& operator=(const Jit&) = delete;
+
+        // Address of a symbol defined by the module, or nullptr.
+        void * address(const std::string& name) const;
+
+        // Call a function defined by the module which takes no arguments and returns int.
+        int run(const std::string& name = "main");
+
+        // Call a function as run does, but report a trap in it (SIGFPE, SIGSEGV - including
+        // a stack overflow -, SIGBUS or SIGILL) as a JitError rather than be killed by it.
+        // (Whatever the code was doing when it trapped is abandoned: a library function it
+        // was in may be left inconsistent.)
+        int run_guarded(const std::string& name = "main");
+};
+
+#endif
@@ -0,0 +1,51 @@
+// Type layout (sizeof/alignof).
+//
+// LayoutEngine computes the size and alignment of C types for a target ABI. Layouts are
+// cached per canonical type, so types must be interned in a TypeContext which outlives
+// the engine.
+
+#ifndef LAYOUT_H_
+#define LAYOUT_H_
+
+#include <unordered_map>
+
+#include "type.h"
+
+// Sizes and alignments (in bytes) of scalar types on the target.
+struct TargetAbi
+{
+    int char_size, char_align;
+    int short_size, short_align;
+    int int_size, int_align;
+    int pointer_size, pointer_align;
+};
+
+// x86-64 System V ABI (3.1.2).
+const TargetAbi X86_64SysV = {1, 1, 2, 2, 4, 4, 8, 8};
+
+struct TypeLayout
+{
+    int size;
+    int align;
+};
+
+class LayoutEngine
+{
+    private:
+        const TargetAbi abi;
+        std::unordered_map<const CType *, TypeLayout> layouts;
+
+        TypeLayout compute(const CType&);
+
+    public:
+        explicit LayoutEngine(const TargetAbi& abi = X86_64SysV);
+
+        // Throws CTypeError for types with no size (void, functions, and arrays of
+        // unknown size).
+        const TypeLayout& layout(const CType&);
+
+        inline int size_of(const CType& ctype) { return layout(ctype).size; }
+        inline int align_of(const CType& ctype) { return layout(ctype).align; }
+};
+
+#endif
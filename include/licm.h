@@ -0,0 +1,30 @@
+// Loop-invariant code motion.
+//
+// An instruction in a loop is invariant if its operands are all defined outside the loop
+// (or are invariant themselves). Invariant arithmetic, comparisons and conversions are
+// moved to the loop's preheader, so they are computed once instead of on every iteration.
+// Loops are visited innermost first, so code can move out of several loops in turn.
+//
+// Moving an instruction out of a loop means it may run when it would not have (the loop
+// may not run at all, or the instruction may be on a path which is not taken), so only
+// instructions which cannot trap are moved (see IrFunction::speculatable). As there is no
+// alias information, a load is only moved if the loop has no stores or calls, and it is in
+// the loop's header (which runs whenever the preheader does).
+//
+// Preheaders are added where they are missing (see insert_preheaders).
+
+#ifndef LICM_H_
+#define LICM_H_
+
+#include "analysis.h"
+#include "ir.h"
+
+class LoopInvariantCodeMotion
+{
+    public:
+        // Returns true if any instructions were moved.
+        bool run(IrFunction&);
+        bool run(IrFunction&, AnalysisCache&);
+};
+
+#endif
@@ -0,0 +1,64 @@
+// Natural loops.
+//
+// An edge t -> h is a back edge if h dominates t. The natural loop of h is h and every
+// block which can reach a back edge into h without passing through h; loops which share
+// a header are one loop. Two loops with different headers are either disjoint or nested,
+// so the loops form a forest. (Cycles which are not natural loops, in irreducible CFGs,
+// are not found - C without 'goto' only produces reducible CFGs.)
+//
+// Loops are numbered in preorder of the dominator tree of their headers, so a loop comes
+// before the loops nested in it. Each block knows its innermost loop, and membership of
+// any other loop is found by walking up the loop tree from there.
+//
+// Loop transformations need somewhere to put code which runs once before the loop:
+// a preheader, the header's only predecessor from outside the loop, which only jumps to
+// the header. insert_preheaders() adds any which are missing.
+
+#ifndef LOOPS_H_
+#define LOOPS_H_
+
+#include <vector>
+
+#include "dominators.h"
+#include "ir.h"
+
+struct IrLoop
+{
+    IrBlockId header;
+
+    // Enclosing loop (or -1), and nesting depth (1 for an outermost loop).
+    int parent;
+    int depth;
+
+    // Blocks in the loop (including nested loops' blocks), in reverse postorder.
+    std::vector<IrBlockId> blocks;
+};
+
+class LoopInfo
+{
+    private:
+        std::vector<IrLoop> list;
+        std::vector<int> innermost;
+
+    public:
+        LoopInfo(const IrFunction&, const DominatorTree&);
+
+        inline const std::vector<IrLoop>& loops() const { return list; }
+        inline const IrLoop& loop(int index) const { return list[index]; }
+
+        // Innermost loop containing a block (or -1).
+        inline int loop_of(IrBlockId block) const { return innermost[block]; }
+
+        // Is a block in a loop (or in a loop nested in it)?
+        bool contains(int loop, IrBlockId) const;
+
+        // The loop's preheader, or IrNoBlock if it does not have one.
+        IrBlockId preheader(const IrFunction&, int loop) const;
+};
+
+// Give every loop a preheader. Phi operands for the edges from outside the loop move to
+// phis in the new preheader. Returns true if any were added (which invalidates the
+// dominator tree and the loop info).
+bool insert_preheaders(IrFunction&, const LoopInfo&);
+
+#endif
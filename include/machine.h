@@ -0,0 +1,103 @@
+// x86-64 machine instructions.
+//
+// AsmEmitter builds the code of each function as an array of MachineInstr, in the dialect
+// of GNU assembler syntax which it writes (AT&T operand order, size suffixes): an entry
+// is an instruction, a label or a directive. PeepholeOptimizer rewrites the array, and it
+// is then written out as text, or encoded by Assembler (which also parses text into it).
+//
+// Registers are numbered as Register (see regalloc.h), and have a width: 0 (byte) ... 3
+// (quadword), or XmmWidth for an xmm register.
+
+#ifndef MACHINE_H_
+#define MACHINE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "writer.h"
+
+// Register names, by width: byte, word, doubleword, quadword. And the size suffixes of
+// mnemonics, by width ("bwlq").
+extern const char * const RegisterNames[4][16];
+extern const char Suffixes[];
+
+const int XmmWidth = 4;
+
+// Base register of a memory operand relative to the instruction pointer.
+const int RipRegister = 16;
+
+enum class MachineOp : uint8_t
+{
+    LABEL, DIRECTIVE, DELETED, MOV, XOR, ADD, SUB, CMP, TEST, JMP, JCC, CALL, RET, OTHER
+};
+
+// Effect of an instruction on the flags: none, read, written (without reading them), or
+// not known.
+enum class MachineFlags : uint8_t
+{
+    NONE, READ, WRITE, UNKNOWN
+};
+
+// Operand: a register, an immediate, memory (base + index * scale + displacement, or a
+// symbol plus a displacement relative to rip), a symbol (a jump or call target, or a
+// label), or an indirect jump or call target (through a register or memory).
+struct MachineOperand
+{
+    enum class Kind : uint8_t
+    {
+        REGISTER, IMMEDIATE, MEMORY, SYMBOL, INDIRECT
+    };
+
+    Kind kind = Kind::IMMEDIATE;
+
+    // Register (REGISTER, and INDIRECT through one), and its width.
+    int reg = -1;
+    int width = -1;
+
+    // Value (IMMEDIATE), or displacement (MEMORY, and the addend of a SYMBOL).
+    int64_t value = 0;
+
+    // Address (MEMORY, and INDIRECT through memory): base (or -1, or RipRegister), index (or
+    // -1) and scale.
+    int base = -1;
+    int index = -1;
+    int scale = 1;
+
+    // Symbol (SYMBOL), or the symbol of a displacement. (A call target may end in '@PLT'.)
+    std::string symbol;
+
+    static MachineOperand in(int reg, int width);
+    static MachineOperand immediate(int64_t);
+    static MachineOperand memory(int base, int64_t displacement, int index = -1, int scale = 1);
+    static MachineOperand to(std::string symbol);
+
+    bool operator==(const MachineOperand&) const;
+    bool operator!=(const MachineOperand& other) const { return !(*this == other); }
+};
+
+// Instruction, label or directive. 'width' is the width of the mnemonic's suffix (0: byte
+// ... 3: quadword), or -1. The mnemonic of a label is its name, and that of a directive is
+// its name (and 'arguments' the rest of the line).
+struct MachineInstr
+{
+    MachineOp op = MachineOp::OTHER;
+    MachineFlags flags = MachineFlags::UNKNOWN;
+    int width = -1;
+    std::string mnemonic;
+    std::string arguments;
+    std::vector<MachineOperand> operands;
+
+    MachineInstr() = default;
+
+    // Instruction (its op, flags and width are given by the mnemonic).
+    MachineInstr(std::string mnemonic, std::vector<MachineOperand> operands);
+
+    static MachineInstr label(std::string name);
+    static MachineInstr directive(std::string name, std::string arguments = "");
+};
+
+BufferedWriter& operator<<(BufferedWriter&, const MachineOperand&);
+BufferedWriter& operator<<(BufferedWriter&, const MachineInstr&);
+
+#endif
@@ -0,0 +1,34 @@
+// Promotion of stack slots to SSA values ("mem2reg").
+//
+// IrGenerator gives every local variable a stack slot. A slot whose address is only used
+// by loads and stores of the whole slot can be replaced with SSA values:
+//  1. Phis are placed at the iterated dominance frontier of the blocks which store to the
+//     slot (Cytron et al.). The placement is pruned with liveness: a phi is only placed
+//     where the variable is live on entry, so variables which are only used near their
+//     definitions do not get phis at every join point.
+//  2. Loads are renamed to the value which reaches them, walking the dominator tree. The
+//     walk uses an explicit stack, and the current value of each variable is kept in an
+//     undo log (as in SymbolTable), so leaving a block is proportional to the number of
+//     stores in it.
+//  3. The slots, loads and stores are removed.
+//
+// A load which no store reaches reads an undefined value; it is replaced with zero.
+//
+// Each step is linear in the size of the function (plus the size of the dominance
+// frontiers), so functions with tens of thousands of blocks are promoted quickly.
+
+#ifndef MEM2REG_H_
+#define MEM2REG_H_
+
+#include "analysis.h"
+#include "ir.h"
+
+class Mem2Reg
+{
+    public:
+        // Returns true if any slots were promoted.
+        bool run(IrFunction&);
+        bool run(IrFunction&, AnalysisCache&);
+};
+
+#endif
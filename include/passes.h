@@ -0,0 +1,106 @@
+// Optimization pipelines.
+//
+// PassManager runs a list of passes over a module. The list depends on the optimization
+// level:
+//
+//     -O0  nothing (the IR is emitted as it was generated, with variables in stack slots)
+//     -O1  mem2reg, sccp, clean-up
+//     -O2  mem2reg, sccp, clean-up, inline, sccp, gvn, licm, vectorize, strength-reduction,
+//          if-convert, clean-up
+//
+// Most passes transform one function at a time, and each runs over every function before
+// the next pass starts. Module passes (the inliner) see the whole module; they are skipped
+// when the manager is run on a single function.
+//
+// Function passes share an AnalysisCache for each function, so the dominator tree and the
+// loops are computed once, and only recomputed after a pass changes the CFG. Each pass is
+// registered with a flag saying whether it keeps the cache valid: such a pass either leaves
+// the CFG alone, or invalidates the cache itself when it changes it (as Mem2Reg does when
+// it removes unreachable blocks). After any other pass which reports a change, the manager
+// invalidates the cache (after a module pass, the caches of every function).
+//
+// An observer can be set to see the module after each pass over it (e.g., to check that
+// the pass has not changed what the program does, by running it in the Interpreter).
+//
+// The manager records, for each pass, the number of times it ran and changed a function
+// (or the module), the wall time taken, and the total size of the functions (instructions
+// and blocks) before and after it. report() prints these, along with the time spent
+// computing each analysis, in the style of gcc's -ftime-passes.
+
+#ifndef PASSES_H_
+#define PASSES_H_
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "analysis.h"
+#include "inline.h"
+#include "ir.h"
+
+struct PassStats
+{
+    std::string name;
+    int runs = 0;
+    int changed = 0;
+    double seconds = 0;
+    size_t instrs_before = 0, instrs_after = 0;
+    size_t blocks_before = 0, blocks_after = 0;
+};
+
+class PassManager
+{
+    public:
+        typedef std::function<bool(IrFunction&, AnalysisCache&)> Pass;
+        typedef std::function<bool(IrModule&)> ModulePass;
+        typedef std::function<void(const std::string& pass, const IrModule&)> Observer;
+
+    private:
+        struct Entry
+        {
+            Pass pass;
+            ModulePass module_pass;
+            bool preserves_cfg;
+        };
+        std::vector<Entry> passes;
+        std::vector<PassStats> pass_stats;
+        Observer observer;
+
+        int analysis_counts[AnalysisCount] = {};
+        double analysis_times[AnalysisCount] = {};
+
+        bool run(size_t entry, IrFunction&, AnalysisCache&);
+        void record(const AnalysisCache&);
+
+    public:
+        // The pipeline for an optimization level (0, 1 or 2; higher levels are 2).
+        explicit PassManager(int level = 2, const InlineParams& = InlineParams());
+
+        // Append a pass to the pipeline.
+        void add(const std::string& name, Pass, bool preserves_cfg);
+        void add_module_pass(const std::string& name, ModulePass);
+
+        // Call a function after each pass over a module.
+        inline void observe(Observer function) { observer = function; }
+
+        // Run the pipeline over a function (without the module passes), or a module.
+        // Returns true if any pass changed it.
+        bool run(IrFunction&);
+        bool run(IrModule&);
+
+        // Statistics for each pass, in pipeline order.
+        inline const std::vector<PassStats>& stats() const { return pass_stats; }
+        inline int computed(Analysis analysis) const
+        {
+            return analysis_counts[static_cast<int>(analysis)];
+        }
+        inline double seconds(Analysis analysis) const
+        {
+            return analysis_times[static_cast<int>(analysis)];
+        }
+
+        void report(std::ostream&) const;
+};
+
+#endif
@@ -0,0 +1,78 @@
+// Machine-level peephole optimization.
+//
+// The emitter expands each tile on its own, so the seams between tiles leave instructions
+// which a look at their neighbours shows to be redundant: a value stored to its spill slot
+// and loaded straight back, a move back to where a value came from, two adjustments of the
+// same register. PeepholeOptimizer rewrites the instructions of a function (as AsmEmitter
+// builds them: see machine.h) with a table of rules, each tried at the instructions with
+// its anchor opcode:
+//  - 'mov r, r' is removed (except a doubleword move, which zeroes the upper half), and so
+//    is 'mov b, a' just after 'mov a, b'. After a store to a spill slot, a load from it into
+//    another register is a register move.
+//  - 'mov $0, r' is 'xor r, r' (shorter), if the flags are dead.
+//  - Adjacent 'add $i' and 'sub $i' of the same operand are merged (or removed, if they
+//    cancel), if the flags are dead.
+//  - 'cmp $0, r' is 'test r, r' (which sets the same flags).
+//  - A jump to a label which is followed by an unconditional jump goes to that jump's
+//    target. 'jcc a; jmp b; a:' is 'jncc b; a:', and a jump to the next instruction is
+//    removed.
+// The flags are dead after an instruction if they are written before they are read: the
+// instructions after it are scanned up to one which writes them (or a call or return), and
+// any label, jump, or instruction whose effect on the flags is not known makes them live.
+// The bits of a register above the width of the value in it are ignored (see AsmEmitter),
+// so a doubleword reload of a quadword store is also redundant.
+//
+// Rules are applied until none matches. Each one removes an instruction or replaces it
+// with a cheaper one, so this ends; it is usually a pass or two over the array.
+
+#ifndef PEEPHOLE_H_
+#define PEEPHOLE_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "machine.h"
+
+class PeepholeOptimizer
+{
+    private:
+        // Index of each label.
+        std::unordered_map<std::string, size_t> labels;
+
+        // Next instruction (or label or directive) after i which is not deleted (or the end).
+        size_t next(size_t i) const;
+        bool flags_dead(size_t i) const;
+        void remove(size_t i);
+
+        // Label of a jump, and its target after any jumps which it goes to.
+        const std::string& target(size_t i) const;
+        const std::string * thread(const std::string& label) const;
+
+        bool self_move(size_t i);
+        bool move_back(size_t i);
+        bool zero(size_t i);
+        bool merge_immediates(size_t i);
+        bool compare_zero(size_t i);
+        bool thread_jump(size_t i);
+        bool branch_over(size_t i);
+        bool jump_next(size_t i);
+
+        struct Rule
+        {
+            MachineOp anchor;
+            bool (PeepholeOptimizer::*apply)(size_t);
+        };
+        static const Rule Rules[];
+
+    public:
+        // (Removed instructions are DELETED, and skipped when the code is written out.)
+        std::vector<MachineInstr>& code;
+
+        explicit PeepholeOptimizer(std::vector<MachineInstr>&);
+
+        // Apply the rules until none matches; returns the number of rewrites.
+        int run();
+};
+
+#endif
@@ -4,6 +4,8 @@
 #define _PRINTER_H_
 
 #include <sstream>
+#include <string>
+#include <vector>
 
 #include "ast.h"
 
@@ -11,11 +13,26 @@
 // string representation for each node:
 // - Expression nodes:
 //   (P/B/U/T/PF/A/E ...)
+// - Declarations, statements, functions and translation units:
+//   (D/C/ES/R/F/TU ...)
+//
+// Visit methods queue child nodes (and the text between them) instead of visiting them
+// directly, so the walk uses an explicit stack.
 class PrinterVisitor : public AstVisitor
 {
     private:
+        struct Item
+        {
+            AstNode * node;
+            std::string text;
+        };
         std::stringstream str;
-        
+        std::vector<Item> stack;
+        std::vector<Item> queued;
+
+        inline void queue(AstNode& node) { queued.push_back(Item{&node, ""}); }
+        inline void queue(const std::string& text) { queued.push_back(Item{nullptr, text}); }
+
     public:
         std::string print(AstNode&);
 
@@ -27,6 +44,15 @@ class PrinterVisitor : public AstVisitor
         virtual void visit(AssignExprAstNode&) override;
         virtual void visit(ExprAstNode&) override;
         virtual void visit(DeclAstNode&) override;
+        virtual void visit(CompoundStmtAstNode&) override;
+        virtual void visit(ExprStmtAstNode&) override;
+        virtual void visit(ReturnStmtAstNode&) override;
+        virtual void visit(IterationStmtAstNode&) override;
+        virtual void visit(SwitchStmtAstNode&) override;
+        virtual void visit(CaseStmtAstNode&) override;
+        virtual void visit(JumpStmtAstNode&) override;
+        virtual void visit(FunctionDefAstNode&) override;
+        virtual void visit(TranslationUnitAstNode&) override;
 };
 
 #endif
\ No newline at end of file
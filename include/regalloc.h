@@ -0,0 +1,206 @@
+// Linear scan register allocation (for x86-64), on SSA form.
+//
+// Following Wimmer and Moessenboeck ("Optimized Interval Splitting in a Linear Scan Register
+// Allocator"), each IR value gets a live interval: a list of ranges of positions, with
+// holes, and the positions where it is used. Instruction k reads its operands at position
+// 4k, clobbers registers (calls) at 4k + 1, and writes its result at 4k + 2. A value's
+// intervals are found by walking backwards from each use to the definition, so building
+// them is linear in their total length; no iterative dataflow is needed.
+//
+// Intervals are allocated in order of their start:
+//  - If a register is free for the whole interval, it is used. A register which is only
+//    free for part of it (e.g., a caller-saved register, until the next call) is used for
+//    that part, and the rest is split off and allocated later.
+//  - Otherwise the interval (of this one and the ones in registers) whose next use is
+//    furthest away is split and spilled up to that next use.
+// Spilled parts of a value share one stack slot, and slots are reused by values whose
+// intervals do not overlap.
+//
+// Moves are coalesced by hints: a phi prefers its operands' registers (and they prefer
+// its), the result of an arithmetic instruction prefers its first operand's register (x86
+// instructions overwrite their first operand), and a parameter prefers the register it is
+// passed in.
+//
+// Where an interval is split, a move is placed before the instruction at the split. Where
+// a value's location differs at the two ends of a CFG edge (or a phi needs its operand),
+// a parallel move is placed on the edge: at the end of the predecessor, or (if it has
+// several successors) at the start of the successor. Critical edges are split first, so
+// one of these is always possible.
+//
+// With an InstructionSelector, the instructions which are covered by another's tile get no
+// interval, and the operands they use are used at the root of the tile, where it is
+// emitted.
+//
+// rax and r11 are never allocated: the emitter uses them as scratch registers, so any
+// operand may be in memory. rsp and rbp hold the stack frame. Constants and the addresses
+// of stack objects (alloca) are not allocated either; they are rematerialised where they
+// are used.
+
+#ifndef REGALLOC_H_
+#define REGALLOC_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "ir.h"
+#include "select.h"
+
+// x86-64 general purpose registers, in encoding order.
+enum class Register : uint8_t
+{
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+// Integer arguments are passed in these registers (System V ABI).
+extern const Register ArgumentRegisters[6];
+
+bool is_callee_saved(Register);
+
+struct Location
+{
+    enum class Kind : uint8_t
+    {
+        // NONE: unused value. REGISTER: 'reg'. STACK: spill slot 'index'. CONSTANT: the
+        // CONST instruction 'index'. FRAME: the address of the ALLOCA instruction 'index'.
+        NONE, REGISTER, STACK, CONSTANT, FRAME
+    };
+    Kind kind = Kind::NONE;
+    Register reg = Register::RAX;
+    uint32_t index = 0;
+
+    static inline Location in(Register reg) { return Location{Kind::REGISTER, reg, 0}; }
+
+    inline bool operator==(const Location& other) const
+    {
+        return kind == other.kind && (kind == Kind::REGISTER ? reg == other.reg : index == other.index);
+    }
+    inline bool operator!=(const Location& other) const { return !(*this == other); }
+};
+
+struct LiveRange
+{
+    uint32_t from, to;
+};
+
+// Live interval of a value (or part of one, after splitting). The parts of a value are
+// linked in order through 'next'.
+struct LiveInterval
+{
+    IrValue value;
+    std::vector<LiveRange> ranges;
+    std::vector<uint32_t> uses;
+    Location location;
+    uint32_t next = UINT32_MAX;
+
+    // Preferred register: a fixed register, or the register of another value.
+    int hint_register = -1;
+    IrValue hint_value = IrNone;
+
+    inline uint32_t start() const { return ranges.front().from; }
+    inline uint32_t end() const { return ranges.back().to; }
+    bool covers(uint32_t position) const;
+
+    // First position in both intervals, or UINT32_MAX.
+    uint32_t intersection(const LiveInterval&) const;
+
+    // First use at or after a position, or UINT32_MAX.
+    uint32_t next_use(uint32_t position) const;
+};
+
+// Move from one location to another. The moves before an instruction are done in phases:
+// 0, the moves at the start of a block (from its predecessor's edge); 1, moves where
+// intervals were split; 2, the moves at the end of a block (to its successor's edge). The
+// moves in each phase are a parallel move: every source is read before any destination is
+// written.
+struct Move
+{
+    uint32_t gap;
+    uint8_t phase;
+    Location from, to;
+};
+
+class LinearScan
+{
+    private:
+        IrFunction& function;
+        const InstructionSelector * selector;
+
+        std::vector<LiveInterval> intervals;
+        std::vector<uint32_t> interval_of;
+        std::vector<uint32_t> block_from, block_to;
+        std::vector<bool> block_start;
+        std::vector<std::vector<IrValue>> live_in;
+
+        // Positions where each register cannot be used (calls, division, shifts, incoming
+        // arguments).
+        std::vector<std::vector<LiveRange>> fixed;
+
+        // Intervals waiting to be allocated (a heap, by start), and the allocated intervals
+        // in registers which are live (active) or in a lifetime hole (inactive) at the
+        // current position.
+        std::vector<uint32_t> unhandled, active, inactive;
+
+        // Spill slot of each value, and the end of the value which last used each slot.
+        std::vector<uint32_t> slot_of;
+        std::vector<uint32_t> value_end;
+        std::vector<uint32_t> slot_end;
+
+        std::vector<Location> operand_locations;
+        std::vector<Location> result_locations;
+        std::vector<Move> move_list;
+        std::vector<uint32_t> move_offsets;
+        uint16_t used_registers = 0;
+
+        void number();
+        void build_intervals();
+        void build_fixed();
+        void allocate();
+        bool try_allocate(uint32_t interval);
+        void allocate_blocked(uint32_t interval);
+        void resolve();
+
+        void push(uint32_t interval);
+        uint32_t split_position(uint32_t) const;
+        uint32_t split(uint32_t interval, uint32_t position);
+
+        // Spill an interval from 'from' (up to its first use after 'position').
+        void spill(uint32_t interval, uint32_t from, uint32_t position);
+
+        int hint(const LiveInterval&) const;
+        uint32_t fixed_intersection(Register, const LiveInterval&) const;
+
+    public:
+        // Allocate a function's values, for the instructions chosen by a selector (or one
+        // instruction for each IR instruction). The function is prepared first.
+        explicit LinearScan(IrFunction&, const InstructionSelector * = nullptr);
+
+        // Split the critical edges of a function, and compact it, so instruction k is the
+        // k'th in block order. (Instructions are selected after this.)
+        static void prepare(IrFunction&);
+
+        static const Register Allocatable[12];
+
+        // Location of an operand of an instruction (a phi's operands are at the ends of
+        // its predecessors), and of the result of an instruction.
+        inline Location operand(IrValue user, size_t i) const
+        {
+            return operand_locations[function.instrs[user].first + i];
+        }
+        inline Location result(IrValue value) const { return result_locations[value]; }
+
+        // Location of a value at a position (while it is live).
+        Location location(IrValue, uint32_t position) const;
+
+        // Moves before instruction 'gap' (in order of phase).
+        inline const Move * moves_begin(uint32_t gap) const { return move_list.data() + move_offsets[gap]; }
+        inline const Move * moves_end(uint32_t gap) const { return move_list.data() + move_offsets[gap + 1]; }
+
+        inline uint32_t spill_slots() const { return slot_end.size(); }
+
+        // Has a register been allocated to any value?
+        inline bool used(Register reg) const { return used_registers & (1 << static_cast<int>(reg)); }
+
+        inline const std::vector<LiveInterval>& all_intervals() const { return intervals; }
+};
+
+#endif
@@ -0,0 +1,93 @@
+// Name resolution.
+//
+// NameResolver binds each identifier expression in a translation unit to its declaration
+// (PrimaryExprAstNode::declaration), in a single walk over the AST. Undeclared identifiers
+// and invalid redeclarations are reported to the ErrorReporter.
+//
+// Declarations are referenced by raw pointer, so the AST must not be rebuilt (e.g., by
+// ConstantFolder) after names are resolved.
+//
+// A resolver can extend the file scope of another (read-only) resolver, to resolve a single
+// function body (see SemanticAnalyser).
+
+#ifndef RESOLVE_H_
+#define RESOLVE_H_
+
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include "ast.h"
+#include "error.h"
+#include "symbol.h"
+
+// Statements are walked with an explicit stack (like PrinterVisitor), so deeply nested
+// blocks cannot overflow the call stack. Expressions are walked with AstWalker.
+class NameResolver : public AstVisitor
+{
+    private:
+        struct Item
+        {
+            AstNode * node;
+
+            // Leave the current scope (node is null).
+            bool leave;
+        };
+        ErrorReporter& error;
+        IdentifierTable identifiers;
+        SymbolTable symbols;
+        AstWalker walker;
+        std::vector<Item> stack;
+        std::vector<Item> queued;
+
+        // File-scope declarations which are also definitions.
+        std::unordered_set<const DeclAstNode *> definitions;
+
+        inline void queue(AstNode& node) { queued.push_back(Item{&node, false}); }
+        inline void queue_leave() { queued.push_back(Item{nullptr, true}); }
+        void run();
+        void enter_function(FunctionDefAstNode&);
+        void resolve_expr(const std::shared_ptr<ExprAstNode>&);
+
+    public:
+        explicit NameResolver(ErrorReporter&, int depth_limit = DefaultAstDepthLimit);
+
+        // Extend the file scope of 'globals', limited to its first 'visible' bindings.
+        NameResolver(
+            ErrorReporter&,
+            const NameResolver& globals,
+            int visible,
+            int depth_limit = DefaultAstDepthLimit);
+
+        void resolve(AstNode&);
+
+        // Resolve the parameters and body of a function (but not its declaration).
+        void resolve_function(FunctionDefAstNode&);
+
+        // Declare an identifier in the current scope ('definition': the declaration is a
+        // file-scope definition).
+        void declare(DeclAstNode&, bool definition);
+
+        // Number of file-scope bindings (see SymbolTable::size).
+        inline int size() const { return symbols.size(); }
+
+        virtual void visit(PrimaryExprAstNode&) override;
+        virtual void visit(BinaryExprAstNode&) override;
+        virtual void visit(UnaryExprAstNode&) override;
+        virtual void visit(TertiaryExprAstNode&) override;
+        virtual void visit(PostfixExprAstNode&) override;
+        virtual void visit(AssignExprAstNode&) override;
+        virtual void visit(ExprAstNode&) override;
+        virtual void visit(DeclAstNode&) override;
+        virtual void visit(CompoundStmtAstNode&) override;
+        virtual void visit(ExprStmtAstNode&) override;
+        virtual void visit(ReturnStmtAstNode&) override;
+        virtual void visit(IterationStmtAstNode&) override;
+        virtual void visit(SwitchStmtAstNode&) override;
+        virtual void visit(CaseStmtAstNode&) override;
+        virtual void visit(JumpStmtAstNode&) override;
+        virtual void visit(FunctionDefAstNode&) override;
+        virtual void visit(TranslationUnitAstNode&) override;
+};
+
+#endif
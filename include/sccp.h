@@ -0,0 +1,58 @@
+// Sparse conditional constant propagation (Wegman and Zadeck).
+//
+// Each value starts out unknown (no evidence yet), and is lowered to a constant, or to
+// "varying" (not a constant), as evidence arrives. Two worklists drive the analysis: CFG
+// edges which have become executable, and values whose lattice value has changed. Only the
+// executable edges of a branch are followed, and only phi operands from executable edges
+// are merged, so code behind a constant condition never makes a value vary.
+//
+// Constants are evaluated with ir_evaluate, at the width of their IR type, so the C rules
+// for promotion, signedness and wraparound (already explicit in the IR) are followed
+// exactly. Operations with undefined results are left alone.
+//
+// Afterwards, values proved constant are rewritten to CONST, branches and switches on
+// constants become jumps, and blocks which cannot be executed are removed.
+
+#ifndef SCCP_H_
+#define SCCP_H_
+
+#include <vector>
+
+#include "ir.h"
+
+class ConstantPropagation
+{
+    private:
+        enum class Lattice : uint8_t
+        {
+            UNKNOWN, CONSTANT, VARYING
+        };
+
+        IrFunction * function = nullptr;
+        std::vector<Lattice> lattice;
+        std::vector<int64_t> values;
+
+        // Executable blocks, and executable edges (one flag per predecessor, stored from
+        // edge_offsets[block]).
+        std::vector<bool> executable;
+        std::vector<uint32_t> edge_offsets;
+        std::vector<bool> edges;
+
+        // Edges (from, to) which may have become executable, and values which have changed.
+        std::vector<std::pair<IrBlockId, IrBlockId>> cfg_work;
+        std::vector<IrValue> ssa_work;
+
+        // Successor taken by a branch or switch on a constant.
+        size_t taken(IrValue terminator) const;
+
+        void mark_edge(IrBlockId from, IrBlockId to);
+        void set(IrValue, Lattice, int64_t value = 0);
+        void visit(IrValue);
+        void visit_phi(IrValue);
+
+    public:
+        // Returns true if the function changed.
+        bool run(IrFunction&);
+};
+
+#endif
@@ -0,0 +1,112 @@
+// Instruction selection by tree-pattern matching (BURS).
+//
+// Within a block, an instruction whose value has a single use, by a later instruction of
+// the same block, can be computed as part of its user: the instructions form trees, and a
+// tree is covered by tiles - patterns of IR instructions which map to a few x86-64
+// instructions (e.g., a load from 'base + index * 4 + 8' to one mov, 'STORE(a, ADD(LOAD(a),
+// x))' to one add to memory, or a comparison and the branch which uses it to cmp and jcc).
+// The tiles are the rules of a tree grammar (tools/lc2_isel/x86_64.py), from which the
+// matching code and tables are generated at build time (isel.h, isel.cpp).
+//
+// Selection is in two passes, as in a bottom-up rewrite system (Pelegri-Llopart and Graham;
+// Fraser, Hanson and Proebsting's iburg):
+//  - Labelling, in order (operands before their users): each instruction gets the cheapest
+//    rule, and its cost, for each nonterminal (reg, addr, cond ...), from the rules whose
+//    patterns match it and its operands' labels. An operand which is not in the tree (it is
+//    used elsewhere too, or by a phi, or in another block) is only a 'reg': it is computed
+//    by its own tile.
+//  - Reduction, from the last instruction back: each instruction which is not covered by a
+//    later tile is the root of a tile (at 'stmt' if it has no result, otherwise at 'reg'),
+//    and the rules chosen for its pattern's leaves cover the instructions below it.
+//
+// A tile is emitted at its root, so its leaves are read there (LinearScan places the uses
+// of instructions in a tile at the root). A load is only put in a tree if no store, call or
+// vector operation comes between it and the tree's root. Constants, stack objects (alloca)
+// and symbols are used in place by any number of tiles; a symbol is only computed into a
+// register (lea) where it is used as a 'reg'.
+//
+// Operands which are used more than once are not in any tree, so e.g. the address of
+// 'a[i] += x', which is used by its load and its store, is computed into a register first.
+
+#ifndef SELECT_H_
+#define SELECT_H_
+
+#include <vector>
+
+#include "ir.h"
+#include "isel.h"
+
+class InstructionSelector
+{
+    private:
+        const IrFunction& function;
+        const IrModule& module;
+
+        // Label of each instruction, and of an operand which is not in the tree.
+        std::vector<IselState> states;
+        IselState leaf;
+
+        // Can the instruction be covered by its user's tile?
+        std::vector<bool> nested;
+
+        // Root of the tile covering each instruction (itself, for a root), and the symbols
+        // which are computed into a register.
+        std::vector<IrValue> roots;
+        std::vector<bool> needed;
+
+        void analyse();
+        void reduce(IrValue root);
+
+        // Constants, stack objects and symbols, which every tile uses in place.
+        bool shared(IrValue) const;
+
+        // (Generated.) Label an instruction, and apply the chain rules to a label.
+        void label(IrValue);
+        static void close(IselState&);
+
+        // Used by the generated matching code.
+        inline IrValue operand(IrValue value, uint32_t i) const { return function.operand(value, i); }
+        bool match(IrValue, IrOp, uint32_t count) const;
+        uint32_t cost(const IselKid&) const;
+        uint32_t rest(IrValue, uint32_t first) const;
+        static inline bool record(IselState& s, IselNonTerminal nt, uint16_t rule, uint32_t cost)
+        {
+            if(cost >= s.cost[nt]) return false;
+            s.cost[nt] = static_cast<uint16_t>(cost);
+            s.rule[nt] = rule;
+            return true;
+        }
+
+        // Predicates of rules.
+        bool rmw(IrValue, const IselKid *, size_t) const;
+        bool wide(IrValue, const IselKid *, size_t) const;
+        bool direct(IrValue, const IselKid *, size_t) const;
+        bool imm32(IrValue, const IselKid *, size_t) const;
+        bool zero(IrValue, const IselKid *, size_t) const;
+        bool scale(IrValue, const IselKid *, size_t) const;
+        bool shift(IrValue, const IselKid *, size_t) const;
+        bool factor(IrValue, const IselKid *, size_t) const;
+
+    public:
+        // Select the instructions of a function. (Its blocks must be in their final order,
+        // and compacted; see LinearScan::prepare.)
+        InstructionSelector(const IrFunction&, const IrModule&);
+
+        // Is an instruction emitted as part of another one's tile (or used in place)?
+        inline bool folded(IrValue value) const
+        {
+            return shared(value) ? !needed[value] : roots[value] != value;
+        }
+
+        // Root of the tile which covers an instruction.
+        inline IrValue root(IrValue value) const { return roots[value]; }
+
+        // Rule for a node of the tile rooted at 'root', at a nonterminal.
+        int rule(IrValue node, IselNonTerminal, IrValue root) const;
+
+        // (Generated.) Leaves of a rule's pattern at a node, in operand order, and the
+        // instructions inside the pattern.
+        void kids(IrValue node, int rule, std::vector<IselKid>&, std::vector<IrValue> * covered = nullptr) const;
+};
+
+#endif
@@ -0,0 +1,106 @@
+// Semantic analysis.
+//
+// TypeChecker checks the constraints on expressions, declarations and statements (6.5 -
+// 6.8), and sets the type of every expression (ExprAstNode::ctype).
+//
+// SemanticAnalyser resolves names and checks types for a translation unit. File-scope
+// declarations are handled first, in order, building a global scope which is then
+// read-only. Function bodies only depend on the global scope, so they are analysed in
+// parallel on a ThreadPool. Each function's errors are buffered, and all errors are
+// reported in source order once analysis has finished, so the output does not depend on
+// scheduling.
+//
+// Initializers of objects with static storage duration must already be folded to
+// constants (see ConstantFolder).
+
+#ifndef SEMA_H_
+#define SEMA_H_
+
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "ast.h"
+#include "error.h"
+#include "thread_pool.h"
+#include "type.h"
+
+// Checks are post-order (with AstWalker), so the types of an expression's operands are
+// known when it is visited. Expressions whose operands could not be typed are not checked
+// (their type is null), so one error is not reported repeatedly.
+class TypeChecker : public AstVisitor
+{
+    private:
+        ErrorReporter& error;
+        TypeContext& context;
+        AstWalker walker;
+
+        // Function being checked (null for file-scope declarations).
+        FunctionDefAstNode * function = nullptr;
+
+        // Declarations of the function's objects with automatic storage duration: its
+        // parameters, and the locals not declared 'static' which have been checked.
+        std::unordered_set<const DeclAstNode *> automatic;
+
+        // Unqualified pointers to each base type, so that most expressions are typed
+        // without taking TypeContext's lock (the checkers of functions run in parallel).
+        std::unordered_map<const CType *, std::shared_ptr<CType>> pointers;
+
+        std::shared_ptr<CType> pointer_to(const std::shared_ptr<CType>&);
+        std::shared_ptr<CType> unqualified(const std::shared_ptr<CType>&);
+        std::shared_ptr<CType> value(const std::shared_ptr<CType>&);
+        std::shared_ptr<CType> promote(const std::shared_ptr<CType>&);
+        std::shared_ptr<CType> common(const std::shared_ptr<CType>&, const std::shared_ptr<CType>&);
+        std::shared_ptr<CType> int_type();
+        bool assignable(const std::shared_ptr<CType>&, ExprAstNode&);
+        std::shared_ptr<CType> increment(ExprAstNode&, int);
+        bool is_constant_initializer(ExprAstNode&) const;
+
+    public:
+        TypeChecker(ErrorReporter&, TypeContext&, int depth_limit = DefaultAstDepthLimit);
+
+        // Check a file-scope declaration.
+        void check(const std::shared_ptr<DeclAstNode>&);
+
+        // Check the parameters and body of a function definition.
+        void check(FunctionDefAstNode&);
+
+        virtual void visit(PrimaryExprAstNode&) override;
+        virtual void visit(BinaryExprAstNode&) override;
+        virtual void visit(UnaryExprAstNode&) override;
+        virtual void visit(TertiaryExprAstNode&) override;
+        virtual void visit(PostfixExprAstNode&) override;
+        virtual void visit(AssignExprAstNode&) override;
+        virtual void visit(ExprAstNode&) override;
+        virtual void visit(DeclAstNode&) override;
+        virtual void visit(CompoundStmtAstNode&) override;
+        virtual void visit(ExprStmtAstNode&) override;
+        virtual void visit(ReturnStmtAstNode&) override;
+        virtual void visit(IterationStmtAstNode&) override;
+        virtual void visit(SwitchStmtAstNode&) override;
+        virtual void visit(CaseStmtAstNode&) override;
+        virtual void visit(JumpStmtAstNode&) override;
+        virtual void visit(FunctionDefAstNode&) override;
+        virtual void visit(TranslationUnitAstNode&) override;
+};
+
+class SemanticAnalyser
+{
+    private:
+        ErrorReporter& error;
+        TypeContext& context;
+        ThreadPool pool;
+        const int depth_limit;
+
+    public:
+        // 'threads': number of worker threads (0 uses one per hardware thread).
+        SemanticAnalyser(
+            ErrorReporter&,
+            TypeContext&,
+            int threads = 0,
+            int depth_limit = DefaultAstDepthLimit);
+
+        void analyse(TranslationUnitAstNode&);
+};
+
+#endif
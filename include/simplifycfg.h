@@ -0,0 +1,54 @@
+// Control flow graph simplification.
+//
+// CfgSimplifier applies these rewrites until none of them applies:
+//  - A branch or switch on a constant, or with all of its edges to the same block (and the
+//    same phi operands), becomes a jump.
+//  - An edge to a block which is only a phi and a branch on that phi (or on a comparison of
+//    the phi with a constant) is threaded: if the phi operand for the edge is a constant,
+//    the edge goes straight to the branch's target. So when 'a && b' is the condition of
+//    another '&&', and 'a' is false, the second test is skipped.
+//  - A block which only jumps elsewhere (a forwarding block) is removed, and its
+//    predecessors jump to its successor instead.
+//  - A block with one successor is merged with that successor, if it is its only
+//    predecessor.
+//  - Unreachable blocks are removed.
+//
+// Each round is linear in the size of the function. Phis which are removed by merging are
+// replaced at the end of each round, in one pass over the operands.
+
+#ifndef SIMPLIFYCFG_H_
+#define SIMPLIFYCFG_H_
+
+#include <vector>
+
+#include "ir.h"
+
+class CfgSimplifier
+{
+    private:
+        IrFunction * function = nullptr;
+
+        // Uses of each value (an upper bound, during a round), and the phis removed in the
+        // current round.
+        std::vector<uint32_t> use_counts;
+        std::vector<IrValue> replacements;
+
+        // Jumps which may still be threaded. (A cycle of branches on constants could
+        // otherwise be threaded forever.)
+        size_t threads = 0;
+
+        bool fold_branch(IrBlockId);
+        bool thread_edge(IrBlockId, size_t edge);
+        bool remove_forwarder(IrBlockId);
+        bool merge(IrBlockId);
+
+    public:
+        // Returns true if the function changed.
+        bool run(IrFunction&);
+};
+
+// Run dead code elimination and CFG simplification until neither changes the function.
+// Returns true if anything changed.
+bool clean_up(IrFunction&);
+
+#endif
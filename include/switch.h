@@ -0,0 +1,99 @@
+// Switch lowering.
+//
+// SwitchPlan decides how a SWITCH is tested: it groups the cases into clusters, and the
+// clusters into a decision tree, which the emitter writes out as instructions. Cases are
+// sorted, and consecutive values with the same target are merged into ranges. Then the
+// ranges are clustered, in order of preference:
+//  - Jump table: a run of ranges whose cases are at least 40% of the values it spans (and
+//    at least 4 cases) is looked up in a table of targets, indexed by value - low, after
+//    one unsigned range check. The runs are chosen to cover the ranges with the fewest
+//    clusters (dynamic programming over the sorted ranges, as in LLVM's switch lowering).
+//  - Bit test: a run of ranges which spans at most 64 values, and goes to at most 3
+//    targets, is tested with one range check and then one bit test against a mask for
+//    each target - where that beats comparing with each range (for 3 ranges to one target,
+//    5 to two, or 6 to three).
+//  - Otherwise, each range is a cluster of its own: one comparison for a single value, or
+//    a range check.
+// The clusters are split at the median into a balanced binary tree of comparisons, so a
+// switch with n clusters takes about log2(n) branches, down to leaves of at most 3
+// clusters, which are tested in turn.
+//
+// Each node of the tree has the bounds which the tests above it put on the value, so a
+// range check which they already imply can be left out (and a leaf's last cluster may need
+// no test at all).
+//
+// Clusters of more than one value have bounds which fit in 32 bits (so their range checks
+// can use immediate operands, whatever the width of the value).
+
+#ifndef SWITCH_H_
+#define SWITCH_H_
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Case of a switch: a value, and the index of its target (among the switch's successors;
+// successor 0 is the default).
+struct SwitchCase
+{
+    int64_t value;
+    uint32_t target;
+};
+
+enum class SwitchClusterKind : uint8_t
+{
+    RANGE, TABLE, BITS
+};
+
+// Values low ... high. RANGE: all of them go to 'target'. TABLE: value v goes to
+// table[v - low] (0, the default, where v is not a case). BITS: value v goes to the target
+// of the first mask with bit v - low set (or to the default, if none has).
+struct SwitchCluster
+{
+    SwitchClusterKind kind;
+    int64_t low, high;
+    uint32_t target = 0;
+    std::vector<uint32_t> table;
+    std::vector<std::pair<uint32_t, uint64_t>> masks;
+};
+
+// Node of the decision tree. A test node sends values below 'pivot' to child 'left', and
+// the rest to 'right'. A leaf (left is -1) tests clusters first ... last - 1 in turn. The
+// value is known to be between 'low' and 'high'.
+struct SwitchNode
+{
+    size_t first, last;
+    int64_t pivot;
+    int left, right;
+    int64_t low, high;
+};
+
+// Minimum density (percent) and number of cases of a jump table, maximum number of targets
+// of a bit test, and maximum number of clusters in a leaf of the tree.
+const int SwitchTableDensity = 40;
+const int SwitchTableCases = 4;
+const int SwitchBitTargets = 3;
+const int SwitchLeafClusters = 3;
+
+class SwitchPlan
+{
+    private:
+        // Ranges of consecutive cases with the same target.
+        std::vector<SwitchCluster> ranges;
+
+        void merge(std::vector<SwitchCase>&);
+        void find_tables();
+        void find_bit_tests();
+        void build_tree(int64_t low, int64_t high);
+
+    public:
+        // Clusters, in order of value, and the decision tree (node 0 is the root).
+        std::vector<SwitchCluster> clusters;
+        std::vector<SwitchNode> nodes;
+
+        // Plan a switch on a value between 'low' and 'high' (the range of its type). The
+        // case values must be distinct.
+        SwitchPlan(std::vector<SwitchCase> cases, int64_t low, int64_t high);
+};
+
+#endif
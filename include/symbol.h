@@ -0,0 +1,96 @@
+// Identifier interning, and scoped symbol table.
+//
+// Identifiers are interned to small integer IDs, so the symbol table never hashes or
+// compares strings. SymbolTable is an open-addressing hash table, keyed by identifier ID,
+// where each slot holds the innermost binding of its identifier. Bindings are appended to
+// a single vector, which doubles as the undo log: each binding records the binding it
+// shadows, and leaving a scope restores those for the bindings made in that scope. So
+// entering a scope is O(1), and leaving it is proportional to the number of symbols it
+// declared, regardless of how many symbols are visible.
+//
+// Both tables can extend a read-only parent (e.g., the file scope shared by functions which
+// are analysed in parallel). Lookups fall back to the parent, which is never modified.
+
+#ifndef SYMBOL_H_
+#define SYMBOL_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class DeclAstNode;
+
+// Map identifier names to dense integer IDs (0, 1, 2, ...). IDs of identifiers which are
+// not in the parent table follow on from the parent's IDs.
+class IdentifierTable
+{
+    private:
+        const IdentifierTable * parent;
+        const int base;
+        std::unordered_map<std::string, int> ids;
+        std::vector<const std::string *> names;
+
+    public:
+        explicit IdentifierTable(const IdentifierTable * parent = nullptr);
+
+        int intern(const std::string&);
+
+        // Get the ID of an identifier, or -1 if it has not been interned.
+        int find(const std::string&) const;
+
+        const std::string& name(int) const;
+        inline int size() const { return base + names.size(); }
+};
+
+class SymbolTable
+{
+    private:
+        struct Slot
+        {
+            int id;
+            int binding;
+        };
+        struct Binding
+        {
+            DeclAstNode * decl;
+            int id;
+            int shadowed;
+            int scope;
+        };
+        const SymbolTable * parent;
+        const int parent_limit;
+        std::vector<Slot> slots;
+        int used = 0;
+        std::vector<Binding> bindings;
+
+        // Number of bindings at the start of each open scope.
+        std::vector<int> scopes;
+
+        int find(int) const;
+        void grow();
+
+    public:
+        // Lookups fall back to the first 'parent_limit' bindings of the parent (i.e., the
+        // declarations which were visible at that point).
+        explicit SymbolTable(const SymbolTable * parent = nullptr, int parent_limit = 0);
+
+        // Enter/leave a block scope. The table starts at file scope.
+        void push_scope();
+        void pop_scope();
+
+        // Scope nesting depth (0 at file scope).
+        inline int depth() const { return scopes.size(); }
+
+        // Number of bindings in open scopes.
+        inline int size() const { return bindings.size(); }
+
+        // Bind an identifier in the current scope. If it is already declared in this
+        // scope, the binding is replaced, and the previous declaration is returned.
+        // Otherwise, returns nullptr.
+        DeclAstNode * declare(int, DeclAstNode *);
+
+        // Get the innermost visible declaration of an identifier (or nullptr).
+        DeclAstNode * lookup(int) const;
+};
+
+#endif
@@ -0,0 +1,63 @@
+// Work-stealing thread pool.
+//
+// ThreadPool runs batches of independent tasks (identified by index). Each worker has its
+// own task queue; tasks are dealt out round-robin at the start of a batch, and a worker
+// which runs out of tasks steals from the other end of another worker's queue. This keeps
+// workers busy when task sizes are uneven (e.g., one large function among many small
+// ones). The calling thread is one of the workers.
+
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+    private:
+        struct Queue
+        {
+            std::mutex lock;
+            std::deque<size_t> tasks;
+        };
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> threads;
+
+        // Batch state (guarded by 'lock').
+        std::mutex lock;
+        std::condition_variable wake;
+        std::condition_variable done;
+        const std::function<void(size_t)> * job = nullptr;
+        uint64_t generation = 0;
+        int busy = 0;
+        bool stopping = false;
+        std::exception_ptr error;
+
+        bool next(int, size_t&);
+        void work(int);
+        void worker(int);
+
+    public:
+        // Use 'threads' workers (including the calling thread). 0 uses one per hardware
+        // thread.
+        explicit ThreadPool(int threads = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        inline int size() const { return queues.size(); }
+
+        // Run task(0) ... task(count - 1), and wait for all of them to finish. If any task
+        // throws, the first exception is rethrown (after the batch has finished).
+        void run(size_t count, const std::function<void(size_t)>& task);
+};
+
+#endif
@@ -2,12 +2,26 @@
 #define _CTYPE_H_
 
 #include <ostream>
+#include <memory>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <stdexcept>
 
 #include "token.h"
 
-class CTypeError
+// 'line' is the line of the declaration, or -1 if it is not known (e.g. sizes of types).
+class CTypeError : public std::runtime_error
 {
+    public:
+        int line;
 
+        explicit CTypeError(const std::string& errmsg, int line = -1)
+          : std::runtime_error(errmsg)
+          , line(line) { }
 };
 
 enum class BasicCTypeType
@@ -22,7 +36,7 @@ enum class BasicCTypeSignedness
 
 enum class BasicCTypeStorage
 {
-    STATIC, NOT_SET
+    STATIC, NOT_SET, REGISTER
 };
 
 enum class BasicCTypeQualifier
@@ -30,6 +44,80 @@ enum class BasicCTypeQualifier
     CONST, NOT_SET
 };
 
+// Packed basic type descriptor.
+//
+// Encodes all attributes of a BasicCType in one integer, so that type checking can work
+// on values in registers:
+//  - bits 0-1: BasicCTypeType
+//  - bits 2-3: BasicCTypeSignedness
+//  - bits 4-5: BasicCTypeStorage
+//  - bit 6:    BasicCTypeQualifier
+typedef uint32_t PackedCType;
+
+const int PackedCTypeBits = 7;
+
+constexpr PackedCType pack_ctype(
+    BasicCTypeType type,
+    BasicCTypeSignedness signedness,
+    BasicCTypeStorage storage = BasicCTypeStorage::NOT_SET,
+    BasicCTypeQualifier qualifier = BasicCTypeQualifier::NOT_SET)
+{
+    return static_cast<PackedCType>(type)
+        | static_cast<PackedCType>(signedness) << 2
+        | static_cast<PackedCType>(storage) << 4
+        | static_cast<PackedCType>(qualifier) << 6;
+}
+
+constexpr BasicCTypeType packed_type(PackedCType t)
+{
+    return static_cast<BasicCTypeType>(t & 0x3);
+}
+
+constexpr BasicCTypeSignedness packed_signedness(PackedCType t)
+{
+    return static_cast<BasicCTypeSignedness>((t >> 2) & 0x3);
+}
+
+constexpr BasicCTypeStorage packed_storage(PackedCType t)
+{
+    return static_cast<BasicCTypeStorage>((t >> 4) & 0x3);
+}
+
+constexpr BasicCTypeQualifier packed_qualifier(PackedCType t)
+{
+    return static_cast<BasicCTypeQualifier>((t >> 6) & 0x1);
+}
+
+// Plain char is signed (x86-64 System V ABI).
+constexpr bool packed_is_unsigned(PackedCType t)
+{
+    return packed_signedness(t) == BasicCTypeSignedness::UNSIGNED;
+}
+
+constexpr PackedCType PackedInt = pack_ctype(BasicCTypeType::INT, BasicCTypeSignedness::SIGNED);
+constexpr PackedCType PackedUnsignedInt = pack_ctype(BasicCTypeType::INT, BasicCTypeSignedness::UNSIGNED);
+
+// Integer promotion (6.3.1.1, 2). char and short int values always fit in int. The result
+// is the unqualified type of the value.
+constexpr PackedCType integer_promotion(PackedCType t)
+{
+    return (packed_type(t) == BasicCTypeType::INT && packed_is_unsigned(t))
+        ? PackedUnsignedInt
+        : PackedInt;
+}
+
+// Usual arithmetic conversions (6.3.1.8). After promotion, both operands are int or
+// unsigned int.
+constexpr PackedCType usual_arithmetic_conversion(PackedCType a, PackedCType b)
+{
+    return (integer_promotion(a) == PackedUnsignedInt || integer_promotion(b) == PackedUnsignedInt)
+        ? PackedUnsignedInt
+        : PackedInt;
+}
+
+// String representation of a packed type, e.g. "[static const unsigned char]".
+const std::string& packed_ctype_str(PackedCType);
+
 class CType
 {
     public:
@@ -61,6 +149,18 @@ class BasicCType : public CType
             , storage(storage)
             , qualifier(qualifier) { }
 
+        explicit inline BasicCType(PackedCType packed)
+            : BasicCType(
+                packed_type(packed),
+                packed_signedness(packed),
+                packed_storage(packed),
+                packed_qualifier(packed)) { }
+
+        inline PackedCType packed() const
+        {
+            return pack_ctype(type, signedness, storage, qualifier);
+        }
+
         virtual operator std::string() override;
 };
 
@@ -73,23 +173,26 @@ class DerivedCType : public CType
 {
     // Derived C Types (35: 6.2.5, 20)
     // Array, struct, union, function, and pointer types. Can be constructed
-    // recursively.
+    // recursively. The base type may be shared with other types.
     public:
-        std::unique_ptr<CType> base;
+        std::shared_ptr<CType> base;
         BasicCTypeQualifier qualifier;
         DerivedCTypeType type;
         int array_size = 0;
 
+        // Parameter types - for FUNCTION types.
+        std::vector<std::shared_ptr<CType>> parameters;
+
         DerivedCType(
-            std::unique_ptr<CType> base,
+            std::shared_ptr<CType> base,
             DerivedCTypeType type,
             BasicCTypeQualifier qualifier = BasicCTypeQualifier::NOT_SET)
             : base(std::move(base))
-            , type(type)
-            , qualifier(qualifier) { }
+            , qualifier(qualifier)
+            , type(type) { }
         
         DerivedCType(
-            std::unique_ptr<CType> base,
+            std::shared_ptr<CType> base,
             DerivedCTypeType type,
             int array_size,
             BasicCTypeQualifier qualifier = BasicCTypeQualifier::NOT_SET)
@@ -111,11 +214,73 @@ class VoidCType : public CType
         virtual operator std::string() override;
 };
 
+// Interned C types.
+//
+// TypeContext owns a single, canonical instance of each distinct type, so structurally equal
+// types are the same object, and can be compared by pointer. Derived types must be built
+// from types interned by the same context. Interned types must not be modified.
+//
+// TypeContext is thread-safe, so it can be shared by passes which run in parallel. Every
+// basic type (and void) is interned when the context is built, and read without locking;
+// only derived types take the lock.
+class TypeContext
+{
+    private:
+        std::mutex lock;
+        // Basic types, indexed by PackedCType. Not modified after construction.
+        std::shared_ptr<BasicCType> basic_types[1 << PackedCTypeBits];
+        std::map<
+            std::tuple<const CType *, DerivedCTypeType, int, BasicCTypeQualifier>,
+            std::shared_ptr<DerivedCType>
+        > derived_types;
+        std::map<
+            std::pair<const CType *, std::vector<const CType *>>,
+            std::shared_ptr<DerivedCType>
+        > function_types;
+        std::shared_ptr<VoidCType> void_ctype;
+
+        std::shared_ptr<DerivedCType> derived(
+            const std::shared_ptr<CType>&, DerivedCTypeType, int, BasicCTypeQualifier);
+
+    public:
+        TypeContext();
+
+        // 'short' and 'int' are signed, if signedness is not set. (Plain 'char' is a
+        // distinct type - 6.2.5, 15).
+        std::shared_ptr<BasicCType> basic(
+            BasicCTypeType,
+            BasicCTypeSignedness,
+            BasicCTypeStorage = BasicCTypeStorage::NOT_SET,
+            BasicCTypeQualifier = BasicCTypeQualifier::NOT_SET);
+        std::shared_ptr<VoidCType> void_type();
+        std::shared_ptr<DerivedCType> pointer(
+            const std::shared_ptr<CType>&, BasicCTypeQualifier = BasicCTypeQualifier::NOT_SET);
+        std::shared_ptr<DerivedCType> array(const std::shared_ptr<CType>&, int);
+        std::shared_ptr<DerivedCType> function(
+            const std::shared_ptr<CType>&,
+            const std::vector<std::shared_ptr<CType>>& = {});
+};
+
+// Build a type from declaration specifiers (6.7).
+//
+// Specifiers are accumulated in a bitmask. The type is resolved from the type specifier
+// bits with a single lookup in a table of valid combinations (6.7.2, 2), e.g.
+// 'unsigned short int', 'signed char'. Invalid declaration specifiers throw CTypeError.
 class CTypeBuilder
 {
+    private:
+        uint32_t specifiers = 0;
+        uint32_t duplicates = 0;
+
+        void add(uint32_t);
+
     public:
         void add_specifier(TokenType);
         void add_qualifier(TokenType);
         void add_storage_specifier(TokenType);
+
+        // Qualifiers and storage class of 'void' types are dropped (VoidCType has
+        // neither). 'line' is that of the declaration, for errors.
+        std::shared_ptr<CType> build(TypeContext&, int line = -1);
 };
 #endif
\ No newline at end of file
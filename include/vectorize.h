@@ -0,0 +1,54 @@
+// Loop vectorization (SSE2).
+//
+// A counted loop over arrays whose body applies element-wise arithmetic:
+//
+//     for(int i = init; i < n; i++) c[i + k] = a[i] + b[i] ^ x;
+//
+// is given a vector loop in front of it, which handles the elements 16 bytes at a time
+// (16 chars, 8 shorts or 4 ints), so the original loop only runs for the few left over:
+//
+//     preheader:   checks (enough iterations, and the arrays do not overlap)  -> vector, exit
+//     vector:      splat invariant operands (x) into 16-byte stack objects     -> header'
+//     header':     vi = phi(init, vi + VF); vi <= n - VF                       -> body', exit
+//     body':       vector operations on the elements vi ... vi + VF - 1
+//     exit:        i0 = phi(init, vi)                                          -> header
+//
+// The loop must be a header (i = phi(init, i + 1); i < n, with n invariant) and a body
+// which only computes the stores: each address is 'base + sext(i + k) * size' with an
+// invariant base (as IrGenerator indexes arrays), and each stored value is built from
+// loads of such addresses, invariant values and constants by ADD, SUB, AND, OR and XOR,
+// and conversions which keep the bits of an element. These operations give the same low
+// bits whatever the width they are done at, so the C integer promotions can be ignored.
+// Every access has the same element type (char, short or int). A value is built in place:
+// operands are loads from the arrays, intermediate results go to stack objects, and the
+// last operation writes to the stored array (see IrOp::VADD).
+//
+// There is no alias information, so the preheader checks at run time that each pair of
+// accesses, one of them a store, either start at the same address (then each element is
+// read before it is written, in both loops) or are at least 16 bytes apart. (Distinct
+// objects, and the same base at a constant distance, are checked at compile time.) The loads
+// for each stored value must come after the store before it in the body, so the vector
+// loop does not move loads across stores.
+//
+// The pass runs after LoopInvariantCodeMotion, which gives loops preheaders and moves the
+// invariant operands out, and before StrengthReduction, which then reduces the addresses
+// in both loops.
+
+#ifndef VECTORIZE_H_
+#define VECTORIZE_H_
+
+#include "analysis.h"
+#include "ir.h"
+
+class LoopVectorizer
+{
+    public:
+        // Size of a vector in bytes.
+        static const int VectorSize = 16;
+
+        // Returns true if any loops were vectorized (which changes the CFG).
+        bool run(IrFunction&);
+        bool run(IrFunction&, AnalysisCache&);
+};
+
+#endif
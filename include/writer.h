@@ -0,0 +1,83 @@
+// Buffered text output.
+//
+// BufferedWriter formats text into a buffer which is allocated once, up front, and hands
+// it to its destination (a file, or a string) only when the buffer is full or flushed.
+// Numbers are formatted straight into the buffer. Unlike an std::ostream, appending is an
+// inline bounds check and a copy: no sentry objects, locales or virtual calls per
+// insertion, which dominate the cost of writing assembly one short token at a time.
+
+#ifndef WRITER_H_
+#define WRITER_H_
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+class BufferedWriter
+{
+    private:
+        std::vector<char> buffer;
+        size_t size = 0;
+        std::FILE * file = nullptr;
+        std::string * text = nullptr;
+        bool failed = false;
+
+        void drain();
+
+    public:
+        static const size_t Capacity = 1 << 16;
+
+        explicit BufferedWriter(std::FILE *);
+        explicit BufferedWriter(std::string&);
+        ~BufferedWriter();
+
+        BufferedWriter(const BufferedWriter&) = delete;
+        BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+        inline void write(const char * data, size_t length)
+        {
+            if(size + length > buffer.size())
+            {
+                drain();
+                if(length > buffer.size())
+                {
+                    // (Too big to buffer.)
+                    if(file) failed = failed || std::fwrite(data, 1, length, file) != length;
+                    if(text) text->append(data, length);
+                    return;
+                }
+            }
+            std::memcpy(buffer.data() + size, data, length);
+            size += length;
+        }
+
+        inline BufferedWriter& operator<<(char c)
+        {
+            if(size == buffer.size()) drain();
+            buffer[size++] = c;
+            return *this;
+        }
+        inline BufferedWriter& operator<<(const char * s)
+        {
+            write(s, std::strlen(s));
+            return *this;
+        }
+        inline BufferedWriter& operator<<(const std::string& s)
+        {
+            write(s.data(), s.size());
+            return *this;
+        }
+        BufferedWriter& operator<<(long long);
+        BufferedWriter& operator<<(unsigned long long);
+        inline BufferedWriter& operator<<(int n) { return *this << static_cast<long long>(n); }
+        inline BufferedWriter& operator<<(long n) { return *this << static_cast<long long>(n); }
+        inline BufferedWriter& operator<<(unsigned n) { return *this << static_cast<unsigned long long>(n); }
+        inline BufferedWriter& operator<<(unsigned long n) { return *this << static_cast<unsigned long long>(n); }
+
+        // Write the buffered text to the destination. Returns false if writing to the file
+        // has failed (now or earlier).
+        bool flush();
+};
+
+#endif
@@ -0,0 +1,68 @@
+#include <chrono>
+
+#include "analysis.h"
+
+const char * analysis_str(Analysis analysis)
+{
+    switch(analysis)
+    {
+        case Analysis::DOMINATORS: return "dominators";
+        case Analysis::FRONTIERS: return "dominance-frontiers";
+        default: return "loops";
+    }
+}
+
+// Time the construction of an analysis.
+template<typename T, typename... Args>
+static T * timed(int& count, double& time, Args&&... args)
+{
+    auto start = std::chrono::steady_clock::now();
+    T * result = new T(std::forward<Args>(args)...);
+    time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    count++;
+    return result;
+}
+
+AnalysisCache::AnalysisCache(const IrFunction& function)
+    : function(function)
+{
+}
+
+const DominatorTree& AnalysisCache::dominators()
+{
+    if(!tree)
+    {
+        int i = static_cast<int>(Analysis::DOMINATORS);
+        tree.reset(timed<DominatorTree>(counts[i], times[i], function));
+    }
+    return *tree;
+}
+
+const DominanceFrontiers& AnalysisCache::frontiers()
+{
+    if(!frontier_sets)
+    {
+        const DominatorTree& dom = dominators();
+        int i = static_cast<int>(Analysis::FRONTIERS);
+        frontier_sets.reset(timed<DominanceFrontiers>(counts[i], times[i], function, dom));
+    }
+    return *frontier_sets;
+}
+
+const LoopInfo& AnalysisCache::loops()
+{
+    if(!loop_info)
+    {
+        const DominatorTree& dom = dominators();
+        int i = static_cast<int>(Analysis::LOOPS);
+        loop_info.reset(timed<LoopInfo>(counts[i], times[i], function, dom));
+    }
+    return *loop_info;
+}
+
+void AnalysisCache::invalidate()
+{
+    loop_info.reset();
+    frontier_sets.reset();
+    tree.reset();
+}
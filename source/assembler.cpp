@@ -0,0 +1,897 @@
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "assembler.h"
+
+typedef MachineOperand Operand;
+
+// Condition codes (the low four bits of jcc and setcc), by the names GNU as accepts.
+static int condition_code(const std::string& name)
+{
+    static const struct { const char * name; int code; } Conditions[] = {
+        {"o", 0}, {"no", 1}, {"b", 2}, {"c", 2}, {"nae", 2}, {"ae", 3}, {"nb", 3}, {"nc", 3},
+        {"e", 4}, {"z", 4}, {"ne", 5}, {"nz", 5}, {"be", 6}, {"na", 6}, {"a", 7}, {"nbe", 7},
+        {"s", 8}, {"ns", 9}, {"p", 10}, {"pe", 10}, {"np", 11}, {"po", 11},
+        {"l", 12}, {"nge", 12}, {"ge", 13}, {"nl", 13}, {"le", 14}, {"ng", 14},
+        {"g", 15}, {"nle", 15}
+    };
+    for(auto& condition : Conditions)
+        if(name == condition.name) return condition.code;
+    return -1;
+}
+
+static bool fits8(int64_t value)
+{
+    return value >= -128 && value <= 127;
+}
+
+static bool fits32(int64_t value)
+{
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+static std::string trim(const std::string& text)
+{
+    size_t begin = text.find_first_not_of(" \t\r");
+    if(begin == std::string::npos) return "";
+    size_t end = text.find_last_not_of(" \t\r");
+    return text.substr(begin, end + 1 - begin);
+}
+
+// Split on commas outside parentheses and strings.
+static std::vector<std::string> split(const std::string& text)
+{
+    std::vector<std::string> parts;
+    std::string part;
+    int depth = 0;
+    bool quoted = false;
+    for(size_t i = 0; i < text.size(); i++)
+    {
+        char c = text[i];
+        if(quoted)
+        {
+            part += c;
+            if(c == '\\' && i + 1 < text.size()) part += text[++i];
+            else if(c == '"') quoted = false;
+            continue;
+        }
+        if(c == '"') quoted = true;
+        else if(c == '(') depth++;
+        else if(c == ')') depth--;
+        else if(c == ',' && depth == 0)
+        {
+            parts.push_back(trim(part));
+            part.clear();
+            continue;
+        }
+        part += c;
+    }
+    if(!trim(part).empty() || !parts.empty()) parts.push_back(trim(part));
+    return parts;
+}
+
+// Register by name (without the '%'), and its width, or -1.
+static int register_number(const std::string& name, int& width)
+{
+    static const std::unordered_map<std::string, std::pair<int, int>> registers = []()
+    {
+        std::unordered_map<std::string, std::pair<int, int>> table;
+        for(int w = 0; w < 4; w++)
+            for(int reg = 0; reg < 16; reg++)
+                table[RegisterNames[w][reg]] = {reg, w};
+        for(int reg = 0; reg < 16; reg++)
+            table["xmm" + std::to_string(reg)] = {reg, XmmWidth};
+        return table;
+    }();
+    auto found = registers.find(name);
+    if(found == registers.end()) return -1;
+    width = found->second.second;
+    return found->second.first;
+}
+
+Assembler::Assembler()
+{
+    for(auto& list : fragments)
+        list.emplace_back();
+}
+
+int Assembler::symbol(const std::string& name)
+{
+    auto found = names.find(name);
+    if(found != names.end()) return found->second;
+    int index = static_cast<int>(symbol_table.size());
+    symbol_table.emplace_back();
+    symbol_table.back().name = name;
+    label_fragments.push_back(0);
+    names[name] = index;
+    return index;
+}
+
+int Assembler::reference(const std::string& name)
+{
+    bool plt = name.size() > 4 && name.compare(name.size() - 4, 4, "@PLT") == 0;
+    return symbol(plt ? name.substr(0, name.size() - 4) : name);
+}
+
+int Assembler::find(const std::string& name) const
+{
+    auto found = names.find(name);
+    return found == names.end() ? -1 : found->second;
+}
+
+void Assembler::bytes(uint64_t value, int size)
+{
+    for(int i = 0; i < size; i++)
+        byte(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+void Assembler::label(const std::string& name)
+{
+    int index = symbol(name);
+    AsmSymbol& sym = symbol_table[index];
+    if(sym.section >= 0) throw AssemblerError("Symbol '" + name + "' is already defined", line);
+    sym.section = current;
+    if(!fragment().bytes.empty() || fragment().target >= 0)
+        fragments[current].emplace_back();
+    label_fragments[index] = fragments[current].size() - 1;
+}
+
+// Parse an integer, a symbol, or a symbol plus or minus an integer.
+static bool parse_value(const std::string& text, std::string& name, int64_t& value)
+{
+    name.clear();
+    value = 0;
+    std::string rest = trim(text);
+    if(rest.empty()) return false;
+    if(!isdigit(static_cast<unsigned char>(rest[0])) && rest[0] != '-' && rest[0] != '+')
+    {
+        size_t end = 0;
+        while(end < rest.size() && (isalnum(static_cast<unsigned char>(rest[end])) || rest[end] == '_'
+            || rest[end] == '.' || rest[end] == '$' || rest[end] == '@'))
+            end++;
+        name = rest.substr(0, end);
+        rest = trim(rest.substr(end));
+        if(rest.empty()) return true;
+        if(rest[0] != '+' && rest[0] != '-') return false;
+    }
+    char * end;
+    errno = 0;
+    value = static_cast<int64_t>(strtoull(rest.c_str(), &end, 0));
+    if(rest[0] == '-') value = strtoll(rest.c_str(), &end, 0);
+    return *end == 0 && errno == 0 && end != rest.c_str();
+}
+
+void Assembler::directive(const std::string& name, const std::string& arguments)
+{
+    if(name == ".text" || name == ".data" || name == ".bss" || name == ".section")
+    {
+        std::string section = name == ".section" ? trim(split(arguments)[0]) : name;
+        current = section == ".text" ? TEXT : section == ".data" ? DATA : section == ".bss" ? BSS : OTHER;
+        return;
+    }
+    if(name == ".globl" || name == ".global")
+    {
+        for(auto& sym : split(arguments))
+            symbol_table[symbol(sym)].global = true;
+        return;
+    }
+    if(name == ".type" || name == ".size" || name == ".file" || name == ".ident") return;
+    if(name == ".balign" || name == ".p2align")
+    {
+        char * end;
+        long value = strtol(arguments.c_str(), &end, 0);
+        size_t align = name == ".balign" ? static_cast<size_t>(value) : size_t(1) << value;
+        if(*end != 0 || value <= 0 || (align & (align - 1)) != 0)
+            throw AssemblerError("Bad alignment: " + arguments, line);
+        if(current < SectionCount) sections[current].align = std::max(sections[current].align, align);
+        fragments[current].emplace_back();
+        fragment().align = align;
+        return;
+    }
+    if(name == ".ascii" || name == ".asciz" || name == ".string")
+    {
+        for(auto& text : split(arguments))
+        {
+            if(text.size() < 2 || text.front() != '"' || text.back() != '"')
+                throw AssemblerError("Expected a string: " + text, line);
+            for(size_t i = 1; i + 1 < text.size(); i++)
+            {
+                if(text[i] != '\\')
+                {
+                    byte(static_cast<uint8_t>(text[i]));
+                    continue;
+                }
+                char c = text[++i];
+                if(c >= '0' && c <= '7')
+                {
+                    int value = 0;
+                    for(int digits = 0; digits < 3 && text[i] >= '0' && text[i] <= '7'; digits++)
+                        value = value * 8 + (text[i++] - '0');
+                    i--;
+                    byte(static_cast<uint8_t>(value));
+                    continue;
+                }
+                switch(c)
+                {
+                    case 'n': byte('\n'); break;
+                    case 't': byte('\t'); break;
+                    case 'r': byte('\r'); break;
+                    case 'b': byte('\b'); break;
+                    case 'f': byte('\f'); break;
+                    default: byte(static_cast<uint8_t>(c)); break;
+                }
+            }
+            if(name != ".ascii") byte(0);
+        }
+        return;
+    }
+    if(name == ".zero" || name == ".skip")
+    {
+        char * end;
+        long size = strtol(arguments.c_str(), &end, 0);
+        if(*end != 0 || size < 0) throw AssemblerError("Bad size: " + arguments, line);
+        fragment().bytes.resize(fragment().bytes.size() + size);
+        return;
+    }
+    int size = name == ".byte" ? 1 : name == ".word" || name == ".short" ? 2
+        : name == ".long" || name == ".int" ? 4 : name == ".quad" ? 8 : 0;
+    if(size == 0) throw AssemblerError("Unknown directive " + name, line);
+    for(auto& text : split(arguments))
+    {
+        std::string sym;
+        int64_t value;
+        if(!parse_value(text, sym, value)) throw AssemblerError("Bad value: " + text, line);
+        if(!sym.empty())
+        {
+            if(size != 8) throw AssemblerError("A symbol needs a .quad: " + text, line);
+            fragment().relocations.push_back({fragment().bytes.size(), symbol(sym), value, false});
+            value = 0;
+        }
+        bytes(static_cast<uint64_t>(value), size);
+    }
+}
+
+void Assembler::encode(const std::vector<uint8_t>& opcode, int width, int reg, bool reg_is_byte,
+    const Operand& rm, int immediate_size, int64_t immediate)
+{
+    bool memory = rm.kind == Operand::Kind::MEMORY;
+    if(!memory && rm.kind != Operand::Kind::REGISTER) throw AssemblerError("Expected a register or memory operand", line);
+    int base = memory ? rm.base : rm.reg;
+    int index = memory ? rm.index : -1;
+
+    uint8_t rex = 0;
+    if(width == 3) rex |= 8;
+    if(reg >= 8) rex |= 4;
+    if(index >= 8) rex |= 2;
+    if(base >= 8 && base != RipRegister) rex |= 1;
+
+    // spl, bpl, sil and dil need a REX prefix (without one, they are ah, ch, dh and bh).
+    bool byte_register = (reg_is_byte && reg >= 4 && reg < 8) || (!memory && rm.width == 0 && base >= 4 && base < 8);
+    if(width == 1) byte(0x66);
+    if(rex != 0 || byte_register) byte(0x40 | rex);
+    for(uint8_t b : opcode)
+        byte(b);
+
+    int r = (reg & 7) << 3;
+    size_t field = 0;
+    if(!memory)
+        byte(static_cast<uint8_t>(0xC0 | r | (base & 7)));
+    else if(base == RipRegister)
+    {
+        byte(static_cast<uint8_t>(0x05 | r));
+        field = fragment().bytes.size();
+        bytes(!rm.symbol.empty() ? 0 : static_cast<uint64_t>(rm.value), 4);
+    }
+    else
+    {
+        if(!rm.symbol.empty()) throw AssemblerError("A symbol must be relative to %rip", line);
+        if(index == 4) throw AssemblerError("%rsp cannot be an index", line);
+        int64_t displacement = rm.value;
+        if(!fits32(displacement)) throw AssemblerError("Displacement out of range", line);
+
+        // rbp and r13 as a base need a displacement; with mod 00 they mean none (or rip).
+        int mod = base < 0 ? 0 : displacement == 0 && (base & 7) != 5 ? 0 : fits8(displacement) ? 1 : 2;
+        bool sib = index >= 0 || base < 0 || (base & 7) == 4;
+        if(!sib)
+            byte(static_cast<uint8_t>(mod << 6 | r | (base & 7)));
+        else
+        {
+            int scale = rm.scale == 8 ? 3 : rm.scale == 4 ? 2 : rm.scale == 2 ? 1 : 0;
+            byte(static_cast<uint8_t>(mod << 6 | r | 4));
+            byte(static_cast<uint8_t>(scale << 6 | ((index >= 0 ? index : 4) & 7) << 3 | (base < 0 ? 5 : base & 7)));
+        }
+        if(mod == 1) bytes(static_cast<uint64_t>(displacement), 1);
+        else if(mod == 2 || base < 0) bytes(static_cast<uint64_t>(displacement), 4);
+    }
+
+    if(immediate_size > 0) bytes(static_cast<uint64_t>(immediate), immediate_size);
+
+    // The displacement from rip is from the end of the instruction.
+    if(memory && base == RipRegister && !rm.symbol.empty())
+    {
+        int64_t distance = static_cast<int64_t>(fragment().bytes.size() - field);
+        fragment().relocations.push_back({field, reference(rm.symbol), rm.value - distance, true});
+    }
+}
+
+void Assembler::jump(int condition, const Operand& target)
+{
+    if(target.kind != Operand::Kind::SYMBOL) throw AssemblerError("Expected a label", line);
+    fragment().target = reference(target.symbol);
+    fragment().condition = condition;
+    fragments[current].emplace_back();
+}
+
+void Assembler::instruction(const std::string& mnemonic, const std::vector<Operand>& operands)
+{
+    auto expect = [&](size_t count)
+    {
+        if(operands.size() != count)
+            throw AssemblerError("Wrong number of operands for " + mnemonic, line);
+    };
+    auto is = [&](size_t i, Operand::Kind kind) { return operands[i].kind == kind; };
+
+    // Instructions without operands, and without a size suffix.
+    static const struct { const char * name; uint8_t rex; uint8_t opcode; } Plain[] = {
+        {"ret", 0, 0xC3}, {"leave", 0, 0xC9}, {"cltd", 0, 0x99}, {"cqto", 0x48, 0x99},
+        {"cltq", 0x48, 0x98}, {"cwtl", 0, 0x98}, {"nop", 0, 0x90}
+    };
+    for(auto& plain : Plain)
+    {
+        if(mnemonic != plain.name) continue;
+        expect(0);
+        if(plain.rex) byte(plain.rex);
+        byte(plain.opcode);
+        return;
+    }
+
+    if(mnemonic == "call" || mnemonic == "jmp")
+    {
+        expect(1);
+        if(is(0, Operand::Kind::INDIRECT))
+        {
+            Operand rm = operands[0];
+            rm.kind = rm.reg >= 0 ? Operand::Kind::REGISTER : Operand::Kind::MEMORY;
+            encode({0xFF}, 2, mnemonic == "call" ? 2 : 4, false, rm);
+        }
+        else if(mnemonic == "jmp")
+            jump(-1, operands[0]);
+        else
+        {
+            if(!is(0, Operand::Kind::SYMBOL)) throw AssemblerError("Expected a function", line);
+            byte(0xE8);
+            fragment().relocations.push_back({fragment().bytes.size(), reference(operands[0].symbol), operands[0].value - 4, true});
+            bytes(0, 4);
+        }
+        return;
+    }
+    if(mnemonic[0] == 'j' && condition_code(mnemonic.substr(1)) >= 0)
+    {
+        expect(1);
+        jump(condition_code(mnemonic.substr(1)), operands[0]);
+        return;
+    }
+    if(mnemonic.compare(0, 3, "set") == 0 && condition_code(mnemonic.substr(3)) >= 0)
+    {
+        expect(1);
+        encode({0x0F, static_cast<uint8_t>(0x90 + condition_code(mnemonic.substr(3)))}, 0, 0, false, operands[0]);
+        return;
+    }
+
+    // (Without a size suffix, which would be ambiguous: 'cmovl' is cmov if less. The
+    // destination register gives the width.)
+    if(mnemonic.compare(0, 4, "cmov") == 0 && condition_code(mnemonic.substr(4)) >= 0)
+    {
+        expect(2);
+        if(!is(1, Operand::Kind::REGISTER) || operands[1].width < 1 || operands[1].width > 3
+            || (is(0, Operand::Kind::REGISTER) && operands[0].width != operands[1].width))
+            throw AssemblerError("Bad operands for " + mnemonic, line);
+        encode({0x0F, static_cast<uint8_t>(0x40 + condition_code(mnemonic.substr(4)))},
+            operands[1].width, operands[1].reg, false, operands[0]);
+        return;
+    }
+    if(mnemonic == "movabsq")
+    {
+        expect(2);
+        if(!is(0, Operand::Kind::IMMEDIATE) || !is(1, Operand::Kind::REGISTER))
+            throw AssemblerError("movabsq needs an immediate and a register", line);
+        byte(static_cast<uint8_t>(0x48 | (operands[1].reg >= 8 ? 1 : 0)));
+        byte(static_cast<uint8_t>(0xB8 + (operands[1].reg & 7)));
+        bytes(static_cast<uint64_t>(operands[0].value), 8);
+        return;
+    }
+
+    // SSE2: mandatory prefix, and the opcode after 0F (of the form which loads, for a move).
+    static const struct { const char * name; uint8_t prefix, opcode; } Sse[] = {
+        {"movdqu", 0xF3, 0x6F}, {"paddb", 0x66, 0xFC}, {"paddw", 0x66, 0xFD}, {"paddd", 0x66, 0xFE},
+        {"psubb", 0x66, 0xF8}, {"psubw", 0x66, 0xF9}, {"psubd", 0x66, 0xFA},
+        {"pand", 0x66, 0xDB}, {"por", 0x66, 0xEB}, {"pxor", 0x66, 0xEF}
+    };
+    for(auto& sse : Sse)
+    {
+        if(mnemonic != sse.name) continue;
+        expect(2);
+        bool store = is(1, Operand::Kind::MEMORY) && sse.opcode == 0x6F;
+        const Operand& reg = operands[store ? 0 : 1];
+        if(!is(store ? 0 : 1, Operand::Kind::REGISTER) || reg.width != XmmWidth
+            || (operands[store ? 1 : 0].kind == Operand::Kind::REGISTER && operands[store ? 1 : 0].width != XmmWidth))
+            throw AssemblerError("Bad operands for " + mnemonic, line);
+        byte(sse.prefix);
+        encode({0x0F, static_cast<uint8_t>(store ? 0x7F : sse.opcode)}, 2, reg.reg, false, operands[store ? 1 : 0]);
+        return;
+    }
+
+    // Zero and sign extension: opcode, and the widths of the source and destination.
+    static const struct { const char * name; uint8_t opcode[2]; int from, to; } Extensions[] = {
+        {"movzbw", {0x0F, 0xB6}, 0, 1}, {"movzbl", {0x0F, 0xB6}, 0, 2}, {"movzbq", {0x0F, 0xB6}, 0, 3},
+        {"movzwl", {0x0F, 0xB7}, 1, 2}, {"movzwq", {0x0F, 0xB7}, 1, 3},
+        {"movsbw", {0x0F, 0xBE}, 0, 1}, {"movsbl", {0x0F, 0xBE}, 0, 2}, {"movsbq", {0x0F, 0xBE}, 0, 3},
+        {"movswl", {0x0F, 0xBF}, 1, 2}, {"movswq", {0x0F, 0xBF}, 1, 3}, {"movslq", {0x63, 0}, 2, 3}
+    };
+    for(auto& extension : Extensions)
+    {
+        if(mnemonic != extension.name) continue;
+        expect(2);
+        if(!is(1, Operand::Kind::REGISTER)) throw AssemblerError("Expected a register", line);
+        std::vector<uint8_t> opcode(extension.opcode, extension.opcode + (extension.opcode[0] == 0x0F ? 2 : 1));
+        encode(opcode, extension.to, operands[1].reg, false, operands[0]);
+        return;
+    }
+
+    // Instructions with a size suffix.
+    const char * suffix = mnemonic.empty() ? nullptr : strchr(Suffixes, mnemonic.back());
+    if(suffix == nullptr || *suffix == 0) throw AssemblerError("Unknown instruction " + mnemonic, line);
+    int width = static_cast<int>(suffix - Suffixes);
+    std::string name = mnemonic.substr(0, mnemonic.size() - 1);
+    for(auto& operand : operands)
+    {
+        if(operand.kind == Operand::Kind::REGISTER && operand.width != width && !(operand.reg == 1 && operand.width == 0))
+            throw AssemblerError("Operand size does not match " + mnemonic, line);
+    }
+    uint8_t w = width == 0 ? 0 : 1;
+    int immediate_size = width == 0 ? 1 : width == 1 ? 2 : 4;
+    auto accumulator = [&](const Operand& operand)
+    {
+        return operand.kind == Operand::Kind::REGISTER && operand.reg == 0;
+    };
+    auto immediate = [&](const Operand& operand)
+    {
+        if(!fits32(operand.value) && !(width < 3 && operand.value >= 0 && operand.value <= UINT32_MAX))
+            throw AssemblerError("Immediate out of range", line);
+        return operand.value;
+    };
+
+    if(name == "mov")
+    {
+        expect(2);
+        const Operand& source = operands[0];
+        const Operand& destination = operands[1];
+        if(source.kind == Operand::Kind::IMMEDIATE)
+        {
+            int64_t value = immediate(source);
+            if(destination.kind == Operand::Kind::REGISTER && width < 3)
+            {
+                if(width == 1) byte(0x66);
+                if(destination.reg >= 8 || (width == 0 && destination.reg >= 4)) byte(destination.reg >= 8 ? 0x41 : 0x40);
+                byte(static_cast<uint8_t>((width == 0 ? 0xB0 : 0xB8) + (destination.reg & 7)));
+                bytes(static_cast<uint64_t>(value), immediate_size);
+            }
+            else
+                encode({static_cast<uint8_t>(0xC6 + w)}, width, 0, false, destination, immediate_size, value);
+        }
+        else if(source.kind == Operand::Kind::REGISTER)
+            encode({static_cast<uint8_t>(0x88 + w)}, width, source.reg, width == 0, destination);
+        else if(destination.kind == Operand::Kind::REGISTER)
+            encode({static_cast<uint8_t>(0x8A + w)}, width, destination.reg, width == 0, source);
+        else
+            throw AssemblerError("Bad operands for " + mnemonic, line);
+        return;
+    }
+
+    // Two-operand arithmetic: base opcode (the extension of the immediate forms is base / 8).
+    static const struct { const char * name; uint8_t base; } Arithmetic[] = {
+        {"add", 0x00}, {"or", 0x08}, {"adc", 0x10}, {"sbb", 0x18},
+        {"and", 0x20}, {"sub", 0x28}, {"xor", 0x30}, {"cmp", 0x38}
+    };
+    for(auto& arithmetic : Arithmetic)
+    {
+        if(name != arithmetic.name) continue;
+        expect(2);
+        const Operand& source = operands[0];
+        const Operand& destination = operands[1];
+        uint8_t base = arithmetic.base;
+        int digit = base / 8;
+        if(source.kind == Operand::Kind::IMMEDIATE)
+        {
+            int64_t value = immediate(source);
+            if(width == 0 && accumulator(destination))
+            {
+                byte(static_cast<uint8_t>(base + 4));
+                bytes(static_cast<uint64_t>(value), 1);
+            }
+            else if(width == 0)
+                encode({0x80}, width, digit, false, destination, 1, value);
+            else if(fits8(value))
+                encode({0x83}, width, digit, false, destination, 1, value);
+            else if(accumulator(destination))
+            {
+                if(width == 1) byte(0x66);
+                if(width == 3) byte(0x48);
+                byte(static_cast<uint8_t>(base + 5));
+                bytes(static_cast<uint64_t>(value), immediate_size);
+            }
+            else
+                encode({0x81}, width, digit, false, destination, immediate_size, value);
+        }
+        else if(source.kind == Operand::Kind::REGISTER)
+            encode({static_cast<uint8_t>(base + w)}, width, source.reg, width == 0, destination);
+        else if(destination.kind == Operand::Kind::REGISTER)
+            encode({static_cast<uint8_t>(base + 2 + w)}, width, destination.reg, width == 0, source);
+        else
+            throw AssemblerError("Bad operands for " + mnemonic, line);
+        return;
+    }
+
+    if(name == "test")
+    {
+        expect(2);
+        if(is(0, Operand::Kind::IMMEDIATE))
+        {
+            int64_t value = immediate(operands[0]);
+            if(accumulator(operands[1]))
+            {
+                if(width == 1) byte(0x66);
+                if(width == 3) byte(0x48);
+                byte(static_cast<uint8_t>(0xA8 + w));
+                bytes(static_cast<uint64_t>(value), immediate_size);
+            }
+            else
+                encode({static_cast<uint8_t>(0xF6 + w)}, width, 0, false, operands[1], immediate_size, value);
+        }
+        else if(is(0, Operand::Kind::REGISTER))
+            encode({static_cast<uint8_t>(0x84 + w)}, width, operands[0].reg, width == 0, operands[1]);
+        else
+            encode({static_cast<uint8_t>(0x84 + w)}, width, operands[1].reg, width == 0, operands[0]);
+        return;
+    }
+
+    // (Only the register forms: bt with a memory operand can address outside it.)
+    if(name == "bt")
+    {
+        expect(2);
+        if(width == 0 || !is(0, Operand::Kind::REGISTER) || !is(1, Operand::Kind::REGISTER))
+            throw AssemblerError("Bad operands for " + mnemonic, line);
+        encode({0x0F, 0xA3}, width, operands[0].reg, false, operands[1]);
+        return;
+    }
+
+    if(name == "imul" && operands.size() > 1)
+    {
+        const Operand& destination = operands.back();
+        if(width == 0 || destination.kind != Operand::Kind::REGISTER)
+            throw AssemblerError("Bad operands for " + mnemonic, line);
+        if(is(0, Operand::Kind::IMMEDIATE))
+        {
+            int64_t value = immediate(operands[0]);
+            const Operand& source = operands.size() == 3 ? operands[1] : destination;
+            if(fits8(value))
+                encode({0x6B}, width, destination.reg, false, source, 1, value);
+            else
+                encode({0x69}, width, destination.reg, false, source, immediate_size, value);
+        }
+        else
+        {
+            expect(2);
+            encode({0x0F, 0xAF}, width, destination.reg, false, operands[0]);
+        }
+        return;
+    }
+
+    // One-operand arithmetic: extension of F6 / F7.
+    static const struct { const char * name; int digit; } Unary[] = {
+        {"not", 2}, {"neg", 3}, {"mul", 4}, {"imul", 5}, {"div", 6}, {"idiv", 7}
+    };
+    for(auto& unary : Unary)
+    {
+        if(name != unary.name) continue;
+        expect(1);
+        encode({static_cast<uint8_t>(0xF6 + w)}, width, unary.digit, false, operands[0]);
+        return;
+    }
+
+    // Shifts and rotates: extension of C0 / C1 (by an immediate), D0 / D1 (by 1) and D2 / D3
+    // (by cl).
+    static const struct { const char * name; int digit; } Shifts[] = {
+        {"rol", 0}, {"ror", 1}, {"shl", 4}, {"sal", 4}, {"shr", 5}, {"sar", 7}
+    };
+    for(auto& shift : Shifts)
+    {
+        if(name != shift.name) continue;
+        if(operands.size() == 1)
+        {
+            encode({static_cast<uint8_t>(0xD0 + w)}, width, shift.digit, false, operands[0]);
+            return;
+        }
+        expect(2);
+        if(is(0, Operand::Kind::IMMEDIATE) && operands[0].value == 1)
+            encode({static_cast<uint8_t>(0xD0 + w)}, width, shift.digit, false, operands[1]);
+        else if(is(0, Operand::Kind::IMMEDIATE))
+            encode({static_cast<uint8_t>(0xC0 + w)}, width, shift.digit, false, operands[1], 1, operands[0].value);
+        else if(is(0, Operand::Kind::REGISTER) && operands[0].reg == 1 && operands[0].width == 0)
+            encode({static_cast<uint8_t>(0xD2 + w)}, width, shift.digit, false, operands[1]);
+        else
+            throw AssemblerError("Shift count must be an immediate or %cl", line);
+        return;
+    }
+
+    if(name == "lea")
+    {
+        expect(2);
+        if(!is(0, Operand::Kind::MEMORY) || !is(1, Operand::Kind::REGISTER))
+            throw AssemblerError("Bad operands for " + mnemonic, line);
+        encode({0x8D}, width, operands[1].reg, false, operands[0]);
+        return;
+    }
+
+    // (push and pop are quadword without REX.W.)
+    if((name == "push" || name == "pop") && width == 3)
+    {
+        expect(1);
+        const Operand& operand = operands[0];
+        if(operand.kind == Operand::Kind::REGISTER)
+        {
+            if(operand.reg >= 8) byte(0x41);
+            byte(static_cast<uint8_t>((name == "push" ? 0x50 : 0x58) + (operand.reg & 7)));
+        }
+        else if(operand.kind == Operand::Kind::IMMEDIATE && name == "push")
+        {
+            int64_t value = immediate(operand);
+            byte(fits8(value) ? 0x6A : 0x68);
+            bytes(static_cast<uint64_t>(value), fits8(value) ? 1 : 4);
+        }
+        else if(name == "push")
+            encode({0xFF}, 2, 6, false, operand);
+        else
+            encode({0x8F}, 2, 0, false, operand);
+        return;
+    }
+
+    throw AssemblerError("Unknown instruction " + mnemonic, line);
+}
+
+static Operand parse_operand(const std::string& text, int line)
+{
+    Operand operand;
+    if(text.empty()) throw AssemblerError("Missing operand", line);
+    bool indirect = text[0] == '*';
+    std::string rest = indirect ? trim(text.substr(1)) : text;
+    if(rest.empty()) throw AssemblerError("Missing operand", line);
+    if(rest[0] == '%')
+    {
+        operand.kind = indirect ? Operand::Kind::INDIRECT : Operand::Kind::REGISTER;
+        operand.reg = register_number(rest.substr(1), operand.width);
+        if(operand.reg < 0) throw AssemblerError("Unknown register " + rest, line);
+        return operand;
+    }
+    if(rest[0] == '$')
+    {
+        std::string sym;
+        operand.kind = Operand::Kind::IMMEDIATE;
+        if(!parse_value(rest.substr(1), sym, operand.value) || !sym.empty())
+            throw AssemblerError("Bad immediate " + rest, line);
+        return operand;
+    }
+
+    // Displacement (a number, a symbol, or both), then an optional (base, index, scale).
+    size_t paren = rest.find('(');
+    if(!trim(rest.substr(0, paren)).empty() && !parse_value(rest.substr(0, paren), operand.symbol, operand.value))
+        throw AssemblerError("Bad operand " + rest, line);
+    if(paren == std::string::npos)
+    {
+        if(indirect || operand.symbol.empty()) throw AssemblerError("Absolute addresses are not supported: " + rest, line);
+        operand.kind = Operand::Kind::SYMBOL;
+        return operand;
+    }
+    operand.kind = indirect ? Operand::Kind::INDIRECT : Operand::Kind::MEMORY;
+    if(rest.back() != ')') throw AssemblerError("Bad operand " + rest, line);
+    auto parts = split(rest.substr(paren + 1, rest.size() - paren - 2));
+    if(parts.empty() || parts.size() > 3) throw AssemblerError("Bad operand " + rest, line);
+    int width;
+    if(parts[0] == "%rip") operand.base = RipRegister;
+    else if(!parts[0].empty())
+    {
+        operand.base = parts[0][0] == '%' ? register_number(parts[0].substr(1), width) : -1;
+        if(operand.base < 0 || width != 3) throw AssemblerError("Bad base register " + parts[0], line);
+    }
+    if(parts.size() > 1)
+    {
+        operand.index = parts[1][0] == '%' ? register_number(parts[1].substr(1), width) : -1;
+        if(operand.index < 0 || width != 3 || operand.base == RipRegister)
+            throw AssemblerError("Bad index register " + parts[1], line);
+    }
+    if(parts.size() > 2)
+    {
+        operand.scale = atoi(parts[2].c_str());
+        if(operand.scale != 1 && operand.scale != 2 && operand.scale != 4 && operand.scale != 8)
+            throw AssemblerError("Bad scale " + parts[2], line);
+    }
+    if(!operand.symbol.empty() && operand.base != RipRegister)
+        throw AssemblerError("A symbol must be relative to %rip", line);
+    return operand;
+}
+
+// Parse assembly, and pass each label, directive and instruction to 'add' with its line.
+template<typename Add>
+static void parse_text(const std::string& text, Add add)
+{
+    size_t position = 0;
+    int line = 0;
+    while(position < text.size())
+    {
+        size_t end = text.find('\n', position);
+        if(end == std::string::npos) end = text.size();
+        std::string statement = trim(text.substr(position, end - position));
+        position = end + 1;
+        line++;
+
+        // Comments.
+        size_t comment = statement.find('#');
+        if(comment != std::string::npos && statement.find('"') > comment)
+            statement = trim(statement.substr(0, comment));
+        if(statement.empty()) continue;
+
+        // Labels.
+        size_t colon = statement.find(':');
+        if(colon != std::string::npos && statement.find_first_of(" \t\"") > colon)
+        {
+            add(MachineInstr::label(statement.substr(0, colon)), line);
+            statement = trim(statement.substr(colon + 1));
+            if(statement.empty()) continue;
+        }
+
+        size_t space = statement.find_first_of(" \t");
+        std::string name = statement.substr(0, space);
+        std::string arguments = space == std::string::npos ? "" : trim(statement.substr(space));
+        if(name[0] == '.')
+        {
+            add(MachineInstr::directive(name, arguments), line);
+            continue;
+        }
+        std::vector<Operand> operands;
+        for(auto& part : split(arguments))
+            operands.push_back(parse_operand(part, line));
+        add(MachineInstr(name, std::move(operands)), line);
+    }
+}
+
+std::vector<MachineInstr> Assembler::parse(const std::string& text)
+{
+    std::vector<MachineInstr> code;
+    parse_text(text, [&](MachineInstr&& instr, int) { code.push_back(std::move(instr)); });
+    return code;
+}
+
+void Assembler::add(const MachineInstr& instr)
+{
+    switch(instr.op)
+    {
+        case MachineOp::DELETED: break;
+        case MachineOp::LABEL: label(instr.mnemonic); break;
+        case MachineOp::DIRECTIVE: directive(instr.mnemonic, instr.arguments); break;
+        default: instruction(instr.mnemonic, instr.operands); break;
+    }
+}
+
+void Assembler::add(const std::vector<MachineInstr>& code)
+{
+    for(const MachineInstr& instr : code)
+        add(instr);
+}
+
+void Assembler::finish()
+{
+    for(int section = 0; section < SectionCount; section++)
+        layout(section);
+}
+
+void Assembler::assemble(const std::string& text)
+{
+    parse_text(text, [&](MachineInstr&& instr, int number)
+    {
+        line = number;
+        add(instr);
+    });
+    line = -1;
+    finish();
+}
+
+void Assembler::layout(int id)
+{
+    std::vector<Fragment>& list = fragments[id];
+    AsmSection& section = sections[id];
+    auto local = [&](int sym)
+    {
+        return symbol_table[sym].section == id && !symbol_table[sym].global;
+    };
+    auto jump_size = [](const Fragment& fragment)
+    {
+        return fragment.target < 0 ? 0 : !fragment.wide ? 2 : fragment.condition < 0 ? 5 : 6;
+    };
+
+    // Lengthen jumps until every displacement fits. (Jumps only grow, so this terminates.)
+    bool changed = true;
+    while(changed)
+    {
+        size_t address = 0;
+        for(auto& fragment : list)
+        {
+            address = (address + fragment.align - 1) & ~(fragment.align - 1);
+            fragment.address = address;
+            address += fragment.bytes.size() + jump_size(fragment);
+        }
+        changed = false;
+        for(auto& fragment : list)
+        {
+            if(fragment.target < 0 || fragment.wide) continue;
+            int64_t next = static_cast<int64_t>(fragment.address + fragment.bytes.size() + 2);
+            if(!local(fragment.target)
+                || !fits8(static_cast<int64_t>(list[label_fragments[fragment.target]].address) - next))
+            {
+                fragment.wide = true;
+                changed = true;
+            }
+        }
+    }
+
+    for(size_t sym = 0; sym < symbol_table.size(); sym++)
+    {
+        if(symbol_table[sym].section == id)
+            symbol_table[sym].offset = list[label_fragments[sym]].address;
+    }
+
+    // Concatenate the fragments (padding text with nops), and encode the jumps.
+    for(auto& fragment : list)
+    {
+        section.bytes.resize(fragment.address, id == TEXT ? 0x90 : 0);
+        for(auto relocation : fragment.relocations)
+        {
+            relocation.offset += fragment.address;
+            section.relocations.push_back(relocation);
+        }
+        section.bytes.insert(section.bytes.end(), fragment.bytes.begin(), fragment.bytes.end());
+        if(fragment.target < 0) continue;
+        if(!fragment.wide)
+        {
+            section.bytes.push_back(static_cast<uint8_t>(fragment.condition < 0 ? 0xEB : 0x70 + fragment.condition));
+            section.bytes.push_back(static_cast<uint8_t>(symbol_table[fragment.target].offset - (section.bytes.size() + 1)));
+            continue;
+        }
+        if(fragment.condition < 0) section.bytes.push_back(0xE9);
+        else
+        {
+            section.bytes.push_back(0x0F);
+            section.bytes.push_back(static_cast<uint8_t>(0x80 + fragment.condition));
+        }
+        section.relocations.push_back({section.bytes.size(), fragment.target, -4, true});
+        section.bytes.resize(section.bytes.size() + 4);
+    }
+
+    // Resolve references to local symbols in the section.
+    std::vector<AsmRelocation> relocations;
+    for(auto& relocation : section.relocations)
+    {
+        if(!relocation.relative || !local(relocation.symbol))
+        {
+            relocations.push_back(relocation);
+            continue;
+        }
+        int64_t value = static_cast<int64_t>(symbol_table[relocation.symbol].offset) + relocation.addend
+            - static_cast<int64_t>(relocation.offset);
+        for(int i = 0; i < 4; i++)
+            section.bytes[relocation.offset + i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+    section.relocations = relocations;
+}
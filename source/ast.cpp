@@ -4,29 +4,205 @@
 #include "ast.h"
 #include "parser.h"
 #include "type.h"
+#include "fold.h"
 
-// Handle 'Expression' parse nodes.
-std::shared_ptr<ExprAstNode> AstBuilder::expr(const ParseNode& node)
+// Map tokens in binary expression parse nodes to BinaryType.
+const std::map<int, BinaryType> BinaryTypes = {
+    {'*', BinaryType::MUL},
+    {'/', BinaryType::DIV},
+    {'%', BinaryType::MOD},
+    {'+', BinaryType::ADD},
+    {'-', BinaryType::SUB},
+    {TOK_SHIFT_LEFT, BinaryType::SHIFT_LEFT},
+    {TOK_SHIFT_RIGHT, BinaryType::SHIFT_RIGHT},
+    {'<', BinaryType::LT},
+    {'>', BinaryType::GT},
+    {TOK_LE, BinaryType::LE},
+    {TOK_GE, BinaryType::GE},
+    {TOK_EQ, BinaryType::EQ},
+    {TOK_NE, BinaryType::NE},
+    {'&', BinaryType::BITWISE_AND},
+    {'^', BinaryType::BITWISE_EXCL_OR},
+    {'|', BinaryType::BITWISE_INCL_OR},
+    {TOK_AND_OP, BinaryType::LOGICAL_AND_OP},
+    {TOK_OR_OP, BinaryType::LOGICAL_OR_OP}
+};
+
+// Map tokens in assignment parse nodes to AssignExprType.
+const std::map<int, AssignExprType> AssignExprTypes = {
+    {TOK_PLUS_ASSIGN, AssignExprType::PLUS},
+    {TOK_MINUS_ASSIGN, AssignExprType::MINUS},
+    {TOK_MUL_ASSIGN, AssignExprType::MUL},
+    {TOK_DIV_ASSIGN, AssignExprType::DIV},
+    {TOK_MOD_ASSIGN, AssignExprType::MOD},
+    {TOK_XOR_ASSIGN, AssignExprType::XOR},
+    {TOK_SHIFT_LEFT_ASSIGN, AssignExprType::SHIFT_LEFT},
+    {TOK_SHIFT_RIGHT_ASSIGN, AssignExprType::SHIFT_RIGHT},
+    {TOK_AND_ASSIGN, AssignExprType::AND},
+    {TOK_OR_ASSIGN, AssignExprType::OR},
+    {'=', AssignExprType::ASSIGN}
+};
+
+// Get the parse node which an expression parse node derives, if it does not produce an
+// AST node itself. E.g., 'Additive' with an empty 'Additive_End', or '(' Expression ')'.
+static const ParseNode * passthrough(const ParseNode& node)
 {
     switch(node.type)
     {
         case NT_PRIMARY:
+            return node.terminals.size() == 2 ? &(*node.children[0]) : nullptr;
+        case NT_UNARY:
+        case NT_CAST:
+            return node.terminals.size() == 0 ? &(*node.children[0]) : nullptr;
+        case NT_POSTFIX:
+        case NT_MULTIPLICATIVE:
+        case NT_ADDITIVE:
+        case NT_BITWISESHIFT:
+        case NT_RELATIONAL:
+        case NT_EQUALITY:
+        case NT_BITWISEAND:
+        case NT_BITWISEEXCLUSIVEOR:
+        case NT_BITWISEINCLUSIVEOR:
+        case NT_LOGICALAND:
+        case NT_LOGICALOR:
+        case NT_CONDITIONAL:
+        case NT_ASSIGNMENT:
+            return node.children[1]->empty ? &(*node.children[0]) : nullptr;
+        case NT_EXPRESSION:
+            return &(*node.children[0]);
+        default:
+            return nullptr;
+    }
+}
+
+// Find the first token within a parse node (for error reporting).
+static std::shared_ptr<Token> first_token(const ParseNode& node)
+{
+    const ParseNode * pn = &node;
+    while(pn->terminals.empty())
+    {
+        if(pn->children.empty()) return nullptr;
+        pn = &(*pn->children[0]);
+    }
+    return pn->terminals[0];
+}
+
+// Error for an invalid declaration, at the first token of a parse node.
+static AstError declaration_error(const std::string& errmsg, const ParseNode& node)
+{
+    auto token = first_token(node);
+    return AstError(errmsg, token ? token->line : 0, token ? token->position : 0);
+}
+
+static bool is_derived(const std::shared_ptr<CType>& type, DerivedCTypeType kind)
+{
+    auto derived = std::dynamic_pointer_cast<DerivedCType>(type);
+    return derived && derived->type == kind;
+}
+
+AstBuilder::AstBuilder(int depth_limit)
+    : context(own_context)
+    , depth_limit(depth_limit)
+{
+}
+
+AstBuilder::AstBuilder(TypeContext& context, int depth_limit)
+    : context(context)
+    , depth_limit(depth_limit)
+{
+}
+
+void AstBuilder::check_depth(const ParseNode& node, int depth)
+{
+    if(depth <= depth_limit) return;
+
+    auto token = first_token(node);
+    throw AstError(
+        "Expression nesting depth limit exceeded",
+        token ? token->line : 0,
+        token ? token->position : 0
+    );
+}
+
+// Handle 'Expression' parse nodes.
+std::shared_ptr<ExprAstNode> AstBuilder::expr(const ParseNode& node, int depth)
+{
+    size_t base = work.size();
+    work.push_back(Work{&node, depth, false});
+
+    while(work.size() > base)
+    {
+        Work item = work.back();
+        work.pop_back();
+
+        if(item.reduce)
+            reduce(*item.node);
+        else
+            expand(*item.node, item.depth);
+    }
+
+    auto result = values.back();
+    values.pop_back();
+    return result;
+}
+
+// Schedule the operands of an expression parse node, followed by the node itself.
+// 'depth' is the depth of the (outermost) AST node built from this parse node.
+void AstBuilder::expand(const ParseNode& root, int depth)
+{
+    const ParseNode * node = &root;
+    for(const ParseNode * next = node;next != nullptr;next = passthrough(*node))
+    {
+        node = next;
+    }
+
+    // Operand parse nodes (and their AST depths).
+    std::vector<std::pair<const ParseNode *, int>> operands;
+    switch(node->type)
+    {
+        case NT_PRIMARY:
+            // constant/string literal/identifier.
+            check_depth(*node, depth);
+            values.push_back(std::make_shared<PrimaryExprAstNode>(node->terminals[0]));
+            return;
+        case NT_POSTFIX:
             {
-                if(node.terminals.size() == 2)
+                // Each postfix operator wraps the expression to its left, so the primary
+                // expression is nested 'count' levels deep.
+                int count = 0;
+                for(const ParseNode * pn = &(*node->children[1]);!pn->empty;pn = &(*pn->children.back()))
                 {
-                    // '(' Expression ')' derivation.
-                    return expr(*node.children[0]);
+                    count++;
                 }
+                check_depth(*node, depth + count - 1);
+                operands.push_back({&(*node->children[0]), depth + count});
 
-                // constant/string literal/identifier.
-                return std::make_shared<PrimaryExprAstNode>(node.terminals[0]);
+                int level = count;
+                for(const ParseNode * pn = &(*node->children[1]);!pn->empty;pn = &(*pn->children.back()))
+                {
+                    level--;
+                    if(pn->terminals[0]->type == '[')
+                    {
+                        operands.push_back({&(*pn->children[0]), depth + level + 1});
+                    }
+                    else if(pn->terminals[0]->type == '(' && !pn->children[0]->empty)
+                    {
+                        const ParseNode& arglist = *pn->children[0];
+                        operands.push_back({&(*arglist.children[0]), depth + level + 1});
+                        for(const ParseNode * a = &(*arglist.children[1]);!a->empty;a = &(*a->children[1]))
+                        {
+                            operands.push_back({&(*a->children[0]), depth + level + 1});
+                        }
+                    }
+                }
             }
-        case NT_POSTFIX:
-            return postfix(node);
+            break;
         case NT_UNARY:
-            return unary(node);
+            check_depth(*node, depth);
+            operands.push_back({&(*node->children[0]), depth + 1});
+            break;
         case NT_CAST:
-            return cast(node);
+            throw std::logic_error("Not implemented yet");
         case NT_MULTIPLICATIVE:
         case NT_ADDITIVE:
         case NT_BITWISESHIFT:
@@ -37,24 +213,95 @@ std::shared_ptr<ExprAstNode> AstBuilder::expr(const ParseNode& node)
         case NT_BITWISEINCLUSIVEOR:
         case NT_LOGICALAND:
         case NT_LOGICALOR:
-            return binary(node);
+            {
+                // a + b + c -> ((a + b) + c). The leftmost operand is nested 'count'
+                // levels deep.
+                int count = 0;
+                for(const ParseNode * pn = &(*node->children[1]);!pn->empty;pn = &(*pn->children[1]))
+                {
+                    count++;
+                }
+                check_depth(*node, depth + count - 1);
+                operands.push_back({&(*node->children[0]), depth + count});
+
+                int level = count;
+                for(const ParseNode * pn = &(*node->children[1]);!pn->empty;pn = &(*pn->children[1]))
+                {
+                    operands.push_back({&(*pn->children[0]), depth + level--});
+                }
+            }
+            break;
         case NT_CONDITIONAL:
-            return tertiary(node);
+            check_depth(*node, depth);
+            operands.push_back({&(*node->children[0]), depth + 1});
+            operands.push_back({&(*node->children[1]->children[0]), depth + 1});
+            operands.push_back({&(*node->children[1]->children[1]), depth + 1});
+            break;
         case NT_ASSIGNMENT:
-            return assignment(node);
-        case NT_EXPRESSION:
-            return expr(*node.children[0]);
+            check_depth(*node, depth);
+            operands.push_back({&(*node->children[0]), depth + 1});
+            operands.push_back({&(*node->children[1]->children[0]), depth + 1});
+            break;
+        default:
+            throw std::logic_error("Unexpected ParseNode type");
+    }
+
+    // Operands are pushed in reverse, so they are built in order.
+    work.push_back(Work{node, depth, true});
+    for(auto operand = operands.rbegin();operand != operands.rend();operand++)
+    {
+        work.push_back(Work{operand->first, operand->second, false});
+    }
+}
+
+// Build the AST node for an expression parse node, from its operands on the value stack.
+void AstBuilder::reduce(const ParseNode& node)
+{
+    switch(node.type)
+    {
+        case NT_POSTFIX:
+            postfix(node);
+            break;
+        case NT_UNARY:
+            unary(node);
+            break;
+        case NT_CONDITIONAL:
+            tertiary(node);
+            break;
+        case NT_ASSIGNMENT:
+            assignment(node);
+            break;
+        default:
+            binary(node);
+            break;
     }
-    throw std::logic_error("Unexpected ParseNode type");
 }
 
-std::shared_ptr<ExprAstNode> AstBuilder::postfix(const ParseNode& node)
+void AstBuilder::postfix(const ParseNode& node)
 {
     // The Postfix grammar rule is right-recursive. Convert this
     // to a left-associative AST representation:
     // a.b.c.d -> ((a.b).c).d
+    size_t count = 1;
+    for(const ParseNode * right = &(*node.children[1]);!right->empty;right = &(*right->children.back()))
+    {
+        if(right->terminals[0]->type == '[')
+        {
+            count++;
+        }
+        else if(right->terminals[0]->type == '(' && !right->children[0]->empty)
+        {
+            count++;
+            for(const ParseNode * a = &(*right->children[0]->children[1]);!a->empty;a = &(*a->children[1]))
+            {
+                count++;
+            }
+        }
+    }
+
+    auto operand = values.end() - count;
+    auto pe = *operand++;
     const ParseNode *right = &(*node.children[1]);
-    auto pe = expr(*node.children[0]);
 
     while(right->empty == false)
     {
@@ -90,7 +337,7 @@ std::shared_ptr<ExprAstNode> AstBuilder::postfix(const ParseNode& node)
                 pe = std::make_shared<PostfixExprAstNode>(
                     PostfixType::ARRAY,
                     pe,
-                    std::list<std::shared_ptr<ExprAstNode>>{expr(*right->children[0])}
+                    std::list<std::shared_ptr<ExprAstNode>>{*operand++}
                 );
                 right = &(*right->children[1]);
                 break;
@@ -102,10 +349,10 @@ std::shared_ptr<ExprAstNode> AstBuilder::postfix(const ParseNode& node)
                     std::list<std::shared_ptr<ExprAstNode>> args;
                     if(!arglist.empty)
                     {
-                        args.push_back(expr(*arglist.children[0]));
+                        args.push_back(*operand++);
                         for(ParseNode * a = &(*arglist.children[1]);a->empty == false;a = &(*a->children[1]))
                         {
-                            args.push_back(expr(*a->children[0]));
+                            args.push_back(*operand++);
                         }
                     }
                     pe = std::make_shared<PostfixExprAstNode>(PostfixType::CALL, pe, std::move(args));
@@ -114,14 +361,12 @@ std::shared_ptr<ExprAstNode> AstBuilder::postfix(const ParseNode& node)
                 break;
         }
     }
-    return pe;
+    values.erase(values.end() - count, values.end());
+    values.push_back(pe);
 }
 
-std::shared_ptr<ExprAstNode> AstBuilder::unary(const ParseNode& node)
+void AstBuilder::unary(const ParseNode& node)
 {
-    if(node.terminals.size() == 0)
-        return expr(*node.children[0]);
-    
     UnaryType type;
     switch(node.terminals[0]->type)
     {
@@ -150,125 +395,616 @@ std::shared_ptr<ExprAstNode> AstBuilder::unary(const ParseNode& node)
             type = UnaryType::NOT;
             break;
     }
-    return std::make_shared<UnaryExprAstNode>(type, expr(*node.children[0]));
-}
-
-std::shared_ptr<ExprAstNode> AstBuilder::cast(const ParseNode& node)
-{
-    if(node.terminals.size() == 0)
-        return expr(*node.children[0]);
-
-    throw std::logic_error("Not implemented yet");
+    values.back() = std::make_shared<UnaryExprAstNode>(type, values.back());
 }
 
-std::shared_ptr<ExprAstNode> AstBuilder::binary(const ParseNode& node)
+void AstBuilder::binary(const ParseNode& node)
 {
     // Handle binary expressions (expressions with two operands)
-    // A + b, a * 2, etc.  This table maps tokens in the ParseNode
-    // to BinaryType.
-    std::map<int, BinaryType> table = {
-        {'*', BinaryType::MUL},
-        {'/', BinaryType::DIV},
-        {'%', BinaryType::MOD},
-        {'+', BinaryType::ADD},
-        {'-', BinaryType::SUB},
-        {TOK_SHIFT_LEFT, BinaryType::SHIFT_LEFT},
-        {TOK_SHIFT_RIGHT, BinaryType::SHIFT_RIGHT},
-        {'<', BinaryType::LT},
-        {'>', BinaryType::GT},
-        {TOK_LE, BinaryType::LE},
-        {TOK_GE, BinaryType::GE},
-        {TOK_EQ, BinaryType::EQ},
-        {TOK_NE, BinaryType::NE},
-        {'&', BinaryType::BITWISE_AND},
-        {'^', BinaryType::BITWISE_EXCL_OR},
-        {'|', BinaryType::BITWISE_INCL_OR},
-        {TOK_AND_OP, BinaryType::LOGICAL_AND_OP},
-        {TOK_OR_OP, BinaryType::LOGICAL_OR_OP}
-    };
-
-    auto left = expr(*node.children[0]);
-    ParseNode * pn = &(*node.children[1]);
+    // A + b, a * 2, etc.
+    size_t count = 1;
+    for(const ParseNode * pn = &(*node.children[1]);!pn->empty;pn = &(*pn->children[1]))
+    {
+        count++;
+    }
 
     // Convert right-recursive grammar to left-associative AST representation.
-    while(pn->empty == false)
+    auto operand = values.end() - count;
+    auto left = *operand++;
+    for(const ParseNode * pn = &(*node.children[1]);!pn->empty;pn = &(*pn->children[1]))
     {
         left = std::make_shared<BinaryExprAstNode>(
             left,
-            expr(*pn->children[0]),
-            table[pn->terminals[0]->type]
+            *operand++,
+            BinaryTypes.at(pn->terminals[0]->type)
         );
-        pn = &(*pn->children[1]);
     }
-    return left;
+    values.erase(values.end() - count, values.end());
+    values.push_back(left);
+}
+
+void AstBuilder::tertiary(const ParseNode&)
+{
+    auto right = values.back();
+    values.pop_back();
+    auto left = values.back();
+    values.pop_back();
+    values.back() = std::make_shared<TertiaryExprAstNode>(values.back(), left, right);
 }
 
-std::shared_ptr<ExprAstNode> AstBuilder::tertiary(const ParseNode& node)
+void AstBuilder::assignment(const ParseNode& node)
 {
-    if(node.children[1]->empty)
+    auto right = values.back();
+    values.pop_back();
+    values.back() = std::make_shared<AssignExprAstNode>(
+        values.back(),
+        AssignExprTypes.at(node.children[1]->terminals[0]->type),
+        right
+    );
+}
+
+// Build the type given by 'DeclarationSpecifiers' parse nodes.
+std::shared_ptr<CType> AstBuilder::specifiers(const ParseNode& node)
+{
+    CTypeBuilder builder;
+    try
     {
-        return expr(*node.children[0]);
+        for(const ParseNode * pn = &node;!pn->empty;pn = &(*pn->children[0]))
+        {
+            TokenType type = static_cast<TokenType>(pn->terminals[0]->type);
+            switch(type)
+            {
+                case TOK_CONST:
+                    builder.add_qualifier(type);
+                    break;
+                case TOK_STATIC:
+                case TOK_REGISTER:
+                    builder.add_storage_specifier(type);
+                    break;
+                default:
+                    builder.add_specifier(type);
+                    break;
+            }
+        }
+        return builder.build(context, first_token(node)->line);
+    }
+    catch(const CTypeError& e)
+    {
+        throw declaration_error(e.what(), node);
     }
+}
 
-    return std::make_shared<TertiaryExprAstNode>(
-        expr(*node.children[0]),
-        expr(*node.children[1]->children[0]),
-        expr(*node.children[1]->children[1]));
+// Apply 'Pointer' parse nodes to a type.
+// 'int * const *' -> [*, [const *, [signed int]]]
+std::shared_ptr<CType> AstBuilder::pointer(const ParseNode& node, std::shared_ptr<CType> type)
+{
+    for(const ParseNode * pn = &node;!pn->empty;pn = &(*pn->children[1]))
+    {
+        type = context.pointer(
+            type,
+            pn->children[0]->empty ? BasicCTypeQualifier::NOT_SET : BasicCTypeQualifier::CONST
+        );
+    }
+    return type;
 }
 
-std::shared_ptr<ExprAstNode> AstBuilder::assignment(const ParseNode& node)
+// Apply the array and function suffixes of a 'DirectDeclarator' parse node to a type.
+// Suffixes apply right-to-left: 'a[2][3]' is an array of 2 arrays of 3 elements. The
+// parameter declarations of the leftmost suffix are returned in 'params' (if given), for
+// function definitions.
+std::shared_ptr<CType> AstBuilder::direct_declarator(
+    const ParseNode& node,
+    std::shared_ptr<CType> type,
+    int depth,
+    std::list<std::shared_ptr<DeclAstNode>> * params)
 {
-    if(node.children[1]->empty)
+    std::vector<const ParseNode *> suffixes;
+    for(const ParseNode * pn = &(*node.children[0]);!pn->empty;pn = &(*pn->children.back()))
     {
-        return expr(*node.children[0]);
+        suffixes.push_back(pn);
+    }
+
+    for(auto suffix = suffixes.rbegin();suffix != suffixes.rend();suffix++)
+    {
+        const ParseNode& pn = **suffix;
+        if(pn.terminals[0]->type == '[')
+        {
+            // The element type must be an object type (6.7.5.2, 1), and the size must be
+            // greater than zero.
+            const Token& size_token = *pn.terminals[1];
+            IntegerConstant size;
+            if(!parse_integer_constant(size_token.lexeme, size) || size.is_zero() || size.bits > INT32_MAX)
+            {
+                throw AstError("Invalid array size", size_token.line, size_token.position);
+            }
+            if(is_derived(type, DerivedCTypeType::FUNCTION) || std::dynamic_pointer_cast<VoidCType>(type))
+            {
+                throw declaration_error("Invalid array element type", pn);
+            }
+            type = context.array(type, size.bits);
+        }
+        else
+        {
+            // Functions cannot return arrays or functions (6.7.5.3, 1).
+            if(is_derived(type, DerivedCTypeType::ARRAY) || is_derived(type, DerivedCTypeType::FUNCTION))
+            {
+                throw declaration_error("Invalid function return type", pn);
+            }
+
+            auto decls = parameters(*pn.children[0], depth + 1);
+            std::vector<std::shared_ptr<CType>> types;
+            for(auto& decl : decls)
+            {
+                types.push_back(decl->type);
+            }
+            type = context.function(type, types);
+
+            if(params && suffix + 1 == suffixes.rend())
+            {
+                *params = std::move(decls);
+            }
+        }
     }
+    return type;
+}
+
+// Build the parameter declarations in a 'ParameterList' parse node. Array and function
+// parameter types are adjusted to pointers (6.7.5.3, 7-8). '(void)' declares no
+// parameters.
+std::list<std::shared_ptr<DeclAstNode>> AstBuilder::parameters(const ParseNode& node, int depth)
+{
+    check_depth(node, depth);
 
-    std::map<int, AssignExprType> table = {
-        {TOK_PLUS_ASSIGN, AssignExprType::PLUS},
-        {TOK_MINUS_ASSIGN, AssignExprType::MINUS},
-        {TOK_MUL_ASSIGN, AssignExprType::MUL},
-        {TOK_DIV_ASSIGN, AssignExprType::DIV},
-        {TOK_MOD_ASSIGN, AssignExprType::MOD},
-        {TOK_XOR_ASSIGN, AssignExprType::XOR},
-        {TOK_SHIFT_LEFT_ASSIGN, AssignExprType::SHIFT_LEFT},
-        {TOK_SHIFT_RIGHT_ASSIGN, AssignExprType::SHIFT_RIGHT},
-        {TOK_AND_ASSIGN, AssignExprType::AND},
-        {TOK_OR_ASSIGN, AssignExprType::OR},
-        {'=', AssignExprType::ASSIGN}
-    };
+    std::list<std::shared_ptr<DeclAstNode>> decls;
+    for(const ParseNode * pn = &node;!pn->empty;pn = &(*pn->children[1]))
+    {
+        const ParseNode& param = *pn->children[0];
+        auto type = pointer(*param.children[1], specifiers(*param.children[0]));
 
-    return std::make_shared<AssignExprAstNode>(
-        expr(*node.children[0]),
-        table[node.children[1]->terminals[0]->type],
-        expr(*node.children[1]->children[0])
+        std::shared_ptr<Token> identifier;
+        if(!param.children[2]->empty)
+        {
+            const ParseNode& direct = *param.children[2]->children[0];
+            identifier = direct.terminals[0];
+            type = direct_declarator(direct, type, depth);
+        }
+
+        auto derived = std::dynamic_pointer_cast<DerivedCType>(type);
+        if(derived && derived->type == DerivedCTypeType::ARRAY)
+        {
+            type = context.pointer(derived->base);
+        }
+        else if(derived && derived->type == DerivedCTypeType::FUNCTION)
+        {
+            type = context.pointer(type);
+        }
+        decls.push_back(std::make_shared<DeclAstNode>(type, identifier));
+    }
+
+    if(decls.size() == 1
+        && !decls.front()->identifier
+        && std::dynamic_pointer_cast<VoidCType>(decls.front()->type))
+    {
+        decls.clear();
+    }
+    return decls;
+}
+
+// Build the declaration for a 'Declarator' parse node, with an optional initializer
+// ('InitDeclarator_End' parse node).
+std::shared_ptr<DeclAstNode> AstBuilder::declarator(
+    const ParseNode& node,
+    std::shared_ptr<CType> type,
+    const ParseNode * init,
+    int depth,
+    std::list<std::shared_ptr<DeclAstNode>> * params)
+{
+    check_depth(node, depth);
+
+    const ParseNode& direct = *node.children[1];
+    type = direct_declarator(direct, pointer(*node.children[0], type), depth, params);
+
+    std::shared_ptr<ExprAstNode> initializer;
+    if(init != nullptr && !init->empty)
+    {
+        initializer = expr(*init->children[0], depth + 1);
+    }
+    return std::make_shared<DeclAstNode>(type, direct.terminals[0], initializer);
+}
+
+// Handle 'InitDeclaratorList' parse nodes. Each declarator is a separate DeclAstNode.
+void AstBuilder::init_declarators(
+    const ParseNode& node,
+    std::shared_ptr<CType> type,
+    int depth,
+    std::list<std::shared_ptr<AstNode>>& items)
+{
+    for(const ParseNode * pn = &node;!pn->empty;pn = &(*pn->children[1]))
+    {
+        const ParseNode& init = *pn->children[0];
+        items.push_back(declarator(*init.children[0], type, &(*init.children[1]), depth));
+    }
+}
+
+void AstBuilder::declaration(const ParseNode& node, int depth, std::list<std::shared_ptr<AstNode>>& items)
+{
+    init_declarators(*node.children[1], specifiers(*node.children[0]), depth, items);
+}
+
+// Handle 'Statement' parse nodes.
+std::shared_ptr<StmtAstNode> AstBuilder::statement(const ParseNode& node, int depth)
+{
+    const ParseNode& stmt = *node.children[0];
+    check_depth(stmt, depth);
+
+    switch(stmt.type)
+    {
+        case NT_COMPOUNDSTATEMENT:
+            return compound(stmt, depth);
+        case NT_EXPRESSIONSTATEMENT:
+            return std::make_shared<ExprStmtAstNode>(
+                stmt.children[0]->empty ? nullptr : expr(*stmt.children[0]->children[0], depth + 1)
+            );
+        case NT_LABELEDSTATEMENT:
+            return labeled(stmt, depth);
+        case NT_SELECTIONSTATEMENT:
+            return selection(stmt, depth);
+        case NT_ITERATIONSTATEMENT:
+            return iteration(stmt, depth);
+        case NT_JUMPSTATEMENT:
+            return jump(stmt, depth);
+        default:
+            throw std::logic_error("Unexpected ParseNode type");
+    }
+}
+
+// Handle 'LabeledStatement' parse nodes. 'case' and 'default' labels may only appear in a
+// switch body (6.8.1, 2).
+std::shared_ptr<StmtAstNode> AstBuilder::labeled(const ParseNode& node, int depth)
+{
+    auto token = node.terminals[0];
+    if(switches == 0)
+    {
+        throw AstError(
+            std::string("'") + (token->type == TOK_CASE ? "case" : "default") + "' label not in a switch statement",
+            token->line,
+            token->position
+        );
+    }
+    if(token->type == TOK_CASE)
+    {
+        auto value = expr(*node.children[0], depth + 1);
+        return std::make_shared<CaseStmtAstNode>(token, value, statement(*node.children[1], depth + 1));
+    }
+    return std::make_shared<CaseStmtAstNode>(token, nullptr, statement(*node.children[0], depth + 1));
+}
+
+// Handle 'SelectionStatement' parse nodes.
+std::shared_ptr<StmtAstNode> AstBuilder::selection(const ParseNode& node, int depth)
+{
+    auto condition = expr(*node.children[0], depth + 1);
+    switches++;
+    auto body = statement(*node.children[1], depth + 1);
+    switches--;
+    return std::make_shared<SwitchStmtAstNode>(node.terminals[0], condition, body);
+}
+
+// Handle 'IterationStatement' parse nodes.
+std::shared_ptr<StmtAstNode> AstBuilder::iteration(const ParseNode& node, int depth)
+{
+    std::list<std::shared_ptr<AstNode>> init;
+    std::shared_ptr<ExprAstNode> condition, step;
+    std::shared_ptr<StmtAstNode> body;
+    IterationType type;
+
+    loops++;
+    switch(node.terminals[0]->type)
+    {
+        case TOK_WHILE:
+            type = IterationType::WHILE;
+            condition = expr(*node.children[0], depth + 1);
+            body = statement(*node.children[1], depth + 1);
+            break;
+        case TOK_DO:
+            type = IterationType::DO;
+            body = statement(*node.children[0], depth + 1);
+            condition = expr(*node.children[1], depth + 1);
+            break;
+        default:
+            {
+                type = IterationType::FOR;
+                const ParseNode& first = *node.children[0]->children[0];
+                if(first.type == NT_DECLARATION)
+                {
+                    declaration(first, depth + 1, init);
+                }
+                else
+                {
+                    init.push_back(std::make_shared<ExprStmtAstNode>(
+                        first.children[0]->empty ? nullptr : expr(*first.children[0]->children[0], depth + 1)
+                    ));
+                }
+                if(!node.children[1]->empty)
+                {
+                    condition = expr(*node.children[1]->children[0], depth + 1);
+                }
+                if(!node.children[2]->empty)
+                {
+                    step = expr(*node.children[2]->children[0], depth + 1);
+                }
+                body = statement(*node.children[3], depth + 1);
+            }
+            break;
+    }
+    loops--;
+
+    return std::make_shared<IterationStmtAstNode>(
+        type, node.terminals[0], std::move(init), condition, step, body
     );
 }
 
-// std::shared_ptr<DeclAstNode> AstBuilder::declaration(const ParseNode& node)
-// {
-//     if(node.children[0]->empty)
-//         throw "errah";
-    
-//     std::vector<int> specifiers;
+// Handle 'JumpStatement' parse nodes. 'continue' may only appear in a loop body, and
+// 'break' in a loop or switch body (6.8.6.2, 1 and 6.8.6.3, 1).
+std::shared_ptr<StmtAstNode> AstBuilder::jump(const ParseNode& node, int depth)
+{
+    auto token = node.terminals[0];
+    switch(token->type)
+    {
+        case TOK_RETURN:
+            return std::make_shared<ReturnStmtAstNode>(
+                token,
+                node.children[0]->empty ? nullptr : expr(*node.children[0]->children[0], depth + 1)
+            );
+        case TOK_BREAK:
+        case TOK_CONTINUE:
+            if(loops == 0 && (token->type == TOK_CONTINUE || switches == 0))
+            {
+                throw AstError(
+                    std::string("'") + (token->type == TOK_BREAK ? "break" : "continue") + "' statement not in a loop",
+                    token->line,
+                    token->position
+                );
+            }
+            return std::make_shared<JumpStmtAstNode>(
+                token->type == TOK_BREAK ? JumpType::BREAK : JumpType::CONTINUE, token
+            );
+        default:
+            throw std::logic_error("Unexpected jump statement");
+    }
+}
 
-//     auto * specifier = &node.children[0];
-//     while((*specifier)->empty == false)
-//     {
-//         specifiers.push_back((*specifier)->terminals[0]->type);
-//     }
-// }
+std::shared_ptr<CompoundStmtAstNode> AstBuilder::compound(const ParseNode& node, int depth)
+{
+    check_depth(node, depth);
 
+    std::list<std::shared_ptr<AstNode>> items;
+    for(const ParseNode * pn = &(*node.children[0]);!pn->empty;pn = &(*pn->children[1]))
+    {
+        const ParseNode& item = *pn->children[0]->children[0];
+        if(item.type == NT_DECLARATION)
+        {
+            declaration(item, depth + 1, items);
+        }
+        else
+        {
+            items.push_back(statement(item, depth + 1));
+        }
+    }
+    return std::make_shared<CompoundStmtAstNode>(std::move(items));
+}
+
+// Handle 'ExternalDeclaration' parse nodes - function definitions, and file-scope
+// declarations.
+void AstBuilder::external_declaration(const ParseNode& node, std::list<std::shared_ptr<AstNode>>& items)
+{
+    auto type = specifiers(*node.children[0]);
+    const ParseNode& end = *node.children[2];
+
+    if(end.children[0]->type != NT_COMPOUNDSTATEMENT)
+    {
+        items.push_back(declarator(*node.children[1], type, &(*end.children[0]), 1));
+        init_declarators(*end.children[1], type, 1, items);
+        return;
+    }
+
+    std::list<std::shared_ptr<DeclAstNode>> params;
+    auto decl = declarator(*node.children[1], type, nullptr, 2, &params);
+    if(!is_derived(decl->type, DerivedCTypeType::FUNCTION))
+    {
+        throw declaration_error("Function definition requires a function declarator", *node.children[1]);
+    }
+    for(auto& param : params)
+    {
+        // (6.9.1, 5)
+        if(!param->identifier)
+        {
+            throw declaration_error("Parameter name omitted", *node.children[1]);
+        }
+    }
+    items.push_back(std::make_shared<FunctionDefAstNode>(
+        decl,
+        std::move(params),
+        compound(*end.children[0], 2)
+    ));
+}
+
+std::shared_ptr<TranslationUnitAstNode> AstBuilder::translation_unit(const ParseNode& node)
+{
+    std::list<std::shared_ptr<AstNode>> items;
+    for(const ParseNode * pn = &node;!pn->empty;pn = &(*pn->children[1]))
+    {
+        external_declaration(*pn->children[0], items);
+    }
+    return std::make_shared<TranslationUnitAstNode>(std::move(items));
+}
 
 std::shared_ptr<AstNode> AstBuilder::build(const ParseNode& node)
 {
+    work.clear();
+    values.clear();
+    loops = 0;
+
     if(node.type == NT_ROOT)
     {
-        return expr(*node.children[0]);
+        const ParseNode& root = *node.children[0];
+        if(root.type == NT_TRANSLATIONUNIT)
+        {
+            return translation_unit(root);
+        }
+        return expr(root);
     }
 
     throw std::logic_error("Not implemented yet.");
 }
 
+// Visitor which collects the child nodes of a single AST node.
+class ChildVisitor : public AstVisitor
+{
+    public:
+        std::vector<std::shared_ptr<AstNode>> children;
+
+        virtual void visit(PrimaryExprAstNode&) override
+        {
+        }
+        virtual void visit(BinaryExprAstNode& node) override
+        {
+            children = {node.left, node.right};
+        }
+        virtual void visit(UnaryExprAstNode& node) override
+        {
+            children = {node.right};
+        }
+        virtual void visit(TertiaryExprAstNode& node) override
+        {
+            children = {node.conditional, node.left, node.right};
+        }
+        virtual void visit(PostfixExprAstNode& node) override
+        {
+            children = {node.left};
+            children.insert(children.end(), node.right.begin(), node.right.end());
+        }
+        virtual void visit(AssignExprAstNode& node) override
+        {
+            children = {node.left, node.right};
+        }
+        virtual void visit(ExprAstNode&) override
+        {
+        }
+        virtual void visit(DeclAstNode& node) override
+        {
+            if(node.initializer) children = {node.initializer};
+        }
+        virtual void visit(CompoundStmtAstNode& node) override
+        {
+            children.assign(node.items.begin(), node.items.end());
+        }
+        virtual void visit(ExprStmtAstNode& node) override
+        {
+            if(node.expr) children = {node.expr};
+        }
+        virtual void visit(ReturnStmtAstNode& node) override
+        {
+            if(node.expr) children = {node.expr};
+        }
+        virtual void visit(IterationStmtAstNode& node) override
+        {
+            // ('do' evaluates its condition after the body.)
+            children.assign(node.init.begin(), node.init.end());
+            if(node.type == IterationType::DO) children.push_back(node.body);
+            if(node.condition) children.push_back(node.condition);
+            if(node.type != IterationType::DO) children.push_back(node.body);
+            if(node.step) children.push_back(node.step);
+        }
+        virtual void visit(SwitchStmtAstNode& node) override
+        {
+            children = {node.condition, node.body};
+        }
+        virtual void visit(CaseStmtAstNode& node) override
+        {
+            if(node.value) children = {node.value};
+            children.push_back(node.body);
+        }
+        virtual void visit(JumpStmtAstNode&) override
+        {
+        }
+        virtual void visit(FunctionDefAstNode& node) override
+        {
+            children = {node.decl};
+            children.insert(children.end(), node.parameters.begin(), node.parameters.end());
+            children.push_back(node.body);
+        }
+        virtual void visit(TranslationUnitAstNode& node) override
+        {
+            children.assign(node.items.begin(), node.items.end());
+        }
+};
+
+std::vector<std::shared_ptr<AstNode>> ast_children(AstNode& node)
+{
+    ChildVisitor visitor;
+    node.accept(visitor);
+    return std::move(visitor.children);
+}
+
+std::vector<CaseStmtAstNode *> switch_labels(SwitchStmtAstNode& node)
+{
+    // (Expressions cannot contain statements, so only statements are searched.)
+    std::vector<CaseStmtAstNode *> labels;
+    std::vector<AstNode *> stack = {node.body.get()};
+    while(!stack.empty())
+    {
+        AstNode * next = stack.back();
+        stack.pop_back();
+        if(dynamic_cast<SwitchStmtAstNode *>(next) || dynamic_cast<ExprAstNode *>(next)) continue;
+        if(auto label = dynamic_cast<CaseStmtAstNode *>(next)) labels.push_back(label);
+
+        auto children = ast_children(*next);
+        for(auto child = children.rbegin();child != children.rend();child++)
+        {
+            stack.push_back(child->get());
+        }
+    }
+    return labels;
+}
+
+AstWalker::AstWalker(int depth_limit)
+    : depth_limit(depth_limit)
+{
+}
+
+void AstWalker::walk(const std::shared_ptr<AstNode>& root, AstVisitor& visitor)
+{
+    stack.clear();
+    stack.push_back(Frame{root, 0, false});
+
+    while(!stack.empty())
+    {
+        if(stack.back().expanded)
+        {
+            // All children have been visited.
+            visiting = std::move(stack.back().node);
+            stack.pop_back();
+            visiting->accept(visitor);
+            continue;
+        }
+
+        stack.back().expanded = true;
+        int depth = stack.back().depth + 1;
+        auto children = ast_children(*stack.back().node);
+        if(!children.empty() && depth > depth_limit)
+        {
+            throw AstError("AST nesting depth limit exceeded", 0, 0);
+        }
+
+        // Children are pushed in reverse, so they are visited in order.
+        for(auto child = children.rbegin();child != children.rend();child++)
+        {
+            stack.push_back(Frame{*child, depth, false});
+        }
+    }
+    visiting.reset();
+}
+
 void PrimaryExprAstNode::accept(AstVisitor& v)
 {
     v.visit(*this);
@@ -304,6 +1040,168 @@ void DeclAstNode::accept(AstVisitor& v)
     v.visit(*this);
 }
 
+void CompoundStmtAstNode::accept(AstVisitor& v)
+{
+    v.visit(*this);
+}
+
+void ExprStmtAstNode::accept(AstVisitor& v)
+{
+    v.visit(*this);
+}
+
+void ReturnStmtAstNode::accept(AstVisitor& v)
+{
+    v.visit(*this);
+}
+
+void IterationStmtAstNode::accept(AstVisitor& v)
+{
+    v.visit(*this);
+}
+
+void SwitchStmtAstNode::accept(AstVisitor& v)
+{
+    v.visit(*this);
+}
+
+void CaseStmtAstNode::accept(AstVisitor& v)
+{
+    v.visit(*this);
+}
+
+void JumpStmtAstNode::accept(AstVisitor& v)
+{
+    v.visit(*this);
+}
+
+void FunctionDefAstNode::accept(AstVisitor& v)
+{
+    v.visit(*this);
+}
+
+void TranslationUnitAstNode::accept(AstVisitor& v)
+{
+    v.visit(*this);
+}
+
+void AstNode::release_node(std::shared_ptr<AstNode> node)
+{
+    // Nodes released while another node is being destroyed are queued, instead of being
+    // destroyed (recursively) in its destructor.
+    static thread_local std::vector<std::shared_ptr<AstNode>> pending;
+    static thread_local bool releasing = false;
+
+    pending.push_back(std::move(node));
+    if(releasing) return;
+
+    releasing = true;
+    while(!pending.empty())
+    {
+        auto next = std::move(pending.back());
+        pending.pop_back();
+        next.reset();
+    }
+    releasing = false;
+}
+
 AstNode::~AstNode() {
     
-}
\ No newline at end of file
+}
+
+PostfixExprAstNode::~PostfixExprAstNode()
+{
+    release(left);
+    for(auto& arg : right)
+    {
+        release(arg);
+    }
+}
+
+UnaryExprAstNode::~UnaryExprAstNode()
+{
+    release(right);
+}
+
+BinaryExprAstNode::~BinaryExprAstNode()
+{
+    release(left);
+    release(right);
+}
+
+TertiaryExprAstNode::~TertiaryExprAstNode()
+{
+    release(conditional);
+    release(left);
+    release(right);
+}
+
+AssignExprAstNode::~AssignExprAstNode()
+{
+    release(left);
+    release(right);
+}
+
+DeclAstNode::~DeclAstNode()
+{
+    release(initializer);
+}
+
+CompoundStmtAstNode::~CompoundStmtAstNode()
+{
+    for(auto& item : items)
+    {
+        release(item);
+    }
+}
+
+ExprStmtAstNode::~ExprStmtAstNode()
+{
+    release(expr);
+}
+
+ReturnStmtAstNode::~ReturnStmtAstNode()
+{
+    release(expr);
+}
+
+IterationStmtAstNode::~IterationStmtAstNode()
+{
+    for(auto& item : init)
+    {
+        release(item);
+    }
+    release(condition);
+    release(step);
+    release(body);
+}
+
+SwitchStmtAstNode::~SwitchStmtAstNode()
+{
+    release(condition);
+    release(body);
+}
+
+CaseStmtAstNode::~CaseStmtAstNode()
+{
+    release(value);
+    release(body);
+}
+
+FunctionDefAstNode::~FunctionDefAstNode()
+{
+    release(decl);
+    for(auto& param : parameters)
+    {
+        release(param);
+    }
+    release(body);
+}
+
+TranslationUnitAstNode::~TranslationUnitAstNode()
+{
+    for(auto& item : items)
+    {
+        release(item);
+    }
+}
@@ -0,0 +1,54 @@
+#include <algorithm>
+
+#include "dce.h"
+
+static bool has_side_effects(IrOp op)
+{
+    return op == IrOp::STORE || ir_is_vector(op) || op == IrOp::CALL || ir_is_terminator(op);
+}
+
+bool DeadCodeElimination::run(IrFunction& function)
+{
+    std::vector<bool> live(function.instrs.size(), false);
+    std::vector<IrValue> work;
+    for(auto& block : function.blocks)
+    {
+        for(IrValue value : block.code)
+        {
+            if(has_side_effects(function.instrs[value].op))
+            {
+                live[value] = true;
+                work.push_back(value);
+            }
+        }
+    }
+    while(!work.empty())
+    {
+        IrValue value = work.back();
+        work.pop_back();
+        for(IrValue operand : function.operands(value))
+        {
+            if(!live[operand])
+            {
+                live[operand] = true;
+                work.push_back(operand);
+            }
+        }
+    }
+
+    bool changed = false;
+    for(auto& block : function.blocks)
+    {
+        size_t size = block.code.size();
+        block.code.erase(
+            std::remove_if(block.code.begin(), block.code.end(), [&](IrValue value)
+            {
+                return !live[value];
+            }),
+            block.code.end()
+        );
+        changed = changed || block.code.size() != size;
+    }
+    if(changed) function.compact();
+    return changed;
+}
@@ -0,0 +1,246 @@
+#include <algorithm>
+
+#include "dominators.h"
+
+std::vector<IrBlockId> reverse_postorder(const IrFunction& function)
+{
+    std::vector<IrBlockId> order;
+    std::vector<bool> visited(function.blocks.size(), false);
+    std::vector<std::pair<IrBlockId, size_t>> stack{{0, 0}};
+    visited[0] = true;
+    while(!stack.empty())
+    {
+        auto& top = stack.back();
+        const auto& succs = function.blocks[top.first].succs;
+        if(top.second < succs.size())
+        {
+            IrBlockId succ = succs[top.second++];
+            if(!visited[succ])
+            {
+                visited[succ] = true;
+                stack.push_back({succ, 0});
+            }
+            continue;
+        }
+        order.push_back(top.first);
+        stack.pop_back();
+    }
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+DominatorTree::DominatorTree(const IrFunction& function, Algorithm algorithm)
+    : idoms(function.blocks.size(), IrNoBlock)
+    , order(::reverse_postorder(function))
+{
+    if(algorithm == Algorithm::AUTO)
+    {
+        algorithm = function.blocks.size() > LargeFunctionBlocks
+            ? Algorithm::LENGAUER_TARJAN
+            : Algorithm::ITERATIVE;
+    }
+
+    if(algorithm == Algorithm::ITERATIVE)
+        iterative(function);
+    else
+        lengauer_tarjan(function);
+    build_tree();
+}
+
+void DominatorTree::iterative(const IrFunction& function)
+{
+    std::vector<uint32_t> index(function.blocks.size(), 0);
+    for(uint32_t i = 0;i < order.size();i++)
+    {
+        index[order[i]] = i;
+    }
+
+    // Walk up the (partial) tree from a and b to their nearest common dominator. Blocks
+    // nearer the root come earlier in reverse postorder.
+    auto intersect = [&](IrBlockId a, IrBlockId b)
+    {
+        while(a != b)
+        {
+            while(index[a] > index[b]) a = idoms[a];
+            while(index[b] > index[a]) b = idoms[b];
+        }
+        return a;
+    };
+
+    idoms[0] = 0;
+    bool changed = true;
+    while(changed)
+    {
+        changed = false;
+        for(size_t i = 1;i < order.size();i++)
+        {
+            IrBlockId block = order[i];
+            IrBlockId idom = IrNoBlock;
+            for(IrBlockId pred : function.blocks[block].preds)
+            {
+                if(idoms[pred] == IrNoBlock) continue;
+                idom = (idom == IrNoBlock) ? pred : intersect(pred, idom);
+            }
+            if(idoms[block] != idom)
+            {
+                idoms[block] = idom;
+                changed = true;
+            }
+        }
+    }
+}
+
+void DominatorTree::lengauer_tarjan(const IrFunction& function)
+{
+    // Number the blocks in DFS preorder. The rest of the algorithm works on these numbers.
+    std::vector<int> number(function.blocks.size(), -1);
+    std::vector<IrBlockId> vertex;
+    std::vector<int> parent;
+    std::vector<std::pair<IrBlockId, size_t>> stack{{0, 0}};
+    number[0] = 0;
+    vertex.push_back(0);
+    parent.push_back(-1);
+    while(!stack.empty())
+    {
+        auto& top = stack.back();
+        const auto& succs = function.blocks[top.first].succs;
+        if(top.second == succs.size())
+        {
+            stack.pop_back();
+            continue;
+        }
+        IrBlockId succ = succs[top.second++];
+        if(number[succ] == -1)
+        {
+            number[succ] = vertex.size();
+            parent.push_back(number[top.first]);
+            vertex.push_back(succ);
+            stack.push_back({succ, 0});
+        }
+    }
+
+    int count = vertex.size();
+    std::vector<int> semi(count), label(count), ancestor(count, -1), idom(count, 0);
+    std::vector<int> bucket_head(count, -1), bucket_next(count, -1);
+    std::vector<int> path;
+    for(int i = 0;i < count;i++)
+    {
+        semi[i] = label[i] = i;
+    }
+
+    // Find the vertex with the smallest semidominator on the path from v to the root of
+    // its tree in the forest, compressing the path as we go.
+    auto eval = [&](int v)
+    {
+        if(ancestor[v] == -1) return v;
+
+        path.clear();
+        for(int u = v;ancestor[ancestor[u]] != -1;u = ancestor[u])
+        {
+            path.push_back(u);
+        }
+        for(auto u = path.rbegin();u != path.rend();u++)
+        {
+            int a = ancestor[*u];
+            if(semi[label[a]] < semi[label[*u]]) label[*u] = label[a];
+            ancestor[*u] = ancestor[a];
+        }
+        return label[v];
+    };
+
+    for(int w = count - 1;w > 0;w--)
+    {
+        for(IrBlockId pred : function.blocks[vertex[w]].preds)
+        {
+            if(number[pred] == -1) continue;
+            int u = eval(number[pred]);
+            if(semi[u] < semi[w]) semi[w] = semi[u];
+        }
+        bucket_next[w] = bucket_head[semi[w]];
+        bucket_head[semi[w]] = w;
+        ancestor[w] = parent[w];
+
+        for(int v = bucket_head[parent[w]];v != -1;v = bucket_next[v])
+        {
+            int u = eval(v);
+            idom[v] = semi[u] < semi[v] ? u : parent[w];
+        }
+        bucket_head[parent[w]] = -1;
+    }
+    for(int w = 1;w < count;w++)
+    {
+        if(idom[w] != semi[w]) idom[w] = idom[idom[w]];
+    }
+
+    for(int w = 0;w < count;w++)
+    {
+        idoms[vertex[w]] = vertex[idom[w]];
+    }
+}
+
+void DominatorTree::build_tree()
+{
+    size_t blocks = idoms.size();
+    child_offsets.assign(blocks + 1, 0);
+    for(IrBlockId block = 1;block < blocks;block++)
+    {
+        if(reachable(block)) child_offsets[idoms[block] + 1]++;
+    }
+    for(size_t i = 1;i <= blocks;i++)
+    {
+        child_offsets[i] += child_offsets[i - 1];
+    }
+    child_list.resize(child_offsets.back());
+    std::vector<uint32_t> next(child_offsets.begin(), child_offsets.end() - 1);
+    for(IrBlockId block = 1;block < blocks;block++)
+    {
+        if(reachable(block)) child_list[next[idoms[block]]++] = block;
+    }
+
+    pre.assign(blocks, 0);
+    post.assign(blocks, 0);
+    uint32_t pre_count = 0, post_count = 0;
+    std::vector<std::pair<IrBlockId, uint32_t>> stack{{0, 0}};
+    pre[0] = pre_count++;
+    tree_order.push_back(0);
+    while(!stack.empty())
+    {
+        auto& top = stack.back();
+        IrRange kids = children(top.first);
+        if(top.second == kids.size())
+        {
+            post[top.first] = post_count++;
+            stack.pop_back();
+            continue;
+        }
+        IrBlockId child = kids[top.second++];
+        pre[child] = pre_count++;
+        tree_order.push_back(child);
+        stack.push_back({child, 0});
+    }
+}
+
+DominanceFrontiers::DominanceFrontiers(const IrFunction& function, const DominatorTree& tree)
+    : frontiers(function.blocks.size())
+{
+    // A join point is in the frontier of each block on the path up the tree from each of
+    // its predecessors, up to (but not including) its immediate dominator.
+    for(IrBlockId block = 0;block < function.blocks.size();block++)
+    {
+        const auto& preds = function.blocks[block].preds;
+        if(preds.size() < 2 || !tree.reachable(block)) continue;
+
+        for(IrBlockId pred : preds)
+        {
+            if(!tree.reachable(pred)) continue;
+            for(IrBlockId runner = pred;runner != tree.idom(block);runner = tree.idom(runner))
+            {
+                auto& frontier = frontiers[runner];
+                if(frontier.empty() || frontier.back() != block)
+                {
+                    frontier.push_back(block);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,1407 @@
+#include <algorithm>
+
+#include "assembler.h"
+#include "emitter.h"
+#include "peephole.h"
+
+// Width of a value of a type (0: byte ... 3: quadword).
+static int width(IrType type)
+{
+    switch(type)
+    {
+        case IrType::I8: return 0;
+        case IrType::I16: return 1;
+        case IrType::I64: return 3;
+        default: return 2;
+    }
+}
+
+// Width of arithmetic on a type. (Narrow values are operated on as doublewords; the bits
+// above their width are ignored.)
+static int arithmetic_width(IrType type)
+{
+    return type == IrType::I64 ? 3 : 2;
+}
+
+// Condition code of a comparison, and of its negation, and the comparison with its
+// operands swapped.
+static const char * condition(IrOp op)
+{
+    switch(op)
+    {
+        case IrOp::EQ: return "e";
+        case IrOp::NE: return "ne";
+        case IrOp::SLT: return "l";
+        case IrOp::SLE: return "le";
+        case IrOp::SGT: return "g";
+        case IrOp::SGE: return "ge";
+        case IrOp::ULT: return "b";
+        case IrOp::ULE: return "be";
+        case IrOp::UGT: return "a";
+        default: return "ae";
+    }
+}
+
+static IrOp invert(IrOp op)
+{
+    switch(op)
+    {
+        case IrOp::EQ: return IrOp::NE;
+        case IrOp::NE: return IrOp::EQ;
+        case IrOp::SLT: return IrOp::SGE;
+        case IrOp::SLE: return IrOp::SGT;
+        case IrOp::SGT: return IrOp::SLE;
+        case IrOp::SGE: return IrOp::SLT;
+        case IrOp::ULT: return IrOp::UGE;
+        case IrOp::ULE: return IrOp::UGT;
+        case IrOp::UGT: return IrOp::ULE;
+        default: return IrOp::ULT;
+    }
+}
+
+static IrOp swap_operands(IrOp op)
+{
+    switch(op)
+    {
+        case IrOp::SLT: return IrOp::SGT;
+        case IrOp::SLE: return IrOp::SGE;
+        case IrOp::SGT: return IrOp::SLT;
+        case IrOp::SGE: return IrOp::SLE;
+        case IrOp::ULT: return IrOp::UGT;
+        case IrOp::ULE: return IrOp::UGE;
+        case IrOp::UGT: return IrOp::ULT;
+        case IrOp::UGE: return IrOp::ULE;
+        default: return op;
+    }
+}
+
+// String literals and static locals ('.str0', 'f.x.0') are local to the file.
+static bool is_local(const std::string& name)
+{
+    return name.find('.') != std::string::npos;
+}
+
+// Mnemonic with the size suffix of a width.
+static std::string sized(const char * name, int w)
+{
+    return name + std::string(1, Suffixes[w]);
+}
+
+// Label local to the file: '.L0_3' (prefix '.L', function 0, number 3).
+static std::string local_label(const char * prefix, int function, size_t n)
+{
+    return prefix + std::to_string(function) + '_' + std::to_string(n);
+}
+
+static MachineOperand reg(Register r, int w)
+{
+    return MachineOperand::in(static_cast<int>(r), w);
+}
+
+static MachineOperand immediate_operand(int64_t value)
+{
+    return MachineOperand::immediate(value);
+}
+
+AsmEmitter::AsmEmitter(BufferedWriter& o, const IrModule& m, int level) : file(&o), module(m), level(level)
+{
+}
+
+AsmEmitter::AsmEmitter(Assembler& a, const IrModule& m, int level) : assembler(&a), module(m), level(level)
+{
+}
+
+void AsmEmitter::write_code(bool optimize)
+{
+    if(optimize && level > 0)
+    {
+        PeepholeOptimizer(code).run();
+    }
+    if(assembler)
+    {
+        assembler->add(code);
+    }
+    else
+    {
+        for(const MachineInstr& instr : code)
+        {
+            *file << instr;
+        }
+    }
+    code.clear();
+}
+
+void AsmEmitter::append(std::string mnemonic, std::vector<MachineOperand> operands)
+{
+    code.emplace_back(std::move(mnemonic), std::move(operands));
+}
+
+void AsmEmitter::define(std::string name)
+{
+    code.push_back(MachineInstr::label(std::move(name)));
+}
+
+void AsmEmitter::directive(std::string name, std::string arguments)
+{
+    code.push_back(MachineInstr::directive(std::move(name), std::move(arguments)));
+}
+
+MachineOperand AsmEmitter::memory(const Location& location) const
+{
+    int32_t offset = location.kind == Location::Kind::FRAME
+        ? frame_offsets[location.index]
+        : slot_base + 8 * static_cast<int32_t>(location.index + 1);
+    return MachineOperand::memory(static_cast<int>(Register::RBP), -offset);
+}
+
+int64_t AsmEmitter::constant(const Location& location) const
+{
+    return function->instrs[location.index].imm;
+}
+
+bool AsmEmitter::immediate(const Location& location) const
+{
+    if(location.kind != Location::Kind::CONSTANT) return false;
+    int64_t value = constant(location);
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+MachineOperand AsmEmitter::source(const Location& location, int w) const
+{
+    switch(location.kind)
+    {
+        case Location::Kind::REGISTER: return reg(location.reg, w);
+        case Location::Kind::CONSTANT: return immediate_operand(constant(location));
+        default: return memory(location);
+    }
+}
+
+Location AsmEmitter::operand(const Location& location, Register scratch)
+{
+    if(location.kind == Location::Kind::FRAME || (location.kind == Location::Kind::CONSTANT && !immediate(location)))
+    {
+        load(location, scratch, 3);
+        return Location::in(scratch);
+    }
+    return location;
+}
+
+void AsmEmitter::load(const Location& location, Register r, int w)
+{
+    w = std::max(w, 2);
+    switch(location.kind)
+    {
+        case Location::Kind::REGISTER:
+            if(location.reg == r) return;
+            break;
+        case Location::Kind::FRAME:
+            append("leaq", {memory(location), reg(r, 3)});
+            return;
+        case Location::Kind::CONSTANT:
+            if(!immediate(location))
+            {
+                append("movabsq", {immediate_operand(constant(location)), reg(r, 3)});
+                return;
+            }
+            break;
+        default:
+            break;
+    }
+    append(sized("mov", w), {source(location, w), reg(r, w)});
+}
+
+void AsmEmitter::store(Register r, const Location& location, int w)
+{
+    if(location.kind == Location::Kind::REGISTER)
+    {
+        load(Location::in(r), location.reg, w);
+    }
+    else if(location.kind == Location::Kind::STACK)
+    {
+        // (Spill slots hold whole registers.)
+        append("movq", {reg(r, 3), memory(location)});
+    }
+}
+
+void AsmEmitter::move(const Location& from, const Location& to)
+{
+    if(from == to) return;
+    if(to.kind == Location::Kind::REGISTER)
+    {
+        load(from, to.reg, 3);
+    }
+    else if(from.kind == Location::Kind::REGISTER)
+    {
+        store(from.reg, to, 3);
+    }
+    else if(immediate(from))
+    {
+        append("movq", {immediate_operand(constant(from)), memory(to)});
+    }
+    else
+    {
+        load(from, Register::R11, 3);
+        store(Register::R11, to, 3);
+    }
+}
+
+// Do a set of moves as if they were simultaneous. A move is done once its destination is
+// not the source of another move; when every destination is (the moves form cycles), one
+// destination is saved in rax, and read from there instead.
+void AsmEmitter::parallel_move(std::vector<std::pair<Location, Location>>& moves)
+{
+    moves.erase(
+        std::remove_if(moves.begin(), moves.end(), [](const std::pair<Location, Location>& m)
+        {
+            return m.first == m.second || m.second.kind == Location::Kind::NONE;
+        }),
+        moves.end()
+    );
+    while(!moves.empty())
+    {
+        size_t ready = moves.size();
+        for(size_t i = 0;i < moves.size() && ready == moves.size();i++)
+        {
+            bool blocked = false;
+            for(size_t j = 0;j < moves.size() && !blocked;j++)
+            {
+                blocked = j != i && moves[j].first == moves[i].second;
+            }
+            if(!blocked) ready = i;
+        }
+        if(ready == moves.size())
+        {
+            Location saved = moves[0].second;
+            move(saved, Location::in(Register::RAX));
+            for(auto& m : moves)
+            {
+                if(m.first == saved) m.first = Location::in(Register::RAX);
+            }
+            ready = 0;
+        }
+        move(moves[ready].first, moves[ready].second);
+        moves[ready] = moves.back();
+        moves.pop_back();
+    }
+}
+
+void AsmEmitter::moves(IrValue gap)
+{
+    const Move * first = allocation->moves_begin(gap), * last = allocation->moves_end(gap);
+    std::vector<std::pair<Location, Location>> phase;
+    while(first != last)
+    {
+        uint8_t current = first->phase;
+        phase.clear();
+        for(;first != last && first->phase == current;first++)
+        {
+            phase.push_back({first->from, first->to});
+        }
+        parallel_move(phase);
+    }
+}
+
+std::string AsmEmitter::label(IrBlockId block) const
+{
+    return local_label(".L", functions, block);
+}
+
+const std::string& AsmEmitter::symbol(int index) const
+{
+    return module.symbols[index].name;
+}
+
+int AsmEmitter::rule(IrValue node, IselNonTerminal nt) const
+{
+    return selector->rule(node, nt, root);
+}
+
+std::vector<IselKid> AsmEmitter::kids(IrValue node, IselNonTerminal nt) const
+{
+    std::vector<IselKid> leaves;
+    selector->kids(node, rule(node, nt), leaves);
+    return leaves;
+}
+
+Location AsmEmitter::leaf(IrValue value) const
+{
+    return allocation->location(value, 4 * root);
+}
+
+AsmAddress AsmEmitter::address(IrValue node)
+{
+    AsmAddress result;
+    address(node, ISEL_ADDR, result);
+    return result;
+}
+
+void AsmEmitter::address(IrValue node, IselNonTerminal nt, AsmAddress& result)
+{
+    // Registers are the base of an 'addr', and the index of an 'index'.
+    int64_t factor = 0;
+    for(const IselKid& kid : kids(node, nt))
+    {
+        int64_t imm = function->instrs[kid.value].imm;
+        switch(kid.nt)
+        {
+            case ISEL_REG: (nt == ISEL_INDEX ? result.index : result.base) = leaf(kid.value); break;
+            case ISEL_INDEX: address(kid.value, ISEL_INDEX, result); break;
+            case ISEL_IMM: result.displacement += imm; break;
+            case ISEL_SYMBOL: result.symbol = static_cast<int>(imm); break;
+            case ISEL_SCALE: result.scale = static_cast<int>(imm); break;
+            case ISEL_SHIFT: result.scale = 1 << imm; break;
+            case ISEL_FACTOR: factor = imm; break;
+            default: break;
+        }
+    }
+
+    // 'x * 3' is 'x + x * 2'.
+    if(factor != 0)
+    {
+        result.index = result.base;
+        result.scale = static_cast<int>(factor - 1);
+    }
+}
+
+AsmOperand AsmEmitter::use(IrValue node)
+{
+    AsmOperand result;
+    if(IselRules[rule(node, ISEL_OPERAND)].chain == ISEL_MEM)
+    {
+        result.memory = true;
+        result.address = address(kids(node, ISEL_MEM)[0].value);
+    }
+    else
+    {
+        result.location = leaf(node);
+    }
+    return result;
+}
+
+void AsmEmitter::prepare(AsmAddress& a)
+{
+    // Constants and stack objects are displacements (from rbp).
+    uint64_t displacement = static_cast<uint64_t>(a.displacement);
+    if(a.base.kind == Location::Kind::CONSTANT)
+    {
+        displacement += static_cast<uint64_t>(constant(a.base));
+        a.base = Location();
+    }
+    else if(a.base.kind == Location::Kind::FRAME)
+    {
+        displacement -= static_cast<uint64_t>(static_cast<int64_t>(frame_offsets[a.base.index]));
+        a.base = Location::in(Register::RBP);
+    }
+    if(a.index.kind == Location::Kind::CONSTANT)
+    {
+        displacement += static_cast<uint64_t>(constant(a.index)) * a.scale;
+        a.index = Location();
+    }
+    a.displacement = static_cast<int64_t>(displacement);
+    if(a.symbol >= 0) return;
+
+    bool fits = a.displacement >= INT32_MIN && a.displacement <= INT32_MAX;
+    bool base = a.base.kind == Location::Kind::NONE || a.base.kind == Location::Kind::REGISTER;
+    bool index = a.index.kind == Location::Kind::NONE || a.index.kind == Location::Kind::REGISTER;
+    bool absolute = a.base.kind == Location::Kind::NONE && a.index.kind == Location::Kind::NONE;
+    if(fits && !absolute && (base || index))
+    {
+        Location& other = base ? a.index : a.base;
+        if(other.kind != Location::Kind::NONE && other.kind != Location::Kind::REGISTER)
+        {
+            load(other, Register::R11, 3);
+            other = Location::in(Register::R11);
+        }
+        return;
+    }
+
+    // Otherwise compute the address in r11: index * scale, then the base, then the
+    // displacement (if it does not fit in 32 bits).
+    bool started = false;
+    if(a.index.kind != Location::Kind::NONE)
+    {
+        load(a.index, Register::R11, 3);
+        int shift = a.scale == 8 ? 3 : a.scale == 4 ? 2 : a.scale == 2 ? 1 : 0;
+        if(shift > 0) append("shlq", {immediate_operand(shift), reg(Register::R11, 3)});
+        started = true;
+    }
+    if(a.base.kind != Location::Kind::NONE)
+    {
+        if(started)
+        {
+            append("addq", {source(a.base, 3), reg(Register::R11, 3)});
+        }
+        else
+        {
+            load(a.base, Register::R11, 3);
+        }
+        started = true;
+    }
+    if(!fits || !started)
+    {
+        if(started)
+        {
+            append("pushq", {reg(Register::RAX, 3)});
+            append("movabsq", {immediate_operand(a.displacement), reg(Register::RAX, 3)});
+            append("addq", {reg(Register::RAX, 3), reg(Register::R11, 3)});
+            append("popq", {reg(Register::RAX, 3)});
+        }
+        else
+        {
+            append(fits ? "movq" : "movabsq", {immediate_operand(a.displacement), reg(Register::R11, 3)});
+        }
+        a.displacement = 0;
+    }
+    a.base = Location::in(Register::R11);
+    a.index = Location();
+    a.scale = 1;
+}
+
+MachineOperand AsmEmitter::indirect(const AsmAddress& a) const
+{
+    if(a.symbol >= 0)
+    {
+        MachineOperand result = MachineOperand::memory(RipRegister, a.displacement);
+        result.symbol = symbol(a.symbol);
+        return result;
+    }
+    bool index = a.index.kind == Location::Kind::REGISTER;
+    return MachineOperand::memory(
+        a.base.kind == Location::Kind::REGISTER ? static_cast<int>(a.base.reg) : -1,
+        a.displacement,
+        index ? static_cast<int>(a.index.reg) : -1,
+        index ? a.scale : 1
+    );
+}
+
+// Destination register of an instruction: its result register, or rax.
+static Register destination(const Location& result)
+{
+    return result.kind == Location::Kind::REGISTER ? result.reg : Register::RAX;
+}
+
+// Does an operand read a register?
+static bool reads(const AsmOperand& operand, Register r)
+{
+    if(!operand.memory) return operand.location == Location::in(r);
+    return operand.address.base == Location::in(r) || operand.address.index == Location::in(r);
+}
+
+void AsmEmitter::load_value(IrValue value)
+{
+    const IrInstr& instr = function->instrs[value];
+    IrValue loaded = instr.op == IrOp::LOAD ? value : function->operand(value, 0);
+    int from = width(function->instrs[loaded].type), to = width(instr.type);
+    Location result = allocation->result(value);
+    Register d = destination(result);
+    AsmAddress a = address(kids(value, ISEL_REG)[0].value);
+    prepare(a);
+
+    int w = to;
+    std::string mnemonic;
+    if(instr.op == IrOp::SEXT)
+    {
+        mnemonic = sized("movs", from) + Suffixes[to];
+    }
+    else if(from < 2)
+    {
+        // (A zero-extending load also zeroes the upper half of the register.)
+        mnemonic = sized("movz", from) + 'l';
+        w = 2;
+    }
+    else
+    {
+        mnemonic = sized("mov", from);
+        w = from;
+    }
+    append(std::move(mnemonic), {indirect(a), reg(d, w)});
+    store(d, result, to);
+}
+
+void AsmEmitter::store_value(IrValue value)
+{
+    std::vector<IselKid> leaves = kids(value, ISEL_STMT);
+    int w = width(function->instrs[function->operand(value, 1)].type);
+    Location stored = leaf(leaves[1].value);
+    if(stored.kind != Location::Kind::REGISTER && !immediate(stored))
+    {
+        load(stored, Register::RAX, 3);
+        stored = Location::in(Register::RAX);
+    }
+    AsmAddress to = address(leaves[0].value);
+    prepare(to);
+    append(sized("mov", w), {source(stored, w), indirect(to)});
+}
+
+void AsmEmitter::update(IrValue value)
+{
+    static const char * const mnemonics[] = {"add", "sub", "and", "or", "xor"};
+    IrValue stored = function->operand(value, 1);
+    IrType type = function->instrs[stored].type;
+    if(function->instrs[stored].op == IrOp::TRUNC) stored = function->operand(stored, 0);
+    IrOp op = function->instrs[stored].op;
+    int w = width(type);
+
+    // 'op x, (address)': x is the leaf which is not loaded.
+    std::vector<IselKid> leaves = kids(value, ISEL_STMT);
+    IselKid x = leaves[1].nt == ISEL_REG ? leaves[1] : leaves[2];
+    Location source_location = leaf(x.value);
+    if(source_location.kind != Location::Kind::REGISTER && !immediate(source_location))
+    {
+        load(source_location, Register::RAX, 3);
+        source_location = Location::in(Register::RAX);
+    }
+    AsmAddress to = address(leaves[0].value);
+    prepare(to);
+
+    int mnemonic = op == IrOp::ADD ? 0 : op == IrOp::SUB ? 1 : op == IrOp::AND ? 2 : op == IrOp::OR ? 3 : 4;
+    MachineOperand x_operand = source_location.kind == Location::Kind::CONSTANT
+        ? immediate_operand(ir_wrap(type, constant(source_location)))
+        : reg(source_location.reg, w);
+    append(sized(mnemonics[mnemonic], w), {x_operand, indirect(to)});
+}
+
+void AsmEmitter::binary(IrValue value)
+{
+    static const char * const mnemonics[] = {"add", "sub", "imul"};
+    const IrInstr& instr = function->instrs[value];
+    int w = arithmetic_width(instr.type);
+    Location result = allocation->result(value);
+    std::vector<IselKid> leaves = kids(value, ISEL_REG);
+    AsmOperand a = use(leaves[0].value), b = use(leaves[1].value);
+
+    // Two-address form: d = a; d op= b. b is memory if either is (unless both are), and
+    // must not be in d (unless a is too).
+    Register d = destination(result);
+    bool in_place = !a.memory && a.location == result;
+    if(instr.op != IrOp::SUB && ((a.memory && !b.memory)
+        || (!a.memory && !b.memory && (a.location.kind == Location::Kind::CONSTANT || (b.location == result && !in_place)))))
+    {
+        std::swap(a, b);
+        in_place = !a.memory && a.location == result;
+    }
+    if(!in_place && reads(b, d)) d = Register::RAX;
+
+    if(a.memory)
+    {
+        prepare(a.address);
+        append(sized("mov", w), {indirect(a.address), reg(d, w)});
+    }
+    else
+    {
+        load(a.location, d, w);
+    }
+    if(b.memory)
+        prepare(b.address);
+    else
+        b.location = operand(b.location, Register::R11);
+
+    const char * mnemonic = "and";
+    switch(instr.op)
+    {
+        case IrOp::ADD: case IrOp::SUB: case IrOp::MUL:
+            mnemonic = mnemonics[static_cast<int>(instr.op) - static_cast<int>(IrOp::ADD)];
+            break;
+        case IrOp::OR: mnemonic = "or"; break;
+        case IrOp::XOR: mnemonic = "xor"; break;
+        default: break;
+    }
+    append(sized(mnemonic, w), {b.memory ? indirect(b.address) : source(b.location, w), reg(d, w)});
+    store(d, result, w);
+}
+
+void AsmEmitter::lea(IrValue value)
+{
+    int w = arithmetic_width(function->instrs[value].type);
+    Location result = allocation->result(value);
+    Register d = destination(result);
+    AsmAddress a = address(value);
+    prepare(a);
+    append(sized("lea", w), {indirect(a), reg(d, w)});
+    store(d, result, w);
+}
+
+void AsmEmitter::divide(IrValue value)
+{
+    const IrInstr& instr = function->instrs[value];
+    int w = arithmetic_width(instr.type);
+    bool is_signed = instr.op == IrOp::SDIV || instr.op == IrOp::SREM;
+
+    // rdx:rax / divisor; quotient in rax, remainder in rdx. (The allocator keeps rdx free.)
+    load(allocation->operand(value, 0), Register::RAX, w);
+    if(is_signed)
+        append(w == 3 ? "cqto" : "cltd");
+    else
+        append("xorl", {reg(Register::RDX, 2), reg(Register::RDX, 2)});
+
+    Location b = allocation->operand(value, 1);
+    if(b.kind == Location::Kind::CONSTANT || b.kind == Location::Kind::FRAME)
+    {
+        load(b, Register::R11, w);
+        b = Location::in(Register::R11);
+    }
+    append(sized(is_signed ? "idiv" : "div", w), {source(b, w)});
+
+    bool remainder = instr.op == IrOp::SREM || instr.op == IrOp::UREM;
+    store(remainder ? Register::RDX : Register::RAX, allocation->result(value), w);
+}
+
+void AsmEmitter::shift(IrValue value)
+{
+    const IrInstr& instr = function->instrs[value];
+    int w = arithmetic_width(instr.type);
+    const char * mnemonic = instr.op == IrOp::SHL ? "shl" : instr.op == IrOp::SAR ? "sar" : "shr";
+    Location result = allocation->result(value);
+    Location count = allocation->operand(value, 1);
+    Register d = destination(result);
+
+    if(count.kind != Location::Kind::CONSTANT)
+    {
+        // Variable counts are in cl. (The allocator keeps rcx free.)
+        load(count, Register::RCX, 2);
+        if(d == Register::RCX) d = Register::RAX;
+    }
+    load(allocation->operand(value, 0), d, w);
+    MachineOperand count_operand = count.kind == Location::Kind::CONSTANT
+        ? immediate_operand(constant(count) & (w == 3 ? 63 : 31))
+        : reg(Register::RCX, 0);
+    append(sized(mnemonic, w), {count_operand, reg(d, w)});
+    store(d, result, w);
+}
+
+IrOp AsmEmitter::flags(IrValue value)
+{
+    return IselRules[rule(value, ISEL_COND)].action == IselAction::TEST ? test(value) : compare(value);
+}
+
+IrOp AsmEmitter::compare(IrValue value)
+{
+    IrOp op = function->instrs[value].op;
+    int w = arithmetic_width(function->instrs[function->operand(value, 0)].type);
+    std::vector<IselKid> leaves = kids(value, ISEL_COND);
+    AsmOperand a = use(leaves[0].value), b = use(leaves[1].value);
+    auto constant_operand = [](const AsmOperand& operand)
+    {
+        return !operand.memory && operand.location.kind == Location::Kind::CONSTANT;
+    };
+    if((constant_operand(a) && !constant_operand(b)) || (b.memory && !a.memory && a.location.kind != Location::Kind::REGISTER))
+    {
+        std::swap(a, b);
+        op = swap_operands(op);
+    }
+
+    // 'cmp b, a' needs a in a register or memory, and b in a register or an immediate (or
+    // memory, if a is in a register).
+    if(a.memory)
+    {
+        if(b.memory)
+        {
+            prepare(a.address);
+            append(sized("mov", w), {indirect(a.address), reg(Register::RAX, w)});
+            a = AsmOperand();
+            a.location = Location::in(Register::RAX);
+        }
+        else if(b.location.kind != Location::Kind::REGISTER && !immediate(b.location))
+        {
+            load(b.location, Register::RAX, w);
+            b.location = Location::in(Register::RAX);
+        }
+    }
+    else if(a.location.kind != Location::Kind::REGISTER
+        && (a.location.kind != Location::Kind::STACK || b.location.kind == Location::Kind::STACK))
+    {
+        load(a.location, Register::RAX, w);
+        a.location = Location::in(Register::RAX);
+    }
+    if(a.memory) prepare(a.address);
+    if(b.memory)
+        prepare(b.address);
+    else
+        b.location = operand(b.location, Register::R11);
+
+    append(sized("cmp", w), {
+        b.memory ? indirect(b.address) : source(b.location, w),
+        a.memory ? indirect(a.address) : source(a.location, w)
+    });
+    return op;
+}
+
+IrOp AsmEmitter::test(IrValue value)
+{
+    // 'x & y == 0' (or '!= 0'): test y, x.
+    int w = arithmetic_width(function->instrs[function->operand(value, 0)].type);
+    std::vector<Location> masks;
+    for(const IselKid& kid : kids(value, ISEL_COND))
+    {
+        if(kid.nt == ISEL_REG) masks.push_back(leaf(kid.value));
+    }
+    Location x = masks[0], y = masks[1];
+    if(x.kind != Location::Kind::REGISTER && (y.kind == Location::Kind::REGISTER || x.kind == Location::Kind::CONSTANT))
+    {
+        std::swap(x, y);
+    }
+    if(x.kind != Location::Kind::REGISTER)
+    {
+        load(x, Register::RAX, w);
+        x = Location::in(Register::RAX);
+    }
+    y = operand(y, Register::R11);
+    append(sized("test", w), {source(y, w), reg(x.reg, w)});
+    return function->instrs[value].op;
+}
+
+void AsmEmitter::set(IrValue value)
+{
+    Location result = allocation->result(value);
+    Register d = destination(result);
+    IrOp op = flags(value);
+    append(std::string("set") + condition(op), {reg(Register::RAX, 0)});
+    append("movzbl", {reg(Register::RAX, 0), reg(d, 2)});
+    store(d, result, 2);
+}
+
+void AsmEmitter::select(IrValue value)
+{
+    const IrInstr& instr = function->instrs[value];
+    int w = arithmetic_width(instr.type);
+    Location result = allocation->result(value);
+    IrValue condition_value = function->operand(value, 0);
+    IrOp op = IrOp::NE;
+    if(IselRules[rule(value, ISEL_REG)].action == IselAction::SELECT)
+    {
+        op = flags(condition_value);
+    }
+    else
+    {
+        Location test = allocation->operand(value, 0);
+        int t = arithmetic_width(function->instrs[condition_value].type);
+        if(test.kind == Location::Kind::CONSTANT || test.kind == Location::Kind::FRAME)
+        {
+            bool taken = test.kind == Location::Kind::FRAME || constant(test) != 0;
+            move(allocation->operand(value, taken ? 1 : 2), result);
+            return;
+        }
+        if(test.kind == Location::Kind::REGISTER)
+            append(sized("test", t), {reg(test.reg, t), reg(test.reg, t)});
+        else
+            append(sized("cmp", t), {immediate_operand(0), memory(test)});
+    }
+
+    // d = b; if(condition) d = a. (mov leaves the flags alone.) If a is already in d, the
+    // condition is inverted instead.
+    Register d = destination(result);
+    Location a = allocation->operand(value, 1), b = allocation->operand(value, 2);
+    if(a == Location::in(d) && b != Location::in(d))
+    {
+        std::swap(a, b);
+        op = invert(op);
+    }
+    load(b, d, w);
+    if(a.kind == Location::Kind::CONSTANT || a.kind == Location::Kind::FRAME)
+    {
+        load(a, Register::R11, w);
+        a = Location::in(Register::R11);
+    }
+    append(std::string("cmov") + condition(op), {a.kind == Location::Kind::REGISTER ? reg(a.reg, w) : memory(a), reg(d, w)});
+    store(d, result, w);
+}
+
+void AsmEmitter::extend(IrValue value)
+{
+    const IrInstr& instr = function->instrs[value];
+    Location result = allocation->result(value);
+    Location a = allocation->operand(value, 0);
+    int from = width(function->instrs[function->operand(value, 0)].type);
+    int to = width(instr.type);
+    Register d = destination(result);
+    if(a.kind == Location::Kind::CONSTANT || a.kind == Location::Kind::FRAME)
+    {
+        load(a, Register::RAX, 3);
+        a = Location::in(Register::RAX);
+    }
+
+    std::string mnemonic;
+    if(instr.op == IrOp::SEXT)
+    {
+        mnemonic = sized("movs", from) + Suffixes[to];
+    }
+    else if(instr.op == IrOp::ZEXT && from < 2)
+    {
+        mnemonic = sized("movz", from) + 'l';
+    }
+    else
+    {
+        // (A doubleword move zeroes the upper half of the register.)
+        from = 2;
+        mnemonic = "movl";
+    }
+    append(std::move(mnemonic), {source(a, from), reg(d, instr.op == IrOp::SEXT ? to : 2)});
+    store(d, result, to);
+}
+
+void AsmEmitter::vector(IrValue value)
+{
+    static const char * const mnemonics[] = {"padd", "psub", "pand", "por", "pxor"};
+    const IrInstr& instr = function->instrs[value];
+    MachineOperand xmm0 = MachineOperand::in(0, XmmWidth), xmm1 = MachineOperand::in(1, XmmWidth);
+    AsmAddress a;
+    for(int i = 1;i <= 2;i++)
+    {
+        a.base = allocation->operand(value, i);
+        prepare(a);
+        append("movdqu", {indirect(a), i == 1 ? xmm0 : xmm1});
+        a = AsmAddress();
+    }
+    std::string mnemonic = mnemonics[static_cast<int>(instr.op) - static_cast<int>(IrOp::VADD)];
+    if(instr.op == IrOp::VADD || instr.op == IrOp::VSUB)
+    {
+        // (Element size: byte, word or doubleword.)
+        mnemonic += "bwd"[width(static_cast<IrType>(instr.imm))];
+    }
+    a.base = allocation->operand(value, 0);
+    prepare(a);
+    append(std::move(mnemonic), {xmm1, xmm0});
+    append("movdqu", {xmm0, indirect(a)});
+}
+
+void AsmEmitter::call(IrValue value)
+{
+    const IrInstr& instr = function->instrs[value];
+    IrValue callee = function->operand(value, 0);
+    size_t arguments = instr.count - 1;
+    size_t stacked = arguments > 6 ? arguments - 6 : 0;
+    const IrInstr& target = function->instrs[callee];
+    bool direct = target.op == IrOp::GLOBAL && module.symbols[target.imm].function;
+
+    // Arguments after the sixth are pushed (last first), keeping the stack 16-byte aligned.
+    if(stacked % 2) append("subq", {immediate_operand(8), reg(Register::RSP, 3)});
+    for(size_t i = arguments;i > 6;i--)
+    {
+        Location argument = allocation->operand(value, i);
+        if(argument.kind == Location::Kind::STACK || immediate(argument))
+        {
+            append("pushq", {source(argument, 3)});
+        }
+        else
+        {
+            Register r = argument.kind == Location::Kind::REGISTER ? argument.reg : Register::RAX;
+            load(argument, r, 3);
+            append("pushq", {reg(r, 3)});
+        }
+    }
+    if(!direct) load(allocation->operand(value, 0), Register::R11, 3);
+
+    std::vector<std::pair<Location, Location>> registers;
+    for(size_t i = 0;i < std::min<size_t>(arguments, 6);i++)
+    {
+        registers.push_back({allocation->operand(value, i + 1), Location::in(ArgumentRegisters[i])});
+    }
+    parallel_move(registers);
+
+    // (al is the number of vector registers used by a variadic call.)
+    append("xorl", {reg(Register::RAX, 2), reg(Register::RAX, 2)});
+    if(direct)
+    {
+        std::string name = symbol(static_cast<int>(target.imm));
+        if(!module.symbols[target.imm].defined) name += "@PLT";
+        append("call", {MachineOperand::to(std::move(name))});
+    }
+    else
+    {
+        MachineOperand callee_operand = reg(Register::R11, 3);
+        callee_operand.kind = MachineOperand::Kind::INDIRECT;
+        append("call", {callee_operand});
+    }
+    if(stacked > 0) append("addq", {immediate_operand(8 * (stacked + stacked % 2)), reg(Register::RSP, 3)});
+    store(Register::RAX, allocation->result(value), arithmetic_width(instr.type));
+}
+
+void AsmEmitter::branch(IrValue value, IrBlockId next)
+{
+    const IrBlock& block = function->blocks[function->instrs[value].block];
+    IrValue condition_value = function->operand(value, 0);
+    IrOp op = IrOp::NE;
+    if(IselRules[rule(value, ISEL_STMT)].action == IselAction::BRANCH)
+    {
+        op = flags(condition_value);
+    }
+    else
+    {
+        Location test = allocation->operand(value, 0);
+        int w = arithmetic_width(function->instrs[condition_value].type);
+        if(test.kind == Location::Kind::CONSTANT || test.kind == Location::Kind::FRAME)
+        {
+            bool taken = test.kind == Location::Kind::FRAME || constant(test) != 0;
+            IrBlockId target = block.succs[taken ? 0 : 1];
+            if(target != next) jump_case("mp", target);
+            return;
+        }
+        if(test.kind == Location::Kind::REGISTER)
+            append(sized("test", w), {reg(test.reg, w), reg(test.reg, w)});
+        else
+            append(sized("cmp", w), {immediate_operand(0), memory(test)});
+    }
+
+    if(block.succs[0] == next)
+    {
+        jump_case(condition(invert(op)), block.succs[1]);
+        return;
+    }
+    jump_case(condition(op), block.succs[0]);
+    if(block.succs[1] != next) jump_case("mp", block.succs[1]);
+}
+
+std::string AsmEmitter::switch_label(int n) const
+{
+    return local_label(".LS", functions, n);
+}
+
+void AsmEmitter::compare_case(Register r, int w, int64_t value)
+{
+    if(value >= INT32_MIN && value <= INT32_MAX)
+    {
+        append(sized("cmp", w), {immediate_operand(value), reg(r, w)});
+    }
+    else
+    {
+        append("movabsq", {immediate_operand(value), reg(Register::R11, 3)});
+        append("cmpq", {reg(Register::R11, 3), reg(r, w)});
+    }
+}
+
+void AsmEmitter::jump_case(const char * condition, IrBlockId target)
+{
+    append(std::string("j") + condition, {MachineOperand::to(label(target))});
+}
+
+void AsmEmitter::dispatch(IrValue value, IrBlockId next)
+{
+    const IrInstr& instr = function->instrs[value];
+    IrType type = function->instrs[function->operand(value, 0)].type;
+    int w = arithmetic_width(type);
+    Location location = allocation->operand(value, 0);
+    Register r = location.kind == Location::Kind::REGISTER ? location.reg : Register::RAX;
+    load(location, r, w);
+
+    // (Narrow values are compared as doublewords, so they are sign-extended first.)
+    int64_t low = type == IrType::I64 ? INT64_MIN : INT32_MIN;
+    int64_t high = type == IrType::I64 ? INT64_MAX : INT32_MAX;
+    if(width(type) < 2)
+    {
+        append(sized("movs", width(type)) + 'l', {reg(r, width(type)), reg(Register::RAX, 2)});
+        r = Register::RAX;
+        low = type == IrType::I8 ? INT8_MIN : INT16_MIN;
+        high = type == IrType::I8 ? INT8_MAX : INT16_MAX;
+    }
+
+    // Cases which go to the same block have the same target (and those which go to the
+    // default's block are left to it).
+    const auto& succs = function->blocks[instr.block].succs;
+    std::vector<SwitchCase> cases;
+    for(uint32_t i = 1;i < instr.count;i++)
+    {
+        uint32_t target = std::find(succs.begin(), succs.end(), succs[i]) - succs.begin();
+        if(target > 0) cases.push_back(SwitchCase{function->instrs[function->operand(value, i)].imm, target});
+    }
+    SwitchPlan plan(cases, low, high);
+
+    // Nodes of the tree, in order, and the label of each right child (-1 for a left one,
+    // which comes straight after its parent's test).
+    std::vector<std::pair<int, int>> work{{0, -1}};
+    while(!work.empty())
+    {
+        const SwitchNode& node = plan.nodes[work.back().first];
+        int l = work.back().second;
+        work.pop_back();
+        if(l >= 0) define(switch_label(l));
+        if(node.left < 0)
+        {
+            test_clusters(value, plan, node, r, w, work.empty() ? next : IrNone);
+            continue;
+        }
+        l = switch_labels++;
+        compare_case(r, w, node.pivot);
+        append("jge", {MachineOperand::to(switch_label(l))});
+        work.push_back({node.right, l});
+        work.push_back({node.left, -1});
+    }
+}
+
+void AsmEmitter::test_clusters(IrValue value, const SwitchPlan& plan, const SwitchNode& node, Register r, int w, IrBlockId next)
+{
+    const auto& succs = function->blocks[function->instrs[value].block].succs;
+    int64_t low = node.low, high = node.high;
+    for(size_t i = node.first;i < node.last;i++)
+    {
+        const SwitchCluster& cluster = plan.clusters[i];
+        bool inside = low >= cluster.low && high <= cluster.high;
+        if(cluster.kind == SwitchClusterKind::RANGE)
+        {
+            if(inside)
+            {
+                if(succs[cluster.target] != next) jump_case("mp", succs[cluster.target]);
+                return;
+            }
+            if(cluster.low == cluster.high)
+            {
+                compare_case(r, w, cluster.low);
+                jump_case("e", succs[cluster.target]);
+            }
+            else if(low >= cluster.low)
+            {
+                compare_case(r, w, cluster.high);
+                jump_case("le", succs[cluster.target]);
+            }
+            else if(high <= cluster.high)
+            {
+                compare_case(r, w, cluster.low);
+                jump_case("ge", succs[cluster.target]);
+            }
+            else
+            {
+                append(sized("lea", w), {MachineOperand::memory(static_cast<int>(r), -cluster.low), reg(Register::R11, w)});
+                append(sized("cmp", w), {immediate_operand(cluster.high - cluster.low), reg(Register::R11, w)});
+                jump_case("be", succs[cluster.target]);
+            }
+        }
+        else
+        {
+            // Index from 0 in r11 (zero-extended, for a doubleword), after a range check
+            // which goes on to the next cluster (or to the default, after the last one).
+            bool last = i + 1 == node.last;
+            int miss = inside || last ? -1 : switch_labels++;
+            append(sized("lea", w), {MachineOperand::memory(static_cast<int>(r), -cluster.low), reg(Register::R11, w)});
+            if(!inside)
+            {
+                append(sized("cmp", w), {immediate_operand(cluster.high - cluster.low), reg(Register::R11, w)});
+                if(last)
+                    jump_case("a", succs[0]);
+                else
+                    append("ja", {MachineOperand::to(switch_label(miss))});
+            }
+            if(cluster.kind == SwitchClusterKind::TABLE)
+            {
+                std::vector<IrBlockId> table;
+                for(uint32_t target : cluster.table) table.push_back(succs[target]);
+                MachineOperand address = MachineOperand::memory(RipRegister, 0);
+                address.symbol = local_label(".LT", functions, tables.size());
+                append("leaq", {address, reg(Register::RAX, 3)});
+                MachineOperand entry = MachineOperand::memory(
+                    static_cast<int>(Register::RAX), 0, static_cast<int>(Register::R11), 8);
+                entry.kind = MachineOperand::Kind::INDIRECT;
+                append("jmp", {entry});
+                tables.push_back(std::move(table));
+            }
+            else
+            {
+                for(const auto& mask : cluster.masks)
+                {
+                    int64_t bits = static_cast<int64_t>(mask.second);
+                    if(mask.second <= UINT32_MAX)
+                        append("movl", {immediate_operand(bits), reg(Register::RAX, 2)});
+                    else if(bits >= INT32_MIN && bits <= INT32_MAX)
+                        append("movq", {immediate_operand(bits), reg(Register::RAX, 3)});
+                    else
+                        append("movabsq", {immediate_operand(bits), reg(Register::RAX, 3)});
+                    append("btq", {reg(Register::R11, 3), reg(Register::RAX, 3)});
+                    jump_case("c", succs[mask.first]);
+                }
+                if(succs[0] != next || miss >= 0) jump_case("mp", succs[0]);
+            }
+            if(miss < 0) return;
+            define(switch_label(miss));
+        }
+
+        // A cluster at the edge of the bounds narrows them.
+        if(low >= cluster.low)
+            low = cluster.high + 1;
+        else if(high <= cluster.high)
+            high = cluster.low - 1;
+    }
+    if(succs[0] != next) jump_case("mp", succs[0]);
+}
+
+void AsmEmitter::tile(IrValue value, IrBlockId next)
+{
+    const IrInstr& instr = function->instrs[value];
+    bool effect = instr.op == IrOp::STORE || ir_is_vector(instr.op) || instr.op == IrOp::CALL
+        || ir_is_terminator(instr.op);
+    if(!effect && allocation->result(value).kind == Location::Kind::NONE) return;
+
+    root = value;
+    switch(IselRules[rule(value, instr.type == IrType::VOID ? ISEL_STMT : ISEL_REG)].action)
+    {
+        case IselAction::LOAD: load_value(value); break;
+        case IselAction::STORE: store_value(value); break;
+        case IselAction::UPDATE: update(value); break;
+        case IselAction::BRANCH: branch(value, next); break;
+        case IselAction::BINARY: binary(value); break;
+        case IselAction::LEA: lea(value); break;
+        case IselAction::SET: set(value); break;
+        case IselAction::SELECT: select(value); break;
+        default: instruction(value, next); break;
+    }
+}
+
+void AsmEmitter::instruction(IrValue value, IrBlockId next)
+{
+    const IrInstr& instr = function->instrs[value];
+    Location result = allocation->result(value);
+    switch(instr.op)
+    {
+        case IrOp::CONST:
+        case IrOp::ALLOCA:
+        case IrOp::PHI:
+            // (Used in place, or set by moves.)
+            break;
+        case IrOp::PARAM:
+            if(instr.imm < 6)
+            {
+                move(Location::in(ArgumentRegisters[instr.imm]), result);
+            }
+            else
+            {
+                Register d = destination(result);
+                append("movq", {MachineOperand::memory(static_cast<int>(Register::RBP), 16 + 8 * (instr.imm - 6)), reg(d, 3)});
+                store(d, result, 3);
+            }
+            break;
+        case IrOp::GLOBAL:
+        case IrOp::LOAD: case IrOp::STORE:
+        case IrOp::ADD: case IrOp::SUB: case IrOp::MUL:
+        case IrOp::AND: case IrOp::OR: case IrOp::XOR:
+        case IrOp::EQ: case IrOp::NE: case IrOp::SLT: case IrOp::SLE: case IrOp::SGT:
+        case IrOp::SGE: case IrOp::ULT: case IrOp::ULE: case IrOp::UGT: case IrOp::UGE:
+            // (Tiles: see tile().)
+            break;
+        case IrOp::SDIV: case IrOp::UDIV: case IrOp::SREM: case IrOp::UREM:
+            divide(value);
+            break;
+        case IrOp::SHL: case IrOp::SAR: case IrOp::SHR:
+            shift(value);
+            break;
+        case IrOp::NEG:
+        case IrOp::NOT:
+        {
+            int w = arithmetic_width(instr.type);
+            Register d = destination(result);
+            load(allocation->operand(value, 0), d, w);
+            append(sized(instr.op == IrOp::NEG ? "neg" : "not", w), {reg(d, w)});
+            store(d, result, w);
+            break;
+        }
+        case IrOp::SEXT: case IrOp::ZEXT: case IrOp::TRUNC:
+            extend(value);
+            break;
+        case IrOp::SELECT:
+            select(value);
+            break;
+        case IrOp::VADD:
+        case IrOp::VSUB:
+        case IrOp::VAND:
+        case IrOp::VOR:
+        case IrOp::VXOR:
+            vector(value);
+            break;
+        case IrOp::CALL:
+            call(value);
+            break;
+        case IrOp::COPY:
+            move(allocation->operand(value, 0), result);
+            break;
+        case IrOp::JUMP:
+        {
+            IrBlockId target = function->blocks[instr.block].succs[0];
+            if(target != next) jump_case("mp", target);
+            break;
+        }
+        case IrOp::BRANCH:
+            branch(value, next);
+            break;
+        case IrOp::SWITCH:
+            dispatch(value, next);
+            break;
+        case IrOp::RET:
+            if(instr.count > 0) load(allocation->operand(value, 0), Register::RAX, arithmetic_width(function->result));
+            epilogue();
+            break;
+    }
+}
+
+void AsmEmitter::prologue(uint32_t frame_size)
+{
+    if(frame)
+    {
+        append("pushq", {reg(Register::RBP, 3)});
+        append("movq", {reg(Register::RSP, 3), reg(Register::RBP, 3)});
+    }
+    for(Register r : saved)
+    {
+        append("pushq", {reg(r, 3)});
+    }
+    if(frame_size > 0) append("subq", {immediate_operand(frame_size), reg(Register::RSP, 3)});
+}
+
+void AsmEmitter::epilogue()
+{
+    if(frame && saved.empty())
+    {
+        append("leave");
+        append("ret");
+        return;
+    }
+    if(frame)
+        append("leaq", {MachineOperand::memory(static_cast<int>(Register::RBP), -8 * static_cast<int>(saved.size())), reg(Register::RSP, 3)});
+    else if(padded)
+        append("addq", {immediate_operand(8), reg(Register::RSP, 3)});
+    for(auto r = saved.rbegin();r != saved.rend();r++)
+    {
+        append("popq", {reg(*r, 3)});
+    }
+    if(frame) append("popq", {reg(Register::RBP, 3)});
+    append("ret");
+}
+
+void AsmEmitter::emit(IrFunction& f)
+{
+    LinearScan::prepare(f);
+    InstructionSelector selection(f, module);
+    LinearScan scan(f, &selection);
+    function = &f;
+    selector = &selection;
+    allocation = &scan;
+    size_t count = f.instrs.size();
+
+    saved.clear();
+    for(Register r : LinearScan::Allocatable)
+    {
+        if(is_callee_saved(r) && scan.used(r)) saved.push_back(r);
+    }
+
+    // Stack objects, then spill slots, below the saved registers.
+    bool calls = false;
+    frame = scan.spill_slots() > 0;
+    frame_offsets.assign(count, 0);
+    int32_t offset = 8 * static_cast<int32_t>(saved.size());
+    for(IrValue value = 0;value < count;value++)
+    {
+        const IrInstr& instr = f.instrs[value];
+        if(instr.op == IrOp::ALLOCA)
+        {
+            int32_t align = 8;
+            while(align > 1 && instr.imm % align != 0) align /= 2;
+            offset = (offset + static_cast<int32_t>(instr.imm) + align - 1) / align * align;
+            frame_offsets[value] = offset;
+            frame = true;
+        }
+        else if(instr.op == IrOp::PARAM && instr.imm >= 6 && scan.result(value).kind != Location::Kind::NONE)
+        {
+            frame = true;
+        }
+        else if(instr.op == IrOp::CALL)
+        {
+            calls = true;
+            frame = frame || instr.count > 7;
+        }
+    }
+    slot_base = offset;
+    offset += 8 * static_cast<int32_t>(scan.spill_slots());
+    uint32_t frame_size = frame ? (offset + 15) / 16 * 16 - 8 * saved.size() : 0;
+    padded = !frame && calls && saved.size() % 2 == 0;
+    if(padded) frame_size = 8;
+
+    directive(".text");
+    if(!is_local(f.name)) directive(".globl", f.name);
+    directive(".type", f.name + ", @function");
+    define(f.name);
+    prologue(frame_size);
+    for(IrBlockId b = 0;b < f.blocks.size();b++)
+    {
+        define(label(b));
+        IrBlockId next = b + 1 < f.blocks.size() ? b + 1 : IrNone;
+        for(IrValue value : f.blocks[b].code)
+        {
+            moves(value);
+            if(!selection.folded(value)) tile(value, next);
+        }
+    }
+    directive(".size", f.name + ", .-" + f.name);
+    for(size_t t = 0;t < tables.size();t++)
+    {
+        directive(".data");
+        directive(".balign", "8");
+        define(local_label(".LT", functions, t));
+        for(IrBlockId target : tables[t])
+        {
+            directive(".quad", label(target));
+        }
+    }
+    tables.clear();
+    switch_labels = 0;
+    write_code(true);
+
+    functions++;
+    function = nullptr;
+    selector = nullptr;
+    allocation = nullptr;
+    root = IrNone;
+}
+
+void AsmEmitter::emit_data()
+{
+    for(size_t i = 0;i < module.symbols.size();i++)
+    {
+        const IrSymbol& object = module.symbols[i];
+        if(object.function || !object.defined) continue;
+
+        bool initialised = !object.data.empty() || object.reference >= 0;
+        directive(initialised ? ".data" : ".bss");
+        if(!is_local(object.name)) directive(".globl", object.name);
+        directive(".balign", std::to_string(object.align));
+        directive(".type", object.name + ", @object");
+        directive(".size", object.name + ", " + std::to_string(object.size));
+        define(object.name);
+
+        int rest = object.size;
+        if(object.reference >= 0)
+        {
+            directive(".quad", symbol(object.reference));
+            rest -= 8;
+        }
+        else if(!object.data.empty())
+        {
+            std::string text = "\"";
+            for(char c : object.data)
+            {
+                unsigned char byte = static_cast<unsigned char>(c);
+                if(byte >= ' ' && byte < 127 && c != '"' && c != '\\')
+                {
+                    text += c;
+                }
+                else
+                {
+                    text += '\\';
+                    text += static_cast<char>('0' + (byte >> 6));
+                    text += static_cast<char>('0' + ((byte >> 3) & 7));
+                    text += static_cast<char>('0' + (byte & 7));
+                }
+            }
+            text += '"';
+            directive(".ascii", std::move(text));
+            rest -= object.data.size();
+        }
+        if(rest > 0) directive(".zero", std::to_string(rest));
+    }
+    write_code(false);
+}
+
+void AsmEmitter::emit_module(IrModule& m)
+{
+    for(auto& f : m.functions)
+    {
+        emit(*f);
+    }
+    emit_data();
+    directive(".section", ".note.GNU-stack,\"\",@progbits");
+    write_code(false);
+}
@@ -8,4 +8,9 @@ void ErrorReporter::report_error(int line, const std::string& error)
 
 ErrorReporter::~ErrorReporter()
 {
-}
\ No newline at end of file
+}
+
+void DiagnosticBuffer::report_error(int line, const std::string& error)
+{
+    errors.push_back({line, error});
+}
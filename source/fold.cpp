@@ -0,0 +1,672 @@
+#include <cctype>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <cstdint>
+
+#include "ast.h"
+#include "fold.h"
+#include "token.h"
+
+std::string parse_string_literal(const std::string& lexeme)
+{
+    static const char Simple[] = "n\nt\tr\ra\ab\bf\fv\v";
+    std::string value;
+    for(size_t position = 1;position + 1 < lexeme.size();position++)
+    {
+        char c = lexeme[position];
+        if(c != '\\' || position + 2 >= lexeme.size())
+        {
+            value.push_back(c);
+            continue;
+        }
+        c = lexeme[++position];
+        unsigned code = 0;
+        if(c >= '0' && c <= '7')
+        {
+            for(int digits = 0;digits < 3 && lexeme[position] >= '0' && lexeme[position] <= '7';digits++)
+            {
+                code = code * 8 + (lexeme[position++] - '0');
+            }
+            position--;
+            value.push_back(static_cast<char>(code));
+        }
+        else if(c == 'x' && std::isxdigit(static_cast<unsigned char>(lexeme[position + 1])))
+        {
+            while(std::isxdigit(static_cast<unsigned char>(lexeme[position + 1])))
+            {
+                char digit = lexeme[++position];
+                code = code * 16 + (std::isdigit(static_cast<unsigned char>(digit)) ? digit - '0' : (digit | 0x20) - 'a' + 10);
+            }
+            value.push_back(static_cast<char>(code));
+        }
+        else
+        {
+            const char * simple = c ? std::strchr(Simple, c) : nullptr;
+            value.push_back(simple && (simple - Simple) % 2 == 0 ? simple[1] : c);
+        }
+    }
+    return value;
+}
+
+bool parse_integer_constant(const std::string& lexeme, IntegerConstant& value)
+{
+    size_t position = 0;
+    bool negative = false;
+    if(position < lexeme.size() && lexeme[position] == '-')
+    {
+        negative = true;
+        position++;
+    }
+
+    int base = 10;
+    if(lexeme.compare(position, 2, "0x") == 0 || lexeme.compare(position, 2, "0X") == 0)
+    {
+        base = 16;
+        position += 2;
+    }
+    else if(position < lexeme.size() && lexeme[position] == '0')
+    {
+        base = 8;
+    }
+
+    uint64_t magnitude = 0;
+    size_t digits = 0;
+    for(;position < lexeme.size();position++, digits++)
+    {
+        char c = lexeme[position];
+        int digit;
+        if(c >= '0' && c <= '9') digit = c - '0';
+        else if(c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else if(c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        else break;
+
+        if(digit >= base) return false;
+        magnitude = magnitude * base + digit;
+        if(magnitude > UINT32_MAX) return false;
+    }
+    if(digits == 0) return false;
+
+    bool suffix = false;
+    if(position < lexeme.size() && (lexeme[position] == 'u' || lexeme[position] == 'U'))
+    {
+        suffix = true;
+        position++;
+    }
+    if(position != lexeme.size()) return false;
+
+    // The type of an integer constant is the first of the list in which its value
+    // can be represented (6.4.4.1, 5). Decimal constants that do not fit in int would
+    // be long int, which is not supported yet.
+    if(negative)
+    {
+        if(suffix || base != 10 || magnitude > 0x80000000u) return false;
+        value = IntegerConstant{static_cast<uint32_t>(-magnitude), false};
+        return true;
+    }
+    if(suffix)
+    {
+        value = IntegerConstant{static_cast<uint32_t>(magnitude), true};
+        return true;
+    }
+    if(magnitude <= INT32_MAX)
+    {
+        value = IntegerConstant{static_cast<uint32_t>(magnitude), false};
+        return true;
+    }
+    if(base == 10) return false;
+    value = IntegerConstant{static_cast<uint32_t>(magnitude), true};
+    return true;
+}
+
+// Get the value of an integer constant primary expression.
+static bool constant_value(const std::shared_ptr<ExprAstNode>& node, IntegerConstant& value)
+{
+    auto primary = std::dynamic_pointer_cast<PrimaryExprAstNode>(node);
+    if(!primary || primary->token->type != TOK_INTEGER_CONSTANT)
+        return false;
+    return parse_integer_constant(primary->token->lexeme, value);
+}
+
+// Create a constant primary expression. Line/position information is taken from the
+// (constant) expression that produced the value.
+static std::shared_ptr<ExprAstNode> make_constant(const std::shared_ptr<ExprAstNode>& origin, IntegerConstant value)
+{
+    auto token = std::static_pointer_cast<PrimaryExprAstNode>(origin)->token;
+    std::string lexeme = value.is_unsigned
+        ? std::to_string(value.bits) + "u"
+        : std::to_string(value.as_signed());
+    return std::make_shared<PrimaryExprAstNode>(
+        std::make_shared<Token>(TOK_INTEGER_CONSTANT, token->line, token->position, lexeme)
+    );
+}
+
+static IntegerConstant make_int(bool b)
+{
+    return IntegerConstant{b ? 1u : 0u, false};
+}
+
+// Evaluate a binary expression with constant operands. Returns false if the result is
+// undefined (signed overflow, division by zero, out-of-range shifts), so that the
+// expression is left for later stages to diagnose.
+static bool evaluate_binary(BinaryType op, IntegerConstant l, IntegerConstant r, IntegerConstant& out)
+{
+    // Usual arithmetic conversions (6.3.1.8). Both operands are already int or
+    // unsigned int, so no integer promotion is needed.
+    bool is_unsigned = l.is_unsigned || r.is_unsigned;
+    int64_t sl = l.as_signed(), sr = r.as_signed();
+
+    auto signed_result = [&out](int64_t v) {
+        if(v < INT32_MIN || v > INT32_MAX) return false;
+        out = IntegerConstant{static_cast<uint32_t>(v), false};
+        return true;
+    };
+    auto unsigned_result = [&out](uint32_t v) {
+        out = IntegerConstant{v, true};
+        return true;
+    };
+
+    switch(op)
+    {
+        case BinaryType::ADD:
+            return is_unsigned ? unsigned_result(l.bits + r.bits) : signed_result(sl + sr);
+        case BinaryType::SUB:
+            return is_unsigned ? unsigned_result(l.bits - r.bits) : signed_result(sl - sr);
+        case BinaryType::MUL:
+            return is_unsigned ? unsigned_result(l.bits * r.bits) : signed_result(sl * sr);
+        case BinaryType::DIV:
+            if(r.is_zero()) return false;
+            return is_unsigned ? unsigned_result(l.bits / r.bits) : signed_result(sl / sr);
+        case BinaryType::MOD:
+            if(r.is_zero()) return false;
+            if(is_unsigned) return unsigned_result(l.bits % r.bits);
+            if(sl == INT32_MIN && sr == -1) return false;
+            return signed_result(sl % sr);
+        case BinaryType::SHIFT_LEFT:
+        case BinaryType::SHIFT_RIGHT:
+            {
+                // The result has the type of the promoted left operand (6.5.7, 3).
+                int64_t count = r.is_unsigned ? r.bits : sr;
+                if(count < 0 || count >= 32) return false;
+                if(l.is_unsigned)
+                {
+                    return unsigned_result(op == BinaryType::SHIFT_LEFT
+                        ? l.bits << count
+                        : l.bits >> count);
+                }
+                if(op == BinaryType::SHIFT_LEFT)
+                {
+                    if(sl < 0) return false;
+                    return signed_result(sl << count);
+                }
+                // Right shift of a negative value is implementation-defined. Use an
+                // arithmetic shift, like GCC.
+                return signed_result(sl >> count);
+            }
+        case BinaryType::LT:
+            out = make_int(is_unsigned ? l.bits < r.bits : sl < sr);
+            return true;
+        case BinaryType::GT:
+            out = make_int(is_unsigned ? l.bits > r.bits : sl > sr);
+            return true;
+        case BinaryType::LE:
+            out = make_int(is_unsigned ? l.bits <= r.bits : sl <= sr);
+            return true;
+        case BinaryType::GE:
+            out = make_int(is_unsigned ? l.bits >= r.bits : sl >= sr);
+            return true;
+        case BinaryType::EQ:
+            out = make_int(l.bits == r.bits);
+            return true;
+        case BinaryType::NE:
+            out = make_int(l.bits != r.bits);
+            return true;
+        case BinaryType::BITWISE_AND:
+            out = IntegerConstant{l.bits & r.bits, is_unsigned};
+            return true;
+        case BinaryType::BITWISE_EXCL_OR:
+            out = IntegerConstant{l.bits ^ r.bits, is_unsigned};
+            return true;
+        case BinaryType::BITWISE_INCL_OR:
+            out = IntegerConstant{l.bits | r.bits, is_unsigned};
+            return true;
+        case BinaryType::LOGICAL_AND_OP:
+            out = make_int(!l.is_zero() && !r.is_zero());
+            return true;
+        case BinaryType::LOGICAL_OR_OP:
+            out = make_int(!l.is_zero() || !r.is_zero());
+            return true;
+    }
+    return false;
+}
+
+// Evaluate a unary expression with a constant operand.
+static bool evaluate_unary(UnaryType op, IntegerConstant v, IntegerConstant& out)
+{
+    switch(op)
+    {
+        case UnaryType::PLUS:
+            out = v;
+            return true;
+        case UnaryType::MINUS:
+            if(!v.is_unsigned && v.as_signed() == INT32_MIN) return false;
+            out = IntegerConstant{static_cast<uint32_t>(-v.bits), v.is_unsigned};
+            return true;
+        case UnaryType::COMPLEMENT:
+            out = IntegerConstant{~v.bits, v.is_unsigned};
+            return true;
+        case UnaryType::NOT:
+            out = make_int(v.is_zero());
+            return true;
+        default:
+            return false;
+    }
+}
+
+// True if the expression can only have the values 0 or 1 (of type int).
+static bool is_boolean(const std::shared_ptr<ExprAstNode>& node)
+{
+    auto binary = std::dynamic_pointer_cast<BinaryExprAstNode>(node);
+    if(binary)
+    {
+        switch(binary->op)
+        {
+            case BinaryType::LT:
+            case BinaryType::GT:
+            case BinaryType::LE:
+            case BinaryType::GE:
+            case BinaryType::EQ:
+            case BinaryType::NE:
+            case BinaryType::LOGICAL_AND_OP:
+            case BinaryType::LOGICAL_OR_OP:
+                return true;
+            default:
+                return false;
+        }
+    }
+    auto unary = std::dynamic_pointer_cast<UnaryExprAstNode>(node);
+    return unary && unary->type == UnaryType::NOT;
+}
+
+// Apply algebraic identities, where one operand is a constant of type int. (An
+// unsigned identity would convert the other operand to unsigned int.) The other operand is
+// kept under a unary +, which promotes it and makes it an rvalue, as the operator would.
+// Only operators which need arithmetic operands are simplified; x + 0 and x - 0 could be
+// pointer arithmetic, or decay an array, which + cannot stand for.
+static std::shared_ptr<ExprAstNode> simplify_binary(
+    BinaryType op,
+    const std::shared_ptr<ExprAstNode>& left,
+    const std::shared_ptr<ExprAstNode>& right)
+{
+    auto operand = [](const std::shared_ptr<ExprAstNode>& node)
+    {
+        return std::make_shared<UnaryExprAstNode>(UnaryType::PLUS, node);
+    };
+    IntegerConstant value;
+    if(constant_value(right, value) && !value.is_unsigned)
+    {
+        switch(op)
+        {
+            case BinaryType::MUL:
+            case BinaryType::DIV:
+                if(value.bits == 1) return operand(left);
+                break;
+            case BinaryType::SHIFT_LEFT:
+            case BinaryType::SHIFT_RIGHT:
+            case BinaryType::BITWISE_EXCL_OR:
+            case BinaryType::BITWISE_INCL_OR:
+                if(value.is_zero()) return operand(left);
+                break;
+            default:
+                break;
+        }
+    }
+    if(constant_value(left, value) && !value.is_unsigned)
+    {
+        switch(op)
+        {
+            case BinaryType::MUL:
+                if(value.bits == 1) return operand(right);
+                break;
+            case BinaryType::BITWISE_EXCL_OR:
+            case BinaryType::BITWISE_INCL_OR:
+                if(value.is_zero()) return operand(right);
+                break;
+            default:
+                break;
+        }
+    }
+    return nullptr;
+}
+
+ConstantFolder::ConstantFolder(int depth_limit)
+    : walker(depth_limit)
+{
+}
+
+std::shared_ptr<AstNode> ConstantFolder::fold(std::shared_ptr<AstNode> root)
+{
+    values.clear();
+    walker.walk(root, *this);
+
+    auto result = values.back();
+    values.clear();
+    return result;
+}
+
+std::shared_ptr<ExprAstNode> ConstantFolder::pop_expr()
+{
+    auto node = std::static_pointer_cast<ExprAstNode>(values.back());
+    values.pop_back();
+    return node;
+}
+
+void ConstantFolder::visit(PrimaryExprAstNode&)
+{
+    values.push_back(walker.current());
+}
+
+void ConstantFolder::visit(BinaryExprAstNode& node)
+{
+    auto right = pop_expr();
+    auto left = pop_expr();
+
+    IntegerConstant lv, rv, value;
+    bool left_constant = constant_value(left, lv);
+    bool right_constant = constant_value(right, rv);
+
+    if(left_constant && right_constant && evaluate_binary(node.op, lv, rv, value))
+    {
+        values.push_back(make_constant(left, value));
+        return;
+    }
+
+    // Short-circuit operators with a constant left operand (the right operand is not
+    // evaluated).
+    if(left_constant && node.op == BinaryType::LOGICAL_AND_OP && lv.is_zero())
+    {
+        values.push_back(make_constant(left, make_int(false)));
+        return;
+    }
+    if(left_constant && node.op == BinaryType::LOGICAL_OR_OP && !lv.is_zero())
+    {
+        values.push_back(make_constant(left, make_int(true)));
+        return;
+    }
+
+    auto simplified = simplify_binary(node.op, left, right);
+    if(simplified)
+    {
+        values.push_back(simplified);
+    }
+    else if(left != node.left || right != node.right)
+    {
+        values.push_back(std::make_shared<BinaryExprAstNode>(left, right, node.op));
+    }
+    else
+    {
+        values.push_back(walker.current());
+    }
+}
+
+void ConstantFolder::visit(UnaryExprAstNode& node)
+{
+    auto right = pop_expr();
+
+    IntegerConstant v, value;
+    if(constant_value(right, v) && evaluate_unary(node.type, v, value))
+    {
+        values.push_back((node.type == UnaryType::PLUS) ? right : make_constant(right, value));
+        return;
+    }
+
+    // !!e -> e, where e is already 0 or 1.
+    auto inner = std::dynamic_pointer_cast<UnaryExprAstNode>(right);
+    if(node.type == UnaryType::NOT && inner && inner->type == UnaryType::NOT && is_boolean(inner->right))
+    {
+        values.push_back(inner->right);
+        return;
+    }
+
+    if(right != node.right)
+    {
+        values.push_back(std::make_shared<UnaryExprAstNode>(node.type, right));
+    }
+    else
+    {
+        values.push_back(walker.current());
+    }
+}
+
+void ConstantFolder::visit(TertiaryExprAstNode& node)
+{
+    auto right = pop_expr();
+    auto left = pop_expr();
+    auto conditional = pop_expr();
+
+    // The result has the common type of the operands (6.5.15, 5), which is only known here
+    // if both are constants; otherwise the conditional is left for the type checker (and
+    // a constant branch for the optimizer).
+    IntegerConstant cv, lv, rv;
+    if(constant_value(conditional, cv) && constant_value(left, lv) && constant_value(right, rv))
+    {
+        IntegerConstant value = cv.is_zero() ? rv : lv;
+        value.is_unsigned = lv.is_unsigned || rv.is_unsigned;
+        values.push_back(make_constant(cv.is_zero() ? right : left, value));
+        return;
+    }
+
+    if(conditional != node.conditional || left != node.left || right != node.right)
+    {
+        values.push_back(std::make_shared<TertiaryExprAstNode>(conditional, left, right));
+    }
+    else
+    {
+        values.push_back(walker.current());
+    }
+}
+
+void ConstantFolder::visit(PostfixExprAstNode& node)
+{
+    std::list<std::shared_ptr<ExprAstNode>> right;
+    bool changed = false;
+    for(auto arg = node.right.rbegin();arg != node.right.rend();arg++)
+    {
+        right.push_front(pop_expr());
+        changed = changed || (right.front() != *arg);
+    }
+    auto left = pop_expr();
+    changed = changed || (left != node.left);
+
+    if(!changed)
+    {
+        values.push_back(walker.current());
+    }
+    else if(node.type == PostfixType::ARRAY || node.type == PostfixType::CALL)
+    {
+        values.push_back(std::make_shared<PostfixExprAstNode>(node.type, left, std::move(right)));
+    }
+    else if(node.type == PostfixType::PTR_OP || node.type == PostfixType::DOT)
+    {
+        values.push_back(std::make_shared<PostfixExprAstNode>(node.type, left, node.identifier));
+    }
+    else
+    {
+        values.push_back(std::make_shared<PostfixExprAstNode>(node.type, left));
+    }
+}
+
+void ConstantFolder::visit(AssignExprAstNode& node)
+{
+    auto right = pop_expr();
+    auto left = pop_expr();
+
+    if(left != node.left || right != node.right)
+    {
+        values.push_back(std::make_shared<AssignExprAstNode>(left, node.type, right));
+    }
+    else
+    {
+        values.push_back(walker.current());
+    }
+}
+
+void ConstantFolder::visit(ExprAstNode&)
+{
+    values.push_back(walker.current());
+}
+
+void ConstantFolder::visit(DeclAstNode& node)
+{
+    auto initializer = node.initializer ? pop_expr() : nullptr;
+    if(initializer != node.initializer)
+    {
+        values.push_back(std::make_shared<DeclAstNode>(node.type, node.identifier, initializer));
+    }
+    else
+    {
+        values.push_back(walker.current());
+    }
+}
+
+void ConstantFolder::visit(CompoundStmtAstNode& node)
+{
+    bool changed = false;
+    auto items = pop_list(node.items, changed);
+    if(changed)
+    {
+        values.push_back(std::make_shared<CompoundStmtAstNode>(std::move(items)));
+    }
+    else
+    {
+        values.push_back(walker.current());
+    }
+}
+
+void ConstantFolder::visit(ExprStmtAstNode& node)
+{
+    auto expr = node.expr ? pop_expr() : nullptr;
+    if(expr != node.expr)
+    {
+        values.push_back(std::make_shared<ExprStmtAstNode>(expr));
+    }
+    else
+    {
+        values.push_back(walker.current());
+    }
+}
+
+void ConstantFolder::visit(ReturnStmtAstNode& node)
+{
+    auto expr = node.expr ? pop_expr() : nullptr;
+    if(expr != node.expr)
+    {
+        values.push_back(std::make_shared<ReturnStmtAstNode>(node.token, expr));
+    }
+    else
+    {
+        values.push_back(walker.current());
+    }
+}
+
+void ConstantFolder::visit(IterationStmtAstNode& node)
+{
+    std::shared_ptr<StmtAstNode> body;
+    if(node.type != IterationType::DO)
+    {
+        auto step = node.step ? pop_expr() : nullptr;
+        body = std::static_pointer_cast<StmtAstNode>(values.back());
+        values.pop_back();
+        auto condition = node.condition ? pop_expr() : nullptr;
+        bool changed = (step != node.step || body != node.body || condition != node.condition);
+        auto init = pop_list(node.init, changed);
+        if(changed)
+        {
+            values.push_back(std::make_shared<IterationStmtAstNode>(
+                node.type, node.token, std::move(init), condition, step, body));
+            return;
+        }
+    }
+    else
+    {
+        auto condition = pop_expr();
+        body = std::static_pointer_cast<StmtAstNode>(values.back());
+        values.pop_back();
+        if(condition != node.condition || body != node.body)
+        {
+            values.push_back(std::make_shared<IterationStmtAstNode>(
+                node.type, node.token, std::list<std::shared_ptr<AstNode>>(), condition, nullptr, body));
+            return;
+        }
+    }
+    values.push_back(walker.current());
+}
+
+void ConstantFolder::visit(SwitchStmtAstNode& node)
+{
+    auto body = std::static_pointer_cast<StmtAstNode>(values.back());
+    values.pop_back();
+    auto condition = pop_expr();
+    if(condition != node.condition || body != node.body)
+    {
+        values.push_back(std::make_shared<SwitchStmtAstNode>(node.token, condition, body));
+    }
+    else
+    {
+        values.push_back(walker.current());
+    }
+}
+
+void ConstantFolder::visit(CaseStmtAstNode& node)
+{
+    auto body = std::static_pointer_cast<StmtAstNode>(values.back());
+    values.pop_back();
+    auto value = node.value ? pop_expr() : nullptr;
+    if(value != node.value || body != node.body)
+    {
+        values.push_back(std::make_shared<CaseStmtAstNode>(node.token, value, body));
+    }
+    else
+    {
+        values.push_back(walker.current());
+    }
+}
+
+void ConstantFolder::visit(JumpStmtAstNode&)
+{
+    values.push_back(walker.current());
+}
+
+void ConstantFolder::visit(FunctionDefAstNode& node)
+{
+    auto body = std::static_pointer_cast<CompoundStmtAstNode>(values.back());
+    values.pop_back();
+
+    bool changed = (body != node.body);
+    auto parameters = pop_list(node.parameters, changed);
+    auto decl = std::static_pointer_cast<DeclAstNode>(values.back());
+    values.pop_back();
+
+    if(changed || decl != node.decl)
+    {
+        values.push_back(std::make_shared<FunctionDefAstNode>(decl, std::move(parameters), body));
+    }
+    else
+    {
+        values.push_back(walker.current());
+    }
+}
+
+void ConstantFolder::visit(TranslationUnitAstNode& node)
+{
+    bool changed = false;
+    auto items = pop_list(node.items, changed);
+    if(changed)
+    {
+        values.push_back(std::make_shared<TranslationUnitAstNode>(std::move(items)));
+    }
+    else
+    {
+        values.push_back(walker.current());
+    }
+}
@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <unordered_set>
+
+#include "gvn.h"
+#include "dominators.h"
+
+// Hash and equality of the expressions computed by instructions. (Phis in different blocks
+// are different expressions.)
+struct ExpressionHash
+{
+    const IrFunction * function;
+
+    size_t operator()(IrValue value) const
+    {
+        const IrInstr& instr = function->instrs[value];
+        size_t hash = static_cast<size_t>(instr.op) * 31 + static_cast<size_t>(instr.type);
+        hash = hash * 1000003 ^ static_cast<size_t>(instr.imm);
+        if(instr.op == IrOp::PHI) hash = hash * 1000003 ^ instr.block;
+        for(IrValue operand : function->operands(value))
+        {
+            hash = hash * 1000003 ^ operand;
+        }
+        return hash;
+    }
+};
+
+struct ExpressionEqual
+{
+    const IrFunction * function;
+
+    bool operator()(IrValue a, IrValue b) const
+    {
+        const IrInstr& x = function->instrs[a];
+        const IrInstr& y = function->instrs[b];
+        if(x.op != y.op || x.type != y.type || x.imm != y.imm || x.count != y.count) return false;
+        if(x.op == IrOp::PHI && x.block != y.block) return false;
+
+        IrRange left = function->operands(a), right = function->operands(b);
+        return std::equal(left.begin(), left.end(), right.begin());
+    }
+};
+
+typedef std::unordered_set<IrValue, ExpressionHash, ExpressionEqual> ExpressionTable;
+
+// Instructions whose value depends only on their operands (and immediate).
+static bool is_pure(IrOp op)
+{
+    return op == IrOp::CONST || op == IrOp::PARAM || op == IrOp::GLOBAL
+        || (op >= IrOp::ADD && op <= IrOp::SELECT) || op == IrOp::PHI;
+}
+
+static bool is_commutative(IrOp op)
+{
+    return op == IrOp::ADD || op == IrOp::MUL || op == IrOp::AND || op == IrOp::OR
+        || op == IrOp::XOR || op == IrOp::EQ || op == IrOp::NE;
+}
+
+// Rewrite 'a > b' as 'b < a', and order the operands of commutative operations.
+static void canonicalise(IrFunction& function, IrValue value)
+{
+    IrInstr& instr = function.instrs[value];
+    bool swap = false;
+    switch(instr.op)
+    {
+        case IrOp::SGT: instr.op = IrOp::SLT; swap = true; break;
+        case IrOp::SGE: instr.op = IrOp::SLE; swap = true; break;
+        case IrOp::UGT: instr.op = IrOp::ULT; swap = true; break;
+        case IrOp::UGE: instr.op = IrOp::ULE; swap = true; break;
+        default:
+            if(is_commutative(instr.op))
+            {
+                // Constants go on the right (as they do in the code we generate).
+                IrValue left = function.operand(value, 0), right = function.operand(value, 1);
+                bool left_constant = function.instrs[left].op == IrOp::CONST;
+                bool right_constant = function.instrs[right].op == IrOp::CONST;
+                swap = left_constant != right_constant ? left_constant : left > right;
+            }
+            break;
+    }
+    if(swap)
+    {
+        IrValue left = function.operand(value, 0);
+        function.set_operand(value, 0, function.operand(value, 1));
+        function.set_operand(value, 1, left);
+    }
+}
+
+// Is an instruction 'ne c, 0', where c is already 0 or 1 (a comparison)?
+static bool is_truth_test(const IrFunction& function, IrValue value)
+{
+    const IrInstr& left = function.instrs[function.operand(value, 0)];
+    const IrInstr& right = function.instrs[function.operand(value, 1)];
+    return ir_is_comparison(left.op) && right.op == IrOp::CONST && right.imm == 0;
+}
+
+bool ValueNumbering::run(IrFunction& function)
+{
+    AnalysisCache cache(function);
+    return run(function, cache);
+}
+
+bool ValueNumbering::run(IrFunction& function, AnalysisCache& cache)
+{
+    if(function.remove_unreachable()) cache.invalidate();
+    const DominatorTree& tree = cache.dominators();
+
+    std::vector<IrValue> replacements(function.instrs.size(), IrNone);
+    auto number = [&](IrValue value)
+    {
+        while(value < replacements.size() && replacements[value] != IrNone)
+        {
+            value = replacements[value];
+        }
+        return value;
+    };
+
+    ExpressionTable available(64, ExpressionHash{&function}, ExpressionEqual{&function});
+    ExpressionTable loads(64, ExpressionHash{&function}, ExpressionEqual{&function});
+    std::vector<IrValue> log;
+    bool changed = false;
+
+    struct Item
+    {
+        IrBlockId block;
+        bool leave;
+        size_t log;
+    };
+    std::vector<Item> stack{{0, false, 0}};
+    while(!stack.empty())
+    {
+        Item item = stack.back();
+        stack.pop_back();
+        if(item.leave)
+        {
+            for(;log.size() > item.log;log.pop_back())
+            {
+                available.erase(log.back());
+            }
+            continue;
+        }
+        stack.push_back({item.block, true, log.size()});
+
+        loads.clear();
+        for(IrValue value : function.blocks[item.block].code)
+        {
+            IrInstr& instr = function.instrs[value];
+
+            // (Phi operands from blocks which have not been visited yet are updated at the
+            // end.)
+            for(uint32_t i = 0;i < instr.count;i++)
+            {
+                function.set_operand(value, i, number(function.operand(value, i)));
+            }
+
+            if(instr.op == IrOp::COPY)
+            {
+                replacements[value] = function.operand(value, 0);
+                changed = true;
+                continue;
+            }
+            if(instr.op == IrOp::STORE || ir_is_vector(instr.op) || instr.op == IrOp::CALL)
+            {
+                loads.clear();
+                continue;
+            }
+            if(instr.op == IrOp::LOAD)
+            {
+                auto found = loads.insert(value);
+                if(!found.second)
+                {
+                    replacements[value] = *found.first;
+                    changed = true;
+                }
+                continue;
+            }
+            if(!is_pure(instr.op)) continue;
+
+            if(instr.op == IrOp::PHI)
+            {
+                // A phi which only merges one value (and itself) is that value.
+                IrValue same = IrNone;
+                bool unique = true;
+                for(IrValue operand : function.operands(value))
+                {
+                    if(operand == value || operand == same) continue;
+                    unique = unique && same == IrNone;
+                    same = operand;
+                }
+                if(unique && same != IrNone)
+                {
+                    replacements[value] = same;
+                    changed = true;
+                    continue;
+                }
+            }
+
+            canonicalise(function, value);
+            if(instr.op == IrOp::NE && is_truth_test(function, value))
+            {
+                // (A comparison result, compared with zero: a condition.)
+                replacements[value] = function.operand(value, 0);
+                changed = true;
+                continue;
+            }
+            auto found = available.insert(value);
+            if(found.second)
+            {
+                log.push_back(value);
+            }
+            else
+            {
+                replacements[value] = *found.first;
+                changed = true;
+            }
+        }
+
+        IrRange children = tree.children(item.block);
+        for(size_t i = children.size();i > 0;i--)
+        {
+            stack.push_back({children[i - 1], false, 0});
+        }
+    }
+    if(!changed) return false;
+
+    for(auto& block : function.blocks)
+    {
+        block.code.erase(
+            std::remove_if(block.code.begin(), block.code.end(), [&](IrValue value)
+            {
+                return replacements[value] != IrNone;
+            }),
+            block.code.end()
+        );
+    }
+    function.replace_uses(replacements);
+    function.compact();
+    return true;
+}
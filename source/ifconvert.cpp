@@ -0,0 +1,211 @@
+#include <algorithm>
+
+#include "ifconvert.h"
+
+// Cost of computing an instruction on a path which did not need it.
+static int speculation_cost(IrOp op)
+{
+    switch(op)
+    {
+        case IrOp::CONST:
+            return 0;
+        case IrOp::MUL:
+            return 3;
+        case IrOp::SDIV:
+        case IrOp::UDIV:
+        case IrOp::SREM:
+        case IrOp::UREM:
+            return 20;
+        default:
+            return 1;
+    }
+}
+
+bool IfConverter::run(IrFunction& f)
+{
+    function = &f;
+    replacements.assign(f.instrs.size(), IrNone);
+    bool changed = false;
+    for(IrBlockId b = 0;b < f.blocks.size();b++)
+    {
+        // Converting a diamond can leave its header a straight-line arm of one around it, so
+        // then the header above it is tried again.
+        IrBlockId header = b;
+        while(convert(header))
+        {
+            changed = true;
+            while(convert(header));
+            const IrBlock& block = f.blocks[header];
+            if(header == 0 || block.preds.size() != 1) break;
+            header = block.preds[0];
+        }
+    }
+    if(changed)
+    {
+        replacements.resize(f.instrs.size(), IrNone);
+        f.replace_uses(replacements);
+        f.compact();
+    }
+    function = nullptr;
+    return changed;
+}
+
+bool IfConverter::arm(IrBlockId b, IrBlockId header, int& cost) const
+{
+    const IrBlock& block = function->blocks[b];
+    if(b == 0 || block.preds.size() != 1 || block.preds[0] != header || block.succs.size() != 1
+        || function->instrs[block.code.back()].op != IrOp::JUMP)
+    {
+        return false;
+    }
+    int total = 0;
+    for(size_t i = 0;i + 1 < block.code.size();i++)
+    {
+        IrValue value = block.code[i];
+        if(function->instrs[value].op == IrOp::PHI || !function->speculatable(value)) return false;
+        total += speculation_cost(function->instrs[value].op);
+    }
+    cost += total;
+    return true;
+}
+
+IrValue IfConverter::resolve(IrValue value) const
+{
+    while(value < replacements.size() && replacements[value] != IrNone) value = replacements[value];
+    return value;
+}
+
+bool IfConverter::boolean(IrValue value) const
+{
+    const IrInstr& instr = function->instrs[resolve(value)];
+    return instr.type == IrType::I32
+        && (ir_is_comparison(instr.op) || (instr.op == IrOp::CONST && (instr.imm == 0 || instr.imm == 1)));
+}
+
+IrValue IfConverter::choose(IrBlockId header, IrValue condition, IrValue a, IrValue b)
+{
+    a = resolve(a);
+    b = resolve(b);
+    if(a == b) return a;
+
+    // 'c ? 1 : 0' is c; 'c ? x : 0' is 'c & x', and 'c ? 1 : x' is 'c | x', if c and x are
+    // both 0 or 1.
+    IrType type = function->instrs[a].type;
+    auto is = [&](IrValue value, int64_t constant)
+    {
+        return function->instrs[value].op == IrOp::CONST && function->instrs[value].imm == constant;
+    };
+    IrOp op = IrOp::SELECT;
+    std::vector<IrValue> operands{condition, a, b};
+    if(boolean(condition) && type == IrType::I32)
+    {
+        if(is(a, 1) && is(b, 0)) return condition;
+        if(is(b, 0) && boolean(a))
+        {
+            op = IrOp::AND;
+            operands = {condition, a};
+        }
+        else if(is(a, 1) && boolean(b))
+        {
+            op = IrOp::OR;
+            operands = {condition, b};
+        }
+    }
+
+    IrValue value = function->create(op, type, operands);
+    auto& code = function->blocks[header].code;
+    function->instrs[value].block = header;
+    code.insert(code.end() - 1, value);
+    return value;
+}
+
+bool IfConverter::convert(IrBlockId header)
+{
+    IrFunction& f = *function;
+    if(f.blocks[header].code.empty()) return false;
+    IrValue branch = f.terminator(header);
+    if(f.instrs[branch].op != IrOp::BRANCH) return false;
+
+    // Each side goes through an arm, or straight to the join.
+    int cost = 0;
+    IrBlockId sides[2], join[2];
+    bool arms[2];
+    for(int s = 0;s < 2;s++)
+    {
+        sides[s] = f.blocks[header].succs[s];
+        arms[s] = arm(sides[s], header, cost);
+        join[s] = arms[s] ? f.blocks[sides[s]].succs[0] : sides[s];
+    }
+    if(join[0] != join[1] || join[0] == header) return false;
+    IrBlock& target = f.blocks[join[0]];
+
+    // Predecessor index of each side's edge into the join.
+    size_t edges[2];
+    for(int s = 0;s < 2;s++)
+    {
+        auto pred = std::find(target.preds.begin(), target.preds.end(), arms[s] ? sides[s] : header);
+        if(s == 1 && !arms[0] && !arms[1]) pred = std::find(pred + 1, target.preds.end(), header);
+        edges[s] = pred - target.preds.begin();
+    }
+
+    for(IrValue value : target.code)
+    {
+        if(f.instrs[value].op != IrOp::PHI) break;
+        if(resolve(f.operand(value, edges[0])) != resolve(f.operand(value, edges[1]))) cost++;
+    }
+    if(cost > IfConvertLimit) return false;
+
+    // Move the arms into the header, in front of the branch, and select between the phis'
+    // operands there.
+    auto& code = f.blocks[header].code;
+    for(int s = 0;s < 2;s++)
+    {
+        if(!arms[s]) continue;
+        auto& moved = f.blocks[sides[s]].code;
+        for(size_t i = 0;i + 1 < moved.size();i++)
+        {
+            f.instrs[moved[i]].block = header;
+            code.insert(code.end() - 1, moved[i]);
+        }
+        f.blocks[sides[s]] = IrBlock();
+    }
+    IrValue condition = resolve(f.operand(branch, 0));
+    for(IrValue value : target.code)
+    {
+        if(f.instrs[value].op != IrOp::PHI) break;
+        IrValue a = f.operand(value, edges[0]), b = f.operand(value, edges[1]);
+        f.set_operand(value, edges[0], choose(header, condition, a, b));
+    }
+    target.preds[edges[0]] = header;
+    f.remove_pred(join[0], edges[1]);
+
+    f.instrs[branch].op = IrOp::JUMP;
+    f.instrs[branch].count = 0;
+    f.blocks[header].succs.assign(1, join[0]);
+
+    if(join[0] != 0 && target.preds.size() == 1) merge(header, join[0]);
+    return true;
+}
+
+void IfConverter::merge(IrBlockId header, IrBlockId join)
+{
+    IrFunction& f = *function;
+    IrBlock& block = f.blocks[header];
+    block.code.pop_back();
+    for(IrValue value : f.blocks[join].code)
+    {
+        if(f.instrs[value].op == IrOp::PHI)
+        {
+            replacements[value] = f.operand(value, 0);
+            continue;
+        }
+        f.instrs[value].block = header;
+        block.code.push_back(value);
+    }
+    block.succs = f.blocks[join].succs;
+    for(IrBlockId succ : block.succs)
+    {
+        std::replace(f.blocks[succ].preds.begin(), f.blocks[succ].preds.end(), join, header);
+    }
+    f.blocks[join] = IrBlock();
+}
@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+#include "induction.h"
+#include "loops.h"
+
+namespace
+{
+    // An address 'base + (sext(variable) + offset) * size'.
+    struct Address
+    {
+        IrValue base;
+        IrValue variable;
+        int64_t offset;
+        int64_t size;
+    };
+
+    class Reducer
+    {
+        private:
+            IrFunction& function;
+            const LoopInfo& info;
+            int loop;
+
+            // Basic induction variables of the loop, and their steps.
+            std::unordered_map<IrValue, int64_t> steps;
+
+            bool constant(IrValue value, int64_t& imm) const
+            {
+                const IrInstr& instr = function.instrs[value];
+                imm = instr.imm;
+                return instr.op == IrOp::CONST;
+            }
+            bool invariant(IrValue value) const
+            {
+                return !info.contains(loop, function.instrs[value].block);
+            }
+
+            bool index(IrValue, Address&) const;
+
+        public:
+            Reducer(IrFunction& function, const LoopInfo& info, int loop)
+                : function(function), info(info), loop(loop) {}
+
+            bool find_variables(size_t back);
+            inline int64_t step(IrValue variable) const { return steps.at(variable); }
+            bool address(IrValue, Address&) const;
+    };
+}
+
+// Find the header phis which are incremented by a constant on the back edge (predecessor
+// 'back').
+bool Reducer::find_variables(size_t back)
+{
+    for(IrValue phi : function.blocks[info.loop(loop).header].code)
+    {
+        if(function.instrs[phi].op != IrOp::PHI) break;
+        if(function.instrs[phi].type != IrType::I32) continue;
+
+        IrValue next = function.operand(phi, back);
+        const IrInstr& instr = function.instrs[next];
+        int64_t step;
+        if(instr.op == IrOp::ADD && function.operand(next, 0) == phi && constant(function.operand(next, 1), step))
+            steps[phi] = step;
+        else if(instr.op == IrOp::ADD && function.operand(next, 1) == phi && constant(function.operand(next, 0), step))
+            steps[phi] = step;
+        else if(instr.op == IrOp::SUB && function.operand(next, 0) == phi && constant(function.operand(next, 1), step))
+            steps[phi] = -step;
+    }
+    return !steps.empty();
+}
+
+// Match 'sext(i + k) * size' (or 'sext(i + k)', with size 1), where i is a basic induction
+// variable.
+bool Reducer::index(IrValue value, Address& address) const
+{
+    address.size = 1;
+    const IrInstr& instr = function.instrs[value];
+    if(instr.op == IrOp::MUL)
+    {
+        if(constant(function.operand(value, 1), address.size))
+            value = function.operand(value, 0);
+        else if(constant(function.operand(value, 0), address.size))
+            value = function.operand(value, 1);
+        else
+            return false;
+    }
+    if(function.instrs[value].op != IrOp::SEXT) return false;
+
+    IrValue variable = function.operand(value, 0);
+    address.offset = 0;
+    if(function.instrs[variable].op == IrOp::ADD && !steps.count(variable))
+    {
+        if(constant(function.operand(variable, 1), address.offset))
+            variable = function.operand(variable, 0);
+        else if(constant(function.operand(variable, 0), address.offset))
+            variable = function.operand(variable, 1);
+        else
+            return false;
+    }
+    address.variable = variable;
+    return steps.count(variable) != 0;
+}
+
+// Match 'base + index', with a loop-invariant base.
+bool Reducer::address(IrValue value, Address& address) const
+{
+    const IrInstr& instr = function.instrs[value];
+    if(instr.op != IrOp::ADD || instr.type != IrType::I64) return false;
+
+    for(int i = 0;i < 2;i++)
+    {
+        address.base = function.operand(value, i);
+        if(invariant(address.base) && index(function.operand(value, 1 - i), address)) return true;
+    }
+    return false;
+}
+
+bool StrengthReduction::run(IrFunction& function)
+{
+    AnalysisCache cache(function);
+    return run(function, cache);
+}
+
+bool StrengthReduction::run(IrFunction& function, AnalysisCache& cache)
+{
+    const LoopInfo& info = cache.loops();
+
+    // Create an instruction before a block's terminator.
+    auto insert = [&](IrBlockId block, IrOp op, IrType type, const std::vector<IrValue>& operands, int64_t imm)
+    {
+        IrValue value = function.create(op, type, operands, imm);
+        function.instrs[value].block = block;
+        auto& code = function.blocks[block].code;
+        code.insert(code.end() - 1, value);
+        return value;
+    };
+
+    std::vector<IrValue> replacements;
+    std::vector<IrValue> removed;
+    for(int l = 0;l < static_cast<int>(info.loops().size());l++)
+    {
+        const IrLoop& loop = info.loop(l);
+        IrBlockId preheader = info.preheader(function, l);
+        const auto& preds = function.blocks[loop.header].preds;
+        if(preheader == IrNoBlock || preds.size() != 2) continue;
+
+        size_t entry = (preds[0] == preheader) ? 0 : 1;
+        IrBlockId latch = preds[1 - entry];
+        Reducer reducer(function, info, l);
+        if(!reducer.find_variables(1 - entry)) continue;
+
+        std::map<std::tuple<IrValue, IrValue, int64_t, int64_t>, IrValue> pointers;
+        for(IrBlockId block : loop.blocks)
+        {
+            // (Only addresses computed in this loop - not in nested loops.)
+            if(info.loop_of(block) != l) continue;
+
+            // (New code is added to the header and the latch, so the block is copied.)
+            const std::vector<IrValue> code = function.blocks[block].code;
+            for(IrValue value : code)
+            {
+                Address address;
+                if(!reducer.address(value, address)) continue;
+
+                auto key = std::make_tuple(address.base, address.variable, address.offset, address.size);
+                auto found = pointers.find(key);
+                if(found == pointers.end())
+                {
+                    IrValue init = function.operand(address.variable, entry);
+                    IrValue start;
+                    if(function.instrs[init].op == IrOp::CONST)
+                    {
+                        int64_t offset = (function.instrs[init].imm + address.offset) * address.size;
+                        start = insert(preheader, IrOp::CONST, IrType::I64, {}, offset);
+                    }
+                    else
+                    {
+                        start = insert(preheader, IrOp::SEXT, IrType::I64, {init}, 0);
+                        if(address.offset != 0)
+                        {
+                            IrValue offset = insert(preheader, IrOp::CONST, IrType::I64, {}, address.offset);
+                            start = insert(preheader, IrOp::ADD, IrType::I64, {start, offset}, 0);
+                        }
+                        if(address.size != 1)
+                        {
+                            IrValue size = insert(preheader, IrOp::CONST, IrType::I64, {}, address.size);
+                            start = insert(preheader, IrOp::MUL, IrType::I64, {start, size}, 0);
+                        }
+                    }
+                    if(function.instrs[start].op != IrOp::CONST || function.instrs[start].imm != 0)
+                        start = insert(preheader, IrOp::ADD, IrType::I64, {address.base, start}, 0);
+                    else
+                        start = address.base;
+
+                    // The phi's operands are filled in once the increment exists.
+                    IrValue phi = function.create(IrOp::PHI, IrType::I64, {start, start});
+                    function.instrs[phi].block = loop.header;
+                    auto& header = function.blocks[loop.header].code;
+                    header.insert(header.begin(), phi);
+
+                    int64_t step = reducer.step(address.variable) * address.size;
+                    IrValue increment = insert(latch, IrOp::CONST, IrType::I64, {}, step);
+                    IrValue next = insert(latch, IrOp::ADD, IrType::I64, {phi, increment}, 0);
+                    function.set_operand(phi, 1 - entry, next);
+                    found = pointers.emplace(key, phi).first;
+                }
+
+                replacements.resize(function.instrs.size(), IrNone);
+                replacements[value] = found->second;
+                removed.push_back(value);
+            }
+        }
+    }
+    if(removed.empty()) return false;
+
+    replacements.resize(function.instrs.size(), IrNone);
+    function.replace_uses(replacements);
+    for(IrValue value : removed)
+    {
+        auto& code = function.blocks[function.instrs[value].block].code;
+        code.erase(std::find(code.begin(), code.end(), value));
+    }
+    return true;
+}
@@ -0,0 +1,304 @@
+#include <algorithm>
+
+#include "inline.h"
+
+namespace
+{
+    // Call graph of the functions defined in a module.
+    struct CallGraph
+    {
+        // Function index of each symbol which is defined in the module, or -1.
+        std::vector<int> defined;
+
+        // Callees of each function (with repeats), and the number of calls to each.
+        std::vector<std::vector<int>> callees;
+        std::vector<int> calls;
+
+        explicit CallGraph(const IrModule&);
+
+        // Function index of the callee of a direct call to a defined function, or -1.
+        int callee(const IrFunction&, IrValue call) const;
+
+        // Functions in bottom-up order (callees first), and the strongly connected
+        // component of each.
+        std::vector<int> bottom_up(std::vector<int>& component) const;
+    };
+}
+
+CallGraph::CallGraph(const IrModule& module)
+    : defined(module.symbols.size(), -1), callees(module.functions.size()), calls(module.functions.size(), 0)
+{
+    for(size_t i = 0;i < module.functions.size();i++)
+    {
+        defined[module.functions[i]->symbol] = i;
+    }
+    for(size_t i = 0;i < module.functions.size();i++)
+    {
+        const IrFunction& function = *module.functions[i];
+        for(const auto& block : function.blocks)
+        {
+            for(IrValue value : block.code)
+            {
+                if(function.instrs[value].op != IrOp::CALL) continue;
+                int target = callee(function, value);
+                if(target < 0) continue;
+                callees[i].push_back(target);
+                calls[target]++;
+            }
+        }
+    }
+}
+
+int CallGraph::callee(const IrFunction& function, IrValue call) const
+{
+    const IrInstr& instr = function.instrs[function.operand(call, 0)];
+    if(instr.op != IrOp::GLOBAL || instr.imm < 0 || instr.imm >= static_cast<int64_t>(defined.size())) return -1;
+    return defined[instr.imm];
+}
+
+// Tarjan's algorithm, with an explicit stack. Components are completed callees first.
+std::vector<int> CallGraph::bottom_up(std::vector<int>& component) const
+{
+    size_t count = callees.size();
+    std::vector<int> index(count, -1), low(count, 0), order, stack;
+    std::vector<bool> on_stack(count, false);
+    std::vector<std::pair<int, size_t>> work;
+    component.assign(count, -1);
+    int next = 0, components = 0;
+
+    auto visit = [&](int f)
+    {
+        index[f] = low[f] = next++;
+        stack.push_back(f);
+        on_stack[f] = true;
+        work.emplace_back(f, 0);
+    };
+    for(size_t root = 0;root < count;root++)
+    {
+        if(index[root] >= 0) continue;
+        visit(root);
+        while(!work.empty())
+        {
+            int f = work.back().first;
+            if(work.back().second < callees[f].size())
+            {
+                int g = callees[f][work.back().second++];
+                if(index[g] < 0)
+                    visit(g);
+                else if(on_stack[g])
+                    low[f] = std::min(low[f], index[g]);
+                continue;
+            }
+
+            work.pop_back();
+            if(!work.empty()) low[work.back().first] = std::min(low[work.back().first], low[f]);
+            if(low[f] != index[f]) continue;
+            int g;
+            do
+            {
+                g = stack.back();
+                stack.pop_back();
+                on_stack[g] = false;
+                component[g] = components;
+                order.push_back(g);
+            }
+            while(g != f);
+            components++;
+        }
+    }
+    return order;
+}
+
+// Number of instructions a function would add to a caller.
+static int cost(const IrFunction& function)
+{
+    int cost = 0;
+    for(const auto& block : function.blocks)
+    {
+        for(IrValue value : block.code)
+        {
+            IrOp op = function.instrs[value].op;
+            cost += op != IrOp::CONST && op != IrOp::PARAM && op != IrOp::GLOBAL && op != IrOp::ALLOCA;
+        }
+    }
+    return cost;
+}
+
+static size_t size(const IrFunction& function)
+{
+    size_t size = 0;
+    for(const auto& block : function.blocks) size += block.code.size();
+    return size;
+}
+
+// Replace a call with a copy of the callee. The call's result is recorded in replacements
+// (which the caller must apply).
+static void inline_call(IrFunction& caller, IrValue call, const IrFunction& callee, std::vector<IrValue>& replacements)
+{
+    IrBlockId block = caller.instrs[call].block;
+    IrValue values = caller.instrs.size();
+    IrBlockId blocks = caller.blocks.size();
+    uint32_t pool = caller.operand_pool.size();
+
+    // Callee values are shifted, except parameters, which become the arguments.
+    std::vector<IrValue> map(callee.instrs.size());
+    for(IrValue value = 0;value < callee.instrs.size();value++)
+    {
+        const IrInstr& instr = callee.instrs[value];
+        map[value] = instr.op == IrOp::PARAM ? caller.operand(call, 1 + instr.imm) : values + value;
+    }
+
+    caller.instrs.insert(caller.instrs.end(), callee.instrs.begin(), callee.instrs.end());
+    for(IrValue value = values;value < caller.instrs.size();value++)
+    {
+        caller.instrs[value].first += pool;
+        caller.instrs[value].block += blocks;
+    }
+    caller.operand_pool.reserve(pool + callee.operand_pool.size());
+    for(IrValue operand : callee.operand_pool)
+    {
+        caller.operand_pool.push_back(map[operand]);
+    }
+
+    // Copy the blocks, followed by the continuation (the rest of the call's block).
+    IrBlockId entry = blocks;
+    IrBlockId next = blocks + callee.blocks.size();
+    caller.blocks.resize(next + 1);
+    std::vector<IrValue> allocas;
+    std::vector<IrBlockId> returns;
+    std::vector<IrValue> results;
+    for(IrBlockId b = 0;b < callee.blocks.size();b++)
+    {
+        const IrBlock& from = callee.blocks[b];
+        IrBlock& to = caller.blocks[entry + b];
+        to.code.reserve(from.code.size());
+        for(IrValue value : from.code)
+        {
+            IrOp op = callee.instrs[value].op;
+            if(op == IrOp::PARAM) continue;
+            if(op == IrOp::ALLOCA)
+                allocas.push_back(map[value]);
+            else
+                to.code.push_back(map[value]);
+        }
+        for(IrBlockId pred : from.preds) to.preds.push_back(entry + pred);
+        for(IrBlockId succ : from.succs) to.succs.push_back(entry + succ);
+
+        if(from.code.empty()) continue;
+        IrInstr& terminator = caller.instrs[to.code.back()];
+        if(terminator.op != IrOp::RET) continue;
+        if(terminator.count > 0) results.push_back(caller.operand(to.code.back(), 0));
+        terminator.op = IrOp::JUMP;
+        terminator.count = 0;
+        to.succs.push_back(next);
+        returns.push_back(entry + b);
+    }
+
+    // Split the call's block.
+    auto& code = caller.blocks[block].code;
+    auto position = std::find(code.begin(), code.end(), call);
+    caller.blocks[next].code.assign(position + 1, code.end());
+    code.erase(position, code.end());
+    for(IrValue value : caller.blocks[next].code) caller.instrs[value].block = next;
+
+    caller.blocks[next].succs = std::move(caller.blocks[block].succs);
+    for(IrBlockId succ : caller.blocks[next].succs)
+    {
+        for(IrBlockId& pred : caller.blocks[succ].preds)
+        {
+            if(pred == block) pred = next;
+        }
+    }
+    caller.blocks[block].succs.clear();
+    caller.append(block, IrOp::JUMP, IrType::VOID);
+    caller.add_edge(block, entry);
+    caller.blocks[next].preds = returns;
+
+    // The result of the call.
+    if(caller.instrs[call].type != IrType::VOID)
+    {
+        IrValue result = results.front();
+        if(results.size() > 1)
+        {
+            result = caller.create(IrOp::PHI, caller.instrs[call].type, results);
+            caller.instrs[result].block = next;
+            caller.blocks[next].code.insert(caller.blocks[next].code.begin(), result);
+        }
+        replacements.resize(caller.instrs.size(), IrNone);
+        replacements[call] = result;
+    }
+
+    auto& start = caller.blocks[0].code;
+    start.insert(start.begin(), allocas.begin(), allocas.end());
+    for(IrValue value : allocas) caller.instrs[value].block = 0;
+}
+
+bool Inliner::run(IrModule& module)
+{
+    CallGraph graph(module);
+    std::vector<int> component;
+    std::vector<int> order = graph.bottom_up(component);
+
+    // Cost of each callee (computed once it is finished).
+    std::vector<int> costs(module.functions.size(), -1);
+    std::vector<IrValue> calls;
+    std::vector<IrValue> replacements;
+    bool changed = false;
+    for(int f : order)
+    {
+        IrFunction& caller = *module.functions[f];
+        calls.clear();
+        for(const auto& block : caller.blocks)
+        {
+            for(IrValue value : block.code)
+            {
+                if(caller.instrs[value].op == IrOp::CALL) calls.push_back(value);
+            }
+        }
+
+        size_t caller_size = size(caller);
+        bool inlined = false;
+        replacements.clear();
+        for(IrValue call : calls)
+        {
+            int g = graph.callee(caller, call);
+            if(g < 0 || component[g] == component[f]) continue;
+
+            const IrFunction& callee = *module.functions[g];
+            size_t args = caller.instrs[call].count - 1;
+            if(args != callee.params.size()) continue;
+            if(caller.instrs[call].type != IrType::VOID && caller.instrs[call].type != callee.result) continue;
+
+            // (The callee has been finished, since it comes first.)
+            if(costs[g] < 0) costs[g] = cost(callee);
+            int benefit = params.call_benefit + args;
+            for(size_t i = 1;i <= args;i++)
+            {
+                if(caller.instrs[caller.operand(call, i)].op == IrOp::CONST) benefit += params.constant_benefit;
+            }
+            int limit = graph.calls[g] == 1 ? params.single_call_threshold : params.threshold;
+            if(costs[g] - benefit > limit) continue;
+            if(caller_size + costs[g] > static_cast<size_t>(params.caller_limit)) continue;
+
+            // (A callee which never returns is left alone: its continuation would be
+            // unreachable.)
+            bool returns = false;
+            for(const auto& block : callee.blocks)
+            {
+                returns = returns || (!block.code.empty() && callee.instrs[block.code.back()].op == IrOp::RET);
+            }
+            if(!returns) continue;
+
+            inline_call(caller, call, callee, replacements);
+            caller_size += costs[g];
+            inlined = true;
+        }
+        if(!inlined) continue;
+
+        replacements.resize(caller.instrs.size(), IrNone);
+        caller.replace_uses(replacements);
+        caller.compact();
+        changed = true;
+    }
+    return changed;
+}
@@ -0,0 +1,664 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <dlfcn.h>
+
+#include "interp.h"
+
+// Handlers, in dispatch table order. Operations suffixed 32 or 64 are specialised for
+// I32 or I64 operands; GENERIC evaluates any other operation with ir_evaluate ('imm' holds
+// the IrOp and the operand type). VECTOR does a vector operation ('d' is the register of the
+// destination address, and 'imm' holds the IrOp and the element type). SELECT picks 'b' or
+// the register in 'imm'. A switch is a chain of CASE (jump to 'b' if the value is 'imm'),
+// then a jump to its default.
+#define INTERP_OPS(X) \
+    X(MOV) X(ALLOCA) \
+    X(ADD32) X(ADD64) X(SUB32) X(SUB64) X(MUL32) X(MUL64) \
+    X(SDIV32) X(SDIV64) X(UDIV32) X(UDIV64) X(SREM32) X(SREM64) X(UREM32) X(UREM64) \
+    X(AND) X(OR) X(XOR) X(SHL32) X(SHL64) X(SAR32) X(SAR64) X(SHR32) X(SHR64) \
+    X(NEG32) X(NEG64) X(NOT) \
+    X(EQ) X(NE) X(SLT) X(SLE) X(SGT) X(SGE) \
+    X(ULT32) X(ULT64) X(ULE32) X(ULE64) X(UGT32) X(UGT64) X(UGE32) X(UGE64) \
+    X(ZEXT8) X(ZEXT16) X(ZEXT32) X(TRUNC8) X(TRUNC16) X(TRUNC32) X(SELECT) \
+    X(LOAD8) X(LOAD16) X(LOAD32) X(LOAD64) X(STORE8) X(STORE16) X(STORE32) X(STORE64) \
+    X(GENERIC) X(VECTOR) \
+    X(CALL) X(CALL_NATIVE) X(CALL_INDIRECT) \
+    X(JUMP) X(BRANCH) X(CASE) X(RET) X(RET_VOID)
+
+namespace
+{
+    enum Code : uint8_t
+    {
+#define X(name) name,
+        INTERP_OPS(X)
+#undef X
+    };
+}
+
+static uint8_t specialise(IrType type, Code code32, Code code64)
+{
+    return type == IrType::I32 ? code32 : type == IrType::I64 ? code64 : GENERIC;
+}
+
+static uint8_t by_width(IrType type, Code code8, Code code16, Code code32, Code code64)
+{
+    switch(type)
+    {
+        case IrType::I8: return code8;
+        case IrType::I16: return code16;
+        case IrType::I32: return code32;
+        default: return code64;
+    }
+}
+
+static inline int64_t wrap32(uint64_t value)
+{
+    return static_cast<int32_t>(static_cast<uint32_t>(value));
+}
+
+static inline char * pointer(int64_t address)
+{
+    return reinterpret_cast<char *>(static_cast<intptr_t>(address));
+}
+
+static void vector(IrOp op, IrType type, char * destination, const char * a, const char * b)
+{
+    int size = ir_type_size(type);
+    char result[16];
+    for(int i = 0;i < 16;i += size)
+    {
+        int64_t x = 0, y = 0, z;
+        std::memcpy(&x, a + i, size);
+        std::memcpy(&y, b + i, size);
+        ir_evaluate(ir_vector_scalar(op), IrType::I64, IrType::I64, x, y, z);
+        std::memcpy(result + i, &z, size);
+    }
+    std::memcpy(destination, result, sizeof(result));
+}
+
+static int64_t call_native(int64_t address, const int64_t * registers, const uint32_t * args, uint32_t count)
+{
+    typedef int64_t (*Native)(int64_t, int64_t, int64_t, int64_t, int64_t, int64_t);
+    int64_t a[6] = {};
+    for(uint32_t i = 0;i < count;i++) a[i] = registers[args[i]];
+    return reinterpret_cast<Native>(static_cast<intptr_t>(address))(a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+Interpreter::Interpreter(const IrModule& module)
+    : functions(module.functions.size()), stack(new char[StackSize])
+{
+    // Address of each symbol: the decoded form of a function defined in the module, an
+    // object laid out here, or whatever the process has under that name.
+    std::vector<int64_t> addresses(module.symbols.size(), 0);
+    for(size_t i = 0;i < module.functions.size();i++)
+    {
+        addresses[module.functions[i]->symbol] = reinterpret_cast<intptr_t>(&functions[i]);
+        names[module.functions[i]->name] = i;
+    }
+
+    std::vector<size_t> offsets(module.symbols.size(), 0);
+    size_t size = 0;
+    for(size_t s = 0;s < module.symbols.size();s++)
+    {
+        const IrSymbol& symbol = module.symbols[s];
+        if(symbol.function || !symbol.defined) continue;
+        size = (size + symbol.align - 1) / symbol.align * symbol.align;
+        offsets[s] = size;
+        size += symbol.size;
+    }
+    objects.reset(new char[size + 1]());
+    for(size_t s = 0;s < module.symbols.size();s++)
+    {
+        const IrSymbol& symbol = module.symbols[s];
+        if(symbol.function || !symbol.defined) continue;
+        addresses[s] = reinterpret_cast<intptr_t>(objects.get() + offsets[s]);
+        std::memcpy(objects.get() + offsets[s], symbol.data.data(), symbol.data.size());
+    }
+    for(size_t s = 0;s < module.symbols.size();s++)
+    {
+        const IrSymbol& symbol = module.symbols[s];
+        if(addresses[s] == 0) addresses[s] = reinterpret_cast<intptr_t>(dlsym(RTLD_DEFAULT, symbol.name.c_str()));
+    }
+    for(size_t s = 0;s < module.symbols.size();s++)
+    {
+        const IrSymbol& symbol = module.symbols[s];
+        if(symbol.function || !symbol.defined || symbol.reference < 0) continue;
+        std::memcpy(objects.get() + offsets[s], &addresses[symbol.reference], sizeof(int64_t));
+    }
+
+    for(size_t i = 0;i < module.functions.size();i++)
+    {
+        decode(module, *module.functions[i], addresses, functions[i]);
+    }
+}
+
+void Interpreter::decode(const IrModule& module, const IrFunction& f, const std::vector<int64_t>& addresses,
+    InterpFunction& out)
+{
+    uint32_t scratch = f.instrs.size();
+    out.name = f.name;
+    out.registers.assign(scratch + 1, 0);
+    out.params.assign(f.params.size(), scratch);
+    for(IrValue value = 0;value < f.instrs.size();value++)
+    {
+        const IrInstr& instr = f.instrs[value];
+        if(instr.op == IrOp::CONST)
+        {
+            out.registers[value] = instr.imm;
+        }
+        else if(instr.op == IrOp::GLOBAL)
+        {
+            out.registers[value] = addresses[instr.imm];
+            if(addresses[instr.imm] == 0)
+            {
+                throw InterpreterError("Undefined symbol '" + module.symbols[instr.imm].name + "'");
+            }
+        }
+        else if(instr.op == IrOp::PARAM && instr.imm < static_cast<int64_t>(out.params.size()))
+        {
+            out.params[instr.imm] = value;
+        }
+    }
+
+    // Copies for the phis of a block, on the edge from its predecessor 'index'. They are
+    // done in an order in which no source is overwritten before it is read (a cycle is
+    // broken by saving one destination in the scratch register).
+    auto copies = [&](IrBlockId block, size_t index)
+    {
+        std::vector<std::pair<uint32_t, uint32_t>> moves;
+        for(IrValue value : f.blocks[block].code)
+        {
+            if(f.instrs[value].op != IrOp::PHI) break;
+            IrValue source = f.operand(value, index);
+            if(source != value) moves.emplace_back(value, source);
+        }
+        while(!moves.empty())
+        {
+            size_t ready = moves.size();
+            for(size_t i = 0;i < moves.size() && ready == moves.size();i++)
+            {
+                bool blocked = false;
+                for(size_t j = 0;j < moves.size() && !blocked;j++)
+                {
+                    blocked = j != i && moves[j].second == moves[i].first;
+                }
+                if(!blocked) ready = i;
+            }
+            if(ready == moves.size())
+            {
+                uint32_t saved = moves[0].first;
+                out.code.push_back(InterpOp{MOV, IrType::VOID, scratch, saved, 0, 0});
+                for(auto& move : moves)
+                {
+                    if(move.second == saved) move.second = scratch;
+                }
+                ready = 0;
+            }
+            out.code.push_back(InterpOp{MOV, IrType::VOID, moves[ready].first, moves[ready].second, 0, 0});
+            moves[ready] = moves.back();
+            moves.pop_back();
+        }
+    };
+    auto has_phis = [&](IrBlockId block)
+    {
+        return f.instrs[f.blocks[block].code.front()].op == IrOp::PHI;
+    };
+
+    // Jump targets are patched once every block has been decoded: 'imm' (or 'b', for the
+    // second successor of a branch) of an instruction, to the start of a block.
+    struct Target
+    {
+        size_t op;
+        bool second;
+        IrBlockId block;
+    };
+    std::vector<Target> targets;
+    std::vector<uint32_t> start(f.blocks.size(), 0);
+
+    // Edges from a branch into a block with phis go through a stub (copies and a jump).
+    struct Stub
+    {
+        size_t op;
+        bool second;
+        IrBlockId block;
+        size_t index;
+    };
+    std::vector<Stub> stubs;
+
+    // Index of the predecessor 'from' of a block, counting edges already taken from it.
+    auto pred_index = [&](IrBlockId block, IrBlockId from, size_t skip)
+    {
+        const auto& preds = f.blocks[block].preds;
+        size_t i = 0;
+        for(;i < preds.size();i++)
+        {
+            if(preds[i] == from && skip-- == 0) break;
+        }
+        return i;
+    };
+
+    for(IrBlockId b = 0;b < f.blocks.size();b++)
+    {
+        const IrBlock& block = f.blocks[b];
+        start[b] = out.code.size();
+        for(IrValue value : block.code)
+        {
+            const IrInstr& instr = f.instrs[value];
+            InterpOp op{MOV, instr.type, value, 0, 0, 0};
+            if(instr.count > 0) op.a = f.operand(value, 0);
+            if(instr.count > 1) op.b = f.operand(value, 1);
+            IrType type = instr.count > 0 ? f.instrs[op.a].type : instr.type;
+            switch(instr.op)
+            {
+                case IrOp::CONST:
+                case IrOp::PARAM:
+                case IrOp::GLOBAL:
+                case IrOp::PHI:
+                    continue;
+                case IrOp::ALLOCA:
+                    op.code = ALLOCA;
+                    op.imm = instr.imm;
+                    op.b = 8;
+                    while(op.b > 1 && instr.imm % op.b != 0) op.b /= 2;
+                    break;
+                case IrOp::ADD: op.code = specialise(type, ADD32, ADD64); break;
+                case IrOp::SUB: op.code = specialise(type, SUB32, SUB64); break;
+                case IrOp::MUL: op.code = specialise(type, MUL32, MUL64); break;
+                case IrOp::SDIV: op.code = specialise(type, SDIV32, SDIV64); break;
+                case IrOp::UDIV: op.code = specialise(type, UDIV32, UDIV64); break;
+                case IrOp::SREM: op.code = specialise(type, SREM32, SREM64); break;
+                case IrOp::UREM: op.code = specialise(type, UREM32, UREM64); break;
+                case IrOp::AND: op.code = AND; break;
+                case IrOp::OR: op.code = OR; break;
+                case IrOp::XOR: op.code = XOR; break;
+                case IrOp::SHL: op.code = specialise(type, SHL32, SHL64); break;
+                case IrOp::SAR: op.code = specialise(type, SAR32, SAR64); break;
+                case IrOp::SHR: op.code = specialise(type, SHR32, SHR64); break;
+                case IrOp::NEG: op.code = specialise(type, NEG32, NEG64); break;
+                case IrOp::NOT: op.code = NOT; break;
+
+                // (Values are kept sign-extended from their width, so signed comparisons
+                // do not depend on it.)
+                case IrOp::EQ: op.code = EQ; break;
+                case IrOp::NE: op.code = NE; break;
+                case IrOp::SLT: op.code = SLT; break;
+                case IrOp::SLE: op.code = SLE; break;
+                case IrOp::SGT: op.code = SGT; break;
+                case IrOp::SGE: op.code = SGE; break;
+                case IrOp::ULT: op.code = specialise(type, ULT32, ULT64); break;
+                case IrOp::ULE: op.code = specialise(type, ULE32, ULE64); break;
+                case IrOp::UGT: op.code = specialise(type, UGT32, UGT64); break;
+                case IrOp::UGE: op.code = specialise(type, UGE32, UGE64); break;
+
+                case IrOp::SEXT:
+                case IrOp::COPY:
+                    op.code = MOV;
+                    break;
+                case IrOp::ZEXT: op.code = by_width(type, ZEXT8, ZEXT16, ZEXT32, MOV); break;
+                case IrOp::TRUNC: op.code = by_width(instr.type, TRUNC8, TRUNC16, TRUNC32, MOV); break;
+                case IrOp::SELECT:
+                    op.code = SELECT;
+                    op.imm = f.operand(value, 2);
+                    break;
+                case IrOp::LOAD: op.code = by_width(instr.type, LOAD8, LOAD16, LOAD32, LOAD64); break;
+                case IrOp::STORE:
+                    op.code = by_width(f.instrs[op.b].type, STORE8, STORE16, STORE32, STORE64);
+                    break;
+                case IrOp::VADD:
+                case IrOp::VSUB:
+                case IrOp::VAND:
+                case IrOp::VOR:
+                case IrOp::VXOR:
+                    op.code = VECTOR;
+                    op.d = op.a;
+                    op.a = op.b;
+                    op.b = f.operand(value, 2);
+                    op.imm = static_cast<int>(instr.op) | instr.imm << 8;
+                    break;
+
+                case IrOp::CALL:
+                {
+                    const IrInstr& target = f.instrs[op.a];
+                    op.b = instr.count - 1;
+                    if(target.op == IrOp::GLOBAL && module.symbols[target.imm].function)
+                    {
+                        op.imm = addresses[target.imm];
+                        op.code = CALL_NATIVE;
+                        const InterpFunction * callee = reinterpret_cast<const InterpFunction *>(op.imm);
+                        if(callee >= functions.data() && callee < functions.data() + functions.size())
+                        {
+                            op.code = CALL;
+                            op.imm = callee - functions.data();
+                        }
+                        else if(op.b > 6)
+                        {
+                            throw InterpreterError(
+                                "Too many arguments to external function '" + module.symbols[target.imm].name + "'");
+                        }
+                    }
+                    else
+                    {
+                        op.code = CALL_INDIRECT;
+                        op.imm = op.a;
+                    }
+                    op.a = out.arguments.size();
+                    for(uint32_t i = 1;i < instr.count;i++) out.arguments.push_back(f.operand(value, i));
+                    break;
+                }
+
+                case IrOp::JUMP:
+                {
+                    IrBlockId to = block.succs[0];
+                    copies(to, pred_index(to, b, 0));
+                    if(to == b + 1) continue;
+                    op.code = JUMP;
+                    targets.push_back(Target{out.code.size(), false, to});
+                    break;
+                }
+                case IrOp::BRANCH:
+                    op.code = BRANCH;
+                    for(size_t i = 0;i < 2;i++)
+                    {
+                        IrBlockId to = block.succs[i];
+                        size_t skip = i == 1 && block.succs[0] == to;
+                        if(has_phis(to))
+                            stubs.push_back(Stub{out.code.size(), i == 1, to, pred_index(to, b, skip)});
+                        else
+                            targets.push_back(Target{out.code.size(), i == 1, to});
+                    }
+                    break;
+                case IrOp::SWITCH:
+                    // (Successor 0, the default, is last.)
+                    for(size_t i = 1;i <= instr.count;i++)
+                    {
+                        size_t k = i % instr.count;
+                        IrBlockId to = block.succs[k];
+                        size_t skip = std::count(block.succs.begin(), block.succs.begin() + k, to);
+                        op.code = k != 0 ? CASE : JUMP;
+                        op.imm = k != 0 ? f.instrs[f.operand(value, k)].imm : 0;
+                        if(has_phis(to))
+                            stubs.push_back(Stub{out.code.size(), k != 0, to, pred_index(to, b, skip)});
+                        else
+                            targets.push_back(Target{out.code.size(), k != 0, to});
+                        if(k != 0) out.code.push_back(op);
+                    }
+                    break;
+                case IrOp::RET: op.code = instr.count > 0 ? RET : RET_VOID; break;
+            }
+            if(op.code == GENERIC)
+            {
+                op.imm = static_cast<int64_t>(instr.op) | static_cast<int64_t>(type) << 8;
+            }
+            out.code.push_back(op);
+        }
+    }
+
+    for(const Stub& stub : stubs)
+    {
+        uint32_t pc = out.code.size();
+        if(stub.second)
+            out.code[stub.op].b = pc;
+        else
+            out.code[stub.op].imm = pc;
+        copies(stub.block, stub.index);
+        targets.push_back(Target{out.code.size(), false, stub.block});
+        out.code.push_back(InterpOp{JUMP, IrType::VOID, 0, 0, 0, 0});
+    }
+    for(const Target& target : targets)
+    {
+        if(target.second)
+            out.code[target.op].b = start[target.block];
+        else
+            out.code[target.op].imm = start[target.block];
+    }
+}
+
+int64_t Interpreter::run(const std::string& name, const std::vector<int64_t>& args)
+{
+    auto found = names.find(name);
+    if(found == names.end()) throw InterpreterError("Undefined function '" + name + "'");
+    return execute(functions[found->second], args);
+}
+
+int64_t Interpreter::execute(const InterpFunction& entry, const std::vector<int64_t>& args)
+{
+    static void * const handlers[] = {
+#define X(name) &&op_##name,
+        INTERP_OPS(X)
+#undef X
+    };
+
+    frames.clear();
+    registers.assign(entry.registers.begin(), entry.registers.end());
+    for(size_t i = 0;i < entry.params.size() && i < args.size();i++) registers[entry.params[i]] = args[i];
+
+    // State of the running frame.
+    const InterpFunction * function = &entry;
+    const InterpOp * pc = entry.code.data();
+    int64_t * r = registers.data();
+    size_t base = 0, top = 0;
+
+    const InterpFunction * callee;
+    int64_t address, result;
+    std::string error;
+
+#define DISPATCH goto *handlers[pc->code]
+#define NEXT pc++; DISPATCH
+#define D r[pc->d]
+#define A r[pc->a]
+#define B r[pc->b]
+
+    DISPATCH;
+
+op_MOV: D = A; NEXT;
+op_ALLOCA:
+    top = (top + pc->b - 1) / pc->b * pc->b;
+    if(top + pc->imm > StackSize)
+    {
+        error = "Stack overflow";
+        goto fail;
+    }
+    D = reinterpret_cast<intptr_t>(stack.get() + top);
+    top += pc->imm;
+    NEXT;
+
+op_ADD32: D = wrap32(static_cast<uint64_t>(A) + static_cast<uint64_t>(B)); NEXT;
+op_ADD64: D = static_cast<int64_t>(static_cast<uint64_t>(A) + static_cast<uint64_t>(B)); NEXT;
+op_SUB32: D = wrap32(static_cast<uint64_t>(A) - static_cast<uint64_t>(B)); NEXT;
+op_SUB64: D = static_cast<int64_t>(static_cast<uint64_t>(A) - static_cast<uint64_t>(B)); NEXT;
+op_MUL32: D = wrap32(static_cast<uint64_t>(A) * static_cast<uint64_t>(B)); NEXT;
+op_MUL64: D = static_cast<int64_t>(static_cast<uint64_t>(A) * static_cast<uint64_t>(B)); NEXT;
+op_SDIV32:
+    if(B == 0 || (A == INT32_MIN && B == -1)) goto divide;
+    D = A / B;
+    NEXT;
+op_SDIV64:
+    if(B == 0 || (A == INT64_MIN && B == -1)) goto divide;
+    D = A / B;
+    NEXT;
+op_UDIV32:
+    if(static_cast<uint32_t>(B) == 0) goto divide;
+    D = wrap32(static_cast<uint32_t>(A) / static_cast<uint32_t>(B));
+    NEXT;
+op_UDIV64:
+    if(B == 0) goto divide;
+    D = static_cast<int64_t>(static_cast<uint64_t>(A) / static_cast<uint64_t>(B));
+    NEXT;
+op_SREM32:
+    if(B == 0 || (A == INT32_MIN && B == -1)) goto divide;
+    D = A % B;
+    NEXT;
+op_SREM64:
+    if(B == 0 || (A == INT64_MIN && B == -1)) goto divide;
+    D = A % B;
+    NEXT;
+op_UREM32:
+    if(static_cast<uint32_t>(B) == 0) goto divide;
+    D = wrap32(static_cast<uint32_t>(A) % static_cast<uint32_t>(B));
+    NEXT;
+op_UREM64:
+    if(B == 0) goto divide;
+    D = static_cast<int64_t>(static_cast<uint64_t>(A) % static_cast<uint64_t>(B));
+    NEXT;
+op_AND: D = A & B; NEXT;
+op_OR: D = A | B; NEXT;
+op_XOR: D = A ^ B; NEXT;
+op_SHL32:
+    if(static_cast<uint64_t>(B) >= 32) goto shift;
+    D = wrap32(static_cast<uint64_t>(A) << B);
+    NEXT;
+op_SHL64:
+    if(static_cast<uint64_t>(B) >= 64) goto shift;
+    D = static_cast<int64_t>(static_cast<uint64_t>(A) << B);
+    NEXT;
+op_SAR32:
+    if(static_cast<uint64_t>(B) >= 32) goto shift;
+    D = A >> B;
+    NEXT;
+op_SAR64:
+    if(static_cast<uint64_t>(B) >= 64) goto shift;
+    D = A >> B;
+    NEXT;
+op_SHR32:
+    if(static_cast<uint64_t>(B) >= 32) goto shift;
+    D = wrap32(static_cast<uint32_t>(A) >> B);
+    NEXT;
+op_SHR64:
+    if(static_cast<uint64_t>(B) >= 64) goto shift;
+    D = static_cast<int64_t>(static_cast<uint64_t>(A) >> B);
+    NEXT;
+op_NEG32: D = wrap32(0 - static_cast<uint64_t>(A)); NEXT;
+op_NEG64: D = static_cast<int64_t>(0 - static_cast<uint64_t>(A)); NEXT;
+op_NOT: D = ~A; NEXT;
+
+op_EQ: D = A == B; NEXT;
+op_NE: D = A != B; NEXT;
+op_SLT: D = A < B; NEXT;
+op_SLE: D = A <= B; NEXT;
+op_SGT: D = A > B; NEXT;
+op_SGE: D = A >= B; NEXT;
+op_ULT32: D = static_cast<uint32_t>(A) < static_cast<uint32_t>(B); NEXT;
+op_ULT64: D = static_cast<uint64_t>(A) < static_cast<uint64_t>(B); NEXT;
+op_ULE32: D = static_cast<uint32_t>(A) <= static_cast<uint32_t>(B); NEXT;
+op_ULE64: D = static_cast<uint64_t>(A) <= static_cast<uint64_t>(B); NEXT;
+op_UGT32: D = static_cast<uint32_t>(A) > static_cast<uint32_t>(B); NEXT;
+op_UGT64: D = static_cast<uint64_t>(A) > static_cast<uint64_t>(B); NEXT;
+op_UGE32: D = static_cast<uint32_t>(A) >= static_cast<uint32_t>(B); NEXT;
+op_UGE64: D = static_cast<uint64_t>(A) >= static_cast<uint64_t>(B); NEXT;
+
+op_ZEXT8: D = static_cast<uint8_t>(A); NEXT;
+op_ZEXT16: D = static_cast<uint16_t>(A); NEXT;
+op_ZEXT32: D = static_cast<uint32_t>(A); NEXT;
+op_TRUNC8: D = static_cast<int8_t>(A); NEXT;
+op_TRUNC16: D = static_cast<int16_t>(A); NEXT;
+op_TRUNC32: D = static_cast<int32_t>(A); NEXT;
+op_SELECT: D = A != 0 ? B : r[pc->imm]; NEXT;
+
+op_LOAD8: { int8_t value; std::memcpy(&value, pointer(A), sizeof(value)); D = value; } NEXT;
+op_LOAD16: { int16_t value; std::memcpy(&value, pointer(A), sizeof(value)); D = value; } NEXT;
+op_LOAD32: { int32_t value; std::memcpy(&value, pointer(A), sizeof(value)); D = value; } NEXT;
+op_LOAD64: std::memcpy(&D, pointer(A), sizeof(int64_t)); NEXT;
+op_STORE8: { int8_t value = B; std::memcpy(pointer(A), &value, sizeof(value)); } NEXT;
+op_STORE16: { int16_t value = B; std::memcpy(pointer(A), &value, sizeof(value)); } NEXT;
+op_STORE32: { int32_t value = B; std::memcpy(pointer(A), &value, sizeof(value)); } NEXT;
+op_STORE64: std::memcpy(pointer(A), &B, sizeof(int64_t)); NEXT;
+
+op_GENERIC:
+    if(!ir_evaluate(static_cast<IrOp>(pc->imm & 255), pc->type, static_cast<IrType>(pc->imm >> 8), A, B, result))
+    {
+        error = std::string("Undefined result of ") + ir_op_str(static_cast<IrOp>(pc->imm & 255));
+        goto fail;
+    }
+    D = result;
+    NEXT;
+op_VECTOR:
+    vector(static_cast<IrOp>(pc->imm & 255), static_cast<IrType>(pc->imm >> 8), pointer(D), pointer(A), pointer(B));
+    NEXT;
+
+op_CALL:
+    callee = &functions[pc->imm];
+    goto call;
+op_CALL_INDIRECT:
+    address = r[pc->imm];
+    callee = reinterpret_cast<const InterpFunction *>(address);
+    if(callee >= functions.data() && callee < functions.data() + functions.size()) goto call;
+    if(address == 0 || pc->b > 6)
+    {
+        error = address == 0 ? "Call through a null pointer" : "Too many arguments to an external function";
+        goto fail;
+    }
+    goto native;
+op_CALL_NATIVE:
+    address = pc->imm;
+native:
+    result = call_native(address, r, function->arguments.data() + pc->a, pc->b);
+    D = ir_wrap(pc->type, result);
+    NEXT;
+
+call:
+    if(frames.size() >= MaxDepth)
+    {
+        error = "Call stack overflow";
+        goto fail;
+    }
+    frames.push_back(Frame{function, pc, base, top, pc->d});
+    {
+        // (The register array may move as it grows.)
+        size_t next = base + function->registers.size();
+        if(registers.size() < next + callee->registers.size())
+        {
+            registers.resize(std::max(next + callee->registers.size(), 2 * registers.size()));
+        }
+        const int64_t * caller = registers.data() + base;
+        const uint32_t * arguments = function->arguments.data() + pc->a;
+        r = registers.data() + next;
+        std::copy(callee->registers.begin(), callee->registers.end(), r);
+        size_t count = std::min<size_t>(pc->b, callee->params.size());
+        for(size_t i = 0;i < count;i++) r[callee->params[i]] = caller[arguments[i]];
+
+        function = callee;
+        base = next;
+        pc = callee->code.data();
+    }
+    DISPATCH;
+
+op_JUMP: pc = function->code.data() + pc->imm; DISPATCH;
+op_BRANCH: pc = function->code.data() + (A != 0 ? pc->imm : pc->b); DISPATCH;
+op_CASE:
+    if(A != pc->imm)
+    {
+        NEXT;
+    }
+    pc = function->code.data() + pc->b;
+    DISPATCH;
+op_RET: result = A; goto ret;
+op_RET_VOID: result = 0; goto ret;
+
+ret:
+    if(frames.empty()) return result;
+    {
+        const Frame& frame = frames.back();
+        function = frame.function;
+        pc = frame.pc;
+        base = frame.base;
+        top = frame.top;
+        r = registers.data() + base;
+        r[frame.result] = result;
+        frames.pop_back();
+    }
+    NEXT;
+
+divide:
+    error = "Division by zero or overflow";
+    goto fail;
+shift:
+    error = "Shift out of range";
+fail:
+    throw InterpreterError(error + " in " + function->name);
+
+#undef DISPATCH
+#undef NEXT
+#undef D
+#undef A
+#undef B
+}
@@ -0,0 +1,699 @@
+#include <algorithm>
+#include <sstream>
+
+#include "ir.h"
+
+static const char * op_names[] = {
+    "const", "param", "global", "alloca",
+    "add", "sub", "mul", "sdiv", "udiv", "srem", "urem", "and", "or", "xor", "shl", "sar", "shr",
+    "neg", "not",
+    "eq", "ne", "slt", "sle", "sgt", "sge", "ult", "ule", "ugt", "uge",
+    "sext", "zext", "trunc",
+    "select",
+    "load", "store",
+    "vadd", "vsub", "vand", "vor", "vxor",
+    "call",
+    "phi",
+    "copy",
+    "jump", "branch", "switch", "ret"
+};
+
+static const char * type_names[] = {"void", "i8", "i16", "i32", "i64"};
+
+const char * ir_op_str(IrOp op)
+{
+    return op_names[static_cast<int>(op)];
+}
+
+const char * ir_type_str(IrType type)
+{
+    return type_names[static_cast<int>(type)];
+}
+
+int ir_type_size(IrType type)
+{
+    static const int sizes[] = {0, 1, 2, 4, 8};
+    return sizes[static_cast<int>(type)];
+}
+
+int64_t ir_wrap(IrType type, int64_t value)
+{
+    switch(type)
+    {
+        case IrType::I8: return static_cast<int8_t>(value);
+        case IrType::I16: return static_cast<int16_t>(value);
+        case IrType::I32: return static_cast<int32_t>(value);
+        default: return value;
+    }
+}
+
+bool ir_evaluate(IrOp op, IrType type, IrType operand_type, int64_t a, int64_t b, int64_t& result)
+{
+    // Unsigned operations see the operands zero-extended from their width. Others work on
+    // 64-bit two's complement, and wrap the result.
+    int bits = 8 * ir_type_size(operand_type);
+    uint64_t mask = bits == 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1;
+    uint64_t ua = static_cast<uint64_t>(a) & mask, ub = static_cast<uint64_t>(b) & mask;
+    bool overflow = b == -1 && static_cast<uint64_t>(a) == ~uint64_t(0) << (bits - 1);
+    uint64_t value;
+    switch(op)
+    {
+        case IrOp::ADD: value = ua + ub; break;
+        case IrOp::SUB: value = ua - ub; break;
+        case IrOp::MUL: value = ua * ub; break;
+        case IrOp::SDIV:
+            if(b == 0 || overflow) return false;
+            value = a / b;
+            break;
+        case IrOp::SREM:
+            if(b == 0 || overflow) return false;
+            value = a % b;
+            break;
+        case IrOp::UDIV:
+            if(ub == 0) return false;
+            value = ua / ub;
+            break;
+        case IrOp::UREM:
+            if(ub == 0) return false;
+            value = ua % ub;
+            break;
+        case IrOp::AND: value = ua & ub; break;
+        case IrOp::OR: value = ua | ub; break;
+        case IrOp::XOR: value = ua ^ ub; break;
+        case IrOp::SHL:
+        case IrOp::SAR:
+        case IrOp::SHR:
+            if(b < 0 || b >= bits) return false;
+            value = op == IrOp::SHL ? ua << b : op == IrOp::SAR ? a >> b : ua >> b;
+            break;
+        case IrOp::NEG: value = 0 - ua; break;
+        case IrOp::NOT: value = ~ua; break;
+        case IrOp::EQ: value = a == b; break;
+        case IrOp::NE: value = a != b; break;
+        case IrOp::SLT: value = a < b; break;
+        case IrOp::SLE: value = a <= b; break;
+        case IrOp::SGT: value = a > b; break;
+        case IrOp::SGE: value = a >= b; break;
+        case IrOp::ULT: value = ua < ub; break;
+        case IrOp::ULE: value = ua <= ub; break;
+        case IrOp::UGT: value = ua > ub; break;
+        case IrOp::UGE: value = ua >= ub; break;
+        case IrOp::SEXT: value = a; break;
+        case IrOp::ZEXT: value = ua; break;
+        case IrOp::TRUNC: value = a; break;
+        default: return false;
+    }
+    result = ir_wrap(type, static_cast<int64_t>(value));
+    return true;
+}
+
+IrBlockId IrFunction::add_block()
+{
+    blocks.emplace_back();
+    return blocks.size() - 1;
+}
+
+void IrFunction::add_edge(IrBlockId from, IrBlockId to)
+{
+    blocks[from].succs.push_back(to);
+    blocks[to].preds.push_back(from);
+}
+
+void IrFunction::remove_pred(IrBlockId block, size_t index)
+{
+    IrBlock& target = blocks[block];
+    target.preds.erase(target.preds.begin() + index);
+    for(IrValue value : target.code)
+    {
+        IrInstr& instr = instrs[value];
+        if(instr.op != IrOp::PHI) break;
+
+        auto first = operand_pool.begin() + instr.first;
+        std::copy(first + index + 1, first + instr.count, first + index);
+        instr.count--;
+    }
+}
+
+void IrFunction::fold_terminator(IrBlockId block, size_t taken)
+{
+    // Edges are removed from the last, so the predecessors of earlier edges keep their
+    // positions.
+    auto& succs = blocks[block].succs;
+    for(size_t i = succs.size();i-- > 0;)
+    {
+        if(i == taken) continue;
+        size_t k = std::count(succs.begin(), succs.begin() + i, succs[i]);
+        const auto& preds = blocks[succs[i]].preds;
+        size_t index = 0;
+        while(preds[index] != block || k-- > 0) index++;
+        remove_pred(succs[i], index);
+    }
+    IrBlockId target = succs[taken];
+    succs.assign(1, target);
+
+    IrInstr& instr = instrs[terminator(block)];
+    instr.op = IrOp::JUMP;
+    instr.count = 0;
+}
+
+bool IrFunction::remove_unreachable()
+{
+    std::vector<bool> reachable(blocks.size(), false);
+    std::vector<IrBlockId> stack{0};
+    reachable[0] = true;
+    while(!stack.empty())
+    {
+        IrBlockId b = stack.back();
+        stack.pop_back();
+        for(IrBlockId succ : blocks[b].succs)
+        {
+            if(!reachable[succ])
+            {
+                reachable[succ] = true;
+                stack.push_back(succ);
+            }
+        }
+    }
+
+    bool removed = false;
+    for(IrBlockId b = 0;b < blocks.size();b++)
+    {
+        if(reachable[b] || (blocks[b].code.empty() && blocks[b].succs.empty())) continue;
+
+        for(IrBlockId succ : blocks[b].succs)
+        {
+            if(!reachable[succ]) continue;
+            auto& preds = blocks[succ].preds;
+            remove_pred(succ, std::find(preds.begin(), preds.end(), b) - preds.begin());
+        }
+        blocks[b] = IrBlock();
+        removed = true;
+    }
+    return removed;
+}
+
+bool IrFunction::split_critical_edges()
+{
+    bool split = false;
+    size_t count = blocks.size();
+    for(IrBlockId b = 0;b < count;b++)
+    {
+        if(blocks[b].succs.size() < 2) continue;
+        for(size_t i = 0;i < blocks[b].succs.size();i++)
+        {
+            // (A block without phis whose only predecessor is this one, along several edges,
+            // is such a shared block already.)
+            IrBlockId succ = blocks[b].succs[i];
+            auto& preds = blocks[succ].preds;
+            bool single = std::count(preds.begin(), preds.end(), b) == static_cast<long>(preds.size())
+                && instrs[blocks[succ].code[0]].op != IrOp::PHI;
+            if(preds.size() < 2 || single) continue;
+
+            // Edges of a switch to the same block share one new block, if the phis take the
+            // same values along them (so the cases can be tested together).
+            size_t edge = std::find(preds.begin(), preds.end(), b) - preds.begin();
+            IrBlockId shared = IrNone;
+            for(size_t j = 0;j < i && shared == IrNone;j++)
+            {
+                IrBlockId middle = blocks[b].succs[j];
+                if(middle < count || blocks[middle].succs[0] != succ) continue;
+                size_t other = std::find(preds.begin(), preds.end(), middle) - preds.begin();
+                bool same = true;
+                for(IrValue value : blocks[succ].code)
+                {
+                    if(instrs[value].op != IrOp::PHI) break;
+                    same = same && operand(value, edge) == operand(value, other);
+                }
+                if(same) shared = middle;
+            }
+            if(shared != IrNone)
+            {
+                remove_pred(succ, edge);
+                blocks[b].succs[i] = shared;
+                blocks[shared].preds.push_back(b);
+                split = true;
+                continue;
+            }
+
+            // The new block takes the edge's place in both lists, so phi operands still
+            // line up with the predecessors.
+            IrBlockId middle = add_block();
+            append(middle, IrOp::JUMP, IrType::VOID);
+            blocks[succ].preds[edge] = middle;
+            blocks[b].succs[i] = middle;
+            blocks[middle].preds.push_back(b);
+            blocks[middle].succs.push_back(succ);
+            split = true;
+        }
+    }
+    return split;
+}
+
+IrValue IrFunction::create(IrOp op, IrType type, const std::vector<IrValue>& operands, int64_t imm)
+{
+    IrInstr instr;
+    instr.op = op;
+    instr.type = type;
+    instr.block = UINT32_MAX;
+    instr.first = operand_pool.size();
+    instr.count = operands.size();
+    instr.imm = imm;
+    operand_pool.insert(operand_pool.end(), operands.begin(), operands.end());
+    instrs.push_back(instr);
+    return instrs.size() - 1;
+}
+
+IrValue IrFunction::append(
+    IrBlockId block, IrOp op, IrType type, const std::vector<IrValue>& operands, int64_t imm)
+{
+    IrValue value = create(op, type, operands, imm);
+    instrs[value].block = block;
+    blocks[block].code.push_back(value);
+    return value;
+}
+
+void IrFunction::set_operands(IrValue value, const std::vector<IrValue>& operands)
+{
+    IrInstr& instr = instrs[value];
+    if(operands.size() > instr.count)
+    {
+        instr.first = operand_pool.size();
+        operand_pool.resize(operand_pool.size() + operands.size());
+    }
+    std::copy(operands.begin(), operands.end(), operand_pool.begin() + instr.first);
+    instr.count = operands.size();
+}
+
+void IrFunction::replace_uses(std::vector<IrValue>& replacements)
+{
+    // Resolve chains (a -> b -> c) first, so each operand is rewritten once.
+    for(IrValue value = 0;value < replacements.size();value++)
+    {
+        IrValue target = replacements[value];
+        while(target != IrNone && target < replacements.size() && replacements[target] != IrNone)
+        {
+            target = replacements[target];
+        }
+        replacements[value] = target;
+    }
+
+    for(auto& operand : operand_pool)
+    {
+        if(operand < replacements.size() && replacements[operand] != IrNone)
+        {
+            operand = replacements[operand];
+        }
+    }
+}
+
+bool IrFunction::speculatable(IrValue value) const
+{
+    const IrInstr& instr = instrs[value];
+    switch(instr.op)
+    {
+        case IrOp::SDIV:
+        case IrOp::UDIV:
+        case IrOp::SREM:
+        case IrOp::UREM:
+        {
+            const IrInstr& divisor = instrs[operand(value, 1)];
+            return divisor.op == IrOp::CONST && divisor.imm != 0 && divisor.imm != -1;
+        }
+        case IrOp::SHL:
+        case IrOp::SAR:
+        case IrOp::SHR:
+        {
+            const IrInstr& amount = instrs[operand(value, 1)];
+            return amount.op == IrOp::CONST && amount.imm >= 0 && amount.imm < 8 * ir_type_size(instr.type);
+        }
+        case IrOp::ALLOCA:
+        case IrOp::PARAM:
+        case IrOp::LOAD:
+        case IrOp::STORE:
+        case IrOp::VADD:
+        case IrOp::VSUB:
+        case IrOp::VAND:
+        case IrOp::VOR:
+        case IrOp::VXOR:
+        case IrOp::CALL:
+        case IrOp::PHI:
+        case IrOp::JUMP:
+        case IrOp::BRANCH:
+        case IrOp::SWITCH:
+        case IrOp::RET:
+            return false;
+        default:
+            return true;
+    }
+}
+
+void IrFunction::compact()
+{
+    std::vector<IrValue> index(instrs.size(), IrNone);
+    IrValue next = 0;
+    for(auto& block : blocks)
+    {
+        for(IrValue value : block.code)
+        {
+            index[value] = next++;
+        }
+    }
+
+    std::vector<IrBlockId> renumber(blocks.size(), UINT32_MAX);
+    IrBlockId kept = 0;
+    for(IrBlockId b = 0;b < blocks.size();b++)
+    {
+        if(b == 0 || !blocks[b].code.empty())
+        {
+            renumber[b] = kept++;
+        }
+    }
+
+    std::vector<IrInstr> compacted;
+    std::vector<IrValue> pool;
+    std::vector<IrBlock> renumbered(kept);
+    compacted.reserve(next);
+    for(IrBlockId b = 0;b < blocks.size();b++)
+    {
+        if(renumber[b] == UINT32_MAX) continue;
+
+        IrBlock& block = renumbered[renumber[b]];
+        block = std::move(blocks[b]);
+        for(auto& pred : block.preds) pred = renumber[pred];
+        for(auto& succ : block.succs) succ = renumber[succ];
+        for(IrValue& value : block.code)
+        {
+            IrInstr instr = instrs[value];
+            instr.block = renumber[b];
+            instr.first = pool.size();
+            for(IrValue operand : operands(value))
+            {
+                pool.push_back(operand == IrNone ? IrNone : index[operand]);
+            }
+            compacted.push_back(instr);
+            value = index[value];
+        }
+    }
+    instrs = std::move(compacted);
+    operand_pool = std::move(pool);
+    blocks = std::move(renumbered);
+}
+
+std::string IrFunction::verify() const
+{
+    std::ostringstream problem;
+    std::vector<bool> placed(instrs.size(), false);
+    for(IrBlockId b = 0;b < blocks.size();b++)
+    {
+        for(IrValue value : blocks[b].code)
+        {
+            if(value >= instrs.size() || placed[value])
+            {
+                problem << "b" << b << ": invalid or repeated instruction %" << value;
+                return problem.str();
+            }
+            placed[value] = true;
+        }
+    }
+
+    if(!blocks.empty() && !blocks[0].preds.empty())
+    {
+        return "b0: entry block has predecessors";
+    }
+
+    for(IrBlockId b = 0;b < blocks.size();b++)
+    {
+        const IrBlock& block = blocks[b];
+        if(block.code.empty())
+        {
+            // (Removed block.)
+            if(!block.preds.empty() || !block.succs.empty())
+            {
+                problem << "b" << b << ": no terminator";
+                return problem.str();
+            }
+            continue;
+        }
+
+        bool body = false;
+        for(size_t i = 0;i < block.code.size();i++)
+        {
+            IrValue value = block.code[i];
+            const IrInstr& instr = instrs[value];
+            if(instr.block != b)
+            {
+                problem << "%" << value << ": wrong block";
+                return problem.str();
+            }
+            if(ir_is_terminator(instr.op) != (i == block.code.size() - 1))
+            {
+                problem << "b" << b << ": terminator is not last";
+                return problem.str();
+            }
+            if(instr.op == IrOp::PHI && (body || instr.count != block.preds.size()))
+            {
+                problem << "%" << value << ": invalid phi";
+                return problem.str();
+            }
+            body = body || instr.op != IrOp::PHI;
+
+            for(IrValue operand : operands(value))
+            {
+                if(operand >= instrs.size() || !placed[operand] || instrs[operand].type == IrType::VOID)
+                {
+                    problem << "%" << value << ": invalid operand";
+                    return problem.str();
+                }
+            }
+            if(instr.op == IrOp::SELECT && (instr.count != 3
+                || instrs[operand(value, 1)].type != instr.type || instrs[operand(value, 2)].type != instr.type))
+            {
+                problem << "%" << value << ": invalid select";
+                return problem.str();
+            }
+        }
+
+        IrValue terminator = block.code.back();
+        IrOp op = instrs[terminator].op;
+        size_t succs = op == IrOp::JUMP ? 1 : op == IrOp::BRANCH ? 2 : op == IrOp::SWITCH ? instrs[terminator].count : 0;
+        if(block.succs.size() != succs)
+        {
+            problem << "b" << b << ": wrong number of successors";
+            return problem.str();
+        }
+        if(op == IrOp::SWITCH)
+        {
+            std::vector<int64_t> cases;
+            for(uint32_t i = 1;i < instrs[terminator].count;i++)
+            {
+                const IrInstr& c = instrs[operand(terminator, i)];
+                if(c.op != IrOp::CONST || c.type != instrs[operand(terminator, 0)].type)
+                {
+                    problem << "%" << terminator << ": invalid case";
+                    return problem.str();
+                }
+                cases.push_back(c.imm);
+            }
+            std::sort(cases.begin(), cases.end());
+            if(std::adjacent_find(cases.begin(), cases.end()) != cases.end())
+            {
+                problem << "%" << terminator << ": duplicate case";
+                return problem.str();
+            }
+        }
+        for(IrBlockId succ : block.succs)
+        {
+            size_t out = 0, in = 0;
+            for(IrBlockId s : block.succs) out += (s == succ);
+            for(IrBlockId p : blocks[succ].preds) in += (p == b);
+            if(out != in)
+            {
+                problem << "b" << b << " -> b" << succ << ": inconsistent edge";
+                return problem.str();
+            }
+        }
+        for(IrBlockId pred : block.preds)
+        {
+            size_t out = 0;
+            for(IrBlockId s : blocks[pred].succs) out += (s == b);
+            if(out == 0)
+            {
+                problem << "b" << pred << " -> b" << b << ": inconsistent edge";
+                return problem.str();
+            }
+        }
+    }
+    return "";
+}
+
+IrUses::IrUses(const IrFunction& function)
+    : offsets(function.instrs.size() + 1, 0)
+{
+    // Count the uses of each value, then fill in the users.
+    for(auto& block : function.blocks)
+    {
+        for(IrValue value : block.code)
+        {
+            for(IrValue operand : function.operands(value))
+            {
+                offsets[operand + 1]++;
+            }
+        }
+    }
+    for(size_t i = 1;i < offsets.size();i++)
+    {
+        offsets[i] += offsets[i - 1];
+    }
+
+    list.resize(offsets.back());
+    std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+    for(auto& block : function.blocks)
+    {
+        for(IrValue value : block.code)
+        {
+            for(IrValue operand : function.operands(value))
+            {
+                list[next[operand]++] = value;
+            }
+        }
+    }
+}
+
+int IrModule::symbol(const std::string& name)
+{
+    auto inserted = names.insert({name, static_cast<int>(symbols.size())});
+    if(inserted.second)
+    {
+        symbols.emplace_back();
+        symbols.back().name = name;
+    }
+    return inserted.first->second;
+}
+
+int IrModule::find(const std::string& name) const
+{
+    auto it = names.find(name);
+    return it == names.end() ? -1 : it->second;
+}
+
+static std::string symbol_name(int symbol, const IrModule * module)
+{
+    if(module && symbol >= 0 && symbol < static_cast<int>(module->symbols.size()))
+    {
+        return "@" + module->symbols[symbol].name;
+    }
+    return "@" + std::to_string(symbol);
+}
+
+std::string ir_str(const IrFunction& function, const IrModule * module)
+{
+    std::ostringstream out;
+    out << "function " << ir_type_str(function.result) << " " << function.name << "(";
+    for(size_t i = 0;i < function.params.size();i++)
+    {
+        out << (i ? ", " : "") << ir_type_str(function.params[i]);
+    }
+    out << ")\n";
+
+    for(IrBlockId b = 0;b < function.blocks.size();b++)
+    {
+        const IrBlock& block = function.blocks[b];
+        if(block.code.empty()) continue;
+
+        out << "b" << b;
+        if(!block.preds.empty())
+        {
+            out << " <-";
+            for(IrBlockId pred : block.preds) out << " b" << pred;
+        }
+        out << ":\n";
+
+        for(IrValue value : block.code)
+        {
+            const IrInstr& instr = function.instrs[value];
+            out << "    ";
+            if(instr.type != IrType::VOID)
+            {
+                out << "%" << value << " = ";
+            }
+            out << ir_op_str(instr.op);
+            if(instr.type != IrType::VOID)
+            {
+                out << " " << ir_type_str(instr.type);
+            }
+            else if(ir_is_vector(instr.op))
+            {
+                out << " " << ir_type_str(static_cast<IrType>(instr.imm));
+            }
+
+            const char * separator = " ";
+            for(IrValue operand : function.operands(value))
+            {
+                out << separator << "%" << operand;
+                separator = ", ";
+            }
+            switch(instr.op)
+            {
+                case IrOp::CONST:
+                case IrOp::PARAM:
+                case IrOp::ALLOCA:
+                    out << " " << instr.imm;
+                    break;
+                case IrOp::GLOBAL:
+                    out << " " << symbol_name(instr.imm, module);
+                    break;
+                case IrOp::JUMP:
+                case IrOp::BRANCH:
+                case IrOp::SWITCH:
+                    for(IrBlockId succ : block.succs)
+                    {
+                        out << separator << "b" << succ;
+                        separator = ", ";
+                    }
+                    break;
+                default:
+                    break;
+            }
+            out << "\n";
+        }
+    }
+    return out.str();
+}
+
+std::string ir_str(const IrModule& module)
+{
+    std::ostringstream out;
+    for(auto& symbol : module.symbols)
+    {
+        if(symbol.function)
+        {
+            if(!symbol.defined) out << "declare @" << symbol.name << "\n";
+            continue;
+        }
+        if(!symbol.defined)
+        {
+            out << "extern @" << symbol.name << "\n";
+            continue;
+        }
+        out << "object @" << symbol.name << " " << symbol.size << " " << symbol.align;
+        if(symbol.reference >= 0)
+        {
+            out << " = @" << module.symbols[symbol.reference].name;
+        }
+        else if(!symbol.data.empty())
+        {
+            static const char digits[] = "0123456789abcdef";
+            out << " = ";
+            for(unsigned char c : symbol.data)
+            {
+                out << digits[c >> 4] << digits[c & 0xF];
+            }
+        }
+        out << "\n";
+    }
+    for(auto& function : module.functions)
+    {
+        out << "\n" << ir_str(*function, &module);
+    }
+    return out.str();
+}
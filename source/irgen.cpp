@@ -0,0 +1,1024 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "irgen.h"
+#include "fold.h"
+
+static std::shared_ptr<DerivedCType> derived(const std::shared_ptr<CType>& type, DerivedCTypeType kind)
+{
+    auto ctype = std::dynamic_pointer_cast<DerivedCType>(type);
+    return (ctype && ctype->type == kind) ? ctype : nullptr;
+}
+
+static bool is_void(const std::shared_ptr<CType>& type)
+{
+    return std::dynamic_pointer_cast<VoidCType>(type) != nullptr;
+}
+
+// Types whose values are addresses (pointers, and arrays and functions, which are
+// converted to pointers).
+static bool is_address(const std::shared_ptr<CType>& type)
+{
+    return std::dynamic_pointer_cast<DerivedCType>(type) != nullptr;
+}
+
+static bool is_unsigned(const std::shared_ptr<CType>& type)
+{
+    auto basic = std::dynamic_pointer_cast<BasicCType>(type);
+    return basic && basic->signedness == BasicCTypeSignedness::UNSIGNED;
+}
+
+// Objects declared 'static' have static storage duration (6.2.4, 3). (The storage class is
+// kept with the specifiers: on the innermost type of a pointer or array declarator.)
+static bool is_static(std::shared_ptr<CType> type)
+{
+    while(auto d = std::dynamic_pointer_cast<DerivedCType>(type)) type = d->base;
+    auto basic = std::dynamic_pointer_cast<BasicCType>(type);
+    return basic && basic->storage == BasicCTypeStorage::STATIC;
+}
+
+static PackedCType packed(const std::shared_ptr<CType>& type)
+{
+    return std::static_pointer_cast<BasicCType>(type)->packed();
+}
+
+// Type of values of a C type (after promotion).
+static IrType value_type(const std::shared_ptr<CType>& type)
+{
+    if(is_void(type)) return IrType::VOID;
+    return is_address(type) ? IrType::I64 : IrType::I32;
+}
+
+// Type of objects of a C type in memory.
+static IrType memory_type(const std::shared_ptr<CType>& type)
+{
+    auto basic = std::dynamic_pointer_cast<BasicCType>(type);
+    if(!basic) return IrType::I64;
+    switch(basic->type)
+    {
+        case BasicCTypeType::CHAR:
+            return IrType::I8;
+        case BasicCTypeType::SHORT_INT:
+            return IrType::I16;
+        default:
+            return IrType::I32;
+    }
+}
+
+// Type pointed to by a pointer (or the element type of an array).
+static std::shared_ptr<CType> pointee(const std::shared_ptr<CType>& type)
+{
+    auto ctype = std::static_pointer_cast<DerivedCType>(type);
+    return ctype->type == DerivedCTypeType::FUNCTION ? type : ctype->base;
+}
+
+// Expressions which are lowered to the address of an object (or function), rather than
+// to a value.
+static bool is_addressable(ExprAstNode& expr)
+{
+    if(auto primary = dynamic_cast<PrimaryExprAstNode *>(&expr))
+    {
+        return primary->token->type != TOK_INTEGER_CONSTANT;
+    }
+    if(auto unary = dynamic_cast<UnaryExprAstNode *>(&expr))
+    {
+        return unary->type == UnaryType::DEREF;
+    }
+    if(auto postfix = dynamic_cast<PostfixExprAstNode *>(&expr))
+    {
+        return postfix->type == PostfixType::ARRAY;
+    }
+    return false;
+}
+
+static BinaryType compound_operator(AssignExprType type)
+{
+    switch(type)
+    {
+        case AssignExprType::PLUS: return BinaryType::ADD;
+        case AssignExprType::MINUS: return BinaryType::SUB;
+        case AssignExprType::MUL: return BinaryType::MUL;
+        case AssignExprType::DIV: return BinaryType::DIV;
+        case AssignExprType::MOD: return BinaryType::MOD;
+        case AssignExprType::XOR: return BinaryType::BITWISE_EXCL_OR;
+        case AssignExprType::AND: return BinaryType::BITWISE_AND;
+        case AssignExprType::OR: return BinaryType::BITWISE_INCL_OR;
+        case AssignExprType::SHIFT_LEFT: return BinaryType::SHIFT_LEFT;
+        default: return BinaryType::SHIFT_RIGHT;
+    }
+}
+
+IrGenerator::IrGenerator(IrModule& module)
+    : module(module)
+{
+}
+
+void IrGenerator::generate(TranslationUnitAstNode& node)
+{
+    node.accept(*this);
+}
+
+void IrGenerator::push(AstNode * node, bool value)
+{
+    frames.push_back(Frame{node, value, 0, {0, 0, 0}, IrNone});
+}
+
+// Pop the current (expression) frame, and push its result.
+void IrGenerator::finish(IrValue lowered)
+{
+    Frame frame = frames.back();
+    frames.pop_back();
+    values.push_back(frame.value ? rvalue(*static_cast<ExprAstNode *>(frame.node), lowered) : lowered);
+}
+
+IrValue IrGenerator::pop()
+{
+    IrValue value = values.back();
+    values.pop_back();
+    return value;
+}
+
+IrValue IrGenerator::emit(IrOp op, IrType type, const std::vector<IrValue>& operands, int64_t imm)
+{
+    return function->append(block, op, type, operands, imm);
+}
+
+IrValue IrGenerator::constant(IrType type, int64_t value)
+{
+    return emit(IrOp::CONST, type, {}, value);
+}
+
+void IrGenerator::jump(IrBlockId target)
+{
+    emit(IrOp::JUMP, IrType::VOID);
+    function->add_edge(block, target);
+}
+
+void IrGenerator::branch(IrValue condition, IrBlockId then, IrBlockId otherwise)
+{
+    emit(IrOp::BRANCH, IrType::VOID, {condition});
+    function->add_edge(block, then);
+    function->add_edge(block, otherwise);
+}
+
+// Value of an expression, from the result of lowering it. Objects are loaded, and arrays
+// and functions are converted to their address (6.3.2.1, 2-4).
+IrValue IrGenerator::rvalue(ExprAstNode& expr, IrValue lowered)
+{
+    if(!is_addressable(expr)
+        || derived(expr.ctype, DerivedCTypeType::ARRAY)
+        || derived(expr.ctype, DerivedCTypeType::FUNCTION))
+    {
+        return lowered;
+    }
+    return load(lowered, expr.ctype);
+}
+
+IrValue IrGenerator::load(IrValue address, const std::shared_ptr<CType>& type)
+{
+    IrType memory = memory_type(type);
+    IrValue value = emit(IrOp::LOAD, memory, {address});
+    if(memory == IrType::I8 || memory == IrType::I16)
+    {
+        value = emit(is_unsigned(type) ? IrOp::ZEXT : IrOp::SEXT, IrType::I32, {value});
+    }
+    return value;
+}
+
+// Store a value (of type 'from') to an object of type 'to'. Returns the value stored (the
+// value of an assignment expression - 6.5.16, 3).
+IrValue IrGenerator::assign(
+    IrValue address,
+    IrValue value,
+    const std::shared_ptr<CType>& from,
+    const std::shared_ptr<CType>& to)
+{
+    value = widen(value, from, to);
+    IrType memory = memory_type(to);
+    if(memory == IrType::I8 || memory == IrType::I16)
+    {
+        IrValue narrow = emit(IrOp::TRUNC, memory, {value});
+        emit(IrOp::STORE, IrType::VOID, {address, narrow});
+        return emit(is_unsigned(to) ? IrOp::ZEXT : IrOp::SEXT, IrType::I32, {narrow});
+    }
+    emit(IrOp::STORE, IrType::VOID, {address, value});
+    return value;
+}
+
+// Convert between integer (I32) and pointer (I64) values.
+IrValue IrGenerator::widen(IrValue value, const std::shared_ptr<CType>& from, const std::shared_ptr<CType>& to)
+{
+    IrType source = value_type(from), target = value_type(to);
+    if(target == IrType::VOID) return IrNone;
+    if(source == target) return value;
+    if(target == IrType::I64)
+    {
+        return emit(is_unsigned(from) ? IrOp::ZEXT : IrOp::SEXT, IrType::I64, {value});
+    }
+    return emit(IrOp::TRUNC, IrType::I32, {value});
+}
+
+// Convert a value to another type (6.3.1.3). Conversions to char and short are truncated and
+// extended again.
+IrValue IrGenerator::convert(IrValue value, const std::shared_ptr<CType>& from, const std::shared_ptr<CType>& to)
+{
+    value = widen(value, from, to);
+    IrType memory = memory_type(to);
+    if(value != IrNone && (memory == IrType::I8 || memory == IrType::I16))
+    {
+        IrValue narrow = emit(IrOp::TRUNC, memory, {value});
+        value = emit(is_unsigned(to) ? IrOp::ZEXT : IrOp::SEXT, IrType::I32, {narrow});
+    }
+    return value;
+}
+
+// Compare a scalar value with 0.
+IrValue IrGenerator::truth(IrValue value, const std::shared_ptr<CType>& type)
+{
+    return emit(IrOp::NE, IrType::I32, {value, constant(value_type(type), 0)});
+}
+
+// Byte offset of 'index' elements of the type pointed to by 'pointer'.
+IrValue IrGenerator::offset(
+    IrValue index,
+    const std::shared_ptr<CType>& type,
+    const std::shared_ptr<CType>& pointer)
+{
+    int size = layout.size_of(*pointee(pointer));
+    IrValue bytes = widen(index, type, pointer);
+    if(size != 1)
+    {
+        bytes = emit(IrOp::MUL, IrType::I64, {bytes, constant(IrType::I64, size)});
+    }
+    return bytes;
+}
+
+// Arithmetic, relational and equality operators (6.5.5 - 6.5.12), for operands of types
+// 'lt' and 'rt'.
+IrValue IrGenerator::arithmetic(
+    BinaryType op,
+    IrValue left,
+    IrValue right,
+    const std::shared_ptr<CType>& lt,
+    const std::shared_ptr<CType>& rt)
+{
+    bool lp = is_address(lt), rp = is_address(rt);
+
+    // Pointer arithmetic (6.5.6, 8-9).
+    if(op == BinaryType::ADD && (lp || rp))
+    {
+        return lp
+            ? emit(IrOp::ADD, IrType::I64, {left, offset(right, rt, lt)})
+            : emit(IrOp::ADD, IrType::I64, {right, offset(left, lt, rt)});
+    }
+    if(op == BinaryType::SUB && lp && !rp)
+    {
+        return emit(IrOp::SUB, IrType::I64, {left, offset(right, rt, lt)});
+    }
+    if(op == BinaryType::SUB && lp)
+    {
+        IrValue difference = emit(IrOp::SUB, IrType::I64, {left, right});
+        int size = layout.size_of(*pointee(lt));
+        if(size != 1)
+        {
+            difference = emit(IrOp::SDIV, IrType::I64, {difference, constant(IrType::I64, size)});
+        }
+        return emit(IrOp::TRUNC, IrType::I32, {difference});
+    }
+
+    // Pointer comparisons are unsigned. (Null pointer constants are converted.)
+    bool is_unsigned;
+    IrType type = IrType::I32;
+    if(lp || rp)
+    {
+        left = lp ? left : widen(left, lt, rt);
+        right = rp ? right : widen(right, rt, lt);
+        is_unsigned = true;
+        type = IrType::I64;
+    }
+    else if(op == BinaryType::SHIFT_LEFT || op == BinaryType::SHIFT_RIGHT)
+    {
+        is_unsigned = integer_promotion(packed(lt)) == PackedUnsignedInt;
+    }
+    else
+    {
+        is_unsigned = usual_arithmetic_conversion(packed(lt), packed(rt)) == PackedUnsignedInt;
+    }
+
+    IrOp ir;
+    switch(op)
+    {
+        case BinaryType::MUL: ir = IrOp::MUL; break;
+        case BinaryType::DIV: ir = is_unsigned ? IrOp::UDIV : IrOp::SDIV; break;
+        case BinaryType::MOD: ir = is_unsigned ? IrOp::UREM : IrOp::SREM; break;
+        case BinaryType::ADD: ir = IrOp::ADD; break;
+        case BinaryType::SUB: ir = IrOp::SUB; break;
+        case BinaryType::SHIFT_LEFT: ir = IrOp::SHL; break;
+        case BinaryType::SHIFT_RIGHT: ir = is_unsigned ? IrOp::SHR : IrOp::SAR; break;
+        case BinaryType::LT: ir = is_unsigned ? IrOp::ULT : IrOp::SLT; break;
+        case BinaryType::GT: ir = is_unsigned ? IrOp::UGT : IrOp::SGT; break;
+        case BinaryType::LE: ir = is_unsigned ? IrOp::ULE : IrOp::SLE; break;
+        case BinaryType::GE: ir = is_unsigned ? IrOp::UGE : IrOp::SGE; break;
+        case BinaryType::EQ: ir = IrOp::EQ; break;
+        case BinaryType::NE: ir = IrOp::NE; break;
+        case BinaryType::BITWISE_AND: ir = IrOp::AND; break;
+        case BinaryType::BITWISE_EXCL_OR: ir = IrOp::XOR; break;
+        default: ir = IrOp::OR; break;
+    }
+    return emit(ir, ir_is_comparison(ir) ? IrType::I32 : type, {left, right});
+}
+
+// Increment or decrement the object at 'address' (6.5.2.4, 6.5.3.1). Returns the new value
+// (prefix), or the old value (postfix).
+IrValue IrGenerator::step(ExprAstNode& operand, IrValue address, bool increment, bool prefix)
+{
+    auto& type = operand.ctype;
+    IrValue old = load(address, type);
+    IrValue updated;
+    if(is_address(type))
+    {
+        int size = layout.size_of(*pointee(type));
+        updated = emit(IrOp::ADD, IrType::I64, {old, constant(IrType::I64, increment ? size : -size)});
+    }
+    else
+    {
+        updated = emit(IrOp::ADD, IrType::I32, {old, constant(IrType::I32, increment ? 1 : -1)});
+    }
+    updated = assign(address, updated, type, type);
+    return prefix ? updated : old;
+}
+
+// Define a module symbol for an object with static storage duration. Initializers are
+// constants, string literals and addresses of objects (see ConstantFolder and TypeChecker).
+int IrGenerator::object(const DeclAstNode& decl, const std::string& name)
+{
+    int index = module.symbol(name);
+    const TypeLayout& type = layout.layout(*decl.type);
+    module.symbols[index].defined = true;
+    module.symbols[index].size = type.size;
+    module.symbols[index].align = type.align;
+
+    auto address = std::dynamic_pointer_cast<UnaryExprAstNode>(decl.initializer);
+    auto primary = std::dynamic_pointer_cast<PrimaryExprAstNode>(address ? address->right : decl.initializer);
+    if(!primary) return index;
+
+    const std::string& lexeme = primary->token->lexeme;
+    if(primary->token->type == TOK_IDENTIFIER)
+    {
+        // '&x', or an array 'a': a static local has a symbol of its own (see visit(DeclAstNode&)).
+        auto local = locals.find(primary->declaration);
+        int target = local != locals.end()
+            ? static_cast<int>(function->instrs[local->second].imm) : module.symbol(lexeme);
+        module.symbols[index].reference = target;
+    }
+    else if(primary->token->type == TOK_STRING_LITERAL)
+    {
+        if(derived(decl.type, DerivedCTypeType::ARRAY))
+        {
+            // (Excess characters are dropped - 6.7.8, 14.)
+            std::string value = parse_string_literal(lexeme);
+            module.symbols[index].data = value.substr(0, std::min<size_t>(value.size(), type.size));
+        }
+        else
+        {
+            int string = string_literal(*primary->token);
+            module.symbols[index].reference = string;
+        }
+    }
+    else if(!is_address(decl.type))
+    {
+        IntegerConstant value;
+        parse_integer_constant(lexeme, value);
+        std::string& data = module.symbols[index].data;
+        for(int i = 0;i < type.size;i++)
+        {
+            data.push_back(static_cast<char>(value.bits >> (8 * i)));
+        }
+    }
+    return index;
+}
+
+// Define a symbol for a string literal (an array of char, with static storage duration -
+// 6.4.5, 5).
+int IrGenerator::string_literal(const Token& token)
+{
+    int index = module.symbol(".str" + std::to_string(strings++));
+    IrSymbol& symbol = module.symbols[index];
+    symbol.defined = true;
+    symbol.data = parse_string_literal(token.lexeme);
+    symbol.size = symbol.data.size() + 1;
+    symbol.align = 1;
+    return index;
+}
+
+void IrGenerator::visit(PrimaryExprAstNode& node)
+{
+    switch(node.token->type)
+    {
+        case TOK_IDENTIFIER:
+            {
+                auto local = locals.find(node.declaration);
+                if(local != locals.end())
+                {
+                    finish(local->second);
+                }
+                else
+                {
+                    finish(emit(IrOp::GLOBAL, IrType::I64, {}, module.symbol(node.token->lexeme)));
+                }
+            }
+            break;
+        case TOK_STRING_LITERAL:
+            finish(emit(IrOp::GLOBAL, IrType::I64, {}, string_literal(*node.token)));
+            break;
+        default:
+            {
+                IntegerConstant value;
+                parse_integer_constant(node.token->lexeme, value);
+                finish(constant(IrType::I32, value.as_signed()));
+            }
+            break;
+    }
+}
+
+void IrGenerator::visit(BinaryExprAstNode& node)
+{
+    Frame& frame = frames.back();
+    if(node.op != BinaryType::LOGICAL_AND_OP && node.op != BinaryType::LOGICAL_OR_OP)
+    {
+        if(frame.state == 0)
+        {
+            frame.state = 1;
+            push(node.right.get());
+            push(node.left.get());
+            return;
+        }
+        IrValue right = pop();
+        IrValue left = pop();
+        finish(arithmetic(node.op, left, right, node.left->ctype, node.right->ctype));
+        return;
+    }
+
+    // '&&' and '||' only evaluate the right operand if the left one doesn't decide the result
+    // (6.5.13, 4; 6.5.14, 4).
+    bool is_and = node.op == BinaryType::LOGICAL_AND_OP;
+    switch(frame.state)
+    {
+        case 0:
+            frame.state = 1;
+            push(node.left.get());
+            break;
+        case 1:
+            {
+                IrValue left = truth(pop(), node.left->ctype);
+                IrBlockId right = function->add_block();
+                IrBlockId end = function->add_block();
+                frame.saved = constant(IrType::I32, is_and ? 0 : 1);
+                frame.blocks[0] = end;
+                if(is_and)
+                    branch(left, right, end);
+                else
+                    branch(left, end, right);
+                block = right;
+                frame.state = 2;
+                push(node.right.get());
+            }
+            break;
+        default:
+            {
+                IrValue right = truth(pop(), node.right->ctype);
+                IrValue decided = frame.saved;
+                jump(frame.blocks[0]);
+                block = frame.blocks[0];
+                finish(emit(IrOp::PHI, IrType::I32, {decided, right}));
+            }
+            break;
+    }
+}
+
+void IrGenerator::visit(UnaryExprAstNode& node)
+{
+    Frame& frame = frames.back();
+    bool address = node.type == UnaryType::INC
+        || node.type == UnaryType::DEC
+        || node.type == UnaryType::ADDROF;
+    if(frame.state == 0)
+    {
+        frame.state = 1;
+        push(node.right.get(), !address);
+        return;
+    }
+
+    ExprAstNode& operand = *node.right;
+    IrValue value = pop();
+    switch(node.type)
+    {
+        case UnaryType::INC:
+        case UnaryType::DEC:
+            finish(step(operand, value, node.type == UnaryType::INC, true));
+            break;
+        case UnaryType::ADDROF:
+        case UnaryType::DEREF:
+        case UnaryType::PLUS:
+            finish(value);
+            break;
+        case UnaryType::MINUS:
+            finish(emit(IrOp::NEG, IrType::I32, {value}));
+            break;
+        case UnaryType::COMPLEMENT:
+            finish(emit(IrOp::NOT, IrType::I32, {value}));
+            break;
+        case UnaryType::NOT:
+            finish(emit(IrOp::EQ, IrType::I32, {value, constant(value_type(operand.ctype), 0)}));
+            break;
+    }
+}
+
+void IrGenerator::visit(TertiaryExprAstNode& node)
+{
+    Frame& frame = frames.back();
+    switch(frame.state)
+    {
+        case 0:
+            frame.state = 1;
+            push(node.conditional.get());
+            break;
+        case 1:
+            {
+                IrValue condition = truth(pop(), node.conditional->ctype);
+                IrBlockId then = function->add_block();
+                frame.blocks[0] = function->add_block();
+                frame.blocks[1] = function->add_block();
+                branch(condition, then, frame.blocks[0]);
+                block = then;
+                frame.state = 2;
+                push(node.left.get());
+            }
+            break;
+        case 2:
+            frame.saved = convert(pop(), node.left->ctype, node.ctype);
+            jump(frame.blocks[1]);
+            block = frame.blocks[0];
+            frame.state = 3;
+            push(node.right.get());
+            break;
+        default:
+            {
+                IrValue right = convert(pop(), node.right->ctype, node.ctype);
+                IrValue left = frame.saved;
+                jump(frame.blocks[1]);
+                block = frame.blocks[1];
+                if(is_void(node.ctype))
+                    finish(IrNone);
+                else
+                    finish(emit(IrOp::PHI, value_type(node.ctype), {left, right}));
+            }
+            break;
+    }
+}
+
+void IrGenerator::visit(PostfixExprAstNode& node)
+{
+    Frame& frame = frames.back();
+    if(frame.state == 0)
+    {
+        frame.state = 1;
+        for(auto arg = node.right.rbegin();arg != node.right.rend();arg++)
+        {
+            push(arg->get());
+        }
+        push(node.left.get(), node.type != PostfixType::INC && node.type != PostfixType::DEC);
+        return;
+    }
+
+    std::vector<IrValue> args(node.right.size());
+    for(size_t i = args.size();i > 0;i--)
+    {
+        args[i - 1] = pop();
+    }
+    IrValue left = pop();
+
+    switch(node.type)
+    {
+        case PostfixType::ARRAY:
+            {
+                // 'a[i]' is '*(a + i)' (6.5.2.1, 2).
+                ExprAstNode& index = *node.right.front();
+                finish(arithmetic(BinaryType::ADD, left, args[0], node.left->ctype, index.ctype));
+            }
+            break;
+        case PostfixType::CALL:
+            {
+                // Arguments are converted to the parameter types (6.5.2.2, 7).
+                auto callee = derived(node.left->ctype, DerivedCTypeType::FUNCTION);
+                if(!callee) callee = std::static_pointer_cast<DerivedCType>(pointee(node.left->ctype));
+
+                std::vector<IrValue> operands{left};
+                auto param = callee->parameters.begin();
+                size_t i = 0;
+                for(auto& arg : node.right)
+                {
+                    operands.push_back(convert(args[i++], arg->ctype, *param++));
+                }
+                finish(emit(IrOp::CALL, value_type(callee->base), operands));
+            }
+            break;
+        case PostfixType::INC:
+        case PostfixType::DEC:
+            finish(step(*node.left, left, node.type == PostfixType::INC, false));
+            break;
+        default:
+            throw std::logic_error("Member access is not supported");
+    }
+}
+
+void IrGenerator::visit(AssignExprAstNode& node)
+{
+    Frame& frame = frames.back();
+    if(frame.state == 0)
+    {
+        frame.state = 1;
+        push(node.right.get());
+        push(node.left.get(), false);
+        return;
+    }
+
+    IrValue right = pop();
+    IrValue address = pop();
+    auto& type = node.left->ctype;
+    if(node.type == AssignExprType::ASSIGN)
+    {
+        finish(assign(address, right, node.right->ctype, type));
+        return;
+    }
+
+    // 'a op= b' is 'a = a op b', with 'a' evaluated once (6.5.16.2, 3).
+    IrValue old = load(address, type);
+    IrValue value = arithmetic(compound_operator(node.type), old, right, type, node.right->ctype);
+    finish(assign(address, value, type, type));
+}
+
+void IrGenerator::visit(ExprAstNode&)
+{
+    finish(IrNone);
+}
+
+void IrGenerator::visit(DeclAstNode& node)
+{
+    Frame& frame = frames.back();
+    if(frame.state == 1)
+    {
+        IrValue value = pop();
+        assign(locals[&node], value, node.initializer->ctype, node.type);
+        frames.pop_back();
+        return;
+    }
+
+    if(derived(node.type, DerivedCTypeType::FUNCTION))
+    {
+        module.symbols[module.symbol(node.identifier->lexeme)].function = true;
+        frames.pop_back();
+        return;
+    }
+
+    if(is_static(node.type))
+    {
+        std::string name = function->name + "." + node.identifier->lexeme + "." + std::to_string(statics++);
+        IrValue address = function->create(IrOp::GLOBAL, IrType::I64, {}, object(node, name));
+        allocas.push_back(address);
+        locals[&node] = address;
+        frames.pop_back();
+        return;
+    }
+
+    int size = layout.size_of(*node.type);
+    IrValue address = function->create(IrOp::ALLOCA, IrType::I64, {}, size);
+    allocas.push_back(address);
+    locals[&node] = address;
+
+    auto string = std::dynamic_pointer_cast<PrimaryExprAstNode>(node.initializer);
+    if(string && string->token->type == TOK_STRING_LITERAL && derived(node.type, DerivedCTypeType::ARRAY))
+    {
+        // Copy the characters, and zero the rest of the array (6.7.8, 21).
+        std::string value = parse_string_literal(string->token->lexeme);
+        for(int i = 0;i < size;i++)
+        {
+            int64_t c = i < static_cast<int>(value.size()) ? value[i] : 0;
+            IrValue element = emit(IrOp::ADD, IrType::I64, {address, constant(IrType::I64, i)});
+            emit(IrOp::STORE, IrType::VOID, {element, constant(IrType::I8, c)});
+        }
+        frames.pop_back();
+    }
+    else if(node.initializer)
+    {
+        frame.state = 1;
+        push(node.initializer.get());
+    }
+    else
+    {
+        frames.pop_back();
+    }
+}
+
+void IrGenerator::visit(CompoundStmtAstNode& node)
+{
+    frames.pop_back();
+    for(auto item = node.items.rbegin();item != node.items.rend();item++)
+    {
+        push(item->get());
+    }
+}
+
+void IrGenerator::visit(ExprStmtAstNode& node)
+{
+    Frame& frame = frames.back();
+    if(frame.state == 0 && node.expr)
+    {
+        frame.state = 1;
+        push(node.expr.get(), false);
+        return;
+    }
+    if(node.expr)
+    {
+        pop();
+    }
+    frames.pop_back();
+}
+
+void IrGenerator::visit(ReturnStmtAstNode& node)
+{
+    Frame& frame = frames.back();
+    if(frame.state == 0 && node.expr)
+    {
+        frame.state = 1;
+        push(node.expr.get());
+        return;
+    }
+
+    if(node.expr)
+    {
+        IrValue value = convert(pop(), node.expr->ctype, result);
+        emit(IrOp::RET, IrType::VOID, {value});
+    }
+    else
+    {
+        emit(IrOp::RET, IrType::VOID);
+    }
+
+    // (Any statements which follow are unreachable.)
+    block = function->add_block();
+    frames.pop_back();
+}
+
+// Loops are lowered with the condition in a header block, which is entered from the
+// block before the loop and from the end of each iteration:
+//
+//     while/for:  [init] -> header: branch cond, body, exit
+//                 body -> continue: step -> header
+//     do:         body -> continue: branch cond, body, exit
+//
+// 'break' jumps to the exit, and 'continue' to the continue block.
+void IrGenerator::visit(IterationStmtAstNode& node)
+{
+    Frame& frame = frames.back();
+    switch(frame.state)
+    {
+        case 0:
+            frame.state = 1;
+            for(auto item = node.init.rbegin();item != node.init.rend();item++)
+            {
+                push(item->get());
+            }
+            break;
+        case 1:
+            {
+                IrBlockId header = function->add_block();
+                jump(header);
+                block = header;
+                frame.blocks[0] = header;
+                frame.state = 2;
+                if(node.type == IterationType::DO)
+                {
+                    // The body is the header.
+                    frame.blocks[1] = function->add_block();
+                    frame.blocks[2] = function->add_block();
+                    loops.push_back(Loop{frame.blocks[2], frame.blocks[1]});
+                    push(node.body.get());
+                }
+                else if(node.condition)
+                {
+                    push(node.condition.get());
+                }
+            }
+            break;
+        case 2:
+            if(node.type == IterationType::DO)
+            {
+                loops.pop_back();
+                jump(frame.blocks[1]);
+                block = frame.blocks[1];
+                frame.state = 4;
+                push(node.condition.get());
+            }
+            else
+            {
+                IrBlockId body = function->add_block();
+                frame.blocks[1] = function->add_block();
+                frame.blocks[2] = function->add_block();
+                if(node.condition)
+                    branch(truth(pop(), node.condition->ctype), body, frame.blocks[2]);
+                else
+                    jump(body);
+                loops.push_back(Loop{frame.blocks[2], frame.blocks[1]});
+                block = body;
+                frame.state = 3;
+                push(node.body.get());
+            }
+            break;
+        case 3:
+            loops.pop_back();
+            jump(frame.blocks[1]);
+            block = frame.blocks[1];
+            frame.state = 5;
+            if(node.step)
+            {
+                push(node.step.get(), false);
+            }
+            break;
+        case 4:
+            branch(truth(pop(), node.condition->ctype), frame.blocks[0], frame.blocks[2]);
+            block = frame.blocks[2];
+            frames.pop_back();
+            break;
+        default:
+            if(node.step)
+            {
+                pop();
+            }
+            jump(frame.blocks[0]);
+            block = frame.blocks[2];
+            frames.pop_back();
+            break;
+    }
+}
+
+// A switch jumps to a block for each of its labels, or to the exit if no label matches:
+//
+//     switch cond, cases..., default (or exit), case blocks...
+//     body (with each label starting its block) -> exit
+//
+// 'break' jumps to the exit.
+void IrGenerator::visit(SwitchStmtAstNode& node)
+{
+    Frame& frame = frames.back();
+    switch(frame.state)
+    {
+        case 0:
+            frame.state = 1;
+            push(node.condition.get());
+            break;
+        case 1:
+            {
+                // The condition has its promoted type (int or unsigned int), so the cases
+                // are I32 constants with the same bits as the C constants.
+                IrValue condition = pop();
+                IrBlockId exit = function->add_block();
+                std::vector<IrValue> operands{condition};
+                std::vector<IrBlockId> targets{exit};
+                for(CaseStmtAstNode * label : switch_labels(node))
+                {
+                    IrBlockId target = function->add_block();
+                    labels[label] = target;
+                    if(!label->value)
+                    {
+                        targets[0] = target;
+                        continue;
+                    }
+                    IntegerConstant value;
+                    parse_integer_constant(std::static_pointer_cast<PrimaryExprAstNode>(label->value)->token->lexeme, value);
+                    operands.push_back(constant(IrType::I32, value.as_signed()));
+                    targets.push_back(target);
+                }
+                emit(IrOp::SWITCH, IrType::VOID, operands);
+                for(IrBlockId target : targets)
+                {
+                    function->add_edge(block, target);
+                }
+
+                // (Statements before the first label are unreachable.)
+                loops.push_back(Loop{exit, loops.empty() ? exit : loops.back().next});
+                frame.blocks[0] = exit;
+                frame.state = 2;
+                block = function->add_block();
+                push(node.body.get());
+            }
+            break;
+        default:
+            loops.pop_back();
+            jump(frame.blocks[0]);
+            block = frame.blocks[0];
+            frames.pop_back();
+            break;
+    }
+}
+
+void IrGenerator::visit(CaseStmtAstNode& node)
+{
+    IrBlockId target = labels[&node];
+    jump(target);
+    block = target;
+    frames.pop_back();
+    push(node.body.get());
+}
+
+void IrGenerator::visit(JumpStmtAstNode& node)
+{
+    jump(node.type == JumpType::BREAK ? loops.back().exit : loops.back().next);
+
+    // (Any statements which follow are unreachable.)
+    block = function->add_block();
+    frames.pop_back();
+}
+
+void IrGenerator::visit(FunctionDefAstNode& node)
+{
+    std::unique_ptr<IrFunction> lowered(new IrFunction);
+    function = lowered.get();
+    function->name = node.decl->identifier->lexeme;
+    function->symbol = module.symbol(function->name);
+    module.symbols[function->symbol].function = true;
+    module.symbols[function->symbol].defined = true;
+
+    result = derived(node.decl->type, DerivedCTypeType::FUNCTION)->base;
+    function->result = value_type(result);
+    block = function->add_block();
+    allocas.clear();
+    locals.clear();
+    loops.clear();
+    labels.clear();
+    statics = 0;
+
+    // Parameters are copied to their own objects.
+    int index = 0;
+    for(auto& param : node.parameters)
+    {
+        IrType type = value_type(param->type);
+        function->params.push_back(type);
+        IrValue value = emit(IrOp::PARAM, type, {}, index++);
+        if(!param->identifier) continue;
+
+        IrValue address = function->create(IrOp::ALLOCA, IrType::I64, {}, layout.size_of(*param->type));
+        allocas.push_back(address);
+        locals[param.get()] = address;
+        assign(address, value, param->type, param->type);
+    }
+
+    push(node.body.get());
+    while(!frames.empty())
+    {
+        frames.back().node->accept(*this);
+    }
+
+    // Reaching the end of a function returns 0 (as for 'main' - 5.1.2.2.3), or nothing.
+    if(is_void(result))
+        emit(IrOp::RET, IrType::VOID);
+    else
+        emit(IrOp::RET, IrType::VOID, {constant(function->result, 0)});
+
+    // Stack slots (and static objects' addresses) go at the start of the entry block.
+    auto& entry = function->blocks[0].code;
+    entry.insert(entry.begin(), allocas.begin(), allocas.end());
+    for(IrValue address : allocas)
+    {
+        function->instrs[address].block = 0;
+    }
+
+    function->remove_unreachable();
+    function->compact();
+    module.functions.push_back(std::move(lowered));
+    function = nullptr;
+}
+
+void IrGenerator::visit(TranslationUnitAstNode& node)
+{
+    for(auto& item : node.items)
+    {
+        if(std::dynamic_pointer_cast<FunctionDefAstNode>(item))
+        {
+            item->accept(*this);
+            continue;
+        }
+
+        auto decl = std::static_pointer_cast<DeclAstNode>(item);
+        if(derived(decl->type, DerivedCTypeType::FUNCTION))
+        {
+            module.symbols[module.symbol(decl->identifier->lexeme)].function = true;
+        }
+        else if(module.find(decl->identifier->lexeme) == -1 || decl->initializer)
+        {
+            // (Later tentative definitions of the same object have no effect - 6.9.2, 2.)
+            object(*decl, decl->identifier->lexeme);
+        }
+    }
+}
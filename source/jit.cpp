@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <cerrno>
+#include <csetjmp>
+#include <csignal>
+#include <cstring>
+#include <vector>
+
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "emitter.h"
+#include "jit.h"
+
+static size_t align_up(size_t offset, size_t align)
+{
+    return (offset + align - 1) / align * align;
+}
+
+Jit::Jit(IrModule& module, int level)
+{
+    Assembler assembler;
+    AsmEmitter(assembler, module, level).emit_module(module);
+    assembler.finish();
+    load(assembler);
+}
+
+Jit::Jit(const std::string& assembly)
+{
+    Assembler assembler;
+    assembler.assemble(assembly);
+    load(assembler);
+}
+
+Jit::~Jit()
+{
+    if(memory) munmap(memory, size);
+}
+
+void Jit::load(const Assembler& assembler)
+{
+    const std::vector<AsmSymbol>& symbols = assembler.symbols();
+    const AsmSection& text = assembler.section(Assembler::TEXT);
+    const AsmSection& data = assembler.section(Assembler::DATA);
+    const AsmSection& bss = assembler.section(Assembler::BSS);
+
+    // Look up the undefined symbols, and give each one referenced by a relative field a
+    // stub (in case it is a function out of range).
+    std::vector<char *> external(symbols.size(), nullptr);
+    std::vector<size_t> stubs(symbols.size(), SIZE_MAX);
+    size_t stub_count = 0;
+    for(int id = 0; id < Assembler::SectionCount; id++)
+    {
+        for(auto& relocation : assembler.section(id).relocations)
+        {
+            const AsmSymbol& sym = symbols[relocation.symbol];
+            if(sym.section >= Assembler::SectionCount)
+                throw JitError("'" + sym.name + "' is not in .text, .data or .bss");
+            if(sym.section >= 0) continue;
+            if(!external[relocation.symbol])
+            {
+                external[relocation.symbol] = static_cast<char *>(dlsym(RTLD_DEFAULT, sym.name.c_str()));
+                if(!external[relocation.symbol]) throw JitError("Undefined symbol '" + sym.name + "'");
+            }
+            if(relocation.relative && stubs[relocation.symbol] == SIZE_MAX) stubs[relocation.symbol] = stub_count++;
+        }
+    }
+
+    // Text and stubs, then data and bss on their own pages.
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t stub_offset = align_up(text.bytes.size(), StubSize);
+    size_t data_offset = align_up(stub_offset + stub_count * StubSize, std::max(page, data.align));
+    size_t bss_offset = align_up(data_offset + data.bytes.size(), bss.align);
+    size = align_up(std::max<size_t>(bss_offset + bss.bytes.size(), 1), page);
+    void * mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mapping == MAP_FAILED) throw JitError(std::string("Cannot map memory: ") + strerror(errno));
+    memory = static_cast<char *>(mapping);
+
+    // (The destructor does not run if the constructor throws.)
+    try
+    {
+        char * bases[Assembler::SectionCount] = {memory, memory + data_offset, memory + bss_offset};
+        std::copy(text.bytes.begin(), text.bytes.end(), bases[Assembler::TEXT]);
+        std::copy(data.bytes.begin(), data.bytes.end(), bases[Assembler::DATA]);
+        for(size_t i = 0; i < symbols.size(); i++)
+        {
+            if(stubs[i] != SIZE_MAX)
+            {
+                // jmp *0(%rip), and the address.
+                static const uint8_t Jump[] = {0xFF, 0x25, 0, 0, 0, 0};
+                char * stub = memory + stub_offset + stubs[i] * StubSize;
+                memcpy(stub, Jump, sizeof(Jump));
+                memcpy(stub + sizeof(Jump), &external[i], sizeof(external[i]));
+            }
+            if(symbols[i].section >= 0 && symbols[i].section < Assembler::SectionCount)
+                addresses[symbols[i].name] = bases[symbols[i].section] + symbols[i].offset;
+        }
+
+        for(int id = 0; id < Assembler::SectionCount; id++)
+        {
+            for(auto& relocation : assembler.section(id).relocations)
+            {
+                const AsmSymbol& sym = symbols[relocation.symbol];
+                char * field = bases[id] + relocation.offset;
+                char * target = sym.section >= 0 ? bases[sym.section] + sym.offset : external[relocation.symbol];
+                if(!relocation.relative)
+                {
+                    uint64_t value = reinterpret_cast<uint64_t>(target) + relocation.addend;
+                    memcpy(field, &value, sizeof(value));
+                    continue;
+                }
+                int64_t value = reinterpret_cast<int64_t>(target) + relocation.addend - reinterpret_cast<int64_t>(field);
+                if(value < INT32_MIN || value > INT32_MAX)
+                {
+                    // (Only calls can go through a stub.)
+                    if(sym.section >= 0 || static_cast<uint8_t>(field[-1]) != 0xE8)
+                        throw JitError("'" + sym.name + "' is out of range of the code");
+                    target = memory + stub_offset + stubs[relocation.symbol] * StubSize;
+                    value = reinterpret_cast<int64_t>(target) + relocation.addend - reinterpret_cast<int64_t>(field);
+                }
+                int32_t field_value = static_cast<int32_t>(value);
+                memcpy(field, &field_value, sizeof(field_value));
+            }
+        }
+
+        if(data_offset > 0 && mprotect(memory, data_offset, PROT_READ | PROT_EXEC) != 0)
+            throw JitError(std::string("Cannot protect memory: ") + strerror(errno));
+    }
+    catch(...)
+    {
+        munmap(memory, size);
+        memory = nullptr;
+        throw;
+    }
+}
+
+void * Jit::address(const std::string& name) const
+{
+    auto found = addresses.find(name);
+    return found == addresses.end() ? nullptr : found->second;
+}
+
+int Jit::run(const std::string& name)
+{
+    void * function = address(name);
+    if(!function) throw JitError("No function '" + name + "'");
+    return reinterpret_cast<int (*)()>(reinterpret_cast<uintptr_t>(function))();
+}
+
+// Where a trap in guarded code returns to (see run_guarded).
+static thread_local sigjmp_buf * trap_target = nullptr;
+
+static void on_trap(int signal)
+{
+    siglongjmp(*trap_target, signal);
+}
+
+int Jit::run_guarded(const std::string& name)
+{
+    static const int Traps[] = {SIGFPE, SIGSEGV, SIGBUS, SIGILL};
+    static const size_t TrapCount = sizeof(Traps) / sizeof(Traps[0]);
+    void * function = address(name);
+    if(!function) throw JitError("No function '" + name + "'");
+
+    // (The handler runs on a stack of its own, so a stack overflow can be reported.)
+    std::vector<char> handler_stack(1 << 16);
+    stack_t stack = {}, old_stack;
+    stack.ss_sp = handler_stack.data();
+    stack.ss_size = handler_stack.size();
+    sigaltstack(&stack, &old_stack);
+
+    struct sigaction action = {}, old_actions[TrapCount];
+    action.sa_handler = on_trap;
+    action.sa_flags = SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    sigjmp_buf target;
+    sigjmp_buf * outer = trap_target;
+    trap_target = &target;
+    for(size_t i = 0; i < TrapCount; i++)
+        sigaction(Traps[i], &action, &old_actions[i]);
+
+    // (The signal mask is restored by siglongjmp.)
+    volatile int result = 0;
+    int trap = sigsetjmp(target, 1);
+    if(trap == 0)
+        result = reinterpret_cast<int (*)()>(reinterpret_cast<uintptr_t>(function))();
+
+    for(size_t i = 0; i < TrapCount; i++)
+        sigaction(Traps[i], &old_actions[i], nullptr);
+    trap_target = outer;
+    sigaltstack(&old_stack, nullptr);
+    if(trap != 0) throw JitError("'" + name + "' trapped: " + strsignal(trap));
+    return result;
+}
@@ -0,0 +1,60 @@
+#include <climits>
+
+#include "layout.h"
+#include "type.h"
+
+LayoutEngine::LayoutEngine(const TargetAbi& abi)
+    : abi(abi)
+{
+}
+
+const TypeLayout& LayoutEngine::layout(const CType& ctype)
+{
+    auto cached = layouts.find(&ctype);
+    if(cached != layouts.end())
+    {
+        return cached->second;
+    }
+
+    TypeLayout computed = compute(ctype);
+    return layouts.emplace(&ctype, computed).first->second;
+}
+
+TypeLayout LayoutEngine::compute(const CType& ctype)
+{
+    auto basic = dynamic_cast<const BasicCType *>(&ctype);
+    if(basic)
+    {
+        switch(basic->type)
+        {
+            case BasicCTypeType::CHAR:
+                return TypeLayout{abi.char_size, abi.char_align};
+            case BasicCTypeType::SHORT_INT:
+                return TypeLayout{abi.short_size, abi.short_align};
+            default:
+                return TypeLayout{abi.int_size, abi.int_align};
+        }
+    }
+
+    auto derived = dynamic_cast<const DerivedCType *>(&ctype);
+    if(derived && derived->type == DerivedCTypeType::POINTER)
+    {
+        return TypeLayout{abi.pointer_size, abi.pointer_align};
+    }
+    if(derived && derived->type == DerivedCTypeType::ARRAY)
+    {
+        if(derived->array_size <= 0)
+            throw CTypeError("Array has incomplete type");
+
+        // Arrays are contiguous, so the element size is also the stride (6.2.5, 20).
+        const TypeLayout& element = layout(*derived->base);
+        if(element.size > INT_MAX / derived->array_size)
+            throw CTypeError("Array is too large");
+        return TypeLayout{element.size * derived->array_size, element.align};
+    }
+    if(derived)
+    {
+        throw CTypeError("Function type has no size");
+    }
+    throw CTypeError("Void type has no size");
+}
@@ -79,12 +79,12 @@ bool Lexer::consume_constant()
     {
         position++;
         position++;
-        while(std::string("1234567890abcdefABCDEF").find(input[position++]) != std::string::npos);
+        while(!at_end() && HexCharacters.find(input[position]) != std::string::npos) position++;
         return true;
     }
     if(std::string("1234567890").find(input[position]) != std::string::npos)
     {
-        while(std::string("1234567890").find(input[position++]) != std::string::npos);
+        while(!at_end() && DigitCharacters.find(input[position]) != std::string::npos) position++;
         return true;
     }
     return false;
@@ -98,7 +98,11 @@ bool Lexer::consume_string_literal()
         while(true)
         {
             if(at_end() || input[position] == '\n') throw std::string("Unterminated string literal");
-            if(input[position++] == '"') break;
+            char c = input[position++];
+            if(c == '"') break;
+
+            // (An escaped quote does not end the literal.)
+            if(c == '\\' && !at_end() && input[position] != '\n') position++;
         }
         return true;
     }
@@ -0,0 +1,65 @@
+#include <algorithm>
+
+#include "licm.h"
+#include "loops.h"
+
+bool LoopInvariantCodeMotion::run(IrFunction& function)
+{
+    AnalysisCache cache(function);
+    return run(function, cache);
+}
+
+bool LoopInvariantCodeMotion::run(IrFunction& function, AnalysisCache& cache)
+{
+    if(cache.loops().loops().empty()) return false;
+    if(insert_preheaders(function, cache.loops())) cache.invalidate();
+    const LoopInfo& info = cache.loops();
+
+    bool changed = false;
+    std::vector<IrValue> hoisted;
+    for(int l = info.loops().size() - 1;l >= 0;l--)
+    {
+        const IrLoop& loop = info.loop(l);
+        IrBlockId preheader = info.preheader(function, l);
+        if(preheader == IrNoBlock) continue;
+
+        bool memory = false;
+        for(IrBlockId block : loop.blocks)
+        {
+            for(IrValue value : function.blocks[block].code)
+            {
+                IrOp op = function.instrs[value].op;
+                memory = memory || op == IrOp::STORE || ir_is_vector(op) || op == IrOp::CALL;
+            }
+        }
+
+        // Blocks are in reverse postorder, so each operand in the loop (other than a phi's)
+        // has been seen, and moved if it is invariant, before it is used.
+        hoisted.clear();
+        for(IrBlockId block : loop.blocks)
+        {
+            auto& code = function.blocks[block].code;
+            code.erase(
+                std::remove_if(code.begin(), code.end(), [&](IrValue value)
+                {
+                    IrInstr& instr = function.instrs[value];
+                    bool load = instr.op == IrOp::LOAD && !memory && block == loop.header;
+                    if(!load && !function.speculatable(value)) return false;
+                    for(IrValue operand : function.operands(value))
+                    {
+                        if(info.contains(l, function.instrs[operand].block)) return false;
+                    }
+                    instr.block = preheader;
+                    hoisted.push_back(value);
+                    return true;
+                }),
+                code.end()
+            );
+        }
+
+        auto& code = function.blocks[preheader].code;
+        code.insert(code.end() - 1, hoisted.begin(), hoisted.end());
+        changed = changed || !hoisted.empty();
+    }
+    return changed;
+}
@@ -0,0 +1,134 @@
+#include <algorithm>
+
+#include "loops.h"
+
+LoopInfo::LoopInfo(const IrFunction& function, const DominatorTree& tree)
+    : innermost(function.blocks.size(), -1)
+{
+    std::vector<uint32_t> rpo(function.blocks.size(), 0);
+    const auto& order = tree.reverse_postorder();
+    for(uint32_t i = 0;i < order.size();i++)
+    {
+        rpo[order[i]] = i;
+    }
+
+    // The last loop to have claimed each block while finding a loop's body.
+    std::vector<int> mark(function.blocks.size(), -1);
+    std::vector<IrBlockId> work;
+    for(IrBlockId header : tree.preorder())
+    {
+        for(IrBlockId pred : function.blocks[header].preds)
+        {
+            if(tree.dominates(header, pred)) work.push_back(pred);
+        }
+        if(work.empty()) continue;
+
+        // The enclosing loop contains the header, and has already claimed it.
+        int index = list.size();
+        int parent = innermost[header];
+        list.push_back(IrLoop{header, parent, parent == -1 ? 1 : list[parent].depth + 1, {header}});
+        IrLoop& loop = list.back();
+
+        // Walk backwards from the back edges to the header.
+        mark[header] = index;
+        while(!work.empty())
+        {
+            IrBlockId block = work.back();
+            work.pop_back();
+            if(mark[block] == index) continue;
+            mark[block] = index;
+            loop.blocks.push_back(block);
+            for(IrBlockId pred : function.blocks[block].preds)
+            {
+                if(tree.reachable(pred) && mark[pred] != index) work.push_back(pred);
+            }
+        }
+
+        std::sort(loop.blocks.begin(), loop.blocks.end(), [&](IrBlockId a, IrBlockId b)
+        {
+            return rpo[a] < rpo[b];
+        });
+
+        // Loops nested in this one come later (their headers are deeper in the dominator
+        // tree), and take over their own blocks.
+        for(IrBlockId block : loop.blocks)
+        {
+            innermost[block] = index;
+        }
+    }
+}
+
+bool LoopInfo::contains(int loop, IrBlockId block) const
+{
+    // Enclosing loops have lower numbers.
+    for(int l = innermost[block];l >= loop;l = list[l].parent)
+    {
+        if(l == loop) return true;
+    }
+    return false;
+}
+
+IrBlockId LoopInfo::preheader(const IrFunction& function, int loop) const
+{
+    IrBlockId found = IrNoBlock;
+    for(IrBlockId pred : function.blocks[list[loop].header].preds)
+    {
+        if(contains(loop, pred)) continue;
+        if(found != IrNoBlock) return IrNoBlock;
+        found = pred;
+    }
+    if(found == IrNoBlock || function.blocks[found].succs.size() != 1) return IrNoBlock;
+    return found;
+}
+
+bool insert_preheaders(IrFunction& function, const LoopInfo& info)
+{
+    bool inserted = false;
+    for(int l = 0;l < static_cast<int>(info.loops().size());l++)
+    {
+        IrBlockId header = info.loop(l).header;
+        if(header == 0 || info.preheader(function, l) != IrNoBlock) continue;
+
+        // Predecessors from outside the loop, and from inside (back edges).
+        std::vector<size_t> outside, inside;
+        const std::vector<IrBlockId> preds = function.blocks[header].preds;
+        for(size_t i = 0;i < preds.size();i++)
+        {
+            (info.contains(l, preds[i]) ? inside : outside).push_back(i);
+        }
+
+        IrBlockId preheader = function.add_block();
+        for(IrValue phi : function.blocks[header].code)
+        {
+            if(function.instrs[phi].op != IrOp::PHI) break;
+
+            IrRange range = function.operands(phi);
+            std::vector<IrValue> operands(range.begin(), range.end());
+            IrValue entry = operands[outside[0]];
+            if(outside.size() > 1)
+            {
+                std::vector<IrValue> incoming;
+                for(size_t i : outside) incoming.push_back(operands[i]);
+                entry = function.append(preheader, IrOp::PHI, function.instrs[phi].type, incoming);
+            }
+            std::vector<IrValue> rewritten{entry};
+            for(size_t i : inside) rewritten.push_back(operands[i]);
+            function.set_operands(phi, rewritten);
+        }
+        function.append(preheader, IrOp::JUMP, IrType::VOID);
+
+        std::vector<IrBlockId> rewired{preheader};
+        for(size_t i : inside) rewired.push_back(preds[i]);
+        for(size_t i : outside)
+        {
+            IrBlockId pred = preds[i];
+            function.blocks[preheader].preds.push_back(pred);
+            auto& succs = function.blocks[pred].succs;
+            std::replace(succs.begin(), succs.end(), header, preheader);
+        }
+        function.blocks[preheader].succs.push_back(header);
+        function.blocks[header].preds = std::move(rewired);
+        inserted = true;
+    }
+    return inserted;
+}
@@ -0,0 +1,228 @@
+#include <cstring>
+
+#include "machine.h"
+
+const char * const RegisterNames[4][16] = {
+    {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+     "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"},
+    {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di",
+     "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w"},
+    {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+     "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"},
+    {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+     "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"}
+};
+const char Suffixes[] = "bwlq";
+
+// Mnemonics (without their suffix) which the peephole rules look for, or which have a
+// known effect on the flags. Conditional jumps, setcc and cmov read the flags, and other
+// moves leave them alone; anything else (shifts, which leave them alone for a count of 0,
+// and divisions) is not known.
+static const struct
+{
+    const char * name;
+    MachineOp op;
+    MachineFlags flags;
+} Mnemonics[] = {
+    {"mov", MachineOp::MOV, MachineFlags::NONE},
+    {"xor", MachineOp::XOR, MachineFlags::WRITE},
+    {"add", MachineOp::ADD, MachineFlags::WRITE},
+    {"sub", MachineOp::SUB, MachineFlags::WRITE},
+    {"cmp", MachineOp::CMP, MachineFlags::WRITE},
+    {"test", MachineOp::TEST, MachineFlags::WRITE},
+    {"and", MachineOp::OTHER, MachineFlags::WRITE},
+    {"or", MachineOp::OTHER, MachineFlags::WRITE},
+    {"imul", MachineOp::OTHER, MachineFlags::WRITE},
+    {"neg", MachineOp::OTHER, MachineFlags::WRITE},
+    {"not", MachineOp::OTHER, MachineFlags::NONE},
+    {"lea", MachineOp::OTHER, MachineFlags::NONE},
+    {"push", MachineOp::OTHER, MachineFlags::NONE},
+    {"pop", MachineOp::OTHER, MachineFlags::NONE},
+    {"cltd", MachineOp::OTHER, MachineFlags::NONE},
+    {"cqto", MachineOp::OTHER, MachineFlags::NONE},
+    {"leave", MachineOp::OTHER, MachineFlags::NONE},
+    {"jmp", MachineOp::JMP, MachineFlags::NONE},
+    {"call", MachineOp::CALL, MachineFlags::NONE},
+    {"ret", MachineOp::RET, MachineFlags::NONE},
+};
+
+static bool starts_with(const std::string& text, const char * prefix)
+{
+    return text.compare(0, std::strlen(prefix), prefix) == 0;
+}
+
+MachineOperand MachineOperand::in(int reg, int width)
+{
+    MachineOperand result;
+    result.kind = Kind::REGISTER;
+    result.reg = reg;
+    result.width = width;
+    return result;
+}
+
+MachineOperand MachineOperand::immediate(int64_t value)
+{
+    MachineOperand result;
+    result.value = value;
+    return result;
+}
+
+MachineOperand MachineOperand::memory(int base, int64_t displacement, int index, int scale)
+{
+    MachineOperand result;
+    result.kind = Kind::MEMORY;
+    result.base = base;
+    result.value = displacement;
+    result.index = index;
+    result.scale = scale;
+    return result;
+}
+
+MachineOperand MachineOperand::to(std::string symbol)
+{
+    MachineOperand result;
+    result.kind = Kind::SYMBOL;
+    result.symbol = std::move(symbol);
+    return result;
+}
+
+bool MachineOperand::operator==(const MachineOperand& other) const
+{
+    return kind == other.kind && reg == other.reg && width == other.width && value == other.value
+        && base == other.base && index == other.index && scale == other.scale && symbol == other.symbol;
+}
+
+MachineInstr::MachineInstr(std::string name, std::vector<MachineOperand> list)
+    : mnemonic(std::move(name))
+    , operands(std::move(list))
+{
+    const std::string& m = mnemonic;
+    if(m != "jmp" && m[0] == 'j')
+    {
+        op = MachineOp::JCC;
+        flags = MachineFlags::READ;
+        return;
+    }
+    if(starts_with(m, "set") || starts_with(m, "cmov"))
+    {
+        flags = MachineFlags::READ;
+        return;
+    }
+    for(auto& entry : Mnemonics)
+    {
+        size_t length = std::strlen(entry.name);
+        if(m.compare(0, length, entry.name) != 0) continue;
+        if(m.size() == length + 1 && std::strchr(Suffixes, m[length]))
+        {
+            width = std::strchr(Suffixes, m[length]) - Suffixes;
+        }
+        else if(m.size() != length)
+        {
+            continue;
+        }
+        op = entry.op;
+        flags = entry.flags;
+        return;
+    }
+    if(starts_with(m, "mov")) flags = MachineFlags::NONE;
+}
+
+MachineInstr MachineInstr::label(std::string name)
+{
+    MachineInstr result;
+    result.op = MachineOp::LABEL;
+    result.mnemonic = std::move(name);
+    return result;
+}
+
+MachineInstr MachineInstr::directive(std::string name, std::string arguments)
+{
+    MachineInstr result;
+    result.op = MachineOp::DIRECTIVE;
+    result.mnemonic = std::move(name);
+    result.arguments = std::move(arguments);
+    return result;
+}
+
+static void write_register(BufferedWriter& out, int reg, int width)
+{
+    out << '%';
+    if(width == XmmWidth)
+        out << "xmm" << reg;
+    else
+        out << RegisterNames[width][reg];
+}
+
+static void write_address(BufferedWriter& out, const MachineOperand& operand)
+{
+    if(!operand.symbol.empty())
+    {
+        out << operand.symbol;
+        if(operand.value > 0) out << '+';
+    }
+    if(operand.value != 0) out << operand.value;
+    out << '(';
+    if(operand.base == RipRegister)
+        out << "%rip";
+    else if(operand.base >= 0)
+        write_register(out, operand.base, 3);
+    if(operand.index >= 0)
+    {
+        out << ',';
+        write_register(out, operand.index, 3);
+        if(operand.scale != 1) out << ',' << operand.scale;
+    }
+    out << ')';
+}
+
+BufferedWriter& operator<<(BufferedWriter& out, const MachineOperand& operand)
+{
+    switch(operand.kind)
+    {
+        case MachineOperand::Kind::REGISTER:
+            write_register(out, operand.reg, operand.width);
+            break;
+        case MachineOperand::Kind::IMMEDIATE:
+            out << '$' << operand.value;
+            break;
+        case MachineOperand::Kind::MEMORY:
+            write_address(out, operand);
+            break;
+        case MachineOperand::Kind::SYMBOL:
+            out << operand.symbol;
+            if(operand.value > 0) out << '+';
+            if(operand.value != 0) out << operand.value;
+            break;
+        case MachineOperand::Kind::INDIRECT:
+            out << '*';
+            if(operand.reg >= 0)
+                write_register(out, operand.reg, operand.width);
+            else
+                write_address(out, operand);
+            break;
+    }
+    return out;
+}
+
+BufferedWriter& operator<<(BufferedWriter& out, const MachineInstr& instr)
+{
+    switch(instr.op)
+    {
+        case MachineOp::DELETED:
+            return out;
+        case MachineOp::LABEL:
+            return out << instr.mnemonic << ":\n";
+        case MachineOp::DIRECTIVE:
+            out << '\t' << instr.mnemonic;
+            if(!instr.arguments.empty()) out << ' ' << instr.arguments;
+            return out << '\n';
+        default:
+            break;
+    }
+    out << '\t' << instr.mnemonic;
+    for(size_t i = 0;i < instr.operands.size();i++)
+    {
+        out << (i == 0 ? " " : ", ") << instr.operands[i];
+    }
+    return out << '\n';
+}
@@ -1,7 +1,10 @@
 #include <string>
 #include <iostream>
+#include <fstream>
 #include <sstream>
 #include <memory>
+#include <cstdio>
+#include <cstdlib>
 
 #include "parser.h"
 #include "lexer.h"
@@ -10,10 +13,231 @@
 #include "token.h"
 #include "parser.h"
 #include "printer.h"
+#include "fold.h"
+#include "sema.h"
+#include "irgen.h"
+#include "passes.h"
+#include "emitter.h"
+#include "interp.h"
+#include "jit.h"
 
+// Write an error at a line (0-based, as the lexer counts them; -1 if not known).
+static void error_at(std::ostream& errors, const std::string& path, int line, const std::string& message)
+{
+    errors << path << ":";
+    if(line >= 0) errors << line + 1 << ":";
+    errors << " error: " << message << std::endl;
+}
+
+static bool report(const DiagnosticBuffer& diagnostics, const std::string& path, std::ostream& errors)
+{
+    for(const auto& error : diagnostics.errors)
+    {
+        error_at(errors, path, error.first, error.second);
+    }
+    return diagnostics.errors.empty();
+}
+
+// Lex, parse, check and lower a translation unit, and write any errors to 'errors'.
+static bool build(const std::string& source, const std::string& path, IrModule& module, std::ostream& errors)
+{
+    DiagnosticBuffer diagnostics;
+    TypeContext context;
+    try
+    {
+        auto tokens = Lexer(source, diagnostics).get_tokens();
+        if(!report(diagnostics, path, errors)) return false;
+
+        auto ast = ConstantFolder().fold(AstBuilder(context).build(*Parser().parse(tokens)));
+        auto tu = std::dynamic_pointer_cast<TranslationUnitAstNode>(ast);
+        SemanticAnalyser(diagnostics, context).analyse(*tu);
+        if(!report(diagnostics, path, errors)) return false;
+
+        IrGenerator(module).generate(*tu);
+    }
+    catch(const ParserError& e)
+    {
+        error_at(errors, path, e.line, e.what());
+        return false;
+    }
+    catch(const AstError& e)
+    {
+        error_at(errors, path, e.line, e.what());
+        return false;
+    }
+    catch(const CTypeError& e)
+    {
+        error_at(errors, path, e.line, e.what());
+        return false;
+    }
+    catch(const std::exception& e)
+    {
+        error_at(errors, path, -1, e.what());
+        return false;
+    }
+    return true;
+}
 
-int __attribute__((weak)) main()
+struct Options
 {
+    std::string input_path, output_path;
+    int level = 2;
+    InlineParams inline_params;
+
+    // Write the pass timing report to stderr.
+    bool time_passes = false;
+
+    // Run main in the interpreter (after optimization) instead of writing assembly.
+    bool interpret = false;
+
+    // Compile to memory, and run main natively (see Jit).
+    bool run = false;
+
+    // Run main in the interpreter before optimization and after each pass, and fail if a
+    // pass changes its result.
+    bool check_passes = false;
+};
+
+// Compile a C file to x86-64 assembly (or run it).
+static int compile(const Options& options)
+{
+    const std::string& input_path = options.input_path;
+    std::ifstream input(input_path);
+    if(!input)
+    {
+        std::cerr << "Cannot open " << input_path << std::endl;
+        return 1;
+    }
+    std::stringstream source;
+    source << input.rdbuf();
+
+    IrModule module;
+    if(!build(source.str(), input_path, module, std::cerr)) return 1;
+
+    try
+    {
+        PassManager passes(options.level, options.inline_params);
+        bool failed = false;
+        if(options.check_passes)
+        {
+            int64_t expected = Interpreter(module).run("main");
+            passes.observe([&](const std::string& pass, const IrModule& optimized)
+            {
+                int64_t result = Interpreter(optimized).run("main");
+                if(result == expected || failed) return;
+                std::cerr << input_path << ": error: main returns " << result << " after " << pass
+                    << " (" << expected << " before optimization)" << std::endl;
+                failed = true;
+            });
+        }
+        passes.run(module);
+        if(options.time_passes) passes.report(std::cerr);
+        if(failed) return 1;
+        if(options.interpret) return Interpreter(module).run("main") & 255;
+        if(options.run) return Jit(module, options.level).run("main") & 255;
+    }
+    catch(const std::runtime_error& e)
+    {
+        std::cerr << input_path << ": error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::FILE * output = std::fopen(options.output_path.c_str(), "w");
+    if(!output)
+    {
+        std::cerr << "Cannot open " << options.output_path << std::endl;
+        return 1;
+    }
+    bool written;
+    {
+        BufferedWriter writer(output);
+        AsmEmitter(writer, module, options.level).emit_module(module);
+        written = writer.flush();
+    }
+    written = std::fclose(output) == 0 && written;
+    if(!written)
+    {
+        std::cerr << "Cannot write " << options.output_path << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Evaluate lines of input: an expression is compiled as the result of a function, run,
+// and its value printed; other lines (declarations and definitions) are added to the
+// program for the lines after them. Each line is run as a new program, so objects do not
+// keep their values from one line to the next. A line which traps (1 / 0) is reported as an
+// error, and evaluation goes on.
+static int evaluate(const Options& options)
+{
+    std::string definitions;
+    std::string input;
+    while(std::getline(std::cin, input))
+    {
+        if(input.find_first_not_of(" \t") == std::string::npos) continue;
+        IrModule module;
+        std::ostringstream ignored;
+        if(build(definitions + "int __repl ( ) { return ( " + input + " ) ; }", "<stdin>", module, ignored))
+        {
+            try
+            {
+                PassManager(options.level, options.inline_params).run(module);
+                std::cout << Jit(module, options.level).run_guarded("__repl") << std::endl;
+            }
+            catch(const std::runtime_error& e)
+            {
+                std::cerr << "error: " << e.what() << std::endl;
+            }
+            continue;
+        }
+        IrModule program;
+        std::ostringstream errors;
+        if(build(definitions + input + "\n", "<stdin>", program, errors)) definitions += input + "\n";
+        else std::cerr << errors.str();
+    }
+    return 0;
+}
+
+// Usage: 'lc2 file.c [-o file.s] [-O0|-O1|-O2] [-finline-limit=N] [-ftime-passes]
+// [--interpret] [--check-passes] [--run]' compiles a file (at -O2 by default; the inline
+// limit is InlineParams::threshold). With --interpret, main is run in the IR interpreter
+// instead, and with --run it is compiled to memory and run natively; its result is the
+// exit status. 'lc2 --run' alone evaluates lines of input (see evaluate). Without
+// arguments, each line of input is parsed, and its AST is printed.
+int __attribute__((weak)) main(int argc, char ** argv)
+{
+    if(argc > 1)
+    {
+        Options options;
+        for(int i = 1;i < argc;i++)
+        {
+            std::string arg = argv[i];
+            if(arg == "-o" && i + 1 < argc)
+                options.output_path = argv[++i];
+            else if(arg.size() == 3 && arg[0] == '-' && arg[1] == 'O' && arg[2] >= '0' && arg[2] <= '3')
+                options.level = arg[2] - '0';
+            else if(arg.compare(0, 15, "-finline-limit=") == 0)
+                options.inline_params.threshold = std::atoi(arg.c_str() + 15);
+            else if(arg == "-ftime-passes")
+                options.time_passes = true;
+            else if(arg == "--interpret")
+                options.interpret = true;
+            else if(arg == "--check-passes")
+                options.check_passes = true;
+            else if(arg == "--run")
+                options.run = true;
+            else
+                options.input_path = arg;
+        }
+        if(options.run && options.input_path.empty()) return evaluate(options);
+        if(options.output_path.empty())
+        {
+            size_t dot = options.input_path.rfind('.');
+            options.output_path = options.input_path.substr(0, dot) + ".s";
+        }
+        return compile(options);
+    }
+
     ErrorReporter er;
 
     while(true)
@@ -28,16 +252,21 @@ int __attribute__((weak)) main()
         try
         {
             auto parse_root = parser.parse(tokens);
-            auto ast = AstBuilder().build(*parse_root);
+            auto ast = ConstantFolder().fold(AstBuilder().build(*parse_root));
             std::cout << printer.print(*ast) << std::endl;
         }
         catch(const ParserError& e)
         {
             std::cerr << "Error occurred during parsing: " << e.what() << std::endl;
-            std::cerr << "  Line number: " << e.line << std::endl;
+            std::cerr << "  Line number: " << e.line + 1 << std::endl;
+            std::cerr << "  Position: " << e.position << std::endl;
+        }
+        catch(const AstError& e)
+        {
+            std::cerr << "Error occurred building AST: " << e.what() << std::endl;
+            std::cerr << "  Line number: " << e.line + 1 << std::endl;
             std::cerr << "  Position: " << e.position << std::endl;
         }
-        
+
     }
 }
-
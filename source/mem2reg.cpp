@@ -0,0 +1,278 @@
+#include <algorithm>
+
+#include "mem2reg.h"
+#include "dominators.h"
+
+bool Mem2Reg::run(IrFunction& function)
+{
+    AnalysisCache cache(function);
+    return run(function, cache);
+}
+
+bool Mem2Reg::run(IrFunction& function, AnalysisCache& cache)
+{
+    if(function.remove_unreachable()) cache.invalidate();
+    size_t count = function.instrs.size();
+    size_t blocks = function.blocks.size();
+
+    // Candidate slots (in the entry block). variable[v] is the variable index of slot v.
+    std::vector<int> variable(count, -1);
+    std::vector<IrValue> slots;
+    for(IrValue value : function.blocks[0].code)
+    {
+        if(function.instrs[value].op == IrOp::ALLOCA)
+        {
+            variable[value] = slots.size();
+            slots.push_back(value);
+        }
+    }
+
+    // A slot can be promoted if its address is only used by loads and stores of the whole
+    // slot, all of the same type.
+    std::vector<IrType> types(slots.size(), IrType::VOID);
+    std::vector<bool> promoted(slots.size(), true);
+    for(auto& block : function.blocks)
+    {
+        for(IrValue value : block.code)
+        {
+            const IrInstr& instr = function.instrs[value];
+            IrRange operands = function.operands(value);
+            for(size_t i = 0;i < operands.size();i++)
+            {
+                if(operands[i] >= count || variable[operands[i]] < 0) continue;
+
+                int var = variable[operands[i]];
+                IrType type = IrType::VOID;
+                if(instr.op == IrOp::LOAD)
+                    type = instr.type;
+                else if(instr.op == IrOp::STORE && i == 0)
+                    type = function.instrs[operands[1]].type;
+
+                if(type == IrType::VOID
+                    || (types[var] != IrType::VOID && types[var] != type)
+                    || ir_type_size(type) != function.instrs[slots[var]].imm)
+                {
+                    promoted[var] = false;
+                }
+                types[var] = type;
+            }
+        }
+    }
+    bool changed = false;
+    for(size_t var = 0;var < slots.size();var++)
+    {
+        if(!promoted[var]) variable[slots[var]] = -1;
+        changed = changed || promoted[var];
+    }
+    if(!changed) return false;
+
+    auto variable_of = [&](IrValue address)
+    {
+        return address < count ? variable[address] : -1;
+    };
+
+    // Blocks which store to each variable, and blocks where it is used before any store.
+    std::vector<std::vector<IrBlockId>> defs(slots.size()), uses(slots.size());
+    std::vector<IrBlockId> stored_in(slots.size(), IrNoBlock), used_in(slots.size(), IrNoBlock);
+    for(IrBlockId b = 0;b < blocks;b++)
+    {
+        for(IrValue value : function.blocks[b].code)
+        {
+            const IrInstr& instr = function.instrs[value];
+            if(instr.op != IrOp::LOAD && instr.op != IrOp::STORE) continue;
+            int var = variable_of(function.operand(value, 0));
+            if(var < 0) continue;
+
+            if(instr.op == IrOp::STORE && stored_in[var] != b)
+            {
+                stored_in[var] = b;
+                defs[var].push_back(b);
+            }
+            else if(instr.op == IrOp::LOAD && stored_in[var] != b && used_in[var] != b)
+            {
+                used_in[var] = b;
+                uses[var].push_back(b);
+            }
+        }
+    }
+
+    const DominatorTree& tree = cache.dominators();
+    const DominanceFrontiers& frontiers = cache.frontiers();
+
+    // Place phis. Marks are stamped with the variable index + 1, so they don't need to be
+    // cleared between variables.
+    std::vector<std::vector<std::pair<IrValue, int>>> phis(blocks);
+    std::vector<int> defined(blocks, 0), live(blocks, 0), placed(blocks, 0), queued(blocks, 0);
+    std::vector<IrBlockId> work;
+    for(size_t var = 0;var < slots.size();var++)
+    {
+        if(!promoted[var] || defs[var].empty()) continue;
+        int stamp = var + 1;
+
+        // Blocks where the variable is live on entry: from the uses, backwards up to the
+        // stores.
+        for(IrBlockId b : defs[var]) defined[b] = stamp;
+        work = uses[var];
+        for(IrBlockId b : work) live[b] = stamp;
+        while(!work.empty())
+        {
+            IrBlockId b = work.back();
+            work.pop_back();
+            for(IrBlockId pred : function.blocks[b].preds)
+            {
+                if(live[pred] != stamp && defined[pred] != stamp)
+                {
+                    live[pred] = stamp;
+                    work.push_back(pred);
+                }
+            }
+        }
+
+        // Iterated dominance frontier of the stores (each phi is also a store).
+        work = defs[var];
+        for(IrBlockId b : work) queued[b] = stamp;
+        while(!work.empty())
+        {
+            IrBlockId b = work.back();
+            work.pop_back();
+            for(IrBlockId join : frontiers.frontier(b))
+            {
+                if(placed[join] == stamp) continue;
+                placed[join] = stamp;
+                if(live[join] != stamp) continue;
+
+                IrValue phi = function.create(
+                    IrOp::PHI,
+                    types[var],
+                    std::vector<IrValue>(function.blocks[join].preds.size(), IrNone)
+                );
+                function.instrs[phi].block = join;
+                phis[join].push_back({phi, static_cast<int>(var)});
+                if(queued[join] != stamp)
+                {
+                    queued[join] = stamp;
+                    work.push_back(join);
+                }
+            }
+        }
+    }
+
+    // Zero for undefined values (created on demand, in the entry block).
+    std::vector<IrValue> undefined_values(5, IrNone);
+    std::vector<IrValue> undefined_code;
+    auto undefined = [&](IrType type)
+    {
+        IrValue& value = undefined_values[static_cast<int>(type)];
+        if(value == IrNone)
+        {
+            value = function.create(IrOp::CONST, type, {}, 0);
+            function.instrs[value].block = 0;
+            undefined_code.push_back(value);
+        }
+        return value;
+    };
+
+    // Rename, walking the dominator tree.
+    struct Item
+    {
+        IrBlockId block;
+        bool leave;
+        size_t log;
+    };
+    std::vector<std::vector<IrValue>> current(slots.size());
+    std::vector<int> log;
+    std::vector<IrValue> replacements(function.instrs.size(), IrNone);
+    std::vector<bool> removed(function.instrs.size(), false);
+    auto top = [&](int var)
+    {
+        return current[var].empty() ? undefined(types[var]) : current[var].back();
+    };
+
+    std::vector<Item> stack{{0, false, 0}};
+    while(!stack.empty())
+    {
+        Item item = stack.back();
+        stack.pop_back();
+        if(item.leave)
+        {
+            for(;log.size() > item.log;log.pop_back())
+            {
+                current[log.back()].pop_back();
+            }
+            continue;
+        }
+        stack.push_back({item.block, true, log.size()});
+
+        IrBlock& block = function.blocks[item.block];
+        for(auto& phi : phis[item.block])
+        {
+            current[phi.second].push_back(phi.first);
+            log.push_back(phi.second);
+        }
+        for(IrValue value : block.code)
+        {
+            const IrInstr& instr = function.instrs[value];
+            if(instr.op == IrOp::ALLOCA)
+            {
+                removed[value] = variable[value] >= 0;
+                continue;
+            }
+            if(instr.op != IrOp::LOAD && instr.op != IrOp::STORE) continue;
+            int var = variable_of(function.operand(value, 0));
+            if(var < 0) continue;
+
+            removed[value] = true;
+            if(instr.op == IrOp::LOAD)
+            {
+                replacements[value] = top(var);
+            }
+            else
+            {
+                current[var].push_back(function.operand(value, 1));
+                log.push_back(var);
+            }
+        }
+
+        // Fill in the operands of the successors' phis for the edges from this block.
+        for(IrBlockId succ : block.succs)
+        {
+            const auto& preds = function.blocks[succ].preds;
+            for(size_t i = 0;i < preds.size();i++)
+            {
+                if(preds[i] != item.block) continue;
+                for(auto& phi : phis[succ])
+                {
+                    function.set_operand(phi.first, i, top(phi.second));
+                }
+            }
+        }
+
+        IrRange children = tree.children(item.block);
+        for(size_t i = children.size();i > 0;i--)
+        {
+            stack.push_back({children[i - 1], false, 0});
+        }
+    }
+
+    // Remove the slots, loads and stores, and add the phis.
+    for(IrBlockId b = 0;b < blocks;b++)
+    {
+        auto& code = function.blocks[b].code;
+        code.erase(
+            std::remove_if(code.begin(), code.end(), [&](IrValue value)
+            {
+                return value < removed.size() && removed[value];
+            }),
+            code.end()
+        );
+        std::vector<IrValue> start;
+        for(auto& phi : phis[b]) start.push_back(phi.first);
+        if(b == 0) start.insert(start.end(), undefined_code.begin(), undefined_code.end());
+        code.insert(code.begin(), start.begin(), start.end());
+    }
+    replacements.resize(function.instrs.size(), IrNone);
+    function.replace_uses(replacements);
+    // (The unreachable blocks are gone, so this keeps the block numbering.)
+    function.compact();
+    return true;
+}
@@ -0,0 +1,189 @@
+#include <chrono>
+#include <iomanip>
+
+#include "passes.h"
+#include "mem2reg.h"
+#include "sccp.h"
+#include "gvn.h"
+#include "licm.h"
+#include "induction.h"
+#include "simplifycfg.h"
+#include "inline.h"
+#include "vectorize.h"
+#include "ifconvert.h"
+
+PassManager::PassManager(int level, const InlineParams& inline_params)
+{
+    if(level <= 0) return;
+
+    add("mem2reg", [](IrFunction& f, AnalysisCache& cache) { return Mem2Reg().run(f, cache); }, true);
+    add("sccp", [](IrFunction& f, AnalysisCache&) { return ConstantPropagation().run(f); }, false);
+    if(level >= 2)
+    {
+        // (Callees are tidied up first, so the inliner sees their final size.)
+        add("clean-up", [](IrFunction& f, AnalysisCache&) { return clean_up(f); }, false);
+        add_module_pass("inline", [inline_params](IrModule& m) { return Inliner(inline_params).run(m); });
+        add("sccp", [](IrFunction& f, AnalysisCache&) { return ConstantPropagation().run(f); }, false);
+        add("gvn", [](IrFunction& f, AnalysisCache& cache) { return ValueNumbering().run(f, cache); }, true);
+        add("licm", [](IrFunction& f, AnalysisCache& cache)
+            {
+                return LoopInvariantCodeMotion().run(f, cache);
+            }, true);
+        add("vectorize", [](IrFunction& f, AnalysisCache& cache) { return LoopVectorizer().run(f, cache); }, true);
+        add("strength-reduction", [](IrFunction& f, AnalysisCache& cache)
+            {
+                return StrengthReduction().run(f, cache);
+            }, true);
+        add("if-convert", [](IrFunction& f, AnalysisCache&) { return IfConverter().run(f); }, false);
+    }
+    add("clean-up", [](IrFunction& f, AnalysisCache&) { return clean_up(f); }, false);
+}
+
+void PassManager::add(const std::string& name, Pass pass, bool preserves_cfg)
+{
+    passes.push_back(Entry{pass, nullptr, preserves_cfg});
+    pass_stats.emplace_back();
+    pass_stats.back().name = name;
+}
+
+void PassManager::add_module_pass(const std::string& name, ModulePass pass)
+{
+    passes.push_back(Entry{nullptr, pass, false});
+    pass_stats.emplace_back();
+    pass_stats.back().name = name;
+}
+
+static size_t size(const IrFunction& function)
+{
+    size_t instrs = 0;
+    for(const auto& block : function.blocks) instrs += block.code.size();
+    return instrs;
+}
+
+static double since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool PassManager::run(size_t entry, IrFunction& function, AnalysisCache& cache)
+{
+    PassStats& stats = pass_stats[entry];
+    stats.instrs_before += size(function);
+    stats.blocks_before += function.blocks.size();
+
+    auto start = std::chrono::steady_clock::now();
+    bool changed = passes[entry].pass(function, cache);
+    stats.seconds += since(start);
+
+    if(changed && !passes[entry].preserves_cfg) cache.invalidate();
+    stats.runs++;
+    stats.changed += changed;
+    stats.instrs_after += size(function);
+    stats.blocks_after += function.blocks.size();
+    return changed;
+}
+
+void PassManager::record(const AnalysisCache& cache)
+{
+    for(int a = 0;a < AnalysisCount;a++)
+    {
+        analysis_counts[a] += cache.computed(static_cast<Analysis>(a));
+        analysis_times[a] += cache.seconds(static_cast<Analysis>(a));
+    }
+}
+
+bool PassManager::run(IrFunction& function)
+{
+    AnalysisCache cache(function);
+    bool changed = false;
+    for(size_t i = 0;i < passes.size();i++)
+    {
+        if(passes[i].pass) changed = run(i, function, cache) || changed;
+    }
+    record(cache);
+    return changed;
+}
+
+bool PassManager::run(IrModule& module)
+{
+    std::vector<std::unique_ptr<AnalysisCache>> caches;
+    for(auto& function : module.functions) caches.emplace_back(new AnalysisCache(*function));
+
+    bool changed = false;
+    for(size_t i = 0;i < passes.size();i++)
+    {
+        if(passes[i].pass)
+        {
+            for(size_t f = 0;f < module.functions.size();f++)
+            {
+                changed = run(i, *module.functions[f], *caches[f]) || changed;
+            }
+            if(observer) observer(pass_stats[i].name, module);
+            continue;
+        }
+
+        PassStats& stats = pass_stats[i];
+        for(auto& function : module.functions)
+        {
+            stats.instrs_before += size(*function);
+            stats.blocks_before += function->blocks.size();
+        }
+        auto start = std::chrono::steady_clock::now();
+        bool result = passes[i].module_pass(module);
+        stats.seconds += since(start);
+        for(auto& function : module.functions)
+        {
+            stats.instrs_after += size(*function);
+            stats.blocks_after += function->blocks.size();
+        }
+        stats.runs++;
+        stats.changed += result;
+        if(result)
+        {
+            for(auto& cache : caches) cache->invalidate();
+        }
+        changed = changed || result;
+        if(observer) observer(pass_stats[i].name, module);
+    }
+
+    for(auto& cache : caches) record(*cache);
+    return changed;
+}
+
+void PassManager::report(std::ostream& out) const
+{
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    double total = 0;
+    for(const auto& stats : pass_stats) total += stats.seconds;
+
+    // (Analysis time is part of the time of the passes which asked for it.)
+    out << "Execution times (seconds)\n";
+    out << std::left << std::setw(24) << " pass" << std::right
+        << std::setw(6) << "runs" << std::setw(9) << "changed"
+        << std::setw(11) << "wall" << std::setw(7) << "%"
+        << std::setw(22) << "instrs" << std::setw(14) << "blocks" << "\n";
+    auto ratio = [&](double seconds) { return total > 0 ? 100 * seconds / total : 0.0; };
+    for(const auto& stats : pass_stats)
+    {
+        out << " " << std::left << std::setw(23) << stats.name << std::right
+            << std::setw(6) << stats.runs << std::setw(9) << stats.changed
+            << std::fixed << std::setprecision(6) << std::setw(11) << stats.seconds
+            << std::setprecision(1) << std::setw(6) << ratio(stats.seconds) << "%"
+            << std::setw(10) << stats.instrs_before << " -> " << std::left << std::setw(8)
+            << stats.instrs_after << std::right
+            << std::setw(6) << stats.blocks_before << " -> " << stats.blocks_after << "\n";
+    }
+    for(int a = 0;a < AnalysisCount;a++)
+    {
+        double seconds = analysis_times[a];
+        out << "  " << std::left << std::setw(22) << analysis_str(static_cast<Analysis>(a))
+            << std::right << std::setw(6) << analysis_counts[a] << std::setw(9) << ""
+            << std::fixed << std::setprecision(6) << std::setw(11) << seconds
+            << std::setprecision(1) << std::setw(6) << ratio(seconds) << "%\n";
+    }
+    out << " " << std::left << std::setw(38) << "TOTAL" << std::right
+        << std::fixed << std::setprecision(6) << std::setw(11) << total << "\n";
+    out.flags(flags);
+    out.precision(precision);
+}
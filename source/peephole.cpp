@@ -0,0 +1,255 @@
+#include "peephole.h"
+
+// Conditions, in pairs with their negations.
+static const char * const Conditions[] = {
+    "e", "ne", "z", "nz", "l", "ge", "le", "g", "b", "ae", "be", "a", "c", "nc", "s", "ns",
+    "o", "no", "p", "np"
+};
+
+static const char * negation(const std::string& condition)
+{
+    for(size_t i = 0;i < sizeof(Conditions) / sizeof(Conditions[0]);i++)
+    {
+        if(condition == Conditions[i]) return Conditions[i ^ 1];
+    }
+    return nullptr;
+}
+
+const PeepholeOptimizer::Rule PeepholeOptimizer::Rules[] = {
+    {MachineOp::MOV, &PeepholeOptimizer::self_move},
+    {MachineOp::MOV, &PeepholeOptimizer::move_back},
+    {MachineOp::MOV, &PeepholeOptimizer::zero},
+    {MachineOp::ADD, &PeepholeOptimizer::merge_immediates},
+    {MachineOp::SUB, &PeepholeOptimizer::merge_immediates},
+    {MachineOp::CMP, &PeepholeOptimizer::compare_zero},
+    {MachineOp::JMP, &PeepholeOptimizer::thread_jump},
+    {MachineOp::JCC, &PeepholeOptimizer::thread_jump},
+    {MachineOp::JCC, &PeepholeOptimizer::branch_over},
+    {MachineOp::JMP, &PeepholeOptimizer::jump_next},
+    {MachineOp::JCC, &PeepholeOptimizer::jump_next},
+};
+
+PeepholeOptimizer::PeepholeOptimizer(std::vector<MachineInstr>& code) : code(code)
+{
+    for(size_t i = 0;i < code.size();i++)
+    {
+        if(code[i].op == MachineOp::LABEL) labels[code[i].mnemonic] = i;
+    }
+}
+
+int PeepholeOptimizer::run()
+{
+    int rewrites = 0;
+    bool changed = true;
+    while(changed)
+    {
+        changed = false;
+        for(size_t i = 0;i < code.size();i++)
+        {
+            for(const Rule& rule : Rules)
+            {
+                if(code[i].op == rule.anchor && (this->*rule.apply)(i))
+                {
+                    rewrites++;
+                    changed = true;
+                }
+            }
+        }
+    }
+    return rewrites;
+}
+
+size_t PeepholeOptimizer::next(size_t i) const
+{
+    i++;
+    while(i < code.size() && code[i].op == MachineOp::DELETED) i++;
+    return i;
+}
+
+bool PeepholeOptimizer::flags_dead(size_t i) const
+{
+    for(size_t j = next(i);j < code.size();j = next(j))
+    {
+        const MachineInstr& instr = code[j];
+        if(instr.op == MachineOp::CALL || instr.op == MachineOp::RET) return true;
+        if(instr.op == MachineOp::LABEL || instr.op == MachineOp::DIRECTIVE || instr.op == MachineOp::JMP) return false;
+        if(instr.flags != MachineFlags::NONE) return instr.flags == MachineFlags::WRITE;
+    }
+    return false;
+}
+
+void PeepholeOptimizer::remove(size_t i)
+{
+    code[i].op = MachineOp::DELETED;
+    code[i].operands.clear();
+}
+
+const std::string& PeepholeOptimizer::target(size_t i) const
+{
+    return code[i].operands[0].symbol;
+}
+
+// Follows at most 8 jumps (a cycle of them gives null).
+const std::string * PeepholeOptimizer::thread(const std::string& label) const
+{
+    const std::string * current = &label;
+    for(int jumps = 0;jumps < 8;jumps++)
+    {
+        auto found = labels.find(*current);
+        if(found == labels.end()) return current;
+        size_t j = next(found->second);
+        while(j < code.size() && code[j].op == MachineOp::LABEL) j = next(j);
+        if(j == code.size() || code[j].op != MachineOp::JMP || !labels.count(target(j))) return current;
+        current = &target(j);
+    }
+    return nullptr;
+}
+
+// mov r, r
+bool PeepholeOptimizer::self_move(size_t i)
+{
+    const MachineInstr& instr = code[i];
+    if(instr.width == 2 || instr.operands[0].kind != MachineOperand::Kind::REGISTER
+        || instr.operands[0] != instr.operands[1])
+    {
+        return false;
+    }
+    remove(i);
+    return true;
+}
+
+// mov a, b; mov b, a -> mov a, b (quadword registers), and mov a, m; mov m, r -> mov a, m;
+// mov a, r (where the second is no wider than the first).
+bool PeepholeOptimizer::move_back(size_t i)
+{
+    size_t j = next(i);
+    if(j == code.size() || code[j].op != MachineOp::MOV) return false;
+    const MachineOperand& a = code[i].operands[0], & b = code[i].operands[1];
+    MachineInstr& back = code[j];
+    if(back.operands[1].kind != MachineOperand::Kind::REGISTER || back.width > code[i].width) return false;
+
+    if(b.kind == MachineOperand::Kind::REGISTER && code[i].width == 3 && back.width == 3)
+    {
+        if(back.operands[0] != b || back.operands[1] != a) return false;
+        remove(j);
+        return true;
+    }
+    if(b.kind != MachineOperand::Kind::MEMORY || back.operands[0] != b) return false;
+    if(a.kind == MachineOperand::Kind::REGISTER)
+        back.operands[0] = MachineOperand::in(a.reg, back.width);
+    else if(a.kind == MachineOperand::Kind::IMMEDIATE)
+        back.operands[0] = a;
+    else
+        return false;
+    return true;
+}
+
+// mov $0, r -> xor r, r
+bool PeepholeOptimizer::zero(size_t i)
+{
+    MachineInstr& instr = code[i];
+    const MachineOperand& source = instr.operands[0], & destination = instr.operands[1];
+    if(instr.width < 2 || source.kind != MachineOperand::Kind::IMMEDIATE || source.value != 0
+        || destination.kind != MachineOperand::Kind::REGISTER || !flags_dead(i))
+    {
+        return false;
+    }
+    // (A doubleword operation zeroes the upper half of the register.)
+    MachineOperand reg = MachineOperand::in(destination.reg, 2);
+    instr.op = MachineOp::XOR;
+    instr.flags = MachineFlags::WRITE;
+    instr.width = 2;
+    instr.mnemonic = "xorl";
+    instr.operands = {reg, reg};
+    return true;
+}
+
+// add $i, x; sub $j, x -> add $(i - j), x
+bool PeepholeOptimizer::merge_immediates(size_t i)
+{
+    size_t j = next(i);
+    if(j == code.size() || (code[j].op != MachineOp::ADD && code[j].op != MachineOp::SUB)) return false;
+    MachineInstr& first = code[i];
+    const MachineInstr& second = code[j];
+    int w = first.width;
+    if(w < 2 || second.width != w || first.operands[0].kind != MachineOperand::Kind::IMMEDIATE
+        || second.operands[0].kind != MachineOperand::Kind::IMMEDIATE || first.operands[1] != second.operands[1]
+        || !flags_dead(j))
+    {
+        return false;
+    }
+    int64_t sum = (first.op == MachineOp::ADD ? 1 : -1) * first.operands[0].value
+        + (second.op == MachineOp::ADD ? 1 : -1) * second.operands[0].value;
+    if(w == 2)
+        sum = static_cast<int32_t>(static_cast<uint32_t>(sum));
+    else if(sum < INT32_MIN || sum > INT32_MAX)
+        return false;
+
+    remove(j);
+    if(sum == 0)
+    {
+        remove(i);
+        return true;
+    }
+    bool add = sum > 0 || sum == INT32_MIN;
+    first.op = add ? MachineOp::ADD : MachineOp::SUB;
+    first.mnemonic = std::string(add ? "add" : "sub") + Suffixes[w];
+    first.operands[0] = MachineOperand::immediate(add ? sum : -sum);
+    return true;
+}
+
+// cmp $0, r -> test r, r
+bool PeepholeOptimizer::compare_zero(size_t i)
+{
+    MachineInstr& instr = code[i];
+    const MachineOperand& source = instr.operands[0];
+    if(source.kind != MachineOperand::Kind::IMMEDIATE || source.value != 0
+        || instr.operands[1].kind != MachineOperand::Kind::REGISTER)
+    {
+        return false;
+    }
+    instr.op = MachineOp::TEST;
+    instr.mnemonic = std::string("test") + Suffixes[instr.width];
+    instr.operands[0] = instr.operands[1];
+    return true;
+}
+
+// jmp a; ... a: jmp b -> jmp b
+bool PeepholeOptimizer::thread_jump(size_t i)
+{
+    if(!labels.count(target(i))) return false;
+    const std::string * label = thread(target(i));
+    if(!label || *label == target(i)) return false;
+    code[i].operands[0].symbol = *label;
+    return true;
+}
+
+// jcc a; jmp b; a: -> jncc b; a:
+bool PeepholeOptimizer::branch_over(size_t i)
+{
+    size_t j = next(i);
+    if(j == code.size() || code[j].op != MachineOp::JMP || !labels.count(target(j))) return false;
+    const char * condition = negation(code[i].mnemonic.substr(1));
+    if(!condition) return false;
+    for(size_t k = next(j);k < code.size() && code[k].op == MachineOp::LABEL;k = next(k))
+    {
+        if(code[k].mnemonic != target(i)) continue;
+        code[i].mnemonic = std::string("j") + condition;
+        code[i].operands[0] = code[j].operands[0];
+        remove(j);
+        return true;
+    }
+    return false;
+}
+
+// jmp a; a: -> a:
+bool PeepholeOptimizer::jump_next(size_t i)
+{
+    for(size_t k = next(i);k < code.size() && code[k].op == MachineOp::LABEL;k = next(k))
+    {
+        if(code[k].mnemonic != target(i)) continue;
+        remove(i);
+        return true;
+    }
+    return false;
+}
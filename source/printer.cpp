@@ -5,7 +5,22 @@
 
 std::string PrinterVisitor::print(AstNode& root)
 {
-    root.accept(*this);
+    stack.push_back(Item{&root, ""});
+    while(!stack.empty())
+    {
+        Item item = std::move(stack.back());
+        stack.pop_back();
+        if(item.node == nullptr)
+        {
+            str << item.text;
+            continue;
+        }
+
+        // Move queued items onto the stack in reverse, so they are printed in order.
+        item.node->accept(*this);
+        stack.insert(stack.end(), queued.rbegin(), queued.rend());
+        queued.clear();
+    }
     return str.str();
 }
 
@@ -17,66 +32,66 @@ void PrinterVisitor::visit(PrimaryExprAstNode& node)
 void PrinterVisitor::visit(BinaryExprAstNode& node)
 {
     str << "(B ";
-    node.left->accept(*this);
+    queue(*node.left);
     switch(node.op)
     {
         case BinaryType::MUL:
-            str << ", *, ";
+            queue(", *, ");
             break;
         case BinaryType::DIV:
-            str << ", /, ";
+            queue(", /, ");
             break;
         case BinaryType::MOD:
-            str << ", %, ";
+            queue(", %, ");
             break;
         case BinaryType::ADD:
-            str << ", +, ";
+            queue(", +, ");
             break;
         case BinaryType::SUB:
-            str << ", -, ";
+            queue(", -, ");
             break;
         case BinaryType::SHIFT_LEFT:
-            str << ", <<, ";
+            queue(", <<, ");
             break;
         case BinaryType::SHIFT_RIGHT:
-            str << ", >>, ";
+            queue(", >>, ");
             break;
         case BinaryType::LT:
-            str << ", <, ";
+            queue(", <, ");
             break;
         case BinaryType::GT:
-            str << ", >, ";
+            queue(", >, ");
             break;
         case BinaryType::LE:
-            str << ", <=, ";
+            queue(", <=, ");
             break;
         case BinaryType::GE:
-            str << ", >=, ";
+            queue(", >=, ");
             break;
         case BinaryType::EQ:
-            str << ", ==, ";
+            queue(", ==, ");
             break;
         case BinaryType::NE:
-            str << ", !=, ";
+            queue(", !=, ");
             break;
         case BinaryType::BITWISE_AND:
-            str << ", &, ";
+            queue(", &, ");
             break;
         case BinaryType::BITWISE_EXCL_OR:
-            str << ", ^, ";
+            queue(", ^, ");
             break;
         case BinaryType::BITWISE_INCL_OR:
-            str << ", |, ";
+            queue(", |, ");
             break;
         case BinaryType::LOGICAL_AND_OP:
-            str << ", &&, ";
+            queue(", &&, ");
             break;
         case BinaryType::LOGICAL_OR_OP:
-            str << ", ||, ";
+            queue(", ||, ");
             break;
     }
-    node.right->accept(*this);
-    str << ")";
+    queue(*node.right);
+    queue(")");
 }
 
 void PrinterVisitor::visit(UnaryExprAstNode& node)
@@ -85,49 +100,49 @@ void PrinterVisitor::visit(UnaryExprAstNode& node)
     if(node.type == UnaryType::INC)
     {
         str << "++, ";
-        node.right->accept(*this);
+        queue(*node.right);
     }
     if(node.type == UnaryType::DEC)
     {
         str << "--, ";
-        node.right->accept(*this);
+        queue(*node.right);
     }
     if(node.type == UnaryType::ADDROF) {
         str << "&, ";
-        node.right->accept(*this);
+        queue(*node.right);
     }
     if(node.type == UnaryType::DEREF) {
         str << "*, ";
-        node.right->accept(*this);
+        queue(*node.right);
     }
     if(node.type == UnaryType::PLUS) {
         str << "+, ";
-        node.right->accept(*this);
+        queue(*node.right);
     }
     if(node.type == UnaryType::MINUS) {
         str << "-, ";
-        node.right->accept(*this);
+        queue(*node.right);
     }
     if(node.type == UnaryType::COMPLEMENT) {
         str << "~, ";
-        node.right->accept(*this);
+        queue(*node.right);
     }
     if(node.type == UnaryType::NOT) {
         str << "!, ";
-        node.right->accept(*this);
+        queue(*node.right);
     }
-    str <<")";
+    queue(")");
 }
 
 void PrinterVisitor::visit(TertiaryExprAstNode& node)
 {
     str << "(T ";
-    node.conditional->accept(*this);
-    str << ", ";
-    node.left->accept(*this);
-    str << ", ";
-    node.right->accept(*this);
-    str << ")";
+    queue(*node.conditional);
+    queue(", ");
+    queue(*node.left);
+    queue(", ");
+    queue(*node.right);
+    queue(")");
 }
 
 void PrinterVisitor::visit(PostfixExprAstNode& node)
@@ -136,94 +151,235 @@ void PrinterVisitor::visit(PostfixExprAstNode& node)
     if(node.type == PostfixType::INC)
     {
         str << "++, ";
-        node.left->accept(*this);
-        str << ")";
+        queue(*node.left);
+        queue(")");
     }
     else if(node.type == PostfixType::DEC)
     {
         str << "--, ";
-        node.left->accept(*this);
-        str << ")";
+        queue(*node.left);
+        queue(")");
     }
     else if(node.type == PostfixType::ARRAY)
     {
         str << "[], ";
-        node.left->accept(*this);
-        str << ", ";
-        (*node.right.begin())->accept(*this);
-        str << ")";
+        queue(*node.left);
+        queue(", ");
+        queue(**node.right.begin());
+        queue(")");
     }
     else if(node.type == PostfixType::PTR_OP)
     {
         str << "->, ";
-        node.left->accept(*this);
-        str << ", " << *node.identifier << ")";
+        queue(*node.left);
+        std::stringstream identifier;
+        identifier << ", " << *node.identifier << ")";
+        queue(identifier.str());
     }
     else if(node.type == PostfixType::DOT)
     {
         str << "., ";
-        node.left->accept(*this);
-        str << ", " << *node.identifier << ")";
+        queue(*node.left);
+        std::stringstream identifier;
+        identifier << ", " << *node.identifier << ")";
+        queue(identifier.str());
     }
     else if(node.type == PostfixType::CALL)
     {
         str << "(), ";
-        node.left->accept(*this);
+        queue(*node.left);
         for(auto arg : node.right)
         {
-            str << ", ";
-            arg->accept(*this);
+            queue(", ");
+            queue(*arg);
         }
-        str << ")";
+        queue(")");
     }
 }
 
 void PrinterVisitor::visit(AssignExprAstNode& node)
 {
     str << "(A ";
-    node.left->accept(*this);
+    queue(*node.left);
     switch(node.type)
     {
         case AssignExprType::ASSIGN:
-            str << ", =, ";
+            queue(", =, ");
             break;
         case AssignExprType::PLUS:
-            str << ", +, ";
+            queue(", +, ");
             break;
         case AssignExprType::MINUS:
-            str << ", -, ";
+            queue(", -, ");
             break;
         case AssignExprType::MUL:
-            str << ", *, ";
+            queue(", *, ");
             break;
         case AssignExprType::DIV:
-            str << ", /, ";
+            queue(", /, ");
             break;
         case AssignExprType::MOD:
-            str << ", %, ";
+            queue(", %, ");
             break;
         case AssignExprType::XOR:
-            str << ", ^, ";
+            queue(", ^, ");
             break;
         case AssignExprType::SHIFT_LEFT:
-            str << ", <<, ";
+            queue(", <<, ");
             break;
         case AssignExprType::SHIFT_RIGHT:
-            str << ", >>, ";
+            queue(", >>, ");
             break;
         case AssignExprType::OR:
-            str << ", |, ";
+            queue(", |, ");
             break;
         case AssignExprType::AND:
-            str << ", &, ";
+            queue(", &, ");
             break;
     }
-    node.right->accept(*this);
-    str << ")";
+    queue(*node.right);
+    queue(")");
 }
 
 void PrinterVisitor::visit(ExprAstNode&)
 {}
 
-void PrinterVisitor::visit(DeclAstNode&)
-{}
\ No newline at end of file
+void PrinterVisitor::visit(DeclAstNode& node)
+{
+    str << "(D ";
+    if(node.identifier)
+    {
+        str << *node.identifier << ", ";
+    }
+    str << *node.type;
+    if(node.initializer)
+    {
+        queue(", ");
+        queue(*node.initializer);
+    }
+    queue(")");
+}
+
+void PrinterVisitor::visit(CompoundStmtAstNode& node)
+{
+    str << "(C";
+    for(auto& item : node.items)
+    {
+        queue(item == node.items.front() ? " " : ", ");
+        queue(*item);
+    }
+    queue(")");
+}
+
+void PrinterVisitor::visit(ExprStmtAstNode& node)
+{
+    str << "(ES";
+    if(node.expr)
+    {
+        queue(" ");
+        queue(*node.expr);
+    }
+    queue(")");
+}
+
+void PrinterVisitor::visit(ReturnStmtAstNode& node)
+{
+    str << "(R";
+    if(node.expr)
+    {
+        queue(" ");
+        queue(*node.expr);
+    }
+    queue(")");
+}
+
+// Loops print their parts in source order. The clauses of a 'for' are separated by ';',
+// and are empty where they are omitted.
+void PrinterVisitor::visit(IterationStmtAstNode& node)
+{
+    switch(node.type)
+    {
+        case IterationType::WHILE:
+            str << "(WHILE ";
+            queue(*node.condition);
+            queue(", ");
+            break;
+        case IterationType::DO:
+            str << "(DO ";
+            queue(*node.body);
+            queue(", ");
+            queue(*node.condition);
+            queue(")");
+            return;
+        case IterationType::FOR:
+            str << "(FOR ";
+            for(auto& item : node.init)
+            {
+                if(item != node.init.front()) queue(", ");
+                queue(*item);
+            }
+            queue("; ");
+            if(node.condition) queue(*node.condition);
+            queue("; ");
+            if(node.step) queue(*node.step);
+            queue("; ");
+            break;
+    }
+    queue(*node.body);
+    queue(")");
+}
+
+void PrinterVisitor::visit(SwitchStmtAstNode& node)
+{
+    str << "(SWITCH ";
+    queue(*node.condition);
+    queue(", ");
+    queue(*node.body);
+    queue(")");
+}
+
+void PrinterVisitor::visit(CaseStmtAstNode& node)
+{
+    if(node.value)
+    {
+        str << "(CASE ";
+        queue(*node.value);
+        queue(", ");
+    }
+    else
+    {
+        str << "(DEFAULT ";
+    }
+    queue(*node.body);
+    queue(")");
+}
+
+void PrinterVisitor::visit(JumpStmtAstNode& node)
+{
+    str << (node.type == JumpType::BREAK ? "(BREAK)" : "(CONTINUE)");
+}
+
+void PrinterVisitor::visit(FunctionDefAstNode& node)
+{
+    str << "(F ";
+    queue(*node.decl);
+    for(auto& param : node.parameters)
+    {
+        queue(", ");
+        queue(*param);
+    }
+    queue(", ");
+    queue(*node.body);
+    queue(")");
+}
+
+void PrinterVisitor::visit(TranslationUnitAstNode& node)
+{
+    str << "(TU";
+    for(auto& item : node.items)
+    {
+        queue(item == node.items.front() ? " " : ", ");
+        queue(*item);
+    }
+    queue(")");
+}
\ No newline at end of file
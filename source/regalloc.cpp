@@ -0,0 +1,623 @@
+#include <algorithm>
+
+#include "regalloc.h"
+
+static const uint32_t Never = UINT32_MAX;
+
+const Register ArgumentRegisters[6] = {
+    Register::RDI, Register::RSI, Register::RDX, Register::RCX, Register::R8, Register::R9
+};
+
+// Caller-saved registers come first, so callee-saved registers (which the prologue must
+// save) are only used when a value is live across a call, or the others are taken.
+const Register LinearScan::Allocatable[12] = {
+    Register::RDI, Register::RSI, Register::RDX, Register::RCX, Register::R8, Register::R9,
+    Register::R10, Register::RBX, Register::R12, Register::R13, Register::R14, Register::R15
+};
+
+bool is_callee_saved(Register reg)
+{
+    return reg == Register::RBX || reg == Register::RBP || reg >= Register::R12;
+}
+
+// First position in two sorted lists of ranges, starting from ranges a[i] and b[j].
+static uint32_t first_intersection(
+    const std::vector<LiveRange>& a, size_t i, const std::vector<LiveRange>& b, size_t j)
+{
+    while(i < a.size() && j < b.size())
+    {
+        if(a[i].to <= b[j].from)
+            i++;
+        else if(b[j].to <= a[i].from)
+            j++;
+        else
+            return std::max(a[i].from, b[j].from);
+    }
+    return Never;
+}
+
+// Index of the first range which ends after a position.
+static size_t range_after(const std::vector<LiveRange>& ranges, uint32_t position)
+{
+    return std::upper_bound(ranges.begin(), ranges.end(), position, [](uint32_t p, const LiveRange& range)
+    {
+        return p < range.to;
+    }) - ranges.begin();
+}
+
+bool LiveInterval::covers(uint32_t position) const
+{
+    size_t i = range_after(ranges, position);
+    return i < ranges.size() && ranges[i].from <= position;
+}
+
+uint32_t LiveInterval::intersection(const LiveInterval& other) const
+{
+    return first_intersection(ranges, 0, other.ranges, 0);
+}
+
+uint32_t LiveInterval::next_use(uint32_t position) const
+{
+    auto use = std::lower_bound(uses.begin(), uses.end(), position);
+    return use == uses.end() ? Never : *use;
+}
+
+void LinearScan::prepare(IrFunction& function)
+{
+    function.remove_unreachable();
+    function.split_critical_edges();
+    function.compact();
+}
+
+LinearScan::LinearScan(IrFunction& f, const InstructionSelector * s) : function(f), selector(s)
+{
+    prepare(function);
+
+    number();
+    build_intervals();
+    build_fixed();
+    allocate();
+    resolve();
+}
+
+void LinearScan::number()
+{
+    size_t blocks = function.blocks.size();
+    block_from.resize(blocks);
+    block_to.resize(blocks);
+    block_start.assign(function.instrs.size(), false);
+    for(IrBlockId b = 0;b < blocks;b++)
+    {
+        const auto& code = function.blocks[b].code;
+        block_from[b] = 4 * code.front();
+        block_to[b] = 4 * (code.back() + 1);
+        block_start[code.front()] = true;
+    }
+}
+
+void LinearScan::build_intervals()
+{
+    size_t count = function.instrs.size();
+    size_t blocks = function.blocks.size();
+    interval_of.assign(count, Never);
+    value_end.assign(count, 0);
+    live_in.assign(blocks, {});
+
+    IrUses uses(function);
+    std::vector<IrValue> live_in_mark(blocks, IrNone), live_out_mark(blocks, IrNone);
+    std::vector<IrBlockId> work;
+    for(IrValue value = 0;value < count;value++)
+    {
+        const IrInstr& instr = function.instrs[value];
+        if(instr.type == IrType::VOID || instr.op == IrOp::CONST || instr.op == IrOp::ALLOCA
+            || uses.count(value) == 0 || (selector && selector->folded(value)))
+        {
+            continue;
+        }
+        interval_of[value] = intervals.size();
+        intervals.emplace_back();
+        LiveInterval& interval = intervals.back();
+        interval.value = value;
+
+        IrBlockId home = instr.block;
+        uint32_t def = instr.op == IrOp::PHI ? block_from[home] : 4 * value + 2;
+
+        // The value is live out of a block: through all of it, or from its definition.
+        auto live_out = [&](IrBlockId b)
+        {
+            if(live_out_mark[b] == value) return;
+            live_out_mark[b] = value;
+            if(b == home)
+            {
+                interval.ranges.push_back({def, block_to[b]});
+            }
+            else
+            {
+                interval.ranges.push_back({block_from[b], block_to[b]});
+                work.push_back(b);
+            }
+        };
+        auto propagate = [&]()
+        {
+            while(!work.empty())
+            {
+                IrBlockId b = work.back();
+                work.pop_back();
+                if(live_in_mark[b] == value) continue;
+                live_in_mark[b] = value;
+                live_in[b].push_back(value);
+                for(IrBlockId pred : function.blocks[b].preds) live_out(pred);
+            }
+        };
+
+        IrRange users = uses.users(value);
+        for(size_t u = 0;u < users.size();u++)
+        {
+            IrValue user = users[u];
+            if(u > 0 && users[u - 1] == user) continue;
+
+            const IrInstr& use = function.instrs[user];
+            if(use.op == IrOp::PHI)
+            {
+                // Phi operands are used at the end of the corresponding predecessor.
+                IrRange operands = function.operands(user);
+                for(size_t i = 0;i < operands.size();i++)
+                {
+                    if(operands[i] != value) continue;
+                    IrBlockId pred = function.blocks[use.block].preds[i];
+                    interval.uses.push_back(block_to[pred] - 1);
+                    live_out(pred);
+                }
+            }
+            else
+            {
+                uint32_t position = 4 * (selector ? selector->root(user) : user);
+                interval.uses.push_back(position);
+                if(use.block == home)
+                {
+                    interval.ranges.push_back({def, position + 1});
+                }
+                else
+                {
+                    interval.ranges.push_back({block_from[use.block], position + 1});
+                    work.push_back(use.block);
+                }
+            }
+            propagate();
+        }
+
+        std::sort(interval.ranges.begin(), interval.ranges.end(), [](const LiveRange& a, const LiveRange& b)
+        {
+            return a.from < b.from;
+        });
+        size_t merged = 0;
+        for(size_t i = 1;i < interval.ranges.size();i++)
+        {
+            LiveRange& last = interval.ranges[merged];
+            if(interval.ranges[i].from <= last.to)
+                last.to = std::max(last.to, interval.ranges[i].to);
+            else
+                interval.ranges[++merged] = interval.ranges[i];
+        }
+        interval.ranges.resize(merged + 1);
+        std::sort(interval.uses.begin(), interval.uses.end());
+        value_end[value] = interval.end();
+    }
+
+    // Hints.
+    for(auto& interval : intervals)
+    {
+        const IrInstr& instr = function.instrs[interval.value];
+        if(instr.op == IrOp::PARAM && instr.imm < 6)
+        {
+            interval.hint_register = static_cast<int>(ArgumentRegisters[instr.imm]);
+        }
+        else if(instr.op == IrOp::PHI)
+        {
+            for(IrValue operand : function.operands(interval.value))
+            {
+                if(interval_of[operand] == Never) continue;
+                if(interval.hint_value == IrNone) interval.hint_value = operand;
+
+                LiveInterval& source = intervals[interval_of[operand]];
+                if(source.hint_value == IrNone) source.hint_value = interval.value;
+            }
+        }
+        else if(instr.count > 0 && ((instr.op >= IrOp::ADD && instr.op <= IrOp::NOT)
+            || (instr.op >= IrOp::SEXT && instr.op <= IrOp::TRUNC) || instr.op == IrOp::COPY))
+        {
+            interval.hint_value = function.operand(interval.value, 0);
+        }
+        else if(instr.op == IrOp::SELECT)
+        {
+            // (The value if the condition is false is moved to the result first.)
+            interval.hint_value = function.operand(interval.value, 2);
+        }
+    }
+}
+
+void LinearScan::build_fixed()
+{
+    fixed.assign(16, {});
+    for(IrValue value = 0;value < function.instrs.size();value++)
+    {
+        const IrInstr& instr = function.instrs[value];
+        uint32_t position = 4 * value;
+        switch(instr.op)
+        {
+            case IrOp::CALL:
+                for(Register reg : Allocatable)
+                {
+                    if(!is_callee_saved(reg)) fixed[static_cast<int>(reg)].push_back({position + 1, position + 2});
+                }
+                break;
+            case IrOp::SDIV:
+            case IrOp::UDIV:
+            case IrOp::SREM:
+            case IrOp::UREM:
+                // rdx:rax is the dividend.
+                fixed[static_cast<int>(Register::RDX)].push_back({position, position + 2});
+                break;
+            case IrOp::SHL:
+            case IrOp::SAR:
+            case IrOp::SHR:
+                // Variable shift counts are in cl.
+                if(function.instrs[function.operand(value, 1)].op != IrOp::CONST)
+                {
+                    fixed[static_cast<int>(Register::RCX)].push_back({position, position + 2});
+                }
+                break;
+            case IrOp::PARAM:
+                // The argument register holds the argument until it is read.
+                if(instr.imm < 6)
+                {
+                    fixed[static_cast<int>(ArgumentRegisters[instr.imm])].push_back({0, position + 1});
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    for(auto& ranges : fixed)
+    {
+        std::sort(ranges.begin(), ranges.end(), [](const LiveRange& a, const LiveRange& b)
+        {
+            return a.from < b.from;
+        });
+    }
+}
+
+uint32_t LinearScan::fixed_intersection(Register reg, const LiveInterval& interval) const
+{
+    const auto& ranges = fixed[static_cast<int>(reg)];
+    return first_intersection(ranges, range_after(ranges, interval.start()), interval.ranges, 0);
+}
+
+void LinearScan::push(uint32_t interval)
+{
+    unhandled.push_back(interval);
+    std::push_heap(unhandled.begin(), unhandled.end(), [&](uint32_t a, uint32_t b)
+    {
+        return intervals[a].start() > intervals[b].start();
+    });
+}
+
+uint32_t LinearScan::split_position(uint32_t position) const
+{
+    // Moves go between instructions. (Phis are all at the start of their block.)
+    position &= ~3u;
+    IrValue value = position / 4;
+    if(value < function.instrs.size() && function.instrs[value].op == IrOp::PHI)
+    {
+        position = block_from[function.instrs[value].block];
+    }
+    return position;
+}
+
+uint32_t LinearScan::split(uint32_t index, uint32_t position)
+{
+    uint32_t child = intervals.size();
+    intervals.emplace_back();
+    LiveInterval& parent = intervals[index];
+    LiveInterval& rest = intervals[child];
+    rest.value = parent.value;
+    rest.hint_register = parent.hint_register;
+    rest.hint_value = parent.hint_value;
+
+    size_t i = range_after(parent.ranges, position);
+    rest.ranges.assign(parent.ranges.begin() + i, parent.ranges.end());
+    parent.ranges.resize(i);
+    if(rest.ranges.front().from < position)
+    {
+        parent.ranges.push_back({rest.ranges.front().from, position});
+        rest.ranges.front().from = position;
+    }
+
+    auto use = std::lower_bound(parent.uses.begin(), parent.uses.end(), position);
+    rest.uses.assign(use, parent.uses.end());
+    parent.uses.erase(use, parent.uses.end());
+
+    rest.next = parent.next;
+    parent.next = child;
+    return child;
+}
+
+void LinearScan::spill(uint32_t index, uint32_t from, uint32_t position)
+{
+    if(from > intervals[index].start()) index = split(index, from);
+
+    // All the spilled parts of a value share a slot. A slot can be reused once the value
+    // which last had it has ended.
+    IrValue value = intervals[index].value;
+    if(slot_of.empty()) slot_of.assign(function.instrs.size(), Never);
+    if(slot_of[value] == Never)
+    {
+        uint32_t start = intervals[index].start();
+        uint32_t slot = 0;
+        while(slot < slot_end.size() && slot_end[slot] > start) slot++;
+        if(slot == slot_end.size()) slot_end.push_back(0);
+        slot_end[slot] = value_end[value];
+        slot_of[value] = slot;
+    }
+    intervals[index].location = Location{Location::Kind::STACK, Register::RAX, slot_of[value]};
+
+    // Load it again before its next use.
+    uint32_t use = intervals[index].next_use(position + 1);
+    if(use == Never) return;
+    uint32_t reload = split_position(use);
+    if(reload > position && reload > intervals[index].start())
+    {
+        push(split(index, reload));
+    }
+}
+
+int LinearScan::hint(const LiveInterval& interval) const
+{
+    if(interval.hint_register >= 0) return interval.hint_register;
+    if(interval.hint_value == IrNone || interval_of[interval.hint_value] == Never) return -1;
+
+    // The register of the part of the other value nearest to this interval.
+    int reg = -1;
+    for(uint32_t part = interval_of[interval.hint_value];part != Never;part = intervals[part].next)
+    {
+        const LiveInterval& other = intervals[part];
+        if(other.location.kind != Location::Kind::REGISTER) continue;
+        if(reg >= 0 && other.start() > interval.start()) break;
+        reg = static_cast<int>(other.location.reg);
+    }
+    return reg;
+}
+
+void LinearScan::allocate()
+{
+    for(uint32_t i = 0;i < intervals.size();i++) push(i);
+
+    auto later = [&](uint32_t a, uint32_t b)
+    {
+        return intervals[a].start() > intervals[b].start();
+    };
+    while(!unhandled.empty())
+    {
+        std::pop_heap(unhandled.begin(), unhandled.end(), later);
+        uint32_t current = unhandled.back();
+        unhandled.pop_back();
+        uint32_t position = intervals[current].start();
+
+        // Retire intervals which have ended, and move intervals into and out of their
+        // lifetime holes.
+        std::vector<uint32_t> still_active, still_inactive;
+        for(uint32_t i : active)
+        {
+            if(intervals[i].end() <= position) continue;
+            (intervals[i].covers(position) ? still_active : still_inactive).push_back(i);
+        }
+        for(uint32_t i : inactive)
+        {
+            if(intervals[i].end() <= position) continue;
+            (intervals[i].covers(position) ? still_active : still_inactive).push_back(i);
+        }
+        active.swap(still_active);
+        inactive.swap(still_inactive);
+
+        if(!try_allocate(current)) allocate_blocked(current);
+        if(intervals[current].location.kind == Location::Kind::REGISTER)
+        {
+            active.push_back(current);
+            used_registers |= 1 << static_cast<int>(intervals[current].location.reg);
+        }
+    }
+}
+
+bool LinearScan::try_allocate(uint32_t current)
+{
+    const LiveInterval& interval = intervals[current];
+    uint32_t free_until[16] = {0};
+    for(Register reg : Allocatable)
+    {
+        free_until[static_cast<int>(reg)] = fixed_intersection(reg, interval);
+    }
+    for(uint32_t i : active)
+    {
+        free_until[static_cast<int>(intervals[i].location.reg)] = 0;
+    }
+    for(uint32_t i : inactive)
+    {
+        int reg = static_cast<int>(intervals[i].location.reg);
+        free_until[reg] = std::min(free_until[reg], intervals[i].intersection(interval));
+    }
+
+    int reg = hint(interval);
+    if(reg < 0 || free_until[reg] < interval.end())
+    {
+        reg = static_cast<int>(Allocatable[0]);
+        for(Register candidate : Allocatable)
+        {
+            if(free_until[static_cast<int>(candidate)] > free_until[reg]) reg = static_cast<int>(candidate);
+        }
+    }
+
+    uint32_t start = interval.start();
+    if(free_until[reg] <= start) return false;
+    if(free_until[reg] < interval.end())
+    {
+        // Free for the first part of the interval only.
+        uint32_t position = split_position(free_until[reg]);
+        if(position <= start) return false;
+        push(split(current, position));
+    }
+    intervals[current].location = Location::in(static_cast<Register>(reg));
+    return true;
+}
+
+void LinearScan::allocate_blocked(uint32_t current)
+{
+    uint32_t start = intervals[current].start();
+    uint32_t use_position[16] = {0}, block_position[16] = {0};
+    for(Register reg : Allocatable)
+    {
+        block_position[static_cast<int>(reg)] = fixed_intersection(reg, intervals[current]);
+        use_position[static_cast<int>(reg)] = block_position[static_cast<int>(reg)];
+    }
+    for(uint32_t i : active)
+    {
+        int reg = static_cast<int>(intervals[i].location.reg);
+        use_position[reg] = std::min(use_position[reg], intervals[i].next_use(start));
+    }
+    for(uint32_t i : inactive)
+    {
+        if(intervals[i].intersection(intervals[current]) == Never) continue;
+        int reg = static_cast<int>(intervals[i].location.reg);
+        use_position[reg] = std::min(use_position[reg], intervals[i].next_use(start));
+    }
+
+    int reg = static_cast<int>(Allocatable[0]);
+    for(Register candidate : Allocatable)
+    {
+        if(use_position[static_cast<int>(candidate)] > use_position[reg]) reg = static_cast<int>(candidate);
+    }
+
+    // If every register is needed sooner than this interval needs one, spill it (until its
+    // next use).
+    uint32_t first_use = intervals[current].next_use(start);
+    uint32_t position = split_position(start);
+    uint32_t blocked = block_position[reg] == Never ? Never : split_position(block_position[reg]);
+    if(use_position[reg] <= first_use || blocked <= start)
+    {
+        spill(current, start, start);
+        return;
+    }
+
+    // Otherwise take the register from the intervals which have it.
+    std::vector<uint32_t> evicted;
+    auto evict = [&](std::vector<uint32_t>& list, bool check)
+    {
+        auto kept = std::remove_if(list.begin(), list.end(), [&](uint32_t i)
+        {
+            if(static_cast<int>(intervals[i].location.reg) != reg) return false;
+            if(check && intervals[i].intersection(intervals[current]) == Never) return false;
+            evicted.push_back(i);
+            return true;
+        });
+        list.erase(kept, list.end());
+    };
+    evict(active, false);
+    evict(inactive, true);
+    for(uint32_t i : evicted) spill(i, position, start);
+
+    intervals[current].location = Location::in(static_cast<Register>(reg));
+    if(blocked < intervals[current].end())
+    {
+        push(split(current, blocked));
+    }
+}
+
+Location LinearScan::location(IrValue value, uint32_t position) const
+{
+    const IrInstr& instr = function.instrs[value];
+    if(instr.op == IrOp::CONST) return Location{Location::Kind::CONSTANT, Register::RAX, value};
+    if(instr.op == IrOp::ALLOCA) return Location{Location::Kind::FRAME, Register::RAX, value};
+    if(interval_of[value] == Never) return Location();
+
+    uint32_t found = interval_of[value];
+    for(uint32_t part = found;part != Never && intervals[part].start() <= position;part = intervals[part].next)
+    {
+        found = part;
+    }
+    return intervals[found].location;
+}
+
+void LinearScan::resolve()
+{
+    size_t count = function.instrs.size();
+    result_locations.resize(count);
+    operand_locations.resize(function.operand_pool.size());
+    for(IrValue value = 0;value < count;value++)
+    {
+        const IrInstr& instr = function.instrs[value];
+        if(instr.type != IrType::VOID)
+        {
+            uint32_t def = instr.op == IrOp::PHI ? block_from[instr.block] : 4 * value + 2;
+            result_locations[value] = location(value, def);
+        }
+
+        IrRange operands = function.operands(value);
+        for(size_t i = 0;i < operands.size();i++)
+        {
+            uint32_t position = 4 * (selector ? selector->root(value) : value);
+            if(instr.op == IrOp::PHI) position = block_to[function.blocks[instr.block].preds[i]] - 1;
+            operand_locations[instr.first + i] = location(operands[i], position);
+        }
+    }
+
+    // Moves where intervals were split (in the middle of a block; at the start of a block,
+    // the edges are resolved below). If the split was in a lifetime hole, the value does
+    // not flow from one part to the next: the next part starts at the definition (blocks
+    // need not be in dominance order, e.g. after inlining) or at a block.
+    for(const auto& interval : intervals)
+    {
+        if(interval.next == Never) continue;
+        const LiveInterval& rest = intervals[interval.next];
+        if(block_start[rest.start() / 4] || interval.end() < rest.start() || interval.location == rest.location) continue;
+        move_list.push_back({rest.start() / 4, 1, interval.location, rest.location});
+    }
+
+    // Moves on edges.
+    for(IrBlockId b = 0;b < function.blocks.size();b++)
+    {
+        const IrBlock& block = function.blocks[b];
+        for(size_t i = 0;i < block.preds.size();i++)
+        {
+            // (Edges of a switch to a shared block need their moves once.)
+            IrBlockId pred = block.preds[i];
+            if(std::find(block.preds.begin(), block.preds.begin() + i, pred) != block.preds.begin() + i) continue;
+            bool at_end = function.blocks[pred].succs.size() == 1;
+            uint32_t gap = function.terminator(pred);
+            if(!at_end)
+            {
+                gap = block.code.front();
+                while(function.instrs[gap].op == IrOp::PHI) gap++;
+            }
+            uint8_t phase = at_end ? 2 : 0;
+
+            for(IrValue value : live_in[b])
+            {
+                Location from = location(value, block_to[pred] - 1), to = location(value, block_from[b]);
+                if(from != to) move_list.push_back({gap, phase, from, to});
+            }
+            for(IrValue value : block.code)
+            {
+                if(function.instrs[value].op != IrOp::PHI) break;
+                Location from = operand(value, i), to = result_locations[value];
+                if(to.kind != Location::Kind::NONE && from != to) move_list.push_back({gap, phase, from, to});
+            }
+        }
+    }
+
+    std::stable_sort(move_list.begin(), move_list.end(), [](const Move& a, const Move& b)
+    {
+        return a.gap < b.gap || (a.gap == b.gap && a.phase < b.phase);
+    });
+    move_offsets.assign(count + 1, 0);
+    for(const Move& move : move_list) move_offsets[move.gap + 1]++;
+    for(size_t i = 1;i <= count;i++) move_offsets[i] += move_offsets[i - 1];
+}
@@ -0,0 +1,216 @@
+#include <string>
+
+#include "resolve.h"
+
+NameResolver::NameResolver(ErrorReporter& error, int depth_limit)
+    : error(error)
+    , walker(depth_limit)
+{
+}
+
+NameResolver::NameResolver(
+    ErrorReporter& error,
+    const NameResolver& globals,
+    int visible,
+    int depth_limit)
+    : error(error)
+    , identifiers(&globals.identifiers)
+    , symbols(&globals.symbols, visible)
+    , walker(depth_limit)
+{
+}
+
+void NameResolver::resolve(AstNode& root)
+{
+    stack.push_back(Item{&root, false});
+    run();
+}
+
+void NameResolver::resolve_function(FunctionDefAstNode& node)
+{
+    enter_function(node);
+    stack.insert(stack.end(), queued.rbegin(), queued.rend());
+    queued.clear();
+    run();
+}
+
+void NameResolver::run()
+{
+    while(!stack.empty())
+    {
+        Item item = stack.back();
+        stack.pop_back();
+        if(item.leave)
+        {
+            symbols.pop_scope();
+            continue;
+        }
+
+        // Move queued items onto the stack in reverse, so they are resolved in order.
+        item.node->accept(*this);
+        stack.insert(stack.end(), queued.rbegin(), queued.rend());
+        queued.clear();
+    }
+}
+
+void NameResolver::resolve_expr(const std::shared_ptr<ExprAstNode>& expr)
+{
+    if(expr)
+    {
+        walker.walk(expr, *this);
+    }
+}
+
+// Declare an identifier in the current scope. At file scope, an identifier may be
+// declared more than once with the same type, but defined only once (6.7, 3; 6.9, 5).
+// Identifiers with block scope may only be declared once in each scope.
+void NameResolver::declare(DeclAstNode& decl, bool definition)
+{
+    if(!decl.identifier) return;
+
+    int id = identifiers.intern(decl.identifier->lexeme);
+    DeclAstNode * previous = symbols.declare(id, &decl);
+    if(previous == nullptr)
+    {
+        if(definition) definitions.insert(&decl);
+        return;
+    }
+
+    if(symbols.depth() > 0 || previous->type != decl.type)
+    {
+        error.report_error(decl.identifier->line, "Redeclaration of '" + decl.identifier->lexeme + "'");
+    }
+    else if(definition && definitions.count(previous))
+    {
+        error.report_error(decl.identifier->line, "Redefinition of '" + decl.identifier->lexeme + "'");
+    }
+    else if(definition)
+    {
+        definitions.insert(&decl);
+    }
+    else if(definitions.count(previous))
+    {
+        // Later references resolve to the definition.
+        symbols.declare(id, previous);
+    }
+}
+
+void NameResolver::visit(PrimaryExprAstNode& node)
+{
+    if(node.token->type != TOK_IDENTIFIER) return;
+
+    node.declaration = symbols.lookup(identifiers.intern(node.token->lexeme));
+    if(node.declaration == nullptr)
+    {
+        error.report_error(node.token->line, "Undeclared identifier '" + node.token->lexeme + "'");
+    }
+}
+
+void NameResolver::visit(BinaryExprAstNode&)
+{}
+
+void NameResolver::visit(UnaryExprAstNode&)
+{}
+
+void NameResolver::visit(TertiaryExprAstNode&)
+{}
+
+void NameResolver::visit(PostfixExprAstNode&)
+{}
+
+void NameResolver::visit(AssignExprAstNode&)
+{}
+
+void NameResolver::visit(ExprAstNode&)
+{}
+
+void NameResolver::visit(DeclAstNode& node)
+{
+    // The scope of an identifier begins after its declarator, so it is visible in its own
+    // initializer (6.2.1, 7).
+    declare(node, symbols.depth() == 0 && node.initializer);
+    resolve_expr(node.initializer);
+}
+
+void NameResolver::visit(CompoundStmtAstNode& node)
+{
+    symbols.push_scope();
+    for(auto& item : node.items)
+    {
+        queue(*item);
+    }
+    queue_leave();
+}
+
+void NameResolver::visit(ExprStmtAstNode& node)
+{
+    resolve_expr(node.expr);
+}
+
+void NameResolver::visit(ReturnStmtAstNode& node)
+{
+    resolve_expr(node.expr);
+}
+
+// An iteration statement is a block, so declarations in the first clause of a 'for' are
+// only in scope in the loop (6.8.5, 5). The clauses are resolved straight away (they do not
+// queue anything).
+void NameResolver::visit(IterationStmtAstNode& node)
+{
+    symbols.push_scope();
+    for(auto& item : node.init)
+    {
+        item->accept(*this);
+    }
+    resolve_expr(node.condition);
+    resolve_expr(node.step);
+    queue(*node.body);
+    queue_leave();
+}
+
+// A selection statement is a block (6.8.4, 3).
+void NameResolver::visit(SwitchStmtAstNode& node)
+{
+    symbols.push_scope();
+    resolve_expr(node.condition);
+    queue(*node.body);
+    queue_leave();
+}
+
+void NameResolver::visit(CaseStmtAstNode& node)
+{
+    resolve_expr(node.value);
+    queue(*node.body);
+}
+
+void NameResolver::visit(JumpStmtAstNode&)
+{}
+
+void NameResolver::visit(FunctionDefAstNode& node)
+{
+    declare(*node.decl, true);
+    enter_function(node);
+}
+
+void NameResolver::enter_function(FunctionDefAstNode& node)
+{
+    // The parameters and the function body share the same block scope (6.2.1, 4).
+    symbols.push_scope();
+    for(auto& param : node.parameters)
+    {
+        declare(*param, false);
+    }
+    for(auto& item : node.body->items)
+    {
+        queue(*item);
+    }
+    queue_leave();
+}
+
+void NameResolver::visit(TranslationUnitAstNode& node)
+{
+    for(auto& item : node.items)
+    {
+        queue(*item);
+    }
+}
@@ -0,0 +1,253 @@
+#include <algorithm>
+
+#include "sccp.h"
+
+bool ConstantPropagation::run(IrFunction& f)
+{
+    function = &f;
+    lattice.assign(f.instrs.size(), Lattice::UNKNOWN);
+    values.assign(f.instrs.size(), 0);
+    executable.assign(f.blocks.size(), false);
+    edge_offsets.assign(f.blocks.size() + 1, 0);
+    for(IrBlockId b = 0;b < f.blocks.size();b++)
+    {
+        edge_offsets[b + 1] = edge_offsets[b] + f.blocks[b].preds.size();
+    }
+    edges.assign(edge_offsets.back(), false);
+    cfg_work.clear();
+    ssa_work.clear();
+
+    IrUses uses(f);
+    executable[0] = true;
+    for(IrValue value : f.blocks[0].code) visit(value);
+    while(!cfg_work.empty() || !ssa_work.empty())
+    {
+        while(!cfg_work.empty())
+        {
+            IrBlockId from = cfg_work.back().first, to = cfg_work.back().second;
+            cfg_work.pop_back();
+
+            const auto& preds = f.blocks[to].preds;
+            bool added = false;
+            for(size_t i = 0;i < preds.size();i++)
+            {
+                if(preds[i] == from && !edges[edge_offsets[to] + i])
+                {
+                    edges[edge_offsets[to] + i] = true;
+                    added = true;
+                }
+            }
+            if(!added) continue;
+
+            // The first time a block is reached, evaluate all of it. After that, only its
+            // phis can change.
+            if(!executable[to])
+            {
+                executable[to] = true;
+                for(IrValue value : f.blocks[to].code) visit(value);
+            }
+            else
+            {
+                for(IrValue value : f.blocks[to].code)
+                {
+                    if(f.instrs[value].op != IrOp::PHI) break;
+                    visit_phi(value);
+                }
+            }
+        }
+
+        while(!ssa_work.empty())
+        {
+            IrValue value = ssa_work.back();
+            ssa_work.pop_back();
+            for(IrValue user : uses.users(value))
+            {
+                if(executable[f.instrs[user].block]) visit(user);
+            }
+        }
+    }
+
+    bool changed = false;
+    for(IrBlockId b = 0;b < f.blocks.size();b++)
+    {
+        if(!executable[b]) continue;
+
+        auto& code = f.blocks[b].code;
+        for(IrValue value : code)
+        {
+            IrInstr& instr = f.instrs[value];
+            if(lattice[value] == Lattice::CONSTANT && instr.op != IrOp::CONST)
+            {
+                instr.op = IrOp::CONST;
+                instr.count = 0;
+                instr.imm = values[value];
+                changed = true;
+            }
+        }
+        std::stable_partition(code.begin(), code.end(), [&](IrValue value)
+        {
+            return f.instrs[value].op == IrOp::PHI;
+        });
+
+        IrOp op = f.instrs[code.back()].op;
+        IrValue condition = op == IrOp::BRANCH || op == IrOp::SWITCH ? f.operand(code.back(), 0) : IrNone;
+        if(condition != IrNone && lattice[condition] == Lattice::CONSTANT)
+        {
+            f.fold_terminator(b, taken(code.back()));
+            changed = true;
+        }
+    }
+
+    if(f.remove_unreachable()) changed = true;
+    if(changed) f.compact();
+    function = nullptr;
+    return changed;
+}
+
+size_t ConstantPropagation::taken(IrValue terminator) const
+{
+    int64_t condition = values[function->operand(terminator, 0)];
+    if(function->instrs[terminator].op == IrOp::BRANCH) return condition != 0 ? 0 : 1;
+    for(uint32_t i = 1;i < function->instrs[terminator].count;i++)
+    {
+        if(function->instrs[function->operand(terminator, i)].imm == condition) return i;
+    }
+    return 0;
+}
+
+void ConstantPropagation::mark_edge(IrBlockId from, IrBlockId to)
+{
+    cfg_work.push_back({from, to});
+}
+
+void ConstantPropagation::set(IrValue value, Lattice state, int64_t constant)
+{
+    // Values only move down the lattice (unknown, then constant, then varying).
+    if(lattice[value] == Lattice::VARYING || state == Lattice::UNKNOWN) return;
+    if(lattice[value] == Lattice::CONSTANT)
+    {
+        if(state == Lattice::CONSTANT && values[value] == constant) return;
+        state = Lattice::VARYING;
+    }
+    lattice[value] = state;
+    values[value] = constant;
+    ssa_work.push_back(value);
+}
+
+void ConstantPropagation::visit(IrValue value)
+{
+    const IrInstr& instr = function->instrs[value];
+    const auto& succs = function->blocks[instr.block].succs;
+    switch(instr.op)
+    {
+        case IrOp::PHI:
+            visit_phi(value);
+            return;
+        case IrOp::CONST:
+            set(value, Lattice::CONSTANT, instr.imm);
+            return;
+        case IrOp::COPY:
+        {
+            IrValue source = function->operand(value, 0);
+            set(value, lattice[source], values[source]);
+            return;
+        }
+        case IrOp::SELECT:
+        {
+            // A known condition picks one operand; otherwise the operands must agree.
+            IrValue condition = function->operand(value, 0);
+            IrValue a = function->operand(value, 1), b = function->operand(value, 2);
+            if(lattice[condition] == Lattice::CONSTANT)
+            {
+                IrValue chosen = values[condition] != 0 ? a : b;
+                set(value, lattice[chosen], values[chosen]);
+            }
+            else if(lattice[condition] == Lattice::VARYING)
+            {
+                if(lattice[a] == Lattice::VARYING || lattice[b] == Lattice::VARYING
+                    || (lattice[a] == Lattice::CONSTANT && lattice[b] == Lattice::CONSTANT && values[a] != values[b]))
+                    set(value, Lattice::VARYING);
+                else if(lattice[a] == Lattice::CONSTANT && lattice[b] == Lattice::CONSTANT)
+                    set(value, Lattice::CONSTANT, values[a]);
+            }
+            return;
+        }
+        case IrOp::JUMP:
+            mark_edge(instr.block, succs[0]);
+            return;
+        case IrOp::BRANCH:
+        case IrOp::SWITCH:
+        {
+            IrValue condition = function->operand(value, 0);
+            if(lattice[condition] == Lattice::CONSTANT)
+            {
+                mark_edge(instr.block, succs[taken(value)]);
+            }
+            else if(lattice[condition] == Lattice::VARYING)
+            {
+                for(IrBlockId succ : succs) mark_edge(instr.block, succ);
+            }
+            return;
+        }
+        case IrOp::STORE:
+        case IrOp::VADD:
+        case IrOp::VSUB:
+        case IrOp::VAND:
+        case IrOp::VOR:
+        case IrOp::VXOR:
+        case IrOp::RET:
+            return;
+        default:
+            break;
+    }
+
+    if(instr.op < IrOp::ADD || instr.op > IrOp::TRUNC)
+    {
+        // Parameters, addresses, loads and calls.
+        set(value, Lattice::VARYING);
+        return;
+    }
+
+    IrRange operands = function->operands(value);
+    for(IrValue operand : operands)
+    {
+        if(lattice[operand] == Lattice::VARYING)
+        {
+            set(value, Lattice::VARYING);
+            return;
+        }
+        if(lattice[operand] == Lattice::UNKNOWN) return;
+    }
+
+    int64_t result;
+    IrType operand_type = function->instrs[operands[0]].type;
+    int64_t b = operands.size() > 1 ? values[operands[1]] : 0;
+    if(ir_evaluate(instr.op, instr.type, operand_type, values[operands[0]], b, result))
+        set(value, Lattice::CONSTANT, result);
+    else
+        set(value, Lattice::VARYING);
+}
+
+void ConstantPropagation::visit_phi(IrValue value)
+{
+    // Merge the operands from executable edges.
+    IrBlockId block = function->instrs[value].block;
+    IrRange operands = function->operands(value);
+    Lattice state = Lattice::UNKNOWN;
+    int64_t constant = 0;
+    for(size_t i = 0;i < operands.size();i++)
+    {
+        IrValue operand = operands[i];
+        if(!edges[edge_offsets[block] + i] || lattice[operand] == Lattice::UNKNOWN) continue;
+
+        if(lattice[operand] == Lattice::VARYING
+            || (state == Lattice::CONSTANT && values[operand] != constant))
+        {
+            state = Lattice::VARYING;
+            break;
+        }
+        state = Lattice::CONSTANT;
+        constant = values[operand];
+    }
+    set(value, state, constant);
+}
@@ -0,0 +1,197 @@
+#include "select.h"
+
+InstructionSelector::InstructionSelector(const IrFunction& f, const IrModule& m) : function(f), module(m)
+{
+    size_t count = function.instrs.size();
+    IselState unlabelled;
+    for(int nt = 0;nt < ISEL_NONTERMINALS;nt++)
+    {
+        unlabelled.cost[nt] = IselInfinity;
+        unlabelled.rule[nt] = 0;
+    }
+    leaf = unlabelled;
+    leaf.cost[ISEL_REG] = 0;
+    close(leaf);
+
+    analyse();
+
+    // Label the operands used in place first: they need not come before their users.
+    states.assign(count, unlabelled);
+    for(IrValue value = 0;value < count;value++)
+    {
+        if(shared(value)) label(value);
+    }
+    for(IrValue value = 0;value < count;value++)
+    {
+        if(!shared(value)) label(value);
+    }
+
+    roots.resize(count);
+    for(IrValue value = 0;value < count;value++) roots[value] = value;
+    needed.assign(count, false);
+    for(IrBlockId b = function.blocks.size();b-- > 0;)
+    {
+        const auto& code = function.blocks[b].code;
+        for(auto value = code.rbegin();value != code.rend();value++)
+        {
+            if(!shared(*value) && roots[*value] == *value) reduce(*value);
+        }
+    }
+}
+
+bool InstructionSelector::shared(IrValue value) const
+{
+    IrOp op = function.instrs[value].op;
+    return op == IrOp::CONST || op == IrOp::ALLOCA || op == IrOp::GLOBAL;
+}
+
+void InstructionSelector::analyse()
+{
+    size_t count = function.instrs.size();
+    nested.assign(count, false);
+    IrUses uses(function);
+
+    // Root of the tree of each instruction which can be in one.
+    std::vector<IrValue> top(count, IrNone);
+
+    for(const IrBlock& block : function.blocks)
+    {
+        // The first instruction after each one which writes memory.
+        IrValue writer = IrNone;
+        for(auto value = block.code.rbegin();value != block.code.rend();value++)
+        {
+            const IrInstr& instr = function.instrs[*value];
+            bool candidate = instr.count > 0 && instr.type != IrType::VOID && instr.op != IrOp::PHI
+                && instr.op != IrOp::CALL && instr.op != IrOp::COPY && uses.count(*value) == 1;
+            if(candidate)
+            {
+                IrValue user = uses.users(*value)[0];
+                const IrInstr& use = function.instrs[user];
+                if(use.block == instr.block && use.op != IrOp::PHI)
+                {
+                    top[*value] = nested[user] ? top[user] : user;
+                    nested[*value] = instr.op != IrOp::LOAD || writer >= top[*value];
+                }
+            }
+            if(instr.op == IrOp::STORE || instr.op == IrOp::CALL || ir_is_vector(instr.op)) writer = *value;
+        }
+    }
+}
+
+bool InstructionSelector::match(IrValue value, IrOp op, uint32_t count) const
+{
+    const IrInstr& instr = function.instrs[value];
+    return (nested[value] || shared(value)) && instr.op == op && instr.count == count;
+}
+
+uint32_t InstructionSelector::cost(const IselKid& kid) const
+{
+    bool tree = nested[kid.value] || shared(kid.value);
+    return (tree ? states[kid.value] : leaf).cost[kid.nt];
+}
+
+uint32_t InstructionSelector::rest(IrValue value, uint32_t first) const
+{
+    uint32_t total = 0;
+    for(uint32_t i = first;i < function.instrs[value].count;i++)
+    {
+        total += cost({operand(value, i), ISEL_REG});
+    }
+    return total;
+}
+
+int InstructionSelector::rule(IrValue node, IselNonTerminal nt, IrValue root) const
+{
+    bool tree = node == root || nested[node] || shared(node);
+    return (tree ? states[node] : leaf).rule[nt];
+}
+
+void InstructionSelector::reduce(IrValue root)
+{
+    const IrInstr& instr = function.instrs[root];
+    std::vector<std::pair<IrValue, IselNonTerminal>> work;
+    std::vector<IselKid> leaves;
+    std::vector<IrValue> covered;
+    work.push_back({root, instr.type == IrType::VOID ? ISEL_STMT : ISEL_REG});
+    while(!work.empty())
+    {
+        IrValue node = work.back().first;
+        IselNonTerminal nt = work.back().second;
+        work.pop_back();
+
+        int r = rule(node, nt, root);
+        leaves.clear();
+        covered.clear();
+        kids(node, r, leaves, &covered);
+        if(node != root && IselRules[r].chain == ISEL_NONTERMINALS) covered.push_back(node);
+        for(IrValue value : covered)
+        {
+            if(!shared(value)) roots[value] = root;
+        }
+
+        // A leaf at 'reg' is computed by its own tile (a symbol into a register).
+        for(const IselKid& kid : leaves)
+        {
+            if(kid.nt != ISEL_REG)
+                work.push_back({kid.value, kid.nt});
+            else if(function.instrs[kid.value].op == IrOp::GLOBAL)
+                needed[kid.value] = true;
+        }
+    }
+}
+
+bool InstructionSelector::rmw(IrValue node, const IselKid * leaves, size_t count) const
+{
+    // The value loaded, at the width it is stored, from the address it is stored to.
+    for(size_t i = 0;i < count;i++)
+    {
+        if(leaves[i].nt != ISEL_LOADED) continue;
+        IrValue load = leaves[i].value;
+        IrOp op = function.instrs[load].op;
+        if(op == IrOp::SEXT || op == IrOp::ZEXT) load = operand(load, 0);
+        return function.instrs[load].op == IrOp::LOAD && operand(load, 0) == operand(node, 0)
+            && function.instrs[load].type == function.instrs[operand(node, 1)].type;
+    }
+    return false;
+}
+
+bool InstructionSelector::wide(IrValue node, const IselKid *, size_t) const
+{
+    // (Narrower values are extended before arithmetic.)
+    IrType type = function.instrs[node].type;
+    return type == IrType::I32 || type == IrType::I64;
+}
+
+bool InstructionSelector::direct(IrValue node, const IselKid *, size_t) const
+{
+    return module.symbols[function.instrs[node].imm].function;
+}
+
+bool InstructionSelector::imm32(IrValue node, const IselKid *, size_t) const
+{
+    int64_t imm = function.instrs[node].imm;
+    return imm >= INT32_MIN && imm <= INT32_MAX;
+}
+
+bool InstructionSelector::zero(IrValue node, const IselKid *, size_t) const
+{
+    return function.instrs[node].imm == 0;
+}
+
+bool InstructionSelector::scale(IrValue node, const IselKid *, size_t) const
+{
+    int64_t imm = function.instrs[node].imm;
+    return imm == 1 || imm == 2 || imm == 4 || imm == 8;
+}
+
+bool InstructionSelector::shift(IrValue node, const IselKid *, size_t) const
+{
+    int64_t imm = function.instrs[node].imm;
+    return imm >= 0 && imm <= 3;
+}
+
+bool InstructionSelector::factor(IrValue node, const IselKid *, size_t) const
+{
+    int64_t imm = function.instrs[node].imm;
+    return imm == 3 || imm == 5 || imm == 9;
+}
@@ -0,0 +1,749 @@
+#include <algorithm>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "sema.h"
+#include "fold.h"
+#include "resolve.h"
+
+static std::shared_ptr<DerivedCType> derived(const std::shared_ptr<CType>& type, DerivedCTypeType kind)
+{
+    auto ctype = std::dynamic_pointer_cast<DerivedCType>(type);
+    return (ctype && ctype->type == kind) ? ctype : nullptr;
+}
+
+static bool is_integer(const std::shared_ptr<CType>& type)
+{
+    return std::dynamic_pointer_cast<BasicCType>(type) != nullptr;
+}
+
+static bool is_void(const std::shared_ptr<CType>& type)
+{
+    return std::dynamic_pointer_cast<VoidCType>(type) != nullptr;
+}
+
+static bool is_pointer(const std::shared_ptr<CType>& type)
+{
+    return derived(type, DerivedCTypeType::POINTER) != nullptr;
+}
+
+static bool is_scalar(const std::shared_ptr<CType>& type)
+{
+    return is_integer(type) || is_pointer(type);
+}
+
+// Pointer to an object type (which pointer arithmetic can be applied to).
+static bool is_object_pointer(const std::shared_ptr<CType>& type)
+{
+    auto pointer = derived(type, DerivedCTypeType::POINTER);
+    return pointer && !is_void(pointer->base) && !derived(pointer->base, DerivedCTypeType::FUNCTION);
+}
+
+static bool is_const(const std::shared_ptr<CType>& type)
+{
+    auto basic = std::dynamic_pointer_cast<BasicCType>(type);
+    if(basic) return basic->qualifier == BasicCTypeQualifier::CONST;
+    auto ctype = std::dynamic_pointer_cast<DerivedCType>(type);
+    return ctype && ctype->qualifier == BasicCTypeQualifier::CONST;
+}
+
+// Line of the first token in an expression (for error reporting).
+static int line_of(ExprAstNode& expr)
+{
+    ExprAstNode * node = &expr;
+    while(true)
+    {
+        if(auto primary = dynamic_cast<PrimaryExprAstNode *>(node))
+            return primary->token->line;
+        else if(auto binary = dynamic_cast<BinaryExprAstNode *>(node))
+            node = binary->left.get();
+        else if(auto unary = dynamic_cast<UnaryExprAstNode *>(node))
+            node = unary->right.get();
+        else if(auto tertiary = dynamic_cast<TertiaryExprAstNode *>(node))
+            node = tertiary->conditional.get();
+        else if(auto postfix = dynamic_cast<PostfixExprAstNode *>(node))
+            node = postfix->left.get();
+        else if(auto assign = dynamic_cast<AssignExprAstNode *>(node))
+            node = assign->left.get();
+        else
+            return 0;
+    }
+}
+
+// Lvalues (6.3.2.1, 1): identifiers designating objects, string literals, '*e' and 'e[i]'.
+static bool is_lvalue(ExprAstNode& expr)
+{
+    if(auto primary = dynamic_cast<PrimaryExprAstNode *>(&expr))
+    {
+        return primary->token->type == TOK_STRING_LITERAL
+            || (primary->token->type == TOK_IDENTIFIER
+                && !derived(primary->ctype, DerivedCTypeType::FUNCTION));
+    }
+    if(auto unary = dynamic_cast<UnaryExprAstNode *>(&expr))
+    {
+        return unary->type == UnaryType::DEREF;
+    }
+    if(auto postfix = dynamic_cast<PostfixExprAstNode *>(&expr))
+    {
+        return postfix->type == PostfixType::ARRAY;
+    }
+    return false;
+}
+
+static bool is_modifiable_lvalue(ExprAstNode& expr)
+{
+    return is_lvalue(expr)
+        && !derived(expr.ctype, DerivedCTypeType::ARRAY)
+        && !is_const(expr.ctype)
+        && !is_void(expr.ctype);
+}
+
+// Null pointer constant (6.3.2.3, 3).
+static bool is_null_constant(ExprAstNode& expr)
+{
+    auto primary = dynamic_cast<PrimaryExprAstNode *>(&expr);
+    IntegerConstant value;
+    return primary
+        && primary->token->type == TOK_INTEGER_CONSTANT
+        && parse_integer_constant(primary->token->lexeme, value)
+        && value.is_zero();
+}
+
+// Integer constant expression (6.6, 6), which has been folded to a single constant.
+static bool is_integer_constant(ExprAstNode& expr, IntegerConstant& value)
+{
+    auto primary = dynamic_cast<PrimaryExprAstNode *>(&expr);
+    return primary
+        && primary->token->type == TOK_INTEGER_CONSTANT
+        && parse_integer_constant(primary->token->lexeme, value);
+}
+
+// Objects declared 'static' have static storage duration (6.2.4, 3), as do those declared
+// at file scope. (The storage class is kept with the specifiers: on the innermost type of
+// a pointer or array declarator.)
+static bool is_static(std::shared_ptr<CType> type)
+{
+    while(auto d = std::dynamic_pointer_cast<DerivedCType>(type)) type = d->base;
+    auto basic = std::dynamic_pointer_cast<BasicCType>(type);
+    return basic && basic->storage == BasicCTypeStorage::STATIC;
+}
+
+TypeChecker::TypeChecker(ErrorReporter& error, TypeContext& context, int depth_limit)
+    : error(error)
+    , context(context)
+    , walker(depth_limit)
+{
+}
+
+// Constant initializer for an object with static storage duration (6.7.8, 4): a constant
+// (integer constant expressions are folded to a single one beforehand), a string literal,
+// or an address constant (6.6, 9) - the address of an object with static storage
+// duration, taken by '&' or by the name of an array. (Addresses of functions are not
+// supported.)
+bool TypeChecker::is_constant_initializer(ExprAstNode& expr) const
+{
+    auto primary = dynamic_cast<PrimaryExprAstNode *>(&expr);
+    if(auto unary = dynamic_cast<UnaryExprAstNode *>(&expr))
+    {
+        if(unary->type != UnaryType::ADDROF) return false;
+        primary = dynamic_cast<PrimaryExprAstNode *>(unary->right.get());
+        if(!primary || primary->token->type != TOK_IDENTIFIER) return false;
+    }
+    else if(!primary)
+    {
+        return false;
+    }
+    else if(primary->token->type != TOK_IDENTIFIER)
+    {
+        return true;
+    }
+    else if(!derived(primary->ctype, DerivedCTypeType::ARRAY))
+    {
+        return false;
+    }
+    return primary->declaration
+        && !automatic.count(primary->declaration)
+        && !derived(primary->ctype, DerivedCTypeType::FUNCTION);
+}
+
+std::shared_ptr<CType> TypeChecker::pointer_to(const std::shared_ptr<CType>& base)
+{
+    auto& type = pointers[base.get()];
+    if(!type)
+    {
+        type = context.pointer(base);
+    }
+    return type;
+}
+
+// Type without qualifiers or storage class.
+std::shared_ptr<CType> TypeChecker::unqualified(const std::shared_ptr<CType>& type)
+{
+    if(auto basic = std::dynamic_pointer_cast<BasicCType>(type))
+    {
+        return context.basic(basic->type, basic->signedness);
+    }
+    if(auto pointer = derived(type, DerivedCTypeType::POINTER))
+    {
+        return pointer_to(pointer->base);
+    }
+    return type;
+}
+
+// Type of the value of an expression. Arrays and functions are converted to pointers
+// (6.3.2.1, 2-4).
+std::shared_ptr<CType> TypeChecker::value(const std::shared_ptr<CType>& type)
+{
+    if(auto array = derived(type, DerivedCTypeType::ARRAY))
+    {
+        return pointer_to(array->base);
+    }
+    if(derived(type, DerivedCTypeType::FUNCTION))
+    {
+        return pointer_to(type);
+    }
+    return unqualified(type);
+}
+
+std::shared_ptr<CType> TypeChecker::promote(const std::shared_ptr<CType>& type)
+{
+    PackedCType packed = integer_promotion(std::static_pointer_cast<BasicCType>(type)->packed());
+    return context.basic(packed_type(packed), packed_signedness(packed));
+}
+
+std::shared_ptr<CType> TypeChecker::common(const std::shared_ptr<CType>& a, const std::shared_ptr<CType>& b)
+{
+    PackedCType packed = usual_arithmetic_conversion(
+        std::static_pointer_cast<BasicCType>(a)->packed(),
+        std::static_pointer_cast<BasicCType>(b)->packed()
+    );
+    return context.basic(packed_type(packed), packed_signedness(packed));
+}
+
+std::shared_ptr<CType> TypeChecker::int_type()
+{
+    return context.basic(BasicCTypeType::INT, BasicCTypeSignedness::SIGNED);
+}
+
+// Simple assignment constraints (6.5.16.1, 1), also used for initialization, arguments and
+// return values. Qualifiers of the pointed-to types are not checked.
+bool TypeChecker::assignable(const std::shared_ptr<CType>& target, ExprAstNode& source)
+{
+    auto type = value(source.ctype);
+    if(is_integer(target) && is_integer(type)) return true;
+
+    auto to = derived(target, DerivedCTypeType::POINTER);
+    auto from = derived(type, DerivedCTypeType::POINTER);
+    if(to && is_null_constant(source)) return true;
+    if(to && from)
+    {
+        return is_void(to->base)
+            || is_void(from->base)
+            || unqualified(to->base) == unqualified(from->base);
+    }
+    return false;
+}
+
+// Prefix/postfix increment and decrement (6.5.2.4, 6.5.3.1).
+std::shared_ptr<CType> TypeChecker::increment(ExprAstNode& operand, int line)
+{
+    if(!is_modifiable_lvalue(operand))
+    {
+        error.report_error(line, "Expression is not assignable");
+        return nullptr;
+    }
+    auto type = value(operand.ctype);
+    if(!is_integer(type) && !is_object_pointer(type))
+    {
+        error.report_error(line, "Invalid operand to increment or decrement");
+        return nullptr;
+    }
+    return type;
+}
+
+void TypeChecker::check(const std::shared_ptr<DeclAstNode>& decl)
+{
+    function = nullptr;
+    walker.walk(decl, *this);
+}
+
+void TypeChecker::check(FunctionDefAstNode& node)
+{
+    function = &node;
+    automatic.clear();
+    for(auto& param : node.parameters)
+    {
+        automatic.insert(param.get());
+        if(is_void(param->type))
+        {
+            error.report_error(param->identifier->line, "Parameter declared void");
+        }
+    }
+    walker.walk(node.body, *this);
+}
+
+void TypeChecker::visit(PrimaryExprAstNode& node)
+{
+    switch(node.token->type)
+    {
+        case TOK_IDENTIFIER:
+            node.ctype = node.declaration ? node.declaration->type : nullptr;
+            break;
+        case TOK_INTEGER_CONSTANT:
+            {
+                // (6.4.4.1, 5)
+                IntegerConstant constant;
+                if(!parse_integer_constant(node.token->lexeme, constant))
+                {
+                    error.report_error(node.token->line, "Integer constant is too large");
+                }
+                node.ctype = context.basic(
+                    BasicCTypeType::INT,
+                    constant.is_unsigned ? BasicCTypeSignedness::UNSIGNED : BasicCTypeSignedness::SIGNED
+                );
+            }
+            break;
+        case TOK_STRING_LITERAL:
+            // Array of char, including the terminating null character (6.4.5, 5).
+            node.ctype = context.array(
+                context.basic(BasicCTypeType::CHAR, BasicCTypeSignedness::NOT_SET),
+                parse_string_literal(node.token->lexeme).size() + 1
+            );
+            break;
+    }
+}
+
+void TypeChecker::visit(BinaryExprAstNode& node)
+{
+    node.ctype = nullptr;
+    if(!node.left->ctype || !node.right->ctype) return;
+
+    auto left = value(node.left->ctype);
+    auto right = value(node.right->ctype);
+    bool integers = is_integer(left) && is_integer(right);
+    bool pointers = is_pointer(left) && is_pointer(right);
+    bool compatible = pointers && (unqualified(derived(left, DerivedCTypeType::POINTER)->base)
+        == unqualified(derived(right, DerivedCTypeType::POINTER)->base));
+
+    switch(node.op)
+    {
+        case BinaryType::MUL:
+        case BinaryType::DIV:
+        case BinaryType::MOD:
+        case BinaryType::BITWISE_AND:
+        case BinaryType::BITWISE_EXCL_OR:
+        case BinaryType::BITWISE_INCL_OR:
+            if(integers) node.ctype = common(left, right);
+            break;
+        case BinaryType::ADD:
+            // (6.5.6, 2)
+            if(integers) node.ctype = common(left, right);
+            else if(is_object_pointer(left) && is_integer(right)) node.ctype = left;
+            else if(is_integer(left) && is_object_pointer(right)) node.ctype = right;
+            break;
+        case BinaryType::SUB:
+            // (6.5.6, 3). (The difference of two pointers is ptrdiff_t - int here.)
+            if(integers) node.ctype = common(left, right);
+            else if(is_object_pointer(left) && is_integer(right)) node.ctype = left;
+            else if(compatible && is_object_pointer(left)) node.ctype = int_type();
+            break;
+        case BinaryType::SHIFT_LEFT:
+        case BinaryType::SHIFT_RIGHT:
+            if(integers) node.ctype = promote(left);
+            break;
+        case BinaryType::LT:
+        case BinaryType::GT:
+        case BinaryType::LE:
+        case BinaryType::GE:
+            if(integers || compatible) node.ctype = int_type();
+            break;
+        case BinaryType::EQ:
+        case BinaryType::NE:
+            // (6.5.9, 2)
+            if(integers || compatible
+                || (pointers && (is_void(derived(left, DerivedCTypeType::POINTER)->base)
+                    || is_void(derived(right, DerivedCTypeType::POINTER)->base)))
+                || (is_pointer(left) && is_null_constant(*node.right))
+                || (is_pointer(right) && is_null_constant(*node.left)))
+            {
+                node.ctype = int_type();
+            }
+            break;
+        case BinaryType::LOGICAL_AND_OP:
+        case BinaryType::LOGICAL_OR_OP:
+            if(is_scalar(left) && is_scalar(right)) node.ctype = int_type();
+            break;
+    }
+
+    if(!node.ctype)
+    {
+        error.report_error(line_of(node), "Invalid operands to binary operator");
+    }
+}
+
+void TypeChecker::visit(UnaryExprAstNode& node)
+{
+    node.ctype = nullptr;
+    ExprAstNode& operand = *node.right;
+    if(!operand.ctype) return;
+
+    auto type = value(operand.ctype);
+    switch(node.type)
+    {
+        case UnaryType::INC:
+        case UnaryType::DEC:
+            node.ctype = increment(operand, line_of(node));
+            return;
+        case UnaryType::ADDROF:
+            {
+                // (6.5.3.2, 1)
+                auto basic = std::dynamic_pointer_cast<BasicCType>(operand.ctype);
+                if(basic && basic->storage == BasicCTypeStorage::REGISTER)
+                {
+                    error.report_error(line_of(node), "Address of register variable requested");
+                    return;
+                }
+                if(is_lvalue(operand) || derived(operand.ctype, DerivedCTypeType::FUNCTION))
+                {
+                    node.ctype = pointer_to(operand.ctype);
+                }
+            }
+            break;
+        case UnaryType::DEREF:
+            if(auto pointer = derived(type, DerivedCTypeType::POINTER))
+            {
+                node.ctype = pointer->base;
+            }
+            break;
+        case UnaryType::PLUS:
+        case UnaryType::MINUS:
+        case UnaryType::COMPLEMENT:
+            if(is_integer(type)) node.ctype = promote(type);
+            break;
+        case UnaryType::NOT:
+            if(is_scalar(type)) node.ctype = int_type();
+            break;
+    }
+
+    if(!node.ctype)
+    {
+        error.report_error(line_of(node), "Invalid operand to unary operator");
+    }
+}
+
+void TypeChecker::visit(TertiaryExprAstNode& node)
+{
+    node.ctype = nullptr;
+    if(!node.conditional->ctype || !node.left->ctype || !node.right->ctype) return;
+
+    if(!is_scalar(value(node.conditional->ctype)))
+    {
+        error.report_error(line_of(node), "Conditional expression requires a scalar condition");
+        return;
+    }
+
+    // (6.5.15, 3 & 6)
+    auto left = value(node.left->ctype);
+    auto right = value(node.right->ctype);
+    if(is_integer(left) && is_integer(right))
+        node.ctype = common(left, right);
+    else if(is_void(left) && is_void(right))
+        node.ctype = left;
+    else if(is_pointer(left) && (left == right || is_null_constant(*node.right)))
+        node.ctype = left;
+    else if(is_pointer(right) && is_null_constant(*node.left))
+        node.ctype = right;
+    else if(is_pointer(left) && is_pointer(right)
+        && (is_void(derived(left, DerivedCTypeType::POINTER)->base)
+            || is_void(derived(right, DerivedCTypeType::POINTER)->base)))
+        node.ctype = pointer_to(context.void_type());
+    else
+        error.report_error(line_of(node), "Incompatible operand types in conditional expression");
+}
+
+void TypeChecker::visit(PostfixExprAstNode& node)
+{
+    node.ctype = nullptr;
+    if(!node.left->ctype) return;
+    for(auto& arg : node.right)
+    {
+        if(!arg->ctype) return;
+    }
+
+    auto left = value(node.left->ctype);
+    switch(node.type)
+    {
+        case PostfixType::ARRAY:
+            {
+                // (6.5.2.1, 1) - either operand may be the pointer.
+                auto right = value(node.right.front()->ctype);
+                if(is_object_pointer(left) && is_integer(right))
+                    node.ctype = derived(left, DerivedCTypeType::POINTER)->base;
+                else if(is_integer(left) && is_object_pointer(right))
+                    node.ctype = derived(right, DerivedCTypeType::POINTER)->base;
+                else
+                    error.report_error(line_of(node), "Subscripted value is not an array or pointer");
+            }
+            break;
+        case PostfixType::CALL:
+            {
+                // (6.5.2.2, 1-2). A function declared with '()' takes no arguments.
+                auto pointer = derived(left, DerivedCTypeType::POINTER);
+                auto callee = pointer ? derived(pointer->base, DerivedCTypeType::FUNCTION) : nullptr;
+                if(!callee)
+                {
+                    error.report_error(line_of(node), "Called object is not a function");
+                    return;
+                }
+                if(callee->parameters.size() != node.right.size())
+                {
+                    error.report_error(line_of(node), "Wrong number of arguments in function call");
+                    return;
+                }
+
+                auto param = callee->parameters.begin();
+                for(auto& arg : node.right)
+                {
+                    if(!assignable(unqualified(*param++), *arg))
+                    {
+                        error.report_error(line_of(*arg), "Incompatible argument type in function call");
+                        return;
+                    }
+                }
+                node.ctype = unqualified(callee->base);
+            }
+            break;
+        case PostfixType::INC:
+        case PostfixType::DEC:
+            node.ctype = increment(*node.left, line_of(node));
+            break;
+        case PostfixType::DOT:
+        case PostfixType::PTR_OP:
+            error.report_error(node.identifier->line, "Member access requires a struct or union");
+            break;
+    }
+}
+
+void TypeChecker::visit(AssignExprAstNode& node)
+{
+    node.ctype = nullptr;
+    if(!node.left->ctype || !node.right->ctype) return;
+
+    if(!is_modifiable_lvalue(*node.left))
+    {
+        error.report_error(line_of(node), "Expression is not assignable");
+        return;
+    }
+
+    // (6.5.16.1, 1; 6.5.16.2, 1-2)
+    auto left = value(node.left->ctype);
+    auto right = value(node.right->ctype);
+    bool valid;
+    switch(node.type)
+    {
+        case AssignExprType::ASSIGN:
+            valid = assignable(left, *node.right);
+            break;
+        case AssignExprType::PLUS:
+        case AssignExprType::MINUS:
+            valid = is_integer(right) && (is_integer(left) || is_object_pointer(left));
+            break;
+        default:
+            valid = is_integer(left) && is_integer(right);
+            break;
+    }
+
+    if(valid)
+        node.ctype = left;
+    else
+        error.report_error(line_of(node), "Incompatible types in assignment");
+}
+
+void TypeChecker::visit(ExprAstNode&)
+{}
+
+void TypeChecker::visit(DeclAstNode& node)
+{
+    bool static_storage = function == nullptr || is_static(node.type);
+    if(!static_storage) automatic.insert(&node);
+    if(is_void(node.type))
+    {
+        error.report_error(node.identifier->line, "Variable declared void");
+        return;
+    }
+    if(!node.initializer || !node.initializer->ctype) return;
+
+    // (6.7.8, 2-4 & 14). Character arrays may be initialized by a string literal.
+    auto array = derived(node.type, DerivedCTypeType::ARRAY);
+    auto string = std::dynamic_pointer_cast<PrimaryExprAstNode>(node.initializer);
+    if(array && string && string->token->type == TOK_STRING_LITERAL && is_integer(array->base))
+    {
+        // (OK)
+    }
+    else if(array || derived(node.type, DerivedCTypeType::FUNCTION))
+    {
+        error.report_error(node.identifier->line, "Invalid initializer");
+    }
+    else if(!assignable(unqualified(node.type), *node.initializer))
+    {
+        error.report_error(node.identifier->line, "Incompatible types in initialization");
+    }
+    else if(static_storage && !is_constant_initializer(*node.initializer))
+    {
+        error.report_error(node.identifier->line, "Initializer element is not constant");
+    }
+}
+
+void TypeChecker::visit(CompoundStmtAstNode&)
+{}
+
+void TypeChecker::visit(ExprStmtAstNode&)
+{}
+
+void TypeChecker::visit(ReturnStmtAstNode& node)
+{
+    // (6.8.6.4, 1)
+    auto result = derived(function->decl->type, DerivedCTypeType::FUNCTION)->base;
+    if(!node.expr)
+    {
+        if(!is_void(result))
+        {
+            error.report_error(node.token->line, "Non-void function should return a value");
+        }
+    }
+    else if(is_void(result))
+    {
+        error.report_error(node.token->line, "Void function should not return a value");
+    }
+    else if(node.expr->ctype && !assignable(unqualified(result), *node.expr))
+    {
+        error.report_error(node.token->line, "Incompatible types in return");
+    }
+}
+
+void TypeChecker::visit(IterationStmtAstNode& node)
+{
+    // (6.8.5, 2)
+    if(node.condition && node.condition->ctype && !is_scalar(value(node.condition->ctype)))
+    {
+        error.report_error(node.token->line, "Loop condition requires a scalar type");
+    }
+}
+
+void TypeChecker::visit(SwitchStmtAstNode& node)
+{
+    // (6.8.4.2, 1)
+    if(node.condition->ctype && !is_integer(value(node.condition->ctype)))
+    {
+        error.report_error(node.token->line, "Switch condition requires an integer type");
+    }
+
+    // (6.8.4.2, 3) Case values are converted to the promoted type of the condition, which
+    // is int or unsigned int, so values with the same bits are the same.
+    std::unordered_set<uint32_t> values;
+    bool has_default = false;
+    for(CaseStmtAstNode * label : switch_labels(node))
+    {
+        IntegerConstant constant;
+        if(!label->value)
+        {
+            if(has_default)
+            {
+                error.report_error(label->token->line, "Multiple default labels in one switch");
+            }
+            has_default = true;
+        }
+        else if(is_integer_constant(*label->value, constant))
+        {
+            if(!values.insert(constant.bits).second)
+            {
+                error.report_error(label->token->line, "Duplicate case value");
+            }
+        }
+    }
+}
+
+void TypeChecker::visit(CaseStmtAstNode& node)
+{
+    // (6.8.4.2, 3)
+    IntegerConstant constant;
+    if(node.value && node.value->ctype && !is_integer_constant(*node.value, constant))
+    {
+        error.report_error(node.token->line, "Case label requires an integer constant expression");
+    }
+}
+
+void TypeChecker::visit(JumpStmtAstNode&)
+{}
+
+void TypeChecker::visit(FunctionDefAstNode&)
+{}
+
+void TypeChecker::visit(TranslationUnitAstNode&)
+{}
+
+SemanticAnalyser::SemanticAnalyser(
+    ErrorReporter& error,
+    TypeContext& context,
+    int threads,
+    int depth_limit)
+    : error(error)
+    , context(context)
+    , pool(threads)
+    , depth_limit(depth_limit)
+{
+}
+
+void SemanticAnalyser::analyse(TranslationUnitAstNode& node)
+{
+    DiagnosticBuffer global_errors;
+    NameResolver globals(global_errors, depth_limit);
+    TypeChecker checker(global_errors, context, depth_limit);
+
+    // File scope. Each function can see the file-scope declarations before its body
+    // (including its own).
+    std::vector<FunctionDefAstNode *> functions;
+    std::vector<int> visible;
+    for(auto& item : node.items)
+    {
+        if(auto def = std::dynamic_pointer_cast<FunctionDefAstNode>(item))
+        {
+            globals.declare(*def->decl, true);
+            functions.push_back(def.get());
+            visible.push_back(globals.size());
+        }
+        else
+        {
+            auto decl = std::static_pointer_cast<DeclAstNode>(item);
+            globals.resolve(*decl);
+            checker.check(decl);
+        }
+    }
+
+    // Function bodies.
+    std::vector<DiagnosticBuffer> function_errors(functions.size());
+    pool.run(functions.size(), [&](size_t i)
+    {
+        NameResolver resolver(function_errors[i], globals, visible[i], depth_limit);
+        resolver.resolve_function(*functions[i]);
+        TypeChecker(function_errors[i], context, depth_limit).check(*functions[i]);
+    });
+
+    // Report errors in source order.
+    std::vector<std::pair<int, std::string>> errors = std::move(global_errors.errors);
+    for(auto& buffer : function_errors)
+    {
+        errors.insert(errors.end(), buffer.errors.begin(), buffer.errors.end());
+    }
+    std::stable_sort(errors.begin(), errors.end(), [](
+        const std::pair<int, std::string>& a,
+        const std::pair<int, std::string>& b)
+    {
+        return a.first < b.first;
+    });
+    for(auto& e : errors)
+    {
+        error.report_error(e.first, e.second);
+    }
+}
@@ -0,0 +1,255 @@
+#include <algorithm>
+
+#include "simplifycfg.h"
+#include "dce.h"
+
+static size_t pred_index(const IrBlock& block, IrBlockId pred)
+{
+    return std::find(block.preds.begin(), block.preds.end(), pred) - block.preds.begin();
+}
+
+bool CfgSimplifier::run(IrFunction& f)
+{
+    function = &f;
+    threads = f.blocks.size();
+    bool changed = false;
+    for(bool progress = true;progress;)
+    {
+        progress = f.remove_unreachable();
+
+        use_counts.assign(f.instrs.size(), 0);
+        for(auto& block : f.blocks)
+        {
+            for(IrValue value : block.code)
+            {
+                for(IrValue operand : f.operands(value)) use_counts[operand]++;
+            }
+        }
+        replacements.assign(f.instrs.size(), IrNone);
+
+        for(IrBlockId b = 0;b < f.blocks.size();b++)
+        {
+            if(f.blocks[b].code.empty()) continue;
+            if(fold_branch(b)) progress = true;
+            for(size_t edge = 0;edge < f.blocks[b].succs.size();edge++)
+            {
+                if(thread_edge(b, edge)) progress = true;
+            }
+            if(remove_forwarder(b)) progress = true;
+            while(merge(b)) progress = true;
+        }
+        f.replace_uses(replacements);
+        changed = changed || progress;
+    }
+    if(changed) f.compact();
+    function = nullptr;
+    return changed;
+}
+
+bool CfgSimplifier::fold_branch(IrBlockId b)
+{
+    IrBlock& block = function->blocks[b];
+    IrValue terminator = function->terminator(b);
+    const IrInstr& instr = function->instrs[terminator];
+    if(instr.op != IrOp::BRANCH && instr.op != IrOp::SWITCH) return false;
+
+    const IrInstr& condition = function->instrs[function->operand(terminator, 0)];
+    size_t taken = 0;
+    if(condition.op == IrOp::CONST && instr.op == IrOp::BRANCH)
+    {
+        taken = condition.imm != 0 ? 0 : 1;
+    }
+    else if(condition.op == IrOp::CONST)
+    {
+        for(uint32_t i = 1;i < instr.count;i++)
+        {
+            if(function->instrs[function->operand(terminator, i)].imm == condition.imm) taken = i;
+        }
+    }
+    else if(std::all_of(block.succs.begin(), block.succs.end(), [&](IrBlockId s) { return s == block.succs[0]; }))
+    {
+        // All edges go to the same block: the phis must not tell them apart.
+        const IrBlock& target = function->blocks[block.succs[0]];
+        size_t first = pred_index(target, b);
+        for(IrValue value : target.code)
+        {
+            if(function->instrs[value].op != IrOp::PHI) break;
+            for(size_t i = first + 1;i < target.preds.size();i++)
+            {
+                if(target.preds[i] == b && function->operand(value, i) != function->operand(value, first)) return false;
+            }
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    function->fold_terminator(b, taken);
+    return true;
+}
+
+bool CfgSimplifier::thread_edge(IrBlockId b, size_t edge)
+{
+    IrBlock& block = function->blocks[b];
+
+    // The successor must be just 'p = phi ...; branch p', or 'p = phi ...; c = p op k;
+    // branch c' (comparing with a constant), so that nothing else in it is skipped.
+    IrBlockId s = block.succs[edge];
+    const IrBlock& middle = function->blocks[s];
+    if(s == b || threads == 0 || std::count(block.succs.begin(), block.succs.end(), s) != 1 || middle.code.size() < 2 || middle.code.size() > 3
+        || function->instrs[middle.code.back()].op != IrOp::BRANCH || middle.succs[0] == middle.succs[1])
+    {
+        return false;
+    }
+    IrValue phi = middle.code[0], condition = middle.code[middle.code.size() - 2];
+    if(function->instrs[phi].op != IrOp::PHI || use_counts[phi] != 1
+        || function->operand(middle.code.back(), 0) != condition)
+    {
+        return false;
+    }
+    IrValue constant = IrNone;
+    if(condition != phi)
+    {
+        const IrInstr& compare = function->instrs[condition];
+        if(!ir_is_comparison(compare.op) || use_counts[condition] != 1
+            || function->operand(condition, 0) != phi)
+        {
+            return false;
+        }
+        constant = function->operand(condition, 1);
+        if(function->instrs[constant].op != IrOp::CONST) return false;
+    }
+
+    size_t index = pred_index(middle, b);
+    IrValue incoming = function->operand(phi, index);
+    if(function->instrs[incoming].op != IrOp::CONST) return false;
+    int64_t taken = function->instrs[incoming].imm;
+    if(constant != IrNone)
+    {
+        const IrInstr& compare = function->instrs[condition];
+        int64_t k = function->instrs[constant].imm;
+        if(!ir_evaluate(compare.op, compare.type, function->instrs[phi].type, taken, k, taken))
+        {
+            return false;
+        }
+    }
+    IrBlockId target = middle.succs[taken != 0 ? 0 : 1];
+    if(target == s) return false;
+
+    // The target's phis take the values they would have taken from the middle block. (If
+    // this block already reaches the target by its other edge, they might need two values.)
+    IrBlock& next = function->blocks[target];
+    bool phis = function->instrs[next.code[0]].op == IrOp::PHI;
+    if(phis && std::find(block.succs.begin(), block.succs.end(), target) != block.succs.end())
+    {
+        return false;
+    }
+    size_t from = pred_index(next, s);
+    for(IrValue value : next.code)
+    {
+        if(function->instrs[value].op != IrOp::PHI) break;
+
+        IrRange operands = function->operands(value);
+        std::vector<IrValue> extended(operands.begin(), operands.end());
+        extended.push_back(operands[from] == phi ? incoming : operands[from]);
+        use_counts[extended.back()]++;
+        function->set_operands(value, extended);
+    }
+    next.preds.push_back(b);
+    block.succs[edge] = target;
+    threads--;
+    function->remove_pred(s, index);
+    return true;
+}
+
+bool CfgSimplifier::remove_forwarder(IrBlockId b)
+{
+    IrBlock& block = function->blocks[b];
+    if(b == 0 || block.code.size() != 1 || block.succs.size() != 1 || block.preds.empty())
+    {
+        return false;
+    }
+    IrBlockId s = block.succs[0];
+    IrBlock& next = function->blocks[s];
+    if(s == b) return false;
+
+    // If the successor has phis, an edge which already reaches it could need two different
+    // values for one predecessor.
+    bool phis = function->instrs[next.code[0]].op == IrOp::PHI;
+    for(IrBlockId pred : block.preds)
+    {
+        if(phis && std::find(next.preds.begin(), next.preds.end(), pred) != next.preds.end())
+        {
+            return false;
+        }
+    }
+
+    size_t index = pred_index(next, b);
+    for(IrValue value : next.code)
+    {
+        if(function->instrs[value].op != IrOp::PHI) break;
+
+        IrRange operands = function->operands(value);
+        IrValue incoming = operands[index];
+        std::vector<IrValue> redirected(operands.begin(), operands.begin() + index);
+        redirected.insert(redirected.end(), operands.begin() + index + 1, operands.end());
+        redirected.insert(redirected.end(), block.preds.size(), incoming);
+        use_counts[incoming] += block.preds.size();
+        function->set_operands(value, redirected);
+    }
+    next.preds.erase(next.preds.begin() + index);
+    for(IrBlockId pred : block.preds)
+    {
+        auto& succs = function->blocks[pred].succs;
+        *std::find(succs.begin(), succs.end(), b) = s;
+        next.preds.push_back(pred);
+    }
+    block = IrBlock();
+    return true;
+}
+
+bool CfgSimplifier::merge(IrBlockId b)
+{
+    IrBlock& block = function->blocks[b];
+    if(block.succs.size() != 1) return false;
+    IrBlockId s = block.succs[0];
+    IrBlock& next = function->blocks[s];
+    if(s == b || next.preds.size() != 1) return false;
+
+    // Phis in the successor have one operand, from this block.
+    block.code.pop_back();
+    for(IrValue value : next.code)
+    {
+        IrInstr& instr = function->instrs[value];
+        if(instr.op == IrOp::PHI)
+        {
+            IrValue incoming = function->operand(value, 0);
+            replacements[value] = incoming;
+            use_counts[incoming] += use_counts[value];
+            continue;
+        }
+        instr.block = b;
+        block.code.push_back(value);
+    }
+    block.succs = next.succs;
+    for(IrBlockId succ : block.succs)
+    {
+        auto& preds = function->blocks[succ].preds;
+        std::replace(preds.begin(), preds.end(), s, b);
+    }
+    next = IrBlock();
+    return true;
+}
+
+bool clean_up(IrFunction& function)
+{
+    bool changed = false;
+    for(bool progress = true;progress;)
+    {
+        progress = DeadCodeElimination().run(function);
+        progress = CfgSimplifier().run(function) || progress;
+        changed = changed || progress;
+    }
+    return changed;
+}
@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <climits>
+
+#include "switch.h"
+
+// Can a cluster span low ... high? (Its range check adds -low, and compares with
+// high - low, as 32-bit immediates.)
+static bool fits(int64_t low, int64_t high)
+{
+    return low > INT32_MIN && high <= INT32_MAX && high - low <= INT32_MAX;
+}
+
+static int64_t cases_in(const SwitchCluster& range)
+{
+    return range.high - range.low + 1;
+}
+
+SwitchPlan::SwitchPlan(std::vector<SwitchCase> cases, int64_t low, int64_t high)
+{
+    merge(cases);
+    find_tables();
+    find_bit_tests();
+    build_tree(low, high);
+}
+
+void SwitchPlan::merge(std::vector<SwitchCase>& cases)
+{
+    std::sort(cases.begin(), cases.end(), [](const SwitchCase& a, const SwitchCase& b)
+    {
+        return a.value < b.value;
+    });
+    for(const SwitchCase& c : cases)
+    {
+        if(!ranges.empty())
+        {
+            SwitchCluster& last = ranges.back();
+            if(last.target == c.target && last.high == c.value - 1 && fits(last.low, c.value))
+            {
+                last.high = c.value;
+                continue;
+            }
+        }
+        SwitchCluster range;
+        range.kind = SwitchClusterKind::RANGE;
+        range.low = range.high = c.value;
+        range.target = c.target;
+        ranges.push_back(range);
+    }
+}
+
+void SwitchPlan::find_tables()
+{
+    // Fewest clusters which cover ranges i ... n - 1, and where the first of them ends.
+    size_t n = ranges.size();
+    std::vector<size_t> best(n + 1, 0), end(n, 0);
+    for(size_t i = n;i-- > 0;)
+    {
+        best[i] = best[i + 1] + 1;
+        end[i] = i + 1;
+        int64_t count = cases_in(ranges[i]);
+        for(size_t j = i + 1;j < n && fits(ranges[i].low, ranges[j].high);j++)
+        {
+            count += cases_in(ranges[j]);
+            int64_t span = ranges[j].high - ranges[i].low + 1;
+            if(count >= SwitchTableCases && count * 100 >= span * SwitchTableDensity && best[j + 1] + 1 < best[i])
+            {
+                best[i] = best[j + 1] + 1;
+                end[i] = j + 1;
+            }
+        }
+    }
+
+    for(size_t i = 0;i < n;i = end[i])
+    {
+        if(end[i] == i + 1)
+        {
+            clusters.push_back(ranges[i]);
+            continue;
+        }
+        SwitchCluster table;
+        table.kind = SwitchClusterKind::TABLE;
+        table.low = ranges[i].low;
+        table.high = ranges[end[i] - 1].high;
+        table.table.assign(table.high - table.low + 1, 0);
+        for(size_t j = i;j < end[i];j++)
+        {
+            std::fill(
+                table.table.begin() + (ranges[j].low - table.low),
+                table.table.begin() + (ranges[j].high - table.low + 1),
+                ranges[j].target);
+        }
+        clusters.push_back(std::move(table));
+    }
+}
+
+void SwitchPlan::find_bit_tests()
+{
+    // Ranges needed for a bit test, by its number of targets.
+    static const size_t Needed[SwitchBitTargets + 1] = {0, 3, 5, 6};
+
+    size_t n = clusters.size();
+    std::vector<size_t> best(n + 1, 0), end(n, 0);
+    std::vector<uint32_t> targets;
+    for(size_t i = n;i-- > 0;)
+    {
+        best[i] = best[i + 1] + 1;
+        end[i] = i + 1;
+        targets.clear();
+        for(size_t j = i;j < n;j++)
+        {
+            const SwitchCluster& range = clusters[j];
+            if(range.kind != SwitchClusterKind::RANGE || !fits(clusters[i].low, range.high)
+                || range.high - clusters[i].low >= 64)
+            {
+                break;
+            }
+            if(std::find(targets.begin(), targets.end(), range.target) == targets.end())
+            {
+                targets.push_back(range.target);
+            }
+            if(targets.size() > SwitchBitTargets) break;
+            if(j + 1 - i >= Needed[targets.size()] && best[j + 1] + 1 < best[i])
+            {
+                best[i] = best[j + 1] + 1;
+                end[i] = j + 1;
+            }
+        }
+    }
+
+    std::vector<SwitchCluster> tested;
+    for(size_t i = 0;i < n;i = end[i])
+    {
+        if(end[i] == i + 1)
+        {
+            tested.push_back(std::move(clusters[i]));
+            continue;
+        }
+        SwitchCluster bits;
+        bits.kind = SwitchClusterKind::BITS;
+        bits.low = clusters[i].low;
+        bits.high = clusters[end[i] - 1].high;
+        for(size_t j = i;j < end[i];j++)
+        {
+            const SwitchCluster& range = clusters[j];
+            auto mask = std::find_if(bits.masks.begin(), bits.masks.end(), [&](const std::pair<uint32_t, uint64_t>& m)
+            {
+                return m.first == range.target;
+            });
+            if(mask == bits.masks.end())
+            {
+                bits.masks.emplace_back(range.target, 0);
+                mask = bits.masks.end() - 1;
+            }
+            for(int64_t v = range.low;v <= range.high;v++)
+            {
+                mask->second |= uint64_t(1) << (v - bits.low);
+            }
+        }
+        tested.push_back(std::move(bits));
+    }
+    clusters = std::move(tested);
+}
+
+void SwitchPlan::build_tree(int64_t low, int64_t high)
+{
+    nodes.push_back(SwitchNode{0, clusters.size(), 0, -1, -1, low, high});
+    std::vector<int> work{0};
+    while(!work.empty())
+    {
+        int n = work.back();
+        work.pop_back();
+        SwitchNode node = nodes[n];
+        if(node.last - node.first <= SwitchLeafClusters) continue;
+
+        size_t middle = (node.first + node.last) / 2;
+        int64_t pivot = clusters[middle].low;
+        nodes[n].pivot = pivot;
+        nodes[n].left = nodes.size();
+        nodes.push_back(SwitchNode{node.first, middle, 0, -1, -1, node.low, pivot - 1});
+        nodes[n].right = nodes.size();
+        nodes.push_back(SwitchNode{middle, node.last, 0, -1, -1, pivot, node.high});
+        work.push_back(nodes[n].left);
+        work.push_back(nodes[n].right);
+    }
+}
@@ -0,0 +1,125 @@
+#include <cstdint>
+
+#include "symbol.h"
+
+const int InitialSymbolTableSize = 64;
+
+IdentifierTable::IdentifierTable(const IdentifierTable * parent)
+    : parent(parent)
+    , base(parent ? parent->size() : 0)
+{
+}
+
+int IdentifierTable::intern(const std::string& identifier)
+{
+    int id = parent ? parent->find(identifier) : -1;
+    if(id != -1) return id;
+
+    auto inserted = ids.insert({identifier, size()});
+    if(inserted.second)
+    {
+        // (References to unordered_map keys are stable.)
+        names.push_back(&inserted.first->first);
+    }
+    return inserted.first->second;
+}
+
+int IdentifierTable::find(const std::string& identifier) const
+{
+    auto it = ids.find(identifier);
+    if(it != ids.end()) return it->second;
+    return parent ? parent->find(identifier) : -1;
+}
+
+const std::string& IdentifierTable::name(int id) const
+{
+    return id < base ? parent->name(id) : *names[id - base];
+}
+
+SymbolTable::SymbolTable(const SymbolTable * parent, int parent_limit)
+    : parent(parent)
+    , parent_limit(parent_limit)
+    , slots(InitialSymbolTableSize, Slot{-1, -1})
+{
+}
+
+// Find the slot for an identifier (or the empty slot where it would be inserted). Linear
+// probing; the table is kept at most half full.
+int SymbolTable::find(int id) const
+{
+    uint32_t mask = slots.size() - 1;
+    uint32_t index = (static_cast<uint32_t>(id) * 2654435761u) & mask;
+    while(slots[index].id != id && slots[index].id != -1)
+    {
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+void SymbolTable::grow()
+{
+    std::vector<Slot> old(slots.size() * 2, Slot{-1, -1});
+    slots.swap(old);
+    for(auto& slot : old)
+    {
+        if(slot.id != -1)
+        {
+            slots[find(slot.id)] = slot;
+        }
+    }
+}
+
+void SymbolTable::push_scope()
+{
+    scopes.push_back(bindings.size());
+}
+
+void SymbolTable::pop_scope()
+{
+    // Undo the bindings made in this scope, restoring the declarations they shadowed.
+    // Slots are not removed, since the identifier is likely to be declared again.
+    for(int i = bindings.size() - 1;i >= scopes.back();i--)
+    {
+        slots[find(bindings[i].id)].binding = bindings[i].shadowed;
+    }
+    bindings.resize(scopes.back());
+    scopes.pop_back();
+}
+
+DeclAstNode * SymbolTable::declare(int id, DeclAstNode * decl)
+{
+    Slot * slot = &slots[find(id)];
+    if(slot->id == -1)
+    {
+        if((used + 1) * 2 > static_cast<int>(slots.size()))
+        {
+            grow();
+            slot = &slots[find(id)];
+        }
+        *slot = Slot{id, -1};
+        used++;
+    }
+
+    if(slot->binding != -1 && bindings[slot->binding].scope == depth())
+    {
+        DeclAstNode * previous = bindings[slot->binding].decl;
+        bindings[slot->binding].decl = decl;
+        return previous;
+    }
+
+    bindings.push_back(Binding{decl, id, slot->binding, depth()});
+    slot->binding = bindings.size() - 1;
+    return nullptr;
+}
+
+DeclAstNode * SymbolTable::lookup(int id) const
+{
+    const Slot& slot = slots[find(id)];
+    if(slot.binding != -1) return bindings[slot.binding].decl;
+    if(parent == nullptr) return nullptr;
+
+    // A binding's index is fixed when the identifier is first declared in its scope.
+    const Slot& parent_slot = parent->slots[parent->find(id)];
+    if(parent_slot.binding == -1 || parent_slot.binding >= parent_limit) return nullptr;
+    return parent->bindings[parent_slot.binding].decl;
+}
@@ -0,0 +1,127 @@
+#include <algorithm>
+
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(int count)
+{
+    if(count <= 0)
+    {
+        count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for(int i = 0;i < count;i++)
+    {
+        queues.push_back(std::unique_ptr<Queue>(new Queue()));
+    }
+
+    // Worker 0 is the thread which calls run().
+    for(int i = 1;i < count;i++)
+    {
+        threads.emplace_back(&ThreadPool::worker, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+// Take the next task for a worker: from the back of its own queue, or else from the front
+// of another worker's queue. Tasks are only added between batches, so if every queue is
+// empty, the batch is finished (for this worker).
+bool ThreadPool::next(int id, size_t& task)
+{
+    for(int i = 0;i < size();i++)
+    {
+        Queue& queue = *queues[(id + i) % size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if(queue.tasks.empty()) continue;
+
+        if(i == 0)
+        {
+            task = queue.tasks.back();
+            queue.tasks.pop_back();
+        }
+        else
+        {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+        }
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::work(int id)
+{
+    size_t task;
+    while(next(id, task))
+    {
+        try
+        {
+            (*job)(task);
+        }
+        catch(...)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if(!error) error = std::current_exception();
+        }
+    }
+}
+
+void ThreadPool::worker(int id)
+{
+    uint64_t seen = 0;
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [&]{ return stopping || generation != seen; });
+            if(stopping) return;
+            seen = generation;
+        }
+
+        work(id);
+
+        std::lock_guard<std::mutex> guard(lock);
+        if(--busy == 0) done.notify_all();
+    }
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t)>& task)
+{
+    for(size_t i = 0;i < count;i++)
+    {
+        Queue& queue = *queues[i % size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.push_back(i);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        job = &task;
+        error = nullptr;
+        busy = threads.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    work(0);
+
+    std::exception_ptr result;
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        done.wait(guard, [&]{ return busy == 0; });
+        job = nullptr;
+        result = error;
+    }
+    if(result) std::rethrow_exception(result);
+}
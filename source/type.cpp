@@ -5,45 +5,65 @@
 CType::~CType() {
 }
 
-BasicCType::operator std::string()
+// Build the string representation for every packed type.
+static std::vector<std::string> packed_ctype_strings()
 {
-    std::stringstream str;
-    str << "[";
-    switch(storage)
-    {
-        case BasicCTypeStorage::STATIC:
-            str << "static ";
-            break;
-    }
-    switch(qualifier)
-    {
-        case BasicCTypeQualifier::CONST:
-            str << "const ";
-            break;
-    }
-    switch(signedness)
-    {
-        case BasicCTypeSignedness::SIGNED:
-            str << "signed ";
-            break;
-        case BasicCTypeSignedness::UNSIGNED:
-            str << "unsigned ";
-            break;
-    }
-    switch(type)
+    std::vector<std::string> strings(1 << PackedCTypeBits);
+    for(PackedCType t = 0;t < strings.size();t++)
     {
-        case BasicCTypeType::CHAR:
-            str << "char";
-            break;
-        case BasicCTypeType::SHORT_INT:
-            str << "short int";
-            break;
-        case BasicCTypeType::INT:
-            str << "int";
-            break;
+        std::stringstream str;
+        str << "[";
+        switch(packed_storage(t))
+        {
+            case BasicCTypeStorage::STATIC:
+                str << "static ";
+                break;
+            case BasicCTypeStorage::REGISTER:
+                str << "register ";
+                break;
+        }
+        switch(packed_qualifier(t))
+        {
+            case BasicCTypeQualifier::CONST:
+                str << "const ";
+                break;
+        }
+        switch(packed_signedness(t))
+        {
+            case BasicCTypeSignedness::SIGNED:
+                str << "signed ";
+                break;
+            case BasicCTypeSignedness::UNSIGNED:
+                str << "unsigned ";
+                break;
+        }
+        switch(packed_type(t))
+        {
+            case BasicCTypeType::CHAR:
+                str << "char";
+                break;
+            case BasicCTypeType::SHORT_INT:
+                str << "short int";
+                break;
+            case BasicCTypeType::INT:
+                str << "int";
+                break;
+        }
+        str << "]";
+        strings[t] = str.str();
     }
-    str << "]";
-    return str.str();
+    return strings;
+}
+
+const std::string& packed_ctype_str(PackedCType t)
+{
+    static const std::vector<std::string> strings = packed_ctype_strings();
+    return strings[t & ((1 << PackedCTypeBits) - 1)];
+}
+
+BasicCType::operator std::string()
+{
+    return packed_ctype_str(packed());
 }
 
 DerivedCType::operator std::string()
@@ -65,15 +85,268 @@ DerivedCType::operator std::string()
             str << "*, ";
             break;
         case DerivedCTypeType::FUNCTION:
-            str << "(), ";
+            str << "(";
+            for(size_t i = 0;i < parameters.size();i++)
+            {
+                str << (i ? ", " : "") << *parameters[i];
+            }
+            str << "), ";
             break;
     }
     str << *base << "]";
     return str.str();
 }
 
+VoidCType::operator std::string()
+{
+    return "[void]";
+}
+
 std::ostream& operator<<(std::ostream& os, CType& ctype)
 {
     os << static_cast<std::string>(ctype);
     return os;
-}
\ No newline at end of file
+}
+
+TypeContext::TypeContext()
+    : void_ctype(std::make_shared<VoidCType>())
+{
+    for(PackedCType t = 0;t < (1 << PackedCTypeBits);t++)
+    {
+        basic_types[t] = std::make_shared<BasicCType>(t);
+    }
+}
+
+std::shared_ptr<BasicCType> TypeContext::basic(
+    BasicCTypeType type,
+    BasicCTypeSignedness signedness,
+    BasicCTypeStorage storage,
+    BasicCTypeQualifier qualifier)
+{
+    if(type != BasicCTypeType::CHAR && signedness == BasicCTypeSignedness::NOT_SET)
+    {
+        signedness = BasicCTypeSignedness::SIGNED;
+    }
+
+    return basic_types[pack_ctype(type, signedness, storage, qualifier)];
+}
+
+std::shared_ptr<VoidCType> TypeContext::void_type()
+{
+    return void_ctype;
+}
+
+std::shared_ptr<DerivedCType> TypeContext::derived(
+    const std::shared_ptr<CType>& base,
+    DerivedCTypeType type,
+    int array_size,
+    BasicCTypeQualifier qualifier)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    auto& ctype = derived_types[std::make_tuple(base.get(), type, array_size, qualifier)];
+    if(!ctype)
+    {
+        ctype = std::make_shared<DerivedCType>(base, type, array_size, qualifier);
+    }
+    return ctype;
+}
+
+std::shared_ptr<DerivedCType> TypeContext::pointer(
+    const std::shared_ptr<CType>& base,
+    BasicCTypeQualifier qualifier)
+{
+    return derived(base, DerivedCTypeType::POINTER, 0, qualifier);
+}
+
+std::shared_ptr<DerivedCType> TypeContext::array(const std::shared_ptr<CType>& base, int size)
+{
+    return derived(base, DerivedCTypeType::ARRAY, size, BasicCTypeQualifier::NOT_SET);
+}
+
+std::shared_ptr<DerivedCType> TypeContext::function(
+    const std::shared_ptr<CType>& base,
+    const std::vector<std::shared_ptr<CType>>& parameters)
+{
+    std::vector<const CType *> key;
+    for(auto& parameter : parameters)
+    {
+        key.push_back(parameter.get());
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    auto& ctype = function_types[std::make_pair(base.get(), std::move(key))];
+    if(!ctype)
+    {
+        ctype = std::make_shared<DerivedCType>(base, DerivedCTypeType::FUNCTION);
+        ctype->parameters = parameters;
+    }
+    return ctype;
+}
+
+// Declaration specifier bits. The type specifiers are the low bits, so that they can
+// index the table of valid combinations.
+const uint32_t SpecifierVoid = 1 << 0;
+const uint32_t SpecifierChar = 1 << 1;
+const uint32_t SpecifierShort = 1 << 2;
+const uint32_t SpecifierInt = 1 << 3;
+const uint32_t SpecifierSigned = 1 << 4;
+const uint32_t SpecifierUnsigned = 1 << 5;
+const uint32_t SpecifierConst = 1 << 6;
+const uint32_t SpecifierStatic = 1 << 7;
+const uint32_t SpecifierRegister = 1 << 8;
+
+const uint32_t TypeSpecifierMask = (1 << 6) - 1;
+const uint32_t StorageSpecifierMask = SpecifierStatic | SpecifierRegister;
+
+// Specifier keywords, in bit order (for diagnostics).
+const std::vector<std::string> SpecifierNames = {
+    "void", "char", "short", "int", "signed", "unsigned", "const", "static", "register"
+};
+
+struct TypeSpecifierEntry
+{
+    bool valid;
+    bool is_void;
+    BasicCTypeType type;
+    BasicCTypeSignedness signedness;
+};
+
+// Table of valid type specifier combinations, indexed by type specifier bits.
+static std::vector<TypeSpecifierEntry> type_specifier_table()
+{
+    std::vector<TypeSpecifierEntry> table(TypeSpecifierMask + 1, TypeSpecifierEntry{false, false, BasicCTypeType::NOT_SET, BasicCTypeSignedness::NOT_SET});
+
+    auto add = [&table](uint32_t bits, BasicCTypeType type, BasicCTypeSignedness signedness) {
+        table[bits] = TypeSpecifierEntry{true, false, type, signedness};
+    };
+
+    table[SpecifierVoid] = TypeSpecifierEntry{true, true, BasicCTypeType::NOT_SET, BasicCTypeSignedness::NOT_SET};
+
+    add(SpecifierChar, BasicCTypeType::CHAR, BasicCTypeSignedness::NOT_SET);
+    add(SpecifierSigned | SpecifierChar, BasicCTypeType::CHAR, BasicCTypeSignedness::SIGNED);
+    add(SpecifierUnsigned | SpecifierChar, BasicCTypeType::CHAR, BasicCTypeSignedness::UNSIGNED);
+
+    for(uint32_t i : {0u, SpecifierInt})
+    {
+        add(SpecifierShort | i, BasicCTypeType::SHORT_INT, BasicCTypeSignedness::SIGNED);
+        add(SpecifierSigned | SpecifierShort | i, BasicCTypeType::SHORT_INT, BasicCTypeSignedness::SIGNED);
+        add(SpecifierUnsigned | SpecifierShort | i, BasicCTypeType::SHORT_INT, BasicCTypeSignedness::UNSIGNED);
+    }
+
+    add(SpecifierInt, BasicCTypeType::INT, BasicCTypeSignedness::SIGNED);
+    add(SpecifierSigned, BasicCTypeType::INT, BasicCTypeSignedness::SIGNED);
+    add(SpecifierSigned | SpecifierInt, BasicCTypeType::INT, BasicCTypeSignedness::SIGNED);
+    add(SpecifierUnsigned, BasicCTypeType::INT, BasicCTypeSignedness::UNSIGNED);
+    add(SpecifierUnsigned | SpecifierInt, BasicCTypeType::INT, BasicCTypeSignedness::UNSIGNED);
+
+    return table;
+}
+
+// Format specifier bits as keywords, e.g. "'unsigned void'".
+static std::string specifier_str(uint32_t bits)
+{
+    std::string str;
+    for(size_t i = 0;i < SpecifierNames.size();i++)
+    {
+        if(bits & (1 << i))
+        {
+            str += (str.empty() ? "'" : " ") + SpecifierNames[i];
+        }
+    }
+    return str + "'";
+}
+
+void CTypeBuilder::add(uint32_t bit)
+{
+    duplicates |= specifiers & bit;
+    specifiers |= bit;
+}
+
+void CTypeBuilder::add_specifier(TokenType token)
+{
+    switch(token)
+    {
+        case TOK_VOID:
+            add(SpecifierVoid);
+            break;
+        case TOK_CHAR:
+            add(SpecifierChar);
+            break;
+        case TOK_SHORT:
+            add(SpecifierShort);
+            break;
+        case TOK_INT:
+            add(SpecifierInt);
+            break;
+        case TOK_SIGNED:
+            add(SpecifierSigned);
+            break;
+        case TOK_UNSIGNED:
+            add(SpecifierUnsigned);
+            break;
+        default:
+            throw std::logic_error("Not a type specifier");
+    }
+}
+
+void CTypeBuilder::add_qualifier(TokenType token)
+{
+    if(token != TOK_CONST)
+        throw std::logic_error("Not a type qualifier");
+
+    // Repeated qualifiers are allowed (6.7.3, 4).
+    specifiers |= SpecifierConst;
+}
+
+void CTypeBuilder::add_storage_specifier(TokenType token)
+{
+    switch(token)
+    {
+        case TOK_STATIC:
+            add(SpecifierStatic);
+            break;
+        case TOK_REGISTER:
+            add(SpecifierRegister);
+            break;
+        default:
+            throw std::logic_error("Not a storage class specifier");
+    }
+}
+
+std::shared_ptr<CType> CTypeBuilder::build(TypeContext& context, int line)
+{
+    static const std::vector<TypeSpecifierEntry> table = type_specifier_table();
+
+    if(duplicates)
+    {
+        throw CTypeError("Duplicate " + specifier_str(duplicates) + " in declaration specifiers", line);
+    }
+    if((specifiers & StorageSpecifierMask) == StorageSpecifierMask)
+    {
+        throw CTypeError("Multiple storage classes in declaration specifiers", line);
+    }
+
+    uint32_t type_specifiers = specifiers & TypeSpecifierMask;
+    const TypeSpecifierEntry& entry = table[type_specifiers];
+    if(!entry.valid)
+    {
+        if(type_specifiers == 0)
+            throw CTypeError("Missing type specifier in declaration specifiers", line);
+        throw CTypeError("Invalid type specifiers " + specifier_str(type_specifiers), line);
+    }
+    if(entry.is_void)
+    {
+        return context.void_type();
+    }
+
+    BasicCTypeStorage storage = BasicCTypeStorage::NOT_SET;
+    if(specifiers & SpecifierStatic) storage = BasicCTypeStorage::STATIC;
+    if(specifiers & SpecifierRegister) storage = BasicCTypeStorage::REGISTER;
+
+    return context.basic(
+        entry.type,
+        entry.signedness,
+        storage,
+        (specifiers & SpecifierConst) ? BasicCTypeQualifier::CONST : BasicCTypeQualifier::NOT_SET
+    );
+}
@@ -0,0 +1,528 @@
+#include <algorithm>
+#include <map>
+
+#include "vectorize.h"
+#include "loops.h"
+
+static bool is_conversion(IrOp op)
+{
+    return op == IrOp::SEXT || op == IrOp::ZEXT || op == IrOp::TRUNC;
+}
+
+static IrOp vector_op(IrOp op)
+{
+    for(int i = static_cast<int>(IrOp::VADD);i <= static_cast<int>(IrOp::VXOR);i++)
+    {
+        if(ir_vector_scalar(static_cast<IrOp>(i)) == op) return static_cast<IrOp>(i);
+    }
+    return IrOp::VOR;
+}
+
+namespace
+{
+    // Array access in the loop: base + sext(i + offset) * size.
+    struct Access
+    {
+        IrValue base;
+        int64_t offset;
+
+        bool operator<(const Access& other) const
+        {
+            return base != other.base ? base < other.base : offset < other.offset;
+        }
+        bool operator==(const Access& other) const
+        {
+            return base == other.base && offset == other.offset;
+        }
+    };
+
+    // Value in a stored value's tree: a load from an array, a value from outside the loop,
+    // a conversion (which keeps the bits of an element), or an operation.
+    struct Node
+    {
+        enum class Kind { LOAD, INVARIANT, CONVERSION, OPERATION };
+        Kind kind;
+        IrValue value;
+        Access access;
+    };
+
+    struct Store
+    {
+        Access access;
+        IrValue value;
+
+        // The stored value's tree, operands before their users.
+        std::vector<Node> nodes;
+    };
+
+    // A loop which can be vectorized.
+    struct Candidate
+    {
+        IrBlockId preheader, header;
+        IrValue init, limit;
+        IrType element;
+
+        // Stores in the body, in order, and the pairs of accesses to check at run time.
+        std::vector<Store> stores;
+        std::vector<std::pair<Access, Access>> checks;
+    };
+
+    class Analyser
+    {
+        private:
+            const IrFunction& function;
+            const LoopInfo& info;
+            int loop = -1;
+            IrValue variable = IrNone;
+            int size = 0;
+
+            // Accesses in the loop, and which of its instructions are accounted for, and
+            // where they are in the body. (The last two are for the whole function, and
+            // only the loop's own entries are reset after it.)
+            std::vector<Access> accesses;
+            std::vector<bool> covered;
+            std::vector<int> position;
+
+            inline bool inside(IrValue value) const
+            {
+                return info.contains(loop, function.instrs[value].block);
+            }
+            inline bool constant(IrValue value, int64_t& imm) const
+            {
+                imm = function.instrs[value].imm;
+                return function.instrs[value].op == IrOp::CONST;
+            }
+
+            bool index(IrValue, int64_t& offset);
+            bool access(IrValue address, Access&);
+            bool conversion(IrValue) const;
+            bool tree(Store&, int after);
+            bool check(Candidate&);
+
+        public:
+            Analyser(const IrFunction& function, const LoopInfo& info)
+              : function(function)
+              , info(info)
+              , covered(function.instrs.size(), false)
+              , position(function.instrs.size(), -1) { }
+
+            bool analyse(int loop, Candidate&);
+    };
+}
+
+// i, or i + k.
+bool Analyser::index(IrValue value, int64_t& offset)
+{
+    offset = 0;
+    if(value == variable) return true;
+    if(function.instrs[value].op != IrOp::ADD || !inside(value)) return false;
+    for(int i = 0;i < 2;i++)
+    {
+        if(function.operand(value, i) == variable && constant(function.operand(value, 1 - i), offset))
+        {
+            covered[value] = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+// base + sext(i + k) * size, with an invariant base. (For bytes, base + sext(i + k).)
+bool Analyser::access(IrValue address, Access& result)
+{
+    const IrInstr& instr = function.instrs[address];
+    if(instr.op != IrOp::ADD || instr.type != IrType::I64 || !inside(address)) return false;
+    for(int i = 0;i < 2;i++)
+    {
+        IrValue base = function.operand(address, i);
+        IrValue scaled = function.operand(address, 1 - i);
+        if(inside(base)) continue;
+
+        IrValue extended = scaled;
+        int64_t scale = 1;
+        if(function.instrs[scaled].op == IrOp::MUL && inside(scaled))
+        {
+            int j = constant(function.operand(scaled, 1), scale) ? 0 : 1;
+            if(!constant(function.operand(scaled, 1 - j), scale)) continue;
+            extended = function.operand(scaled, j);
+        }
+        if(scale != size || function.instrs[extended].op != IrOp::SEXT || !inside(extended)) continue;
+        if(!index(function.operand(extended, 0), result.offset)) continue;
+
+        result.base = base;
+        covered[address] = covered[scaled] = covered[extended] = true;
+        if(std::find(accesses.begin(), accesses.end(), result) == accesses.end()) accesses.push_back(result);
+        return true;
+    }
+    return false;
+}
+
+// Does a conversion keep the bits of an element?
+bool Analyser::conversion(IrValue value) const
+{
+    const IrInstr& instr = function.instrs[value];
+    if(!is_conversion(instr.op)) return false;
+    return ir_type_size(instr.type) >= size && ir_type_size(function.instrs[function.operand(value, 0)].type) >= size;
+}
+
+// Can a stored value be computed by vector operations? Its loads must come after the store
+// at position 'after' (the one before this store).
+bool Analyser::tree(Store& store, int after)
+{
+    // (Postorder: a node is pushed again, as done, above its operands.)
+    std::vector<std::pair<IrValue, bool>> stack{{function.operand(store.value, 1), false}};
+    std::vector<IrValue> seen;
+    std::map<IrValue, Node> pending;
+    while(!stack.empty())
+    {
+        IrValue value = stack.back().first;
+        bool done = stack.back().second;
+        stack.pop_back();
+        if(done)
+        {
+            store.nodes.push_back(pending[value]);
+            continue;
+        }
+        if(std::find(seen.begin(), seen.end(), value) != seen.end()) continue;
+        seen.push_back(value);
+
+        const IrInstr& instr = function.instrs[value];
+        Node node{Node::Kind::INVARIANT, value, Access{IrNone, 0}};
+        std::vector<IrValue> operands;
+        if(inside(value))
+        {
+            if(position[value] < 0) return false;
+            covered[value] = true;
+            if(instr.op == IrOp::LOAD)
+            {
+                node.kind = Node::Kind::LOAD;
+                if(ir_type_size(instr.type) != size || position[value] < after) return false;
+                if(!access(function.operand(value, 0), node.access)) return false;
+            }
+            else if(conversion(value))
+            {
+                node.kind = Node::Kind::CONVERSION;
+                operands = {function.operand(value, 0)};
+            }
+            else if(instr.op == IrOp::ADD || instr.op == IrOp::SUB || instr.op == IrOp::AND || instr.op == IrOp::OR
+                || instr.op == IrOp::XOR)
+            {
+                node.kind = Node::Kind::OPERATION;
+                operands = {function.operand(value, 0), function.operand(value, 1)};
+            }
+            else
+                return false;
+        }
+        pending[value] = node;
+        stack.push_back(std::make_pair(value, true));
+        for(IrValue operand : operands) stack.push_back(std::make_pair(operand, false));
+    }
+    return true;
+}
+
+bool Analyser::analyse(int index, Candidate& candidate)
+{
+    loop = index;
+    variable = IrNone;
+    size = 0;
+    accesses.clear();
+    bool found = check(candidate);
+
+    // (Only the instructions of a loop of two blocks are marked.)
+    const IrLoop& l = info.loop(loop);
+    if(l.blocks.size() == 2)
+    {
+        for(IrBlockId b : l.blocks)
+        {
+            for(IrValue value : function.blocks[b].code)
+            {
+                covered[value] = false;
+                position[value] = -1;
+            }
+        }
+    }
+    return found;
+}
+
+bool Analyser::check(Candidate& candidate)
+{
+    const IrLoop& l = info.loop(loop);
+    IrBlockId preheader = info.preheader(function, loop);
+    if(preheader == IrNoBlock || l.blocks.size() != 2) return false;
+
+    // Header: i = phi(init, next); i < n; branch body, exit.
+    IrBlockId header = l.header;
+    IrBlockId body = l.blocks[1];
+    const IrBlock& head = function.blocks[header];
+    if(head.code.size() != 3 || head.preds.size() != 2 || head.succs[0] != body) return false;
+    IrValue phi = head.code[0], compare = head.code[1];
+    if(function.instrs[phi].op != IrOp::PHI || function.instrs[phi].type != IrType::I32) return false;
+    if(function.instrs[compare].op != IrOp::SLT || function.operand(compare, 0) != phi
+        || function.operand(head.code[2], 0) != compare || inside(function.operand(compare, 1)))
+        return false;
+    size_t from_body = head.preds[0] == body ? 0 : 1;
+    variable = phi;
+
+    // next = i + 1, in the body.
+    IrValue next = function.operand(phi, from_body);
+    int64_t step = 0;
+    if(function.instrs[next].op != IrOp::ADD || function.instrs[next].block != body) return false;
+    int j = function.operand(next, 0) == phi ? 1 : 0;
+    if(function.operand(next, 1 - j) != phi || !constant(function.operand(next, j), step) || step != 1) return false;
+    covered[next] = true;
+
+    // The stores, and their values.
+    const auto& code = function.blocks[body].code;
+    for(size_t i = 0;i < code.size();i++) position[code[i]] = static_cast<int>(i);
+    int after = -1;
+    for(IrValue value : code)
+    {
+        if(function.instrs[value].op != IrOp::STORE) continue;
+        IrType type = function.instrs[function.operand(value, 1)].type;
+        if(candidate.stores.empty())
+        {
+            if(type != IrType::I8 && type != IrType::I16 && type != IrType::I32) return false;
+            candidate.element = type;
+            size = ir_type_size(type);
+        }
+        Store store{Access{IrNone, 0}, value, {}};
+        if(type != candidate.element || !access(function.operand(value, 0), store.access)) return false;
+        if(!tree(store, after)) return false;
+        covered[value] = true;
+        candidate.stores.push_back(store);
+        after = position[value];
+    }
+    if(candidate.stores.empty()) return false;
+
+    // Nothing else may be in the body.
+    covered[code.back()] = true;
+    for(IrValue value : code)
+    {
+        if(!covered[value]) return false;
+    }
+
+    // Pairs of accesses, one of them a store, which might overlap.
+    for(const Store& store : candidate.stores)
+    {
+        for(const Access& other : accesses)
+        {
+            const Access& a = store.access;
+            if(a == other) continue;
+            if(a.base == other.base)
+            {
+                // (The distance is known.)
+                int64_t distance = (a.offset - other.offset) * size;
+                if(distance > -LoopVectorizer::VectorSize && distance < LoopVectorizer::VectorSize) return false;
+                continue;
+            }
+            if(function.instrs[a.base].op == IrOp::GLOBAL && function.instrs[other.base].op == IrOp::GLOBAL)
+                continue;
+            auto pair = other < a ? std::make_pair(other, a) : std::make_pair(a, other);
+            if(std::find(candidate.checks.begin(), candidate.checks.end(), pair) == candidate.checks.end())
+                candidate.checks.push_back(pair);
+        }
+    }
+
+    candidate.preheader = preheader;
+    candidate.header = header;
+    candidate.init = function.operand(phi, 1 - from_body);
+    candidate.limit = function.operand(compare, 1);
+    return true;
+}
+
+// Build the vector loop in front of a loop (see vectorize.h).
+static void vectorize(IrFunction& function, const Candidate& candidate)
+{
+    IrBlockId preheader = candidate.preheader;
+    IrType element = candidate.element;
+    int size = ir_type_size(element);
+    int64_t lanes = LoopVectorizer::VectorSize / size;
+    auto constant = [&](IrBlockId block, IrType type, int64_t value)
+    {
+        return function.append(block, IrOp::CONST, type, {}, value);
+    };
+
+    // A vector on the stack (in the entry block, with the other stack objects).
+    auto object = [&]()
+    {
+        IrValue value = function.create(IrOp::ALLOCA, IrType::I64, {}, LoopVectorizer::VectorSize);
+        function.instrs[value].block = 0;
+        auto& code = function.blocks[0].code;
+        code.insert(code.begin(), value);
+        return value;
+    };
+
+    // Address of an access at an index (I64).
+    auto address = [&](IrBlockId block, const Access& access, IrValue index)
+    {
+        IrValue offset = index;
+        if(access.offset != 0)
+            offset = function.append(block, IrOp::ADD, IrType::I64, {offset, constant(block, IrType::I64, access.offset)});
+        if(size != 1)
+            offset = function.append(block, IrOp::MUL, IrType::I64, {offset, constant(block, IrType::I64, size)});
+        return function.append(block, IrOp::ADD, IrType::I64, {access.base, offset});
+    };
+
+    IrBlockId vector = function.add_block();
+    IrBlockId header = function.add_block();
+    IrBlockId body = function.add_block();
+    IrBlockId exit = function.add_block();
+
+    // Preheader: are there enough iterations, and are the arrays apart? (Distances from
+    // -15 to 15, other than 0, overlap.)
+    function.blocks[preheader].code.pop_back();
+    IrValue init = function.append(preheader, IrOp::SEXT, IrType::I64, {candidate.init});
+    IrValue limit = function.append(preheader, IrOp::SEXT, IrType::I64, {candidate.limit});
+    IrValue count = function.append(preheader, IrOp::SUB, IrType::I64, {limit, init});
+    IrValue ok = function.append(preheader, IrOp::SGE, IrType::I32, {count, constant(preheader, IrType::I64, lanes)});
+    for(const auto& check : candidate.checks)
+    {
+        IrValue distance = function.append(preheader, IrOp::SUB, IrType::I64,
+            {address(preheader, check.first, init), address(preheader, check.second, init)});
+        IrValue same = function.append(preheader, IrOp::EQ, IrType::I32, {distance, constant(preheader, IrType::I64, 0)});
+        IrValue biased = function.append(preheader, IrOp::ADD, IrType::I64,
+            {distance, constant(preheader, IrType::I64, LoopVectorizer::VectorSize - 1)});
+        IrValue apart = function.append(preheader, IrOp::UGE, IrType::I32,
+            {biased, constant(preheader, IrType::I64, 2 * LoopVectorizer::VectorSize - 1)});
+        ok = function.append(preheader, IrOp::AND, IrType::I32,
+            {ok, function.append(preheader, IrOp::OR, IrType::I32, {same, apart})});
+    }
+    function.append(preheader, IrOp::BRANCH, IrType::VOID, {ok});
+    function.blocks[preheader].succs.clear();
+    function.add_edge(preheader, vector);
+    function.add_edge(preheader, exit);
+
+    // Vector preheader: the last index at which a whole vector fits, and splats of the
+    // invariant operands (the element times 0x01...01, twice).
+    IrValue last = function.append(vector, IrOp::SUB, IrType::I32, {candidate.limit, constant(vector, IrType::I32, lanes)});
+    uint64_t ones = size == 1 ? 0x0101010101010101 : size == 2 ? 0x0001000100010001 : 0x0000000100000001;
+    uint64_t mask = (uint64_t(1) << (8 * size)) - 1;
+    std::map<IrValue, IrValue> splats;
+    auto splat = [&](IrValue value)
+    {
+        auto found = splats.find(value);
+        if(found != splats.end()) return found->second;
+        const IrInstr& instr = function.instrs[value];
+        IrValue pattern;
+        if(instr.op == IrOp::CONST)
+        {
+            pattern = constant(vector, IrType::I64, static_cast<int64_t>((static_cast<uint64_t>(instr.imm) & mask) * ones));
+        }
+        else
+        {
+            IrValue bits = instr.type == element ? value : function.append(vector, IrOp::TRUNC, element, {value});
+            bits = function.append(vector, IrOp::ZEXT, IrType::I64, {bits});
+            pattern = function.append(vector, IrOp::MUL, IrType::I64, {bits, constant(vector, IrType::I64, ones)});
+        }
+        IrValue slot = object();
+        function.append(vector, IrOp::STORE, IrType::VOID, {slot, pattern});
+        IrValue high = function.append(vector, IrOp::ADD, IrType::I64, {slot, constant(vector, IrType::I64, 8)});
+        function.append(vector, IrOp::STORE, IrType::VOID, {high, pattern});
+        return splats[value] = slot;
+    };
+    for(const Store& store : candidate.stores)
+    {
+        for(const Node& node : store.nodes)
+        {
+            if(node.kind == Node::Kind::INVARIANT) splat(node.value);
+        }
+    }
+    function.append(vector, IrOp::JUMP, IrType::VOID);
+    function.add_edge(vector, header);
+
+    // Vector header: vi = phi(init, vi + lanes), while vi <= n - lanes.
+    IrValue index = function.append(header, IrOp::PHI, IrType::I32, {candidate.init, candidate.init});
+    IrValue more = function.append(header, IrOp::SLE, IrType::I32, {index, last});
+    function.append(header, IrOp::BRANCH, IrType::VOID, {more});
+    function.add_edge(header, body);
+    function.add_edge(header, exit);
+
+    // Vector body: the stores in order. An operation writes its result to a temporary,
+    // except for the last, which writes to the stored array.
+    IrValue wide = function.append(body, IrOp::SEXT, IrType::I64, {index});
+    std::map<Access, IrValue> addresses;
+    auto vector_address = [&](const Access& access)
+    {
+        auto found = addresses.find(access);
+        if(found != addresses.end()) return found->second;
+        return addresses[access] = address(body, access, wide);
+    };
+    for(const Store& store : candidate.stores)
+    {
+        IrValue destination = vector_address(store.access);
+        IrValue root = function.operand(store.value, 1);
+        IrValue top = root;
+        while(is_conversion(function.instrs[top].op)) top = function.operand(top, 0);
+        std::map<IrValue, IrValue> vectors;
+        for(const Node& node : store.nodes)
+        {
+            switch(node.kind)
+            {
+                case Node::Kind::LOAD:
+                    vectors[node.value] = vector_address(node.access);
+                    break;
+                case Node::Kind::INVARIANT:
+                    vectors[node.value] = splats[node.value];
+                    break;
+                case Node::Kind::CONVERSION:
+                    vectors[node.value] = vectors[function.operand(node.value, 0)];
+                    break;
+                case Node::Kind::OPERATION:
+                {
+                    IrValue result = node.value == top ? destination : object();
+                    function.append(body, vector_op(function.instrs[node.value].op), IrType::VOID,
+                        {result, vectors[function.operand(node.value, 0)], vectors[function.operand(node.value, 1)]},
+                        static_cast<int64_t>(element));
+                    vectors[node.value] = result;
+                    break;
+                }
+            }
+        }
+
+        // (A copy, or a splat.)
+        IrValue value = vectors[root];
+        if(value != destination)
+            function.append(body, IrOp::VOR, IrType::VOID, {destination, value, value}, static_cast<int64_t>(element));
+    }
+    IrValue next = function.append(body, IrOp::ADD, IrType::I32, {index, constant(body, IrType::I32, lanes)});
+    function.set_operand(index, 1, next);
+    function.append(body, IrOp::JUMP, IrType::VOID);
+    function.add_edge(body, header);
+
+    // Exit: the scalar loop starts where the vector loop stopped (or at init).
+    IrValue start = function.append(exit, IrOp::PHI, IrType::I32, {candidate.init, index});
+    function.append(exit, IrOp::JUMP, IrType::VOID);
+    function.blocks[exit].succs.push_back(candidate.header);
+    IrBlock& scalar = function.blocks[candidate.header];
+    for(size_t i = 0;i < scalar.preds.size();i++)
+    {
+        if(scalar.preds[i] != preheader) continue;
+        scalar.preds[i] = exit;
+        function.set_operand(scalar.code[0], static_cast<int>(i), start);
+    }
+}
+
+bool LoopVectorizer::run(IrFunction& function)
+{
+    AnalysisCache cache(function);
+    return run(function, cache);
+}
+
+bool LoopVectorizer::run(IrFunction& function, AnalysisCache& cache)
+{
+    const LoopInfo& info = cache.loops();
+    std::vector<Candidate> candidates;
+    Analyser analyser(function, info);
+    for(size_t l = 0;l < info.loops().size();l++)
+    {
+        Candidate candidate;
+        if(analyser.analyse(static_cast<int>(l), candidate)) candidates.push_back(candidate);
+    }
+
+    // (Loops with two blocks are disjoint, so each can be changed without the others'
+    // analysis going stale.)
+    for(const Candidate& candidate : candidates)
+        vectorize(function, candidate);
+    if(!candidates.empty()) cache.invalidate();
+    return !candidates.empty();
+}
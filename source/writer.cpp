@@ -0,0 +1,50 @@
+#include "writer.h"
+
+BufferedWriter::BufferedWriter(std::FILE * f) : buffer(Capacity), file(f)
+{
+}
+
+BufferedWriter::BufferedWriter(std::string& s) : buffer(Capacity), text(&s)
+{
+}
+
+BufferedWriter::~BufferedWriter()
+{
+    flush();
+}
+
+void BufferedWriter::drain()
+{
+    if(size == 0) return;
+    if(file) failed = failed || std::fwrite(buffer.data(), 1, size, file) != size;
+    if(text) text->append(buffer.data(), size);
+    size = 0;
+}
+
+bool BufferedWriter::flush()
+{
+    drain();
+    if(file) failed = failed || std::fflush(file) != 0;
+    return !failed;
+}
+
+BufferedWriter& BufferedWriter::operator<<(unsigned long long n)
+{
+    // Digits are produced backwards, into the end of a small array.
+    char digits[20];
+    char * p = digits + sizeof(digits);
+    do
+    {
+        *--p = static_cast<char>('0' + n % 10);
+        n /= 10;
+    } while(n != 0);
+    write(p, digits + sizeof(digits) - p);
+    return *this;
+}
+
+BufferedWriter& BufferedWriter::operator<<(long long n)
+{
+    if(n >= 0) return *this << static_cast<unsigned long long>(n);
+    *this << '-';
+    return *this << (0ull - static_cast<unsigned long long>(n));
+}
@@ -4,6 +4,7 @@
 
 #include "token.h"
 #include "type.h"
+#include "layout.h"
 
 TEST(TypeSuite, Basic)
 {
@@ -47,4 +48,186 @@ TEST(TypeSuite, Derived)
         BasicCTypeQualifier::CONST
     );
     ASSERT_EQ(static_cast<std::string>(type), std::string("[const *, [signed int]]"));
-}
\ No newline at end of file
+}
+TEST(TypeSuite, Interning)
+{
+    TypeContext context;
+
+    auto int_type = context.basic(BasicCTypeType::INT, BasicCTypeSignedness::NOT_SET);
+    EXPECT_EQ(int_type, context.basic(BasicCTypeType::INT, BasicCTypeSignedness::SIGNED));
+    EXPECT_NE(int_type, context.basic(BasicCTypeType::INT, BasicCTypeSignedness::UNSIGNED));
+    EXPECT_NE(
+        context.basic(BasicCTypeType::CHAR, BasicCTypeSignedness::NOT_SET),
+        context.basic(BasicCTypeType::CHAR, BasicCTypeSignedness::SIGNED)
+    );
+    EXPECT_NE(
+        int_type,
+        context.basic(BasicCTypeType::INT, BasicCTypeSignedness::SIGNED, BasicCTypeStorage::NOT_SET, BasicCTypeQualifier::CONST)
+    );
+    EXPECT_EQ(context.void_type(), context.void_type());
+    EXPECT_EQ(static_cast<std::string>(*context.void_type()), std::string("[void]"));
+
+    // int *[10]
+    auto pointer = context.pointer(int_type);
+    auto array = context.array(pointer, 10);
+    EXPECT_EQ(pointer, context.pointer(int_type));
+    EXPECT_NE(pointer, context.pointer(int_type, BasicCTypeQualifier::CONST));
+    EXPECT_EQ(array, context.array(context.pointer(int_type), 10));
+    EXPECT_NE(array, context.array(context.pointer(int_type), 11));
+    EXPECT_EQ(array->base, pointer);
+    EXPECT_EQ(static_cast<std::string>(*array), std::string("[[10], [*, [signed int]]]"));
+
+    EXPECT_NE(context.function(int_type), context.pointer(int_type));
+    EXPECT_EQ(context.function(pointer), context.function(context.pointer(int_type)));
+}
+
+TEST(TypeSuite, Packed)
+{
+    BasicCType type(
+        BasicCTypeType::SHORT_INT,
+        BasicCTypeSignedness::UNSIGNED,
+        BasicCTypeStorage::STATIC,
+        BasicCTypeQualifier::CONST
+    );
+    PackedCType packed = type.packed();
+    EXPECT_EQ(packed_type(packed), BasicCTypeType::SHORT_INT);
+    EXPECT_EQ(packed_signedness(packed), BasicCTypeSignedness::UNSIGNED);
+    EXPECT_EQ(packed_storage(packed), BasicCTypeStorage::STATIC);
+    EXPECT_EQ(packed_qualifier(packed), BasicCTypeQualifier::CONST);
+    EXPECT_EQ(BasicCType(packed).packed(), packed);
+    EXPECT_EQ(packed_ctype_str(packed), "[static const unsigned short int]");
+    EXPECT_EQ(packed_ctype_str(PackedInt), "[signed int]");
+
+    constexpr PackedCType uchar = pack_ctype(BasicCTypeType::CHAR, BasicCTypeSignedness::UNSIGNED);
+    constexpr PackedCType plain_char = pack_ctype(BasicCTypeType::CHAR, BasicCTypeSignedness::NOT_SET);
+    constexpr PackedCType cuint = pack_ctype(
+        BasicCTypeType::INT, BasicCTypeSignedness::UNSIGNED, BasicCTypeStorage::NOT_SET, BasicCTypeQualifier::CONST);
+    constexpr PackedCType plain_int = pack_ctype(BasicCTypeType::INT, BasicCTypeSignedness::NOT_SET);
+
+    static_assert(integer_promotion(uchar) == PackedInt, "unsigned char promotes to int");
+    static_assert(integer_promotion(plain_char) == PackedInt, "char promotes to int");
+    static_assert(integer_promotion(cuint) == PackedUnsignedInt, "const unsigned int is unsigned int");
+    static_assert(integer_promotion(plain_int) == PackedInt, "int is signed int");
+    static_assert(usual_arithmetic_conversion(uchar, plain_int) == PackedInt, "");
+    static_assert(usual_arithmetic_conversion(plain_char, cuint) == PackedUnsignedInt, "");
+    static_assert(usual_arithmetic_conversion(cuint, cuint) == PackedUnsignedInt, "");
+}
+
+std::shared_ptr<CType> build_type(TypeContext& context, std::vector<TokenType> tokens)
+{
+    CTypeBuilder builder;
+    for(auto token : tokens)
+    {
+        switch(token)
+        {
+            case TOK_CONST:
+                builder.add_qualifier(token);
+                break;
+            case TOK_STATIC:
+            case TOK_REGISTER:
+                builder.add_storage_specifier(token);
+                break;
+            default:
+                builder.add_specifier(token);
+                break;
+        }
+    }
+    return builder.build(context);
+}
+
+std::string build_type_error(std::vector<TokenType> tokens)
+{
+    TypeContext context;
+    try
+    {
+        build_type(context, tokens);
+    }
+    catch(const CTypeError& e)
+    {
+        return e.what();
+    }
+    return "";
+}
+
+TEST(TypeSuite, Builder)
+{
+    TypeContext context;
+    EXPECT_EQ(
+        build_type(context, {TOK_UNSIGNED, TOK_SHORT, TOK_INT}),
+        context.basic(BasicCTypeType::SHORT_INT, BasicCTypeSignedness::UNSIGNED)
+    );
+    EXPECT_EQ(
+        build_type(context, {TOK_INT, TOK_SHORT}),
+        context.basic(BasicCTypeType::SHORT_INT, BasicCTypeSignedness::SIGNED)
+    );
+    EXPECT_EQ(
+        build_type(context, {TOK_CONST, TOK_STATIC, TOK_CHAR}),
+        context.basic(BasicCTypeType::CHAR, BasicCTypeSignedness::NOT_SET, BasicCTypeStorage::STATIC, BasicCTypeQualifier::CONST)
+    );
+    EXPECT_EQ(
+        build_type(context, {TOK_SIGNED}),
+        context.basic(BasicCTypeType::INT, BasicCTypeSignedness::SIGNED)
+    );
+    EXPECT_EQ(
+        build_type(context, {TOK_REGISTER, TOK_UNSIGNED, TOK_CONST, TOK_CONST}),
+        context.basic(BasicCTypeType::INT, BasicCTypeSignedness::UNSIGNED, BasicCTypeStorage::REGISTER, BasicCTypeQualifier::CONST)
+    );
+    EXPECT_EQ(build_type(context, {TOK_VOID}), context.void_type());
+    EXPECT_EQ(static_cast<std::string>(*build_type(context, {TOK_REGISTER, TOK_CHAR})), "[register char]");
+}
+
+TEST(TypeSuite, BuilderErrors)
+{
+    EXPECT_EQ(build_type_error({TOK_SHORT, TOK_SHORT}), "Duplicate 'short' in declaration specifiers");
+    EXPECT_EQ(build_type_error({TOK_STATIC, TOK_INT, TOK_STATIC}), "Duplicate 'static' in declaration specifiers");
+    EXPECT_EQ(build_type_error({TOK_UNSIGNED, TOK_VOID}), "Invalid type specifiers 'void unsigned'");
+    EXPECT_EQ(build_type_error({TOK_CHAR, TOK_SHORT}), "Invalid type specifiers 'char short'");
+    EXPECT_EQ(build_type_error({TOK_SIGNED, TOK_UNSIGNED}), "Invalid type specifiers 'signed unsigned'");
+    EXPECT_EQ(build_type_error({TOK_CONST}), "Missing type specifier in declaration specifiers");
+    EXPECT_EQ(build_type_error({TOK_STATIC, TOK_REGISTER, TOK_INT}), "Multiple storage classes in declaration specifiers");
+
+    // Errors carry the line of the declaration.
+    TypeContext context;
+    CTypeBuilder builder;
+    builder.add_specifier(TOK_CHAR);
+    builder.add_specifier(TOK_VOID);
+    try
+    {
+        builder.build(context, 7);
+        ADD_FAILURE() << "no CTypeError";
+    }
+    catch(const CTypeError& e)
+    {
+        EXPECT_EQ(e.line, 7);
+    }
+}
+
+TEST(TypeSuite, Layout)
+{
+    TypeContext context;
+    LayoutEngine engine;
+
+    auto char_type = context.basic(BasicCTypeType::CHAR, BasicCTypeSignedness::NOT_SET);
+    auto short_type = context.basic(BasicCTypeType::SHORT_INT, BasicCTypeSignedness::UNSIGNED);
+    auto int_type = context.basic(BasicCTypeType::INT, BasicCTypeSignedness::SIGNED);
+
+    EXPECT_EQ(engine.size_of(*char_type), 1);
+    EXPECT_EQ(engine.size_of(*short_type), 2);
+    EXPECT_EQ(engine.align_of(*int_type), 4);
+    EXPECT_EQ(engine.size_of(*context.pointer(char_type)), 8);
+
+    // short [3][5]
+    auto array = context.array(context.array(short_type, 5), 3);
+    EXPECT_EQ(engine.size_of(*array), 30);
+    EXPECT_EQ(engine.align_of(*array), 2);
+    EXPECT_EQ(&engine.layout(*array), &engine.layout(*context.array(context.array(short_type, 5), 3)));
+
+    EXPECT_THROW(engine.size_of(*context.void_type()), CTypeError);
+    EXPECT_THROW(engine.size_of(*context.function(int_type)), CTypeError);
+    EXPECT_THROW(engine.size_of(*context.array(int_type, 0)), CTypeError);
+
+    // Target ABI is configurable.
+    TargetAbi ilp32 = X86_64SysV;
+    ilp32.pointer_size = ilp32.pointer_align = 4;
+    EXPECT_EQ(LayoutEngine(ilp32).size_of(*context.array(context.pointer(int_type), 2)), 8);
+}
@@ -0,0 +1,308 @@
+#include <cstdio>
+#include <cstdlib>
+#include <sys/wait.h>
+#include <gtest/gtest.h>
+
+#include "assembler.h"
+#include "ir.h"
+#include "passes.h"
+#include "emitter.h"
+#include "peephole.h"
+#include "switch.h"
+#include "writer.h"
+
+// (test_opt.cpp)
+std::unique_ptr<IrModule> build_ssa(const std::string& src);
+
+// Assembly for a translation unit (optimised as by the compiler driver).
+static std::string assemble(const std::string& src, int level = 2)
+{
+    auto module = build_ssa(src);
+    PassManager(level).run(*module);
+    std::string text;
+    {
+        BufferedWriter writer(text);
+        AsmEmitter(writer, *module, level).emit_module(*module);
+    }
+    return text;
+}
+
+// Assembly after the peephole optimizer.
+static std::string peephole(const std::string& text)
+{
+    std::vector<MachineInstr> code = Assembler::parse(text);
+    PeepholeOptimizer(code).run();
+    std::string result;
+    {
+        BufferedWriter writer(result);
+        for(const MachineInstr& instr : code) writer << instr;
+    }
+    return result;
+}
+
+// Assemble and link a program with the system compiler driver, run it, and return its
+// exit status (or -1 if it could not be built).
+static int run_program(const std::string& src)
+{
+    std::string path = testing::TempDir() + "lc2_emitter_test";
+    std::FILE * file = std::fopen((path + ".s").c_str(), "w");
+    if(!file) return -1;
+    std::string text = assemble(src);
+    std::fwrite(text.data(), 1, text.size(), file);
+    std::fclose(file);
+
+    if(std::system(("cc -o " + path + " " + path + ".s").c_str()) != 0) return -1;
+    int status = std::system((path + " > /dev/null").c_str());
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+TEST(EmitterSuite, Writer)
+{
+    std::string text;
+    {
+        BufferedWriter writer(text);
+        for(size_t i = 0;i < BufferedWriter::Capacity;i++)
+        {
+            writer << 'x';
+        }
+        writer << ' ' << 0 << ' ' << -42 << ' ' << INT64_MIN << ' ' << UINT64_MAX << ' ' << std::string("end");
+    }
+    EXPECT_EQ(text.size(), BufferedWriter::Capacity + 52);
+    EXPECT_EQ(text.substr(BufferedWriter::Capacity),
+        " 0 -42 -9223372036854775808 18446744073709551615 end");
+}
+
+TEST(EmitterSuite, Function)
+{
+    // Arguments are used where they arrive, and there is no frame.
+    EXPECT_EQ(assemble("int f ( int a , int b ) { return a + b * 2 ; }"),
+        "\t.text\n"
+        "\t.globl f\n"
+        "\t.type f, @function\n"
+        "f:\n"
+        ".L0_0:\n"
+        "\tleal (%rdi,%rsi,2), %edi\n"
+        "\tmovl %edi, %eax\n"
+        "\tret\n"
+        "\t.size f, .-f\n"
+        "\t.section .note.GNU-stack,\"\",@progbits\n"
+    );
+}
+
+TEST(EmitterSuite, Data)
+{
+    std::string text = assemble("char * s = \"a\" ; int n = 258 ; int z ;");
+    EXPECT_NE(text.find(
+        "\t.data\n"
+        "\t.globl s\n"
+        "\t.balign 8\n"
+        "\t.type s, @object\n"
+        "\t.size s, 8\n"
+        "s:\n"
+        "\t.quad .str0\n"), std::string::npos);
+    EXPECT_NE(text.find("n:\n\t.ascii \"\\002\\001\\000\\000\"\n"), std::string::npos);
+    EXPECT_NE(text.find("\t.bss\n\t.globl z\n"), std::string::npos);
+    EXPECT_NE(text.find(".str0:\n\t.ascii \"a\"\n\t.zero 1\n"), std::string::npos);
+
+    // Escape sequences are decoded.
+    text = assemble("char * s = \"%d\\n\" ;");
+    EXPECT_NE(text.find(".str0:\n\t.ascii \"%d\\012\"\n\t.zero 1\n"), std::string::npos);
+}
+
+TEST(EmitterSuite, FusedBranch)
+{
+    // The comparison for the loop's condition sets the flags for the branch.
+    std::string text = assemble("int f ( int a , int b ) { while ( a < b ) { a = a + a ; } return a ; }");
+    EXPECT_NE(text.find("\tcmpl %esi, %edi\n\tjge "), std::string::npos);
+    EXPECT_EQ(text.find("set"), std::string::npos);
+}
+
+TEST(EmitterSuite, Select)
+{
+    // '?:' is a cmov on the flags of its condition, with no branch.
+    std::string text = assemble("int f ( int a , int b ) { return a < b ? a : b ; }");
+    EXPECT_NE(text.find("\tcmpl %esi, %edi\n\tcmovl %edi, %esi\n"), std::string::npos);
+    EXPECT_EQ(text.find("\tj"), std::string::npos);
+    text = assemble("int f ( int a , int b ) { return a ? a + 1 : b * 2 ; }");
+    EXPECT_NE(text.find("\tcmovne "), std::string::npos);
+
+    // '&&' of two comparisons is an and of their setcc.
+    text = assemble("int f ( int a , int b , int c ) { return a < b && b < c ; }");
+    EXPECT_NE(text.find("\tandl "), std::string::npos);
+    EXPECT_EQ(text.find("\tj"), std::string::npos);
+
+    // A division is not speculated.
+    text = assemble("int f ( int a , int b ) { return b ? a / b : 0 ; }");
+    EXPECT_EQ(text.find("cmov"), std::string::npos);
+}
+
+TEST(EmitterSuite, Selection)
+{
+    // Addressing modes.
+    std::string text = assemble("int f ( int * p , int i ) { return p [ i ] ; }");
+    EXPECT_NE(text.find("\tmovl (%rdi,%rsi,4), "), std::string::npos);
+    text = assemble("char * s ; int f ( ) { return s [ 3 ] ; }");
+    EXPECT_NE(text.find("\tmovq s(%rip), %rdi\n\tmovsbl 3(%rdi), "), std::string::npos);
+
+    // Read-modify-write, and operands in memory.
+    text = assemble("int n ; int f ( int x ) { n += x ; return 0 ; }");
+    EXPECT_NE(text.find("\taddl %edi, n(%rip)\n"), std::string::npos);
+    text = assemble("int f ( int * p , int b ) { return p [ 2 ] + b ; }");
+    EXPECT_NE(text.find("\taddl 8(%rdi), %esi\n"), std::string::npos);
+    text = assemble("int f ( int * p , int b ) { return p [ 1 ] < b ; }");
+    EXPECT_NE(text.find("\tcmpl %esi, 4(%rdi)\n\tsetl %al\n"), std::string::npos);
+
+    // lea, and test for a mask.
+    text = assemble("int f ( int a ) { return a * 5 ; }");
+    EXPECT_NE(text.find("\tleal (%rdi,%rdi,4), "), std::string::npos);
+    text = assemble("int f ( int a , int b ) { while ( ( a & b ) == 0 ) { a = a + 1 ; } return a ; }");
+    EXPECT_NE(text.find("\ttestl %edi, %esi\n\tjne "), std::string::npos);
+}
+
+TEST(EmitterSuite, Switch)
+{
+    // Consecutive cases with one target are a range; dense ones are a jump table.
+    SwitchPlan plan({{5, 1}, {3, 1}, {4, 1}, {100, 2}}, INT32_MIN, INT32_MAX);
+    ASSERT_EQ(plan.clusters.size(), 2u);
+    EXPECT_EQ(plan.clusters[0].kind, SwitchClusterKind::RANGE);
+    EXPECT_EQ(plan.clusters[0].low, 3);
+    EXPECT_EQ(plan.clusters[0].high, 5);
+    plan = SwitchPlan({{1, 1}, {2, 2}, {4, 3}, {6, 1}, {7, 4}, {50, 5}}, INT32_MIN, INT32_MAX);
+    ASSERT_EQ(plan.clusters.size(), 2u);
+    EXPECT_EQ(plan.clusters[0].kind, SwitchClusterKind::TABLE);
+    EXPECT_EQ(plan.clusters[0].table, std::vector<uint32_t>({1, 2, 0, 3, 0, 1, 4}));
+
+    // Sparse cases to few targets are bit tests, with a mask for each target.
+    plan = SwitchPlan({{0, 1}, {10, 1}, {20, 1}, {63, 1}, {3, 2}, {40, 2}, {41, 3}}, INT32_MIN, INT32_MAX);
+    ASSERT_EQ(plan.clusters.size(), 1u);
+    EXPECT_EQ(plan.clusters[0].kind, SwitchClusterKind::BITS);
+    ASSERT_EQ(plan.clusters[0].masks.size(), 3u);
+    EXPECT_EQ(plan.clusters[0].masks[1], std::make_pair(2u, (uint64_t(1) << 3) | (uint64_t(1) << 40)));
+
+    // Otherwise, a balanced tree of comparisons.
+    std::vector<SwitchCase> cases;
+    for(uint32_t i = 0;i < 12;i++) cases.push_back({int64_t(i) * 1000, i + 1});
+    plan = SwitchPlan(cases, INT32_MIN, INT32_MAX);
+    ASSERT_EQ(plan.nodes.size(), 7u);
+    EXPECT_EQ(plan.nodes[0].pivot, 6000);
+    EXPECT_EQ(plan.nodes[plan.nodes[0].left].high, 5999);
+
+    std::string text = assemble(
+        "int f ( int x ) { switch ( x ) { case 1 : return 3 ; case 2 : return 8 ; case 3 : case 4 : return 1 ; "
+        "case 5 : return 9 ; } return 0 ; }");
+    EXPECT_NE(text.find("\tleal -1(%rdi), %r11d\n\tcmpl $4, %r11d\n"), std::string::npos);
+    EXPECT_NE(text.find("\tjmp *(%rax,%r11,8)\n"), std::string::npos);
+    text = assemble(
+        "int f ( int x ) { switch ( x ) { case 1 : case 9 : case 17 : case 30 : return 3 ; } return 0 ; }");
+    EXPECT_NE(text.find("\tbtq %r11, %rax\n"), std::string::npos);
+}
+
+TEST(EmitterSuite, Peephole)
+{
+    // Moves to the same register, and back to where they came from, are removed (but not a
+    // doubleword move, which zeroes the upper half). A reload from a spill slot just stored
+    // is a register move.
+    EXPECT_EQ(peephole("\tmovq %rax, %rax\n\tmovl %eax, %eax\n\tmovq %rdi, %rax\n\tmovq %rax, %rdi\n"),
+        "\tmovl %eax, %eax\n\tmovq %rdi, %rax\n");
+    EXPECT_EQ(peephole("\tmovq %rax, -8(%rbp)\n\tmovq -8(%rbp), %rax\n\tmovl -8(%rbp), %ecx\n"),
+        "\tmovq %rax, -8(%rbp)\n\tmovl %eax, %ecx\n");
+    EXPECT_EQ(peephole("\tmovl %eax, %esi\n\tmovl %esi, %eax\n"), "\tmovl %eax, %esi\n\tmovl %esi, %eax\n");
+
+    // mov $0 is xor where the flags are dead (not between a cmp and a cmov, or before a label).
+    EXPECT_EQ(peephole("\tmovq $0, %rsi\n\tcmpl %edi, %edx\n\tjl .L0_1\n"),
+        "\txorl %esi, %esi\n\tcmpl %edi, %edx\n\tjl .L0_1\n");
+    EXPECT_EQ(peephole("\tcmpl %edi, %edx\n\tmovl $0, %esi\n\tcmovl %edi, %esi\n"),
+        "\tcmpl %edi, %edx\n\tmovl $0, %esi\n\tcmovl %edi, %esi\n");
+    EXPECT_EQ(peephole("\tmovl $0, %eax\n.L0_1:\n"), "\tmovl $0, %eax\n.L0_1:\n");
+
+    // Immediates are merged, and compared with zero by test.
+    EXPECT_EQ(peephole("\taddq $8, %rsp\n\tsubq $24, %rsp\n\tret\n"), "\tsubq $16, %rsp\n\tret\n");
+    EXPECT_EQ(peephole("\taddl $1, %eax\n\tsubl $1, %eax\n\tret\n"), "\tret\n");
+    EXPECT_EQ(peephole("\taddl $1, %eax\n\tsubl $1, %eax\n\tjl .L0_1\n"),
+        "\taddl $1, %eax\n\tsubl $1, %eax\n\tjl .L0_1\n");
+    EXPECT_EQ(peephole("\tcmpl $0, %edi\n\tcmpq $0, 8(%rdi)\n"), "\ttestl %edi, %edi\n\tcmpq $0, 8(%rdi)\n");
+
+    // Jumps to jumps go to their targets, a branch over a jump is inverted, and jumps to the
+    // next instruction are removed.
+    EXPECT_EQ(peephole(".L0_0:\n\tjl .L0_2\n\tjmp .L0_3\n.L0_1:\n\tret\n.L0_2:\n\tjmp .L0_1\n.L0_3:\n\tjmp .L0_4\n.L0_4:\n\tret\n"),
+        ".L0_0:\n\tjge .L0_3\n.L0_1:\n\tret\n.L0_2:\n\tjmp .L0_1\n.L0_3:\n.L0_4:\n\tret\n");
+    EXPECT_EQ(peephole(".L0_1:\n\tjmp .L0_2\n.L0_2:\n\tjmp .L0_1\n\tjmp *(%rax,%r11,8)\n\t.data\n\t.quad .L0_1\n"),
+        ".L0_1:\n.L0_2:\n\tjmp .L0_1\n\tjmp *(%rax,%r11,8)\n\t.data\n\t.quad .L0_1\n");
+
+    // The emitter's code is not rewritten at -O0.
+    std::string text = assemble("int f ( int x ) { return x ? 1 : 0 ; }", 0);
+    EXPECT_NE(text.find("\tmovq $0, %rdi\n"), std::string::npos);
+    EXPECT_EQ(text.find("\txorl %edi, %edi\n"), std::string::npos);
+}
+
+TEST(EmitterSuite, Programs)
+{
+    if(std::system("cc --version > /dev/null 2>&1") != 0)
+    {
+        GTEST_SKIP() << "No system compiler";
+    }
+
+    // Recursion, and values live across calls.
+    EXPECT_EQ(run_program(
+        "int fib ( int n ) { return n < 2 ? n : fib ( n - 1 ) + fib ( n - 2 ) ; }"
+        "int main ( ) { return fib ( 10 ) ; }"), 55);
+
+    // Arguments which swap registers.
+    EXPECT_EQ(run_program(
+        "int g ( int a , int b ) { return a - b ; }"
+        "int f ( int a , int b ) { return g ( b , a ) ; }"
+        "int main ( ) { return f ( 3 , 10 ) ; }"), 7);
+
+    // Arguments on the stack.
+    EXPECT_EQ(run_program(
+        "int h ( int a , int b , int c , int d , int e , int f , int g , int i , int j )"
+        "{ return a + 2 * b + 3 * c + 4 * d + 5 * e + 6 * f + 7 * g + 8 * i + 9 * j ; }"
+        "int k ( int a , int b , int c , int d , int e , int f , int g , int i , int j )"
+        "{ return h ( j , i , g , f , e , d , c , b , a ) + h ( b , a , d , c , f , e , i , g , j ) ; }"
+        "int main ( ) { return k ( 1 , 2 , 3 , 4 , 5 , 6 , 7 , 8 , 9 ) & 255 ; }"), 190);
+
+    // Division, shifts and unsigned arithmetic.
+    EXPECT_EQ(run_program(
+        "int f ( unsigned a , int n ) { return ( a >> n ) + ( a << n ) % 7 + a / 3 ; }"
+        "int main ( ) { return f ( 200 , 3 ) + f ( -5 , 1 ) ; }"), 176);
+
+    // Short-circuit operators and conditionals (phis).
+    EXPECT_EQ(run_program(
+        "int f ( int a , int b ) { return ( a && b ) + ( a || b ) * 2 + ( a ? b : 3 ) * 4 + ( a < b ) * 16 ; }"
+        "int main ( ) { return f ( 0 , 1 ) + f ( 1 , 0 ) * 3 + f ( 2 , 5 ) * 5 + f ( 0 , 0 ) * 7 ; }"), 59);
+
+    // Stack arrays, narrow types and globals.
+    EXPECT_EQ(run_program(
+        "short sh [ 3 ] ; char * s = \"abc\" ; "
+        "int main ( ) { char t [ 6 ] = \"hello\" ; short * p = sh ; p [ 0 ] = -3 ; p [ 1 ] = 40000 ; "
+        "unsigned char c = 250 ; c = c + 10 ; signed char d = -2 ; "
+        "return p [ 0 ] + ( p [ 1 ] < 0 ) * 10 + c + d * 2 + t [ 1 ] + s [ 2 ] ; }"), 207);
+
+    // More values live across calls than there are callee-saved registers (spills).
+    EXPECT_EQ(run_program(
+        "int g ( int x ) { return x * 3 + 1 ; }"
+        "int f ( int p ) { int a0 = g ( p ) ; int a1 = g ( a0 ) ; int a2 = g ( a1 ) ; int a3 = g ( a2 ) ; "
+        "int a4 = g ( a3 ) ; int a5 = g ( a4 ) ; int a6 = g ( a5 ) ; int a7 = g ( a6 ) ; int a8 = g ( a7 ) ; "
+        "return a0 ^ a1 ^ a2 ^ a3 ^ a4 ^ a5 ^ a6 ^ a7 ^ a8 ^ ( a0 - a8 ) ^ ( a1 * a7 ) ; }"
+        "int main ( ) { return f ( 1 ) & 255 ; }"), 137);
+
+    // Loops over arrays (strength-reduced), nested loops, 'break' and 'continue'.
+    EXPECT_EQ(run_program(
+        "int sum ( int * a , int n ) { int s = 0 ; for ( int i = 0 ; i < n ; i ++ ) s += a [ i ] * a [ n - 1 - i ] ; return s ; }"
+        "int main ( ) { int a [ 10 ] ; int i = 0 ; while ( i < 10 ) { a [ i ] = i * i ; i ++ ; } "
+        "int k = 0 ; do k += 3 ; while ( k < 20 ) ; for ( ; ; ) { k ++ ; break ; } "
+        "for ( i = 0 ; i < 5 ; i ++ ) { continue ; k = 0 ; } "
+        "return ( sum ( a , 10 ) + k ) & 255 ; }"), 198);
+    EXPECT_EQ(run_program(
+        "short m [ 4 ] [ 5 ] ; "
+        "int main ( ) { for ( int i = 0 ; i < 4 ; i ++ ) for ( int j = 0 ; j < 5 ; j ++ ) m [ i ] [ j ] = i * 10 - j ; "
+        "int s = 0 ; for ( int i = 3 ; i >= 0 ; i -- ) { char * p = \"abcdef\" ; for ( int j = 4 ; j > 0 ; j -= 2 ) "
+        "s += m [ i ] [ j ] + p [ j + 1 ] ; } return s & 255 ; }"), 136);
+
+    // Inlined calls in a loop: a callee with an array, and one with several returns.
+    EXPECT_EQ(run_program(
+        "int at ( int * p , int i ) { int t [ 2 ] ; t [ 0 ] = p [ i ] ; t [ 1 ] = i ; return t [ 0 ] + t [ 1 ] ; }"
+        "int clamp ( int x ) { while ( x > 9 ) return 9 ; return x ; }"
+        "int main ( ) { int a [ 5 ] ; int s = 0 ; for ( int i = 0 ; i < 5 ; i ++ ) a [ i ] = i * 3 ; "
+        "for ( int i = 0 ; i < 5 ; i ++ ) s += clamp ( at ( a , i ) ) ; return s ; }"), 30);
+}
@@ -0,0 +1,133 @@
+#include <iostream>
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "error.h"
+#include "lexer.h"
+#include "parser.h"
+#include "ast.h"
+#include "printer.h"
+#include "fold.h"
+
+std::shared_ptr<AstNode> fold(const char * src)
+{
+    ErrorReporter err;
+    std::vector<std::shared_ptr<Token>> tokens = Lexer(src, err).get_tokens();
+    std::shared_ptr<AstNode> ast_root = AstBuilder().build(*Parser().parse(tokens));
+    return ConstantFolder().fold(ast_root);
+}
+
+void expect_constant(const char * src, const char * expected_lexeme)
+{
+    auto primary = std::dynamic_pointer_cast<PrimaryExprAstNode>(fold(src));
+    ASSERT_TRUE(primary != nullptr) << src;
+    EXPECT_EQ(primary->token->type, TOK_INTEGER_CONSTANT);
+    EXPECT_EQ(primary->token->lexeme, expected_lexeme) << src;
+}
+
+void expect_folded_ast(const char * src, const char * expected_ast)
+{
+    std::string ast_str = PrinterVisitor().print(*fold(src));
+    EXPECT_STREQ(ast_str.c_str(), expected_ast);
+}
+
+TEST(FoldSuite, IntegerConstants)
+{
+    IntegerConstant value;
+    ASSERT_TRUE(parse_integer_constant("1024", value));
+    EXPECT_EQ(value.bits, 1024u);
+    EXPECT_FALSE(value.is_unsigned);
+
+    ASSERT_TRUE(parse_integer_constant("0x7fffffff", value));
+    EXPECT_FALSE(value.is_unsigned);
+    ASSERT_TRUE(parse_integer_constant("0xFFFFFFFF", value));
+    EXPECT_TRUE(value.is_unsigned);
+    ASSERT_TRUE(parse_integer_constant("017", value));
+    EXPECT_EQ(value.bits, 15u);
+    ASSERT_TRUE(parse_integer_constant("7u", value));
+    EXPECT_TRUE(value.is_unsigned);
+    ASSERT_TRUE(parse_integer_constant("-2147483648", value));
+    EXPECT_EQ(value.as_signed(), INT32_MIN);
+
+    EXPECT_FALSE(parse_integer_constant("2147483648", value));
+    EXPECT_FALSE(parse_integer_constant("0x100000000", value));
+    EXPECT_FALSE(parse_integer_constant("09", value));
+}
+
+TEST(FoldSuite, StringLiterals)
+{
+    EXPECT_EQ(parse_string_literal("\"abc\""), "abc");
+    EXPECT_EQ(parse_string_literal("\"%d\\n\\t\\\\\\\"\\'\\?\""), "%d\n\t\\\"'?");
+    EXPECT_EQ(parse_string_literal("\"\\0\\101\\1010\\x41g\\xff\""), std::string("\0A" "A0" "Ag\xff", 7));
+    EXPECT_EQ(parse_string_literal("\"\\q\""), "q");
+}
+
+TEST(FoldSuite, Arithmetic)
+{
+    expect_constant("( 4 * 1024 ) - 1", "4095");
+    expect_constant("7 / 2", "3");
+    expect_constant("-7 / 2", "-3");
+    expect_constant("-7 % 2", "-1");
+    expect_constant("1 << 4 | 3", "19");
+    expect_constant("-16 >> 2", "-4");
+    expect_constant("~ 0", "-1");
+    expect_constant("! 5", "0");
+    expect_constant("3 < 4 && 4 < 3", "0");
+}
+
+TEST(FoldSuite, UnsignedArithmetic)
+{
+    // Unsigned arithmetic wraps around. Mixed signed/unsigned operands are converted to
+    // unsigned int.
+    expect_constant("0xFFFFFFFF + 1", "0u");
+    expect_constant("0 - 0x80000000", "2147483648u");
+    expect_constant("-1 < 0xFFFFFFFF", "0");
+    expect_constant("0xFFFFFFFF >> 28", "15u");
+    expect_constant("- 0x80000000", "2147483648u");
+}
+
+TEST(FoldSuite, Undefined)
+{
+    // Undefined results are not folded.
+    expect_folded_ast("1 / 0", "(B (P CONSTANT), /, (P CONSTANT))");
+    expect_folded_ast("0x7FFFFFFF + 1", "(B (P CONSTANT), +, (P CONSTANT))");
+    expect_folded_ast("1 << 32", "(B (P CONSTANT), <<, (P CONSTANT))");
+    expect_folded_ast("-1 << 1", "(B (P CONSTANT), <<, (P CONSTANT))");
+}
+
+TEST(FoldSuite, Identities)
+{
+    // The other operand is kept under a unary +, so it is still promoted, and not an lvalue.
+    expect_folded_ast("x * 1", "(U +, (P IDENTIFIER))");
+    expect_folded_ast("1 * x", "(U +, (P IDENTIFIER))");
+    expect_folded_ast("x | ( 2 - 2 )", "(U +, (P IDENTIFIER))");
+    expect_folded_ast("x << 0", "(U +, (P IDENTIFIER))");
+    expect_folded_ast("! ! ( a < b )", "(B (P IDENTIFIER), <, (P IDENTIFIER))");
+
+    // Not identities (x + 0 could be pointer arithmetic, or decay an array).
+    expect_folded_ast("x + 0", "(B (P IDENTIFIER), +, (P CONSTANT))");
+    expect_folded_ast("! ! a", "(U !, (U !, (P IDENTIFIER)))");
+    expect_folded_ast("x + 0xFFFFFFFF * 0", "(B (P IDENTIFIER), +, (P CONSTANT))");
+    expect_folded_ast("0 - x", "(B (P CONSTANT), -, (P IDENTIFIER))");
+}
+
+TEST(FoldSuite, Conditional)
+{
+    expect_folded_ast("0 && a ( )", "(P CONSTANT)");
+    expect_folded_ast("2 || a ( )", "(P CONSTANT)");
+
+    // Constant operands have their common type (6.5.15, 5). The type of other operands is not
+    // known yet, so their conditional is not folded.
+    expect_constant("1 ? 1 : 0xFFFFFFFF", "1u");
+    expect_constant("0 ? 1 : 2", "2");
+    expect_folded_ast("1 ? a : b", "(T (P CONSTANT), (P IDENTIFIER), (P IDENTIFIER))");
+    expect_folded_ast("1 ? 1 : b", "(T (P CONSTANT), (P CONSTANT), (P IDENTIFIER))");
+    expect_folded_ast("a [ 2 * 3 ] = b ? 1 + 1 : c", "(A (PF [], (P IDENTIFIER), (P CONSTANT)), =, (T (P IDENTIFIER), (P CONSTANT), (P IDENTIFIER)))");
+}
+
+TEST(FoldSuite, DeepNesting)
+{
+    std::string src = "0";
+    for(int i = 0;i < 5000;i++) src += " + 1";
+    expect_constant(src.c_str(), "5000");
+}
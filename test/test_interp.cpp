@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+
+#include "ir.h"
+#include "interp.h"
+#include "passes.h"
+
+// (test_ir.cpp)
+std::unique_ptr<IrModule> lower(const std::string& src);
+
+// Run main as generated, and after each pass of the -O2 pipeline; each run must agree.
+static int64_t run_main(const std::string& src)
+{
+    auto module = lower(src);
+    int64_t expected = Interpreter(*module).run("main");
+    PassManager passes(2);
+    passes.observe([&](const std::string& pass, const IrModule& optimized)
+    {
+        EXPECT_EQ(Interpreter(optimized).run("main"), expected) << "after " << pass;
+    });
+    passes.run(*module);
+    return expected;
+}
+
+TEST(InterpSuite, Programs)
+{
+    EXPECT_EQ(run_main(
+        "int fib ( int n ) { return n < 2 ? n : fib ( n - 1 ) + fib ( n - 2 ) ; }"
+        "int main ( ) { return fib ( 15 ) ; }"), 610);
+
+    // Division, shifts and unsigned arithmetic, at each width.
+    EXPECT_EQ(run_main(
+        "int f ( unsigned a , int n ) { return ( a >> n ) + ( a << n ) % 7 + a / 3 ; }"
+        "int main ( ) { return f ( 200 , 3 ) + f ( -5 , 1 ) ; }"), -715827792);
+    EXPECT_EQ(run_main(
+        "int main ( ) { int x [ 8 ] ; int * p = x + 7 ; int a = -7 ; unsigned b = 5 ; unsigned short c = 65535 ; "
+        "signed char d = 127 ; d = d + 1 ; "
+        "return ( p - x ) * 1000 + ( a / 2 ) + ( a % 3 ) * 10 + ( b - 6 > b ) * 100 + ( c + 1 ) / 256 + d ; }"), 7215);
+
+    // A conditional with a constant condition still converts to the common type of its
+    // operands.
+    EXPECT_EQ(run_main(
+        "unsigned g0 ; int g2 = -1 ; unsigned short h = 65535 ; "
+        "int main ( ) { return ( ( 1 ? g2 : g0 ) % 3 == 0 ) + ( ( 1 ? g2 : g0 ) > 5 ) * 2 "
+        "+ ( ( 0 ? g2 : h ) + 1 ) / 4096 * 4 ; }"), 67);
+
+    // Phis which swap (a cycle of copies).
+    EXPECT_EQ(run_main(
+        "int main ( ) { int a = 1 , b = 2 , c = 3 ; for ( int i = 0 ; i < 5 ; i ++ ) { int t = a ; a = b ; b = c ; c = t ; } "
+        "return a * 100 + b * 10 + c ; }"), 312);
+
+    // Stack arrays, narrow types and globals.
+    EXPECT_EQ(run_main(
+        "short sh [ 3 ] ; char * s = \"abc\" ; "
+        "int main ( ) { char t [ 6 ] = \"hello\" ; short * p = sh ; p [ 0 ] = -3 ; p [ 1 ] = 40000 ; "
+        "unsigned char c = 250 ; c = c + 10 ; signed char d = -2 ; "
+        "return p [ 0 ] + ( p [ 1 ] < 0 ) * 10 + c + d * 2 + t [ 1 ] + s [ 2 ] ; }"), 207);
+
+    // Inlined calls in a loop, and more than six arguments.
+    EXPECT_EQ(run_main(
+        "int at ( int * p , int i ) { int t [ 2 ] ; t [ 0 ] = p [ i ] ; t [ 1 ] = i ; return t [ 0 ] + t [ 1 ] ; }"
+        "int clamp ( int x ) { while ( x > 9 ) return 9 ; return x ; }"
+        "int h ( int a , int b , int c , int d , int e , int f , int g , int i ) { return a - b + c - d + e - f + g * i ; }"
+        "int main ( ) { int a [ 5 ] ; int s = 0 ; for ( int i = 0 ; i < 5 ; i ++ ) a [ i ] = i * 3 ; "
+        "for ( int i = 0 ; i < 5 ; i ++ ) s += clamp ( at ( a , i ) ) ; return s + h ( 1 , 2 , 3 , 4 , 5 , 6 , 7 , 8 ) ; }"),
+        83);
+
+    // Vectorized loops, with odd trip counts, and arrays which overlap (the vector loop
+    // is skipped for 'a + 1', but not for 'a + 4' or 'a').
+    EXPECT_EQ(run_main(
+        "void add ( int * a , int * b , int * c , int n ) { for ( int i = 0 ; i < n ; i ++ ) c [ i ] = a [ i ] + b [ i ] ; }"
+        "void sub ( char * a , int n , char k ) { for ( int i = 0 ; i < n ; i ++ ) a [ i ] = a [ i ] - k ; }"
+        "void mask ( short * a , short * b , int n ) { for ( int i = 0 ; i < n ; i ++ ) b [ i ] = a [ i ] & 255 | 4096 ; }"
+        "int main ( ) { int a [ 41 ] ; char s [ 37 ] ; short t [ 23 ] ; int h = 0 ; "
+        "for ( int i = 0 ; i < 41 ; i ++ ) a [ i ] = i * i ; for ( int i = 0 ; i < 37 ; i ++ ) s [ i ] = i * 7 ; "
+        "for ( int i = 0 ; i < 23 ; i ++ ) t [ i ] = i * 1000 ; "
+        "add ( a , a , a + 1 , 20 ) ; add ( a , a + 2 , a + 4 , 30 ) ; add ( a , a , a , 37 ) ; "
+        "sub ( s , 37 , 3 ) ; sub ( s + 5 , 19 , -100 ) ; mask ( t , t , 23 ) ; mask ( t + 1 , t + 9 , 13 ) ; "
+        "for ( int i = 0 ; i < 41 ; i ++ ) h = h * 31 + a [ i ] ; for ( int i = 0 ; i < 37 ; i ++ ) h = h * 31 + s [ i ] ; "
+        "for ( int i = 0 ; i < 23 ; i ++ ) h = h * 31 + t [ i ] ; return h ; }"), 1563883761);
+
+    // Switches: a jump table, with fallthrough, a bit test, a tree of comparisons, and
+    // 'continue' and 'break' in a switch in a loop.
+    EXPECT_EQ(run_main(
+        "int dense ( int x ) { int r = 0 ; switch ( x ) { case 1 : r = 10 ; break ; case 2 : r = 20 ; case 3 : r = r + 30 ; break ; "
+        "case 4 : case 5 : return 55 ; case 7 : r = 70 ; break ; default : r = -1 ; } return r ; }"
+        "int bits ( int x ) { switch ( x ) { case 0 : case 10 : case 20 : case 30 : case 40 : case 50 : return 1 ; "
+        "case 3 : case 33 : case 45 : case 61 : return 2 ; } return 0 ; }"
+        "int sparse ( int x ) { switch ( x ) { case -1000000 : return 1 ; case 5 : return 2 ; case 1000 : return 3 ; "
+        "case 77777 : return 4 ; case 2147483647 : return 5 ; case -2147483647 - 1 : return 6 ; case 90 : return 7 ; } return 0 ; }"
+        "int main ( ) { int h = 0 ; for ( int i = -3 ; i < 100 ; i ++ ) { switch ( i % 4 ) { case 0 : continue ; case 1 : break ; "
+        "default : h = h + 1 ; } h = ( h * 7 + dense ( i ) + bits ( i ) * 3 + sparse ( i ) * 5 ) % 1000003 ; } "
+        "return h + sparse ( 77777 ) + sparse ( -2147483647 - 1 ) + sparse ( 2147483647 ) ; }"), 366981);
+
+    // Conditional expressions and '&&' / '||' (selects, at each width, and of pointers).
+    EXPECT_EQ(run_main(
+        "int pick ( int a , int b , int k ) { return k > 0 ? ( a & 255 ) << 2 : b >> 1 ; }"
+        "int main ( ) { int h = 0 ; char c = 0 ; short s = 0 ; int * p ; int a [ 2 ] ; a [ 0 ] = 5 ; a [ 1 ] = 7 ; "
+        "for ( int i = -20 ; i < 20 ; i ++ ) { int x = i * 7 % 11 ; int m = x < i ? x : i ; "
+        "int b = x > 3 && i < 5 || x == -2 ; char d = i & 1 ? c + 1 : c - 2 ; c = d ; s = x > 0 ? s * 3 : s + i ; "
+        "p = x < 0 ? a : a + 1 ; unsigned u = i ; "
+        "h = ( h * 31 + m * 3 + b + d + s + * p + ( u > 10 ? 1 : 2 ) + pick ( x , i , x - i ) ) % 1000003 ; } return h ; }"),
+        816881);
+
+    // Static locals are initialized once, by constants or addresses of static objects.
+    EXPECT_EQ(run_main(
+        "int x = 4 ; int g [ 3 ] ; int * p = & x ; int * q = g ; "
+        "int f ( int y ) { static int n = 1 ; static int * r = & n ; n = n + y ; return * r ; }"
+        "int h ( ) { static int a [ 2 ] ; static int * s = a ; s [ 0 ] = s [ 0 ] + 1 ; return a [ 0 ] ; }"
+        "int main ( ) { q [ 2 ] = 30 ; * p = * p + 1 ; return f ( 5 ) + f ( 7 ) + g [ 2 ] + x + h ( ) * 10 + h ( ) ; }"), 6 + 13 + 30 + 5 + 10 + 2);
+
+    // Escape sequences in string literals.
+    EXPECT_EQ(run_main(
+        "int strlen ( char * s ) ; char g [ 4 ] = \"\\x41\\n\" ; "
+        "int main ( ) { char t [ 3 ] = \"\\101\\\"\" ; return strlen ( \"a\\tb\\\\\\\"c\\n\" ) * 1000 + t [ 0 ] + t [ 1 ] + g [ 1 ] + g [ 2 ] ; }"),
+        7000 + 65 + 34 + 10);
+
+    // A library function.
+    EXPECT_EQ(run_main(
+        "int strlen ( char * s ) ; int main ( ) { return strlen ( \"hello\" ) ; }"), 5);
+}
+
+TEST(InterpSuite, Run)
+{
+    auto module = lower(
+        "int n ; int f ( int a , int b ) { n ++ ; return a * b - n ; } void g ( ) { n = 0 ; }");
+    Interpreter interpreter(*module);
+    EXPECT_EQ(interpreter.run("f", {6, 7}), 41);
+    EXPECT_EQ(interpreter.run("f", {-1, 3}), -5);
+    EXPECT_EQ(interpreter.run("g"), 0);
+    EXPECT_EQ(interpreter.run("f", {1, 1}), 0);
+    EXPECT_THROW(interpreter.run("h"), InterpreterError);
+}
+
+TEST(InterpSuite, Errors)
+{
+    auto module = lower(
+        "int d ( int a , int b ) { return a / b ; } int s ( int a , int b ) { return a << b ; }"
+        "int r ( int n ) { return r ( n + 1 ) ; }");
+    Interpreter interpreter(*module);
+    EXPECT_EQ(interpreter.run("d", {7, 2}), 3);
+    EXPECT_THROW(interpreter.run("d", {7, 0}), InterpreterError);
+    EXPECT_THROW(interpreter.run("d", {INT32_MIN, -1}), InterpreterError);
+    EXPECT_THROW(interpreter.run("s", {1, 32}), InterpreterError);
+    EXPECT_THROW(interpreter.run("r", {0}), InterpreterError);
+    EXPECT_EQ(interpreter.run("s", {1, 31}), INT32_MIN);
+
+    EXPECT_THROW(Interpreter(*lower("int nowhere ( ) ; int main ( ) { return nowhere ( ) ; }")), InterpreterError);
+}
@@ -0,0 +1,351 @@
+#include <iostream>
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "error.h"
+#include "lexer.h"
+#include "parser.h"
+#include "ast.h"
+#include "fold.h"
+#include "sema.h"
+#include "ir.h"
+#include "irgen.h"
+
+class MockErrorReporter : public ErrorReporter
+{
+    public:
+        MOCK_METHOD(void, report_error, (int line, const std::string& error), (override));
+};
+
+std::unique_ptr<IrModule> lower(const std::string& src)
+{
+    MockErrorReporter err;
+    EXPECT_CALL(err, report_error).Times(0);
+
+    TypeContext context;
+    std::vector<std::shared_ptr<Token>> tokens = Lexer(src, err).get_tokens();
+    auto ast = ConstantFolder().fold(AstBuilder(context).build(*Parser().parse(tokens)));
+    auto tu = std::dynamic_pointer_cast<TranslationUnitAstNode>(ast);
+    SemanticAnalyser(err, context, 1).analyse(*tu);
+
+    std::unique_ptr<IrModule> module(new IrModule);
+    IrGenerator(*module).generate(*tu);
+    for(auto& function : module->functions)
+    {
+        EXPECT_EQ(function->verify(), "");
+    }
+    return module;
+}
+
+// IR of the last function in a translation unit.
+std::string lower_function(const std::string& src)
+{
+    auto module = lower(src);
+    return ir_str(*module->functions.back(), module.get());
+}
+
+TEST(IrSuite, Function)
+{
+    // b0: branch to b1 or b2, which both jump to b3.
+    IrFunction f;
+    for(int i = 0;i < 4;i++) f.add_block();
+    IrValue p = f.append(0, IrOp::PARAM, IrType::I32, {}, 0);
+    IrValue one = f.append(0, IrOp::CONST, IrType::I32, {}, 1);
+    f.append(0, IrOp::BRANCH, IrType::VOID, {p});
+    f.add_edge(0, 1);
+    f.add_edge(0, 2);
+    IrValue sum = f.append(1, IrOp::ADD, IrType::I32, {p, one});
+    f.append(1, IrOp::JUMP, IrType::VOID);
+    f.add_edge(1, 3);
+    f.append(2, IrOp::JUMP, IrType::VOID);
+    f.add_edge(2, 3);
+    IrValue phi = f.append(3, IrOp::PHI, IrType::I32, {sum, p});
+    f.append(3, IrOp::RET, IrType::VOID, {phi});
+    EXPECT_EQ(f.verify(), "");
+
+    IrUses uses(f);
+    EXPECT_EQ(uses.count(p), 3u);
+    EXPECT_EQ(uses.count(one), 1u);
+    EXPECT_EQ(uses.users(sum)[0], phi);
+    EXPECT_EQ(uses.count(phi), 1u);
+
+    // Replace 'one' with a copy of the parameter.
+    std::vector<IrValue> replacements(f.instrs.size(), IrNone);
+    replacements[one] = p;
+    f.replace_uses(replacements);
+    EXPECT_EQ(f.operand(sum, 1), p);
+
+    // Jump straight to b2, so b1 (and its phi operand) is removed, then renumber.
+    f.blocks[0].succs = {2};
+    f.blocks[1].preds.clear();
+    f.blocks[0].code.pop_back();
+    f.append(0, IrOp::JUMP, IrType::VOID);
+    EXPECT_TRUE(f.remove_unreachable());
+    EXPECT_EQ(f.verify(), "");
+    f.compact();
+    EXPECT_EQ(f.verify(), "");
+    EXPECT_EQ(ir_str(f),
+        "function void ()\n"
+        "b0:\n"
+        "    %0 = param i32 0\n"
+        "    %1 = const i32 1\n"
+        "    jump b1\n"
+        "b1 <- b0:\n"
+        "    jump b2\n"
+        "b2 <- b1:\n"
+        "    %4 = phi i32 %0\n"
+        "    ret %4\n"
+    );
+}
+
+TEST(IrSuite, Verify)
+{
+    IrFunction f;
+    f.add_block();
+    f.add_block();
+    IrValue c = f.append(0, IrOp::CONST, IrType::I32, {}, 0);
+    f.append(0, IrOp::BRANCH, IrType::VOID, {c});
+    f.add_edge(0, 1);
+    EXPECT_EQ(f.verify(), "b0: wrong number of successors");
+
+    f.add_edge(0, 1);
+    f.append(1, IrOp::RET, IrType::VOID, {IrValue(10)});
+    EXPECT_EQ(f.verify(), "%2: invalid operand");
+}
+
+TEST(IrSuite, Evaluate)
+{
+    int64_t result;
+    EXPECT_TRUE(ir_evaluate(IrOp::ADD, IrType::I32, IrType::I32, INT32_MAX, 1, result));
+    EXPECT_EQ(result, INT32_MIN);
+    EXPECT_TRUE(ir_evaluate(IrOp::UDIV, IrType::I32, IrType::I32, -2, 2, result));
+    EXPECT_EQ(result, INT32_MAX);
+    EXPECT_TRUE(ir_evaluate(IrOp::SHR, IrType::I32, IrType::I32, -1, 28, result));
+    EXPECT_EQ(result, 15);
+    EXPECT_TRUE(ir_evaluate(IrOp::SAR, IrType::I32, IrType::I32, -16, 2, result));
+    EXPECT_EQ(result, -4);
+    EXPECT_TRUE(ir_evaluate(IrOp::ULT, IrType::I32, IrType::I32, 1, -1, result));
+    EXPECT_EQ(result, 1);
+    EXPECT_TRUE(ir_evaluate(IrOp::SLT, IrType::I32, IrType::I32, 1, -1, result));
+    EXPECT_EQ(result, 0);
+
+    // Conversions.
+    EXPECT_TRUE(ir_evaluate(IrOp::TRUNC, IrType::I8, IrType::I32, 300, 0, result));
+    EXPECT_EQ(result, 44);
+    EXPECT_TRUE(ir_evaluate(IrOp::ZEXT, IrType::I32, IrType::I16, -1, 0, result));
+    EXPECT_EQ(result, 65535);
+    EXPECT_TRUE(ir_evaluate(IrOp::SEXT, IrType::I64, IrType::I32, -1, 0, result));
+    EXPECT_EQ(result, -1);
+
+    // Undefined results.
+    EXPECT_FALSE(ir_evaluate(IrOp::SDIV, IrType::I32, IrType::I32, 1, 0, result));
+    EXPECT_FALSE(ir_evaluate(IrOp::SREM, IrType::I32, IrType::I32, INT32_MIN, -1, result));
+    EXPECT_TRUE(ir_evaluate(IrOp::SDIV, IrType::I64, IrType::I64, INT32_MIN, -1, result));
+    EXPECT_FALSE(ir_evaluate(IrOp::SHL, IrType::I32, IrType::I32, 1, 32, result));
+}
+
+TEST(IrSuite, Arithmetic)
+{
+    EXPECT_EQ(lower_function("int f ( int a , int b ) { return a + b * 2 ; }"),
+        "function i32 f(i32, i32)\n"
+        "b0:\n"
+        "    %0 = alloca i64 4\n"
+        "    %1 = alloca i64 4\n"
+        "    %2 = param i32 0\n"
+        "    store %0, %2\n"
+        "    %4 = param i32 1\n"
+        "    store %1, %4\n"
+        "    %6 = load i32 %0\n"
+        "    %7 = load i32 %1\n"
+        "    %8 = const i32 2\n"
+        "    %9 = mul i32 %7, %8\n"
+        "    %10 = add i32 %6, %9\n"
+        "    ret %10\n"
+    );
+
+    // Unsigned operations, and integer promotion of narrow values.
+    EXPECT_EQ(lower_function("unsigned f ( unsigned short s , unsigned u ) { return - s / u ; }"),
+        "function i32 f(i32, i32)\n"
+        "b0:\n"
+        "    %0 = alloca i64 2\n"
+        "    %1 = alloca i64 4\n"
+        "    %2 = param i32 0\n"
+        "    %3 = trunc i16 %2\n"
+        "    store %0, %3\n"
+        "    %5 = zext i32 %3\n"
+        "    %6 = param i32 1\n"
+        "    store %1, %6\n"
+        "    %8 = load i16 %0\n"
+        "    %9 = zext i32 %8\n"
+        "    %10 = neg i32 %9\n"
+        "    %11 = load i32 %1\n"
+        "    %12 = udiv i32 %10, %11\n"
+        "    ret %12\n"
+    );
+}
+
+TEST(IrSuite, Assignment)
+{
+    // Compound assignment to a char truncates, and the result is the value stored.
+    EXPECT_EQ(lower_function("int g ; void f ( ) { char c ; g = c += 300 ; }"),
+        "function void f()\n"
+        "b0:\n"
+        "    %0 = alloca i64 1\n"
+        "    %1 = global i64 @g\n"
+        "    %2 = const i32 300\n"
+        "    %3 = load i8 %0\n"
+        "    %4 = sext i32 %3\n"
+        "    %5 = add i32 %4, %2\n"
+        "    %6 = trunc i8 %5\n"
+        "    store %0, %6\n"
+        "    %8 = sext i32 %6\n"
+        "    store %1, %8\n"
+        "    ret\n"
+    );
+
+    // Pointer arithmetic is scaled by the element size.
+    EXPECT_EQ(lower_function("int f ( int * p , int * q ) { p ++ ; return p - q ; }"),
+        "function i32 f(i64, i64)\n"
+        "b0:\n"
+        "    %0 = alloca i64 8\n"
+        "    %1 = alloca i64 8\n"
+        "    %2 = param i64 0\n"
+        "    store %0, %2\n"
+        "    %4 = param i64 1\n"
+        "    store %1, %4\n"
+        "    %6 = load i64 %0\n"
+        "    %7 = const i64 4\n"
+        "    %8 = add i64 %6, %7\n"
+        "    store %0, %8\n"
+        "    %10 = load i64 %0\n"
+        "    %11 = load i64 %1\n"
+        "    %12 = sub i64 %10, %11\n"
+        "    %13 = const i64 4\n"
+        "    %14 = sdiv i64 %12, %13\n"
+        "    %15 = trunc i32 %14\n"
+        "    ret %15\n"
+    );
+}
+
+TEST(IrSuite, ControlFlow)
+{
+    // The right operand of '&&' is evaluated in its own block.
+    EXPECT_EQ(lower_function("int g ( ) ; int f ( int a ) { return a && g ( ) ; }"),
+        "function i32 f(i32)\n"
+        "b0:\n"
+        "    %0 = alloca i64 4\n"
+        "    %1 = param i32 0\n"
+        "    store %0, %1\n"
+        "    %3 = load i32 %0\n"
+        "    %4 = const i32 0\n"
+        "    %5 = ne i32 %3, %4\n"
+        "    %6 = const i32 0\n"
+        "    branch %5, b1, b2\n"
+        "b1 <- b0:\n"
+        "    %8 = global i64 @g\n"
+        "    %9 = call i32 %8\n"
+        "    %10 = const i32 0\n"
+        "    %11 = ne i32 %9, %10\n"
+        "    jump b2\n"
+        "b2 <- b0 b1:\n"
+        "    %13 = phi i32 %6, %11\n"
+        "    ret %13\n"
+    );
+
+    // Unreachable code (after 'return') is dropped.
+    EXPECT_EQ(lower_function("int * f ( int a , int * p ) { return a ? p : 0 ; a = 1 ; }"),
+        "function i64 f(i32, i64)\n"
+        "b0:\n"
+        "    %0 = alloca i64 4\n"
+        "    %1 = alloca i64 8\n"
+        "    %2 = param i32 0\n"
+        "    store %0, %2\n"
+        "    %4 = param i64 1\n"
+        "    store %1, %4\n"
+        "    %6 = load i32 %0\n"
+        "    %7 = const i32 0\n"
+        "    %8 = ne i32 %6, %7\n"
+        "    branch %8, b1, b2\n"
+        "b1 <- b0:\n"
+        "    %10 = load i64 %1\n"
+        "    jump b3\n"
+        "b2 <- b0:\n"
+        "    %12 = const i32 0\n"
+        "    %13 = sext i64 %12\n"
+        "    jump b3\n"
+        "b3 <- b1 b2:\n"
+        "    %15 = phi i64 %10, %13\n"
+        "    ret %15\n"
+    );
+}
+
+TEST(IrSuite, Switch)
+{
+    // A block for each label (the default's is successor 0), into which the previous
+    // label's code falls through; 'break' goes to the block after the switch (b1).
+    EXPECT_EQ(lower_function(
+        "int f ( int a ) { int r = 0 ; switch ( a ) { case 1 : r = 5 ; case -3 : return r ; default : break ; } return 7 ; }"),
+        "function i32 f(i32)\n"
+        "b0:\n"
+        "    %0 = alloca i64 4\n"
+        "    %1 = alloca i64 4\n"
+        "    %2 = param i32 0\n"
+        "    store %0, %2\n"
+        "    %4 = const i32 0\n"
+        "    store %1, %4\n"
+        "    %6 = load i32 %0\n"
+        "    %7 = const i32 1\n"
+        "    %8 = const i32 -3\n"
+        "    switch %6, %7, %8, b4, b2, b3\n"
+        "b1 <- b4:\n"
+        "    %10 = const i32 7\n"
+        "    ret %10\n"
+        "b2 <- b0:\n"
+        "    %12 = const i32 5\n"
+        "    store %1, %12\n"
+        "    jump b3\n"
+        "b3 <- b0 b2:\n"
+        "    %15 = load i32 %1\n"
+        "    ret %15\n"
+        "b4 <- b0:\n"
+        "    jump b1\n"
+    );
+}
+
+TEST(IrSuite, Symbols)
+{
+    auto module = lower(
+        "int g ; char s [ 4 ] = \"abc\" ; char * p = \"xy\" ; short h = - 2 ; int g ;"
+        "int f ( char c ) ; int k ( ) { return f ( 300 ) ; }"
+    );
+    EXPECT_EQ(ir_str(*module),
+        "object @g 4 4\n"
+        "object @s 4 1 = 616263\n"
+        "object @p 8 8 = @.str0\n"
+        "object @.str0 3 1 = 7879\n"
+        "object @h 2 2 = feff\n"
+        "declare @f\n"
+        "\n"
+        "function i32 k()\n"
+        "b0:\n"
+        "    %0 = global i64 @f\n"
+        "    %1 = const i32 300\n"
+        "    %2 = trunc i8 %1\n"
+        "    %3 = sext i32 %2\n"
+        "    %4 = call i32 %0, %3\n"
+        "    ret %4\n"
+    );
+}
+
+TEST(IrSuite, DeepExpression)
+{
+    // Lowering does not recurse.
+    std::string src = "int f ( int a ) { return a";
+    for(int i = 0;i < 2000;i++) src += " + a";
+    src += " ; }";
+
+    auto module = lower(src);
+    IrFunction& f = *module->functions.back();
+    EXPECT_EQ(f.instrs[f.operand(f.terminator(0), 0)].op, IrOp::ADD);
+    EXPECT_EQ(f.instrs.size(), 4005u);
+}
@@ -0,0 +1,203 @@
+#include <gtest/gtest.h>
+
+#include "ir.h"
+#include "assembler.h"
+#include "emitter.h"
+#include "jit.h"
+#include "passes.h"
+#include "writer.h"
+
+// (test_opt.cpp)
+std::unique_ptr<IrModule> build_ssa(const std::string& src);
+
+// Machine code for assembly text, in hex.
+static std::string encode(const std::string& text)
+{
+    Assembler assembler;
+    assembler.assemble(text);
+    std::string hex;
+    for(uint8_t b : assembler.section(Assembler::TEXT).bytes)
+    {
+        static const char Digits[] = "0123456789abcdef";
+        hex += Digits[b >> 4];
+        hex += Digits[b & 15];
+    }
+    return hex;
+}
+
+// Compile a program (optimised as by the compiler driver), and run its main in memory.
+static int run_program(const std::string& src)
+{
+    auto module = build_ssa(src);
+    PassManager(2).run(*module);
+    return Jit(*module).run();
+}
+
+TEST(JitSuite, Encoding)
+{
+    // (As encoded by GNU as.)
+    EXPECT_EQ(encode("movq %rsp, %rbp"), "4889e5");
+    EXPECT_EQ(encode("movl $-1, %eax"), "b8ffffffff");
+    EXPECT_EQ(encode("movq $-8, %r12"), "49c7c4f8ffffff");
+    EXPECT_EQ(encode("movb $5, %sil"), "40b605");
+    EXPECT_EQ(encode("movw %r8w, 2(%rsp)"), "664489442402");
+    EXPECT_EQ(encode("addl $1000, %eax"), "05e8030000");
+    EXPECT_EQ(encode("subq $16, %rsp"), "4883ec10");
+    EXPECT_EQ(encode("cmpb $7, (%rdi)"), "803f07");
+    EXPECT_EQ(encode("xorl %edx, %edx"), "31d2");
+    EXPECT_EQ(encode("imull $1000, %ecx, %edx"), "69d1e8030000");
+    EXPECT_EQ(encode("movq (%rax,%rcx,8), %r13"), "4c8b2cc8");
+    EXPECT_EQ(encode("leaq 4(,%rdx,4), %rax"), "488d049504000000");
+    EXPECT_EQ(encode("movl 0(%rbp), %eax"), "8b4500");
+    EXPECT_EQ(encode("movzbl %sil, %eax"), "400fb6c6");
+    EXPECT_EQ(encode("movslq %edi, %rax"), "4863c7");
+    EXPECT_EQ(encode("sarl -4(%rbp)"), "d17dfc");
+    EXPECT_EQ(encode("shlq %cl, %r9"), "49d3e1");
+    EXPECT_EQ(encode("sete %r10b"), "410f94c2");
+    EXPECT_EQ(encode("pushq %r15\npopq %rbx"), "41575b");
+    EXPECT_EQ(encode("idivl %ecx\ncqto"), "f7f94899");
+    EXPECT_EQ(encode("movabsq $81985529216486895, %rax"), "48b8efcdab8967452301");
+    EXPECT_EQ(encode("call *%r11\ntestl %eax, %eax"), "41ffd385c0");
+    EXPECT_EQ(encode("btq %r11, %rax"), "4c0fa3d8");
+    EXPECT_EQ(encode("cmovl %edi, %esi\ncmovne -8(%rbp), %r10"), "0f4cf74c0f4555f8");
+
+    EXPECT_THROW(encode("movl %eax, %rbx"), AssemblerError);
+    EXPECT_THROW(encode("frobq %rax"), AssemblerError);
+    EXPECT_THROW(encode("a:\na:"), AssemblerError);
+}
+
+TEST(JitSuite, Jumps)
+{
+    // Short jumps where the target is near, long ones otherwise.
+    EXPECT_EQ(encode("a: jmp a"), "ebfe");
+    EXPECT_EQ(encode("jne b\n.zero 127\nb:"), "757f" + std::string(254, '0'));
+    std::string text = encode("jne b\n.zero 128\nb: jmp a");
+    EXPECT_EQ(text.substr(0, 12), "0f8580000000");
+    EXPECT_EQ(text.substr(text.size() - 10), "e900000000");
+
+    // References to global symbols and other sections are left to the loader.
+    Assembler assembler;
+    assembler.assemble(".globl f\nf: call f\nleaq x(%rip), %rax\nret\n.data\nx: .quad f+8");
+    const AsmSection& section = assembler.section(Assembler::TEXT);
+    ASSERT_EQ(section.relocations.size(), 2u);
+    EXPECT_EQ(section.relocations[0].offset, 1u);
+    EXPECT_EQ(section.relocations[0].addend, -4);
+    EXPECT_EQ(section.relocations[1].symbol, assembler.find("x"));
+    const AsmSection& data = assembler.section(Assembler::DATA);
+    ASSERT_EQ(data.relocations.size(), 1u);
+    EXPECT_FALSE(data.relocations[0].relative);
+    EXPECT_EQ(data.relocations[0].addend, 8);
+}
+
+TEST(JitSuite, Load)
+{
+    Jit jit(
+        ".text\n.globl add\nadd:\n\tleal (%rdi,%rsi), %eax\n\tret\n"
+        ".globl count\ncount:\n\taddl $1, n(%rip)\n\tmovl n(%rip), %eax\n\tret\n"
+        ".bss\n.balign 4\nn:\n\t.zero 4\n");
+    auto add = reinterpret_cast<int (*)(int, int)>(reinterpret_cast<uintptr_t>(jit.address("add")));
+    EXPECT_EQ(add(40, 2), 42);
+    EXPECT_EQ(jit.run("count"), 1);
+    EXPECT_EQ(jit.run("count"), 2);
+    EXPECT_EQ(jit.address("missing"), nullptr);
+    EXPECT_THROW(jit.run("missing"), JitError);
+
+    EXPECT_THROW(Jit("call nowhere_at_all\n"), JitError);
+
+    // A guarded call reports a trap, and can be made again.
+    Jit traps("divide:\n\tmovl $1, %eax\n\tcltd\n\txorl %ecx, %ecx\n\tidivl %ecx\n\tret\n"
+        "null:\n\txorl %eax, %eax\n\tmovl (%rax), %eax\n\tret\n"
+        "deep:\n\tcall deep\n\tret\n"
+        "seven:\n\tmovl $7, %eax\n\tret\n");
+    EXPECT_THROW(traps.run_guarded("divide"), JitError);
+    EXPECT_THROW(traps.run_guarded("divide"), JitError);
+    EXPECT_THROW(traps.run_guarded("null"), JitError);
+    EXPECT_THROW(traps.run_guarded("deep"), JitError);
+    EXPECT_EQ(traps.run_guarded("seven"), 7);
+}
+
+TEST(JitSuite, Emitted)
+{
+    // The emitter's instructions are encoded as the assembly it writes is.
+    auto module = build_ssa(
+        "int n ; char * s = \"ab\" ; int f ( int x ) { switch ( x ) { case 1 : case 3 : case 4 : case 9 : return 2 ; } return x ; }"
+        "int main ( ) { int h = 0 ; for ( int i = 0 ; i < 30 ; i ++ ) h = h * 3 + f ( i ) + s [ i & 1 ] ; n = h ; return h ; }");
+    PassManager(2).run(*module);
+    std::string text;
+    {
+        BufferedWriter writer(text);
+        AsmEmitter(writer, *module).emit_module(*module);
+    }
+    Assembler assembled, emitted;
+    assembled.assemble(text);
+    AsmEmitter(emitted, *module).emit_module(*module);
+    emitted.finish();
+    for(int id = 0; id < Assembler::SectionCount; id++)
+    {
+        EXPECT_EQ(emitted.section(id).bytes, assembled.section(id).bytes);
+        EXPECT_EQ(emitted.section(id).relocations.size(), assembled.section(id).relocations.size());
+    }
+    EXPECT_EQ(emitted.symbols().size(), assembled.symbols().size());
+}
+
+TEST(JitSuite, Programs)
+{
+    EXPECT_EQ(run_program(
+        "int fib ( int n ) { return n < 2 ? n : fib ( n - 1 ) + fib ( n - 2 ) ; }"
+        "int main ( ) { return fib ( 10 ) ; }"), 55);
+
+    // Arguments on the stack.
+    EXPECT_EQ(run_program(
+        "int h ( int a , int b , int c , int d , int e , int f , int g , int i , int j )"
+        "{ return a + 2 * b + 3 * c + 4 * d + 5 * e + 6 * f + 7 * g + 8 * i + 9 * j ; }"
+        "int main ( ) { return h ( 9 , 8 , 7 , 6 , 5 , 4 , 3 , 2 , 1 ) ; }"), 165);
+
+    // Stack arrays, narrow types and globals (a pointer to a string literal).
+    EXPECT_EQ(run_program(
+        "short sh [ 3 ] ; char * s = \"abc\" ; "
+        "int main ( ) { char t [ 6 ] = \"hello\" ; short * p = sh ; p [ 0 ] = -3 ; p [ 1 ] = 40000 ; "
+        "unsigned char c = 250 ; c = c + 10 ; signed char d = -2 ; "
+        "return p [ 0 ] + ( p [ 1 ] < 0 ) * 10 + c + d * 2 + t [ 1 ] + s [ 2 ] ; }"), 207);
+
+    // Addresses of static objects as initializers.
+    EXPECT_EQ(run_program(
+        "int x = 4 ; int g [ 3 ] ; int * p = & x ; int * q = g ; "
+        "int f ( int y ) { static int n = 1 ; static int * r = & n ; n = n + y ; return * r ; }"
+        "int h ( ) { static int a [ 2 ] ; static int * s = a ; s [ 0 ] = s [ 0 ] + 1 ; return a [ 0 ] ; }"
+        "int main ( ) { q [ 2 ] = 30 ; * p = * p + 1 ; return f ( 5 ) + f ( 7 ) + g [ 2 ] + x + h ( ) * 10 + h ( ) ; }"), 66);
+
+    // Vectorized loops (SSE2).
+    EXPECT_EQ(run_program(
+        "void f ( short * a , short * b , int n , short k ) { for ( int i = 0 ; i < n ; i ++ ) b [ i ] = a [ i ] + k ^ a [ i ] ; }"
+        "int main ( ) { short a [ 30 ] ; int h = 0 ; for ( int i = 0 ; i < 30 ; i ++ ) a [ i ] = i * 1001 ; "
+        "f ( a , a , 30 , 77 ) ; f ( a + 1 , a + 10 , 19 , -3 ) ; "
+        "for ( int i = 0 ; i < 30 ; i ++ ) h = h * 31 + a [ i ] ; return h ; }"), 1392367086);
+
+    // Conditional expressions and '&&' / '||' (selects, at each width, and of pointers).
+    EXPECT_EQ(run_program(
+        "int pick ( int a , int b , int k ) { return k > 0 ? ( a & 255 ) << 2 : b >> 1 ; }"
+        "int main ( ) { int h = 0 ; char c = 0 ; short s = 0 ; int * p ; int a [ 2 ] ; a [ 0 ] = 5 ; a [ 1 ] = 7 ; "
+        "for ( int i = -20 ; i < 20 ; i ++ ) { int x = i * 7 % 11 ; int m = x < i ? x : i ; "
+        "int b = x > 3 && i < 5 || x == -2 ; char d = i & 1 ? c + 1 : c - 2 ; c = d ; s = x > 0 ? s * 3 : s + i ; "
+        "p = x < 0 ? a : a + 1 ; unsigned u = i ; "
+        "h = ( h * 31 + m * 3 + b + d + s + * p + ( u > 10 ? 1 : 2 ) + pick ( x , i , x - i ) ) % 1000003 ; } return h ; }"),
+        816881);
+
+    // Switches: a jump table, with fallthrough, a bit test, a tree of comparisons, and
+    // 'continue' and 'break' in a switch in a loop.
+    EXPECT_EQ(run_program(
+        "int dense ( int x ) { int r = 0 ; switch ( x ) { case 1 : r = 10 ; break ; case 2 : r = 20 ; case 3 : r = r + 30 ; break ; "
+        "case 4 : case 5 : return 55 ; case 7 : r = 70 ; break ; default : r = -1 ; } return r ; }"
+        "int bits ( int x ) { switch ( x ) { case 0 : case 10 : case 20 : case 30 : case 40 : case 50 : return 1 ; "
+        "case 3 : case 33 : case 45 : case 61 : return 2 ; } return 0 ; }"
+        "int sparse ( int x ) { switch ( x ) { case -1000000 : return 1 ; case 5 : return 2 ; case 1000 : return 3 ; "
+        "case 77777 : return 4 ; case 2147483647 : return 5 ; case -2147483647 - 1 : return 6 ; case 90 : return 7 ; } return 0 ; }"
+        "int main ( ) { int h = 0 ; for ( int i = -3 ; i < 100 ; i ++ ) { switch ( i % 4 ) { case 0 : continue ; case 1 : break ; "
+        "default : h = h + 1 ; } h = ( h * 7 + dense ( i ) + bits ( i ) * 3 + sparse ( i ) * 5 ) % 1000003 ; } "
+        "return h + sparse ( 77777 ) + sparse ( -2147483647 - 1 ) + sparse ( 2147483647 ) ; }"), 366981);
+
+    // Library functions.
+    EXPECT_EQ(run_program(
+        "int strlen ( char * s ) ; int abs ( int x ) ;"
+        "int main ( ) { return strlen ( \"hello\" ) + abs ( -10 ) ; }"), 15);
+}
@@ -202,8 +202,19 @@ TEST(LexerSuite, Constants)
     tokens = Lexer("0x1234567890abcdef", reporter).get_tokens();
     EXPECT_EQ(*tokens[0], Token(TOK_INTEGER_CONSTANT, 0, 0, "0x1234567890abcdef"));
 
+    tokens = Lexer("12;0x1f)", reporter).get_tokens();
+    EXPECT_EQ(*tokens[0], Token(TOK_INTEGER_CONSTANT, 0, 0, "12"));
+    EXPECT_EQ(*tokens[1], Token(';', 0, 2, ";"));
+    EXPECT_EQ(*tokens[2], Token(TOK_INTEGER_CONSTANT, 0, 3, "0x1f"));
+    EXPECT_EQ(*tokens[3], Token(')', 0, 7, ")"));
+
     tokens = Lexer("\"a string\"", reporter).get_tokens();
     EXPECT_EQ(*tokens[0], Token(TOK_STRING_LITERAL, 0, 0, "\"a string\""));
+
+    // An escaped quote does not end a string literal.
+    tokens = Lexer("\"a \\\" b\\\\\";", reporter).get_tokens();
+    EXPECT_EQ(*tokens[0], Token(TOK_STRING_LITERAL, 0, 0, "\"a \\\" b\\\\\""));
+    EXPECT_EQ(*tokens[1], Token(';', 0, 10, ";"));
 }
 
 TEST(LexerSuite, Identifiers)
@@ -0,0 +1,731 @@
+#include <iostream>
+#include <sstream>
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "error.h"
+#include "lexer.h"
+#include "parser.h"
+#include "ast.h"
+#include "fold.h"
+#include "sema.h"
+#include "ir.h"
+#include "irgen.h"
+#include "mem2reg.h"
+#include "sccp.h"
+#include "gvn.h"
+#include "dce.h"
+#include "simplifycfg.h"
+#include "dominators.h"
+#include "loops.h"
+#include "licm.h"
+#include "induction.h"
+#include "vectorize.h"
+#include "ifconvert.h"
+#include "passes.h"
+#include "inline.h"
+
+class MockErrorReporter : public ErrorReporter
+{
+    public:
+        MOCK_METHOD(void, report_error, (int line, const std::string& error), (override));
+};
+
+// Lower a translation unit, and promote its variables to SSA values.
+std::unique_ptr<IrModule> build_ssa(const std::string& src)
+{
+    MockErrorReporter err;
+    EXPECT_CALL(err, report_error).Times(0);
+
+    TypeContext context;
+    std::vector<std::shared_ptr<Token>> tokens = Lexer(src, err).get_tokens();
+    auto ast = ConstantFolder().fold(AstBuilder(context).build(*Parser().parse(tokens)));
+    auto tu = std::dynamic_pointer_cast<TranslationUnitAstNode>(ast);
+    SemanticAnalyser(err, context, 1).analyse(*tu);
+
+    std::unique_ptr<IrModule> module(new IrModule);
+    IrGenerator(*module).generate(*tu);
+    for(auto& function : module->functions)
+    {
+        Mem2Reg().run(*function);
+    }
+    return module;
+}
+
+// IR of the last function in a translation unit, after constant propagation.
+std::string propagate(const std::string& src)
+{
+    auto module = build_ssa(src);
+    IrFunction& function = *module->functions.back();
+    ConstantPropagation().run(function);
+    EXPECT_EQ(function.verify(), "");
+    return ir_str(function, module.get());
+}
+
+// IR of the last function in a translation unit, after value numbering.
+std::string number_values(const std::string& src)
+{
+    auto module = build_ssa(src);
+    IrFunction& function = *module->functions.back();
+    ValueNumbering().run(function);
+    EXPECT_EQ(function.verify(), "");
+    return ir_str(function, module.get());
+}
+
+TEST(OptSuite, ConstantBranches)
+{
+    // The call is behind a constant condition, so it disappears.
+    EXPECT_EQ(propagate("int g ( ) ; int f ( ) { int debug = 0 ; return debug && g ( ) ; }"),
+        "function i32 f()\n"
+        "b0:\n"
+        "    %0 = const i32 0\n"
+        "    %1 = const i32 0\n"
+        "    %2 = const i32 0\n"
+        "    %3 = const i32 0\n"
+        "    jump b1\n"
+        "b1 <- b0:\n"
+        "    %5 = const i32 0\n"
+        "    ret %5\n"
+    );
+
+    // Only the executable operand of the phi counts.
+    EXPECT_EQ(propagate("int f ( int a ) { int k = 1 ; int x = k ? 2 : a ; return x * 3 ; }"),
+        "function i32 f(i32)\n"
+        "b0:\n"
+        "    %0 = param i32 0\n"
+        "    %1 = const i32 1\n"
+        "    %2 = const i32 0\n"
+        "    %3 = const i32 1\n"
+        "    jump b1\n"
+        "b1 <- b0:\n"
+        "    %5 = const i32 2\n"
+        "    jump b2\n"
+        "b2 <- b1:\n"
+        "    %7 = const i32 2\n"
+        "    %8 = const i32 3\n"
+        "    %9 = const i32 6\n"
+        "    ret %9\n"
+    );
+
+    // A varying condition keeps both sides.
+    std::string ir = propagate("int g ( ) ; int f ( int a ) { int k = 1 ; return a && g ( ) + k ; }");
+    EXPECT_NE(ir.find("call"), std::string::npos);
+    EXPECT_NE(ir.find("branch"), std::string::npos);
+
+    // A switch on a constant goes to its case.
+    ir = propagate("int f ( ) { int k = 2 ; switch ( k ) { case 1 : return 10 ; case 2 : return 20 ; } return 30 ; }");
+    EXPECT_EQ(ir.find("switch"), std::string::npos);
+    EXPECT_NE(ir.find("const i32 20\n    ret"), std::string::npos);
+}
+
+TEST(OptSuite, ConstantArithmetic)
+{
+    // char wraps to -56; unsigned short is zero-extended.
+    std::string ir = propagate(
+        "int f ( ) { char c = 200 ; unsigned short s = 65535 ; return c + s + 1 ; }");
+    EXPECT_NE(ir.find("const i32 65480\n    ret"), std::string::npos);
+
+    // Unsigned and signed comparisons.
+    ir = propagate("int f ( ) { unsigned u = 0 ; int i = 0 ; return ( ( u - 1 > 0 ) << 1 ) | ( i - 1 > 0 ) ; }");
+    EXPECT_NE(ir.find("const i32 2\n    ret"), std::string::npos);
+
+    // Undefined results are not folded.
+    ir = propagate("int f ( ) { int z = 0 ; return 1 / z ; }");
+    EXPECT_NE(ir.find("sdiv"), std::string::npos);
+    ir = propagate("int f ( ) { int n = 32 ; return 1 << n ; }");
+    EXPECT_NE(ir.find("shl"), std::string::npos);
+}
+
+TEST(OptSuite, ValueNumbering)
+{
+    // The index computation and the load are only done once.
+    EXPECT_EQ(number_values("int f ( int * a , int i ) { return a [ i ] * a [ i ] ; }"),
+        "function i32 f(i64, i32)\n"
+        "b0:\n"
+        "    %0 = param i64 0\n"
+        "    %1 = param i32 1\n"
+        "    %2 = sext i64 %1\n"
+        "    %3 = const i64 4\n"
+        "    %4 = mul i64 %2, %3\n"
+        "    %5 = add i64 %0, %4\n"
+        "    %6 = load i32 %5\n"
+        "    %7 = mul i32 %6, %6\n"
+        "    ret %7\n"
+    );
+
+    // Expressions in a dominating block are available; 'b > a' is 'a < b', and testing
+    // it for '&&' gives the same value.
+    EXPECT_EQ(number_values("int f ( int a , int b ) { return ( a < b ) + ( a && b > a ) ; }"),
+        "function i32 f(i32, i32)\n"
+        "b0:\n"
+        "    %0 = param i32 0\n"
+        "    %1 = param i32 1\n"
+        "    %2 = slt i32 %0, %1\n"
+        "    %3 = const i32 0\n"
+        "    %4 = ne i32 %0, %3\n"
+        "    branch %4, b1, b2\n"
+        "b1 <- b0:\n"
+        "    jump b2\n"
+        "b2 <- b0 b1:\n"
+        "    %7 = phi i32 %3, %2\n"
+        "    %8 = add i32 %2, %7\n"
+        "    ret %8\n"
+    );
+
+    // Neither side of a conditional dominates the other.
+    EXPECT_EQ(number_values("int f ( int a , int b ) { return a ? b * 2 : b * 2 ; }"),
+        "function i32 f(i32, i32)\n"
+        "b0:\n"
+        "    %0 = param i32 0\n"
+        "    %1 = param i32 1\n"
+        "    %2 = const i32 0\n"
+        "    %3 = ne i32 %0, %2\n"
+        "    branch %3, b1, b2\n"
+        "b1 <- b0:\n"
+        "    %5 = const i32 2\n"
+        "    %6 = mul i32 %1, %5\n"
+        "    jump b3\n"
+        "b2 <- b0:\n"
+        "    %8 = const i32 2\n"
+        "    %9 = mul i32 %1, %8\n"
+        "    jump b3\n"
+        "b3 <- b1 b2:\n"
+        "    %11 = phi i32 %6, %9\n"
+        "    ret %11\n"
+    );
+
+    // A store may change the value loaded.
+    EXPECT_EQ(number_values("int f ( int * p , int * q ) { int x = * p ; * q = 1 ; return x + * p ; }"),
+        "function i32 f(i64, i64)\n"
+        "b0:\n"
+        "    %0 = param i64 0\n"
+        "    %1 = param i64 1\n"
+        "    %2 = load i32 %0\n"
+        "    %3 = const i32 1\n"
+        "    store %1, %3\n"
+        "    %5 = load i32 %0\n"
+        "    %6 = add i32 %2, %5\n"
+        "    ret %6\n"
+    );
+}
+
+TEST(OptSuite, DeadCode)
+{
+    auto module = build_ssa("int f ( int a ) { int x = a * 2 ; int y = x + 1 ; return a ; }");
+    IrFunction& function = *module->functions.back();
+    EXPECT_TRUE(DeadCodeElimination().run(function));
+    EXPECT_EQ(function.verify(), "");
+    EXPECT_EQ(ir_str(function),
+        "function i32 f(i32)\n"
+        "b0:\n"
+        "    %0 = param i32 0\n"
+        "    ret %0\n"
+    );
+    EXPECT_FALSE(DeadCodeElimination().run(function));
+}
+
+TEST(OptSuite, SimplifyCfg)
+{
+    // After constant propagation, the blocks of '?:' are merged into one.
+    auto module = build_ssa("int f ( int a ) { int k = 1 ; int x = k ? 2 : a ; return x * 3 ; }");
+    IrFunction& function = *module->functions.back();
+    ConstantPropagation().run(function);
+    EXPECT_TRUE(clean_up(function));
+    EXPECT_EQ(function.verify(), "");
+    EXPECT_EQ(ir_str(function),
+        "function i32 f(i32)\n"
+        "b0:\n"
+        "    %0 = const i32 6\n"
+        "    ret %0\n"
+    );
+
+    // When 'a' is false, the test of 'a && b' jumps straight past the call.
+    module = build_ssa("int g ( ) ; int f ( int a , int b ) { return ( a && b ) && g ( ) ; }");
+    IrFunction& threaded = *module->functions.back();
+    ValueNumbering().run(threaded);
+    EXPECT_TRUE(clean_up(threaded));
+    EXPECT_EQ(threaded.verify(), "");
+    EXPECT_EQ(ir_str(threaded, module.get()),
+        "function i32 f(i32, i32)\n"
+        "b0:\n"
+        "    %0 = param i32 0\n"
+        "    %1 = param i32 1\n"
+        "    %2 = const i32 0\n"
+        "    %3 = ne i32 %0, %2\n"
+        "    branch %3, b1, b3\n"
+        "b1 <- b0:\n"
+        "    %5 = ne i32 %1, %2\n"
+        "    %6 = ne i32 %5, %2\n"
+        "    branch %6, b2, b3\n"
+        "b2 <- b1:\n"
+        "    %8 = global i64 @g\n"
+        "    %9 = call i32 %8\n"
+        "    %10 = ne i32 %9, %2\n"
+        "    jump b3\n"
+        "b3 <- b1 b2 b0:\n"
+        "    %12 = phi i32 %2, %10, %2\n"
+        "    ret %12\n"
+    );
+
+    // The empty side of '?:' is removed.
+    module = build_ssa("int f ( int a , int b ) { return a ? b : 0 ; }");
+    IrFunction& forwarded = *module->functions.back();
+    EXPECT_TRUE(clean_up(forwarded));
+    EXPECT_EQ(forwarded.verify(), "");
+    EXPECT_EQ(ir_str(forwarded),
+        "function i32 f(i32, i32)\n"
+        "b0:\n"
+        "    %0 = param i32 0\n"
+        "    %1 = param i32 1\n"
+        "    %2 = const i32 0\n"
+        "    %3 = ne i32 %0, %2\n"
+        "    branch %3, b2, b1\n"
+        "b1 <- b0:\n"
+        "    %5 = const i32 0\n"
+        "    jump b2\n"
+        "b2 <- b1 b0:\n"
+        "    %7 = phi i32 %5, %1\n"
+        "    ret %7\n"
+    );
+}
+
+TEST(OptSuite, Loops)
+{
+    auto module = build_ssa(
+        "int f ( int n ) { int s = 0 ; for ( int i = 0 ; i < n ; i ++ ) { int j = 0 ; "
+        "while ( j < i ) { s += j ; j ++ ; } } do s -- ; while ( s > 100 ) ; return s ; }");
+    IrFunction& function = *module->functions.back();
+    DominatorTree tree(function);
+    LoopInfo info(function, tree);
+
+    // The 'while' is nested in the 'for'. The 'do' loop's header is its body.
+    ASSERT_EQ(info.loops().size(), 3u);
+    EXPECT_EQ(info.loop(0).header, 1u);
+    EXPECT_EQ(info.loop(0).parent, -1);
+    EXPECT_EQ(info.loop(0).blocks, std::vector<IrBlockId>({1, 2, 5, 8, 3, 6, 7}));
+    EXPECT_EQ(info.loop(1).header, 5u);
+    EXPECT_EQ(info.loop(1).parent, 0);
+    EXPECT_EQ(info.loop(1).depth, 2);
+    EXPECT_EQ(info.loop(2).blocks, std::vector<IrBlockId>({9, 10}));
+    EXPECT_EQ(info.loop_of(6), 1);
+    EXPECT_EQ(info.loop_of(0), -1);
+    EXPECT_TRUE(info.contains(0, 6));
+    EXPECT_FALSE(info.contains(1, 3));
+    EXPECT_EQ(info.preheader(function, 1), 2u);
+
+    // A header entered from two blocks outside the loop gets a preheader, with a phi for
+    // the values from outside.
+    IrFunction g;
+    g.name = "g";
+    g.result = IrType::I32;
+    for(int b = 0;b < 4;b++) g.add_block();
+    IrValue param = g.append(0, IrOp::PARAM, IrType::I32);
+    g.append(0, IrOp::BRANCH, IrType::VOID, {param});
+    IrValue five = g.append(2, IrOp::CONST, IrType::I32, {}, 5);
+    g.append(2, IrOp::JUMP, IrType::VOID);
+    IrValue phi = g.append(1, IrOp::PHI, IrType::I32, {param, five, IrNone});
+    IrValue one = g.append(1, IrOp::CONST, IrType::I32, {}, 1);
+    IrValue next = g.append(1, IrOp::ADD, IrType::I32, {phi, one});
+    g.set_operand(phi, 2, next);
+    g.append(1, IrOp::BRANCH, IrType::VOID, {next});
+    g.append(3, IrOp::RET, IrType::VOID, {phi});
+    g.add_edge(0, 1);
+    g.add_edge(0, 2);
+    g.add_edge(2, 1);
+    g.add_edge(1, 1);
+    g.add_edge(1, 3);
+
+    DominatorTree g_tree(g);
+    LoopInfo g_info(g, g_tree);
+    EXPECT_EQ(g_info.preheader(g, 0), IrNoBlock);
+    EXPECT_TRUE(insert_preheaders(g, g_info));
+    EXPECT_EQ(g.verify(), "");
+    EXPECT_EQ(ir_str(g),
+        "function i32 g()\n"
+        "b0:\n"
+        "    %0 = param i32 0\n"
+        "    branch %0, b4, b2\n"
+        "b1 <- b4 b1:\n"
+        "    %4 = phi i32 %9, %6\n"
+        "    %5 = const i32 1\n"
+        "    %6 = add i32 %4, %5\n"
+        "    branch %6, b1, b3\n"
+        "b2 <- b0:\n"
+        "    %2 = const i32 5\n"
+        "    jump b4\n"
+        "b3 <- b1:\n"
+        "    ret %4\n"
+        "b4 <- b0 b2:\n"
+        "    %9 = phi i32 %0, %2\n"
+        "    jump b1\n"
+    );
+}
+
+TEST(OptSuite, LoopInvariantCodeMotion)
+{
+    // 'k * 3 + 1' and the constants move to the preheader. The division is by a constant,
+    // so it cannot trap, but it depends on the load.
+    auto module = build_ssa(
+        "int f ( int * a , int n , int k ) { int s = 0 ; "
+        "for ( int i = 0 ; i < n ; i ++ ) s += a [ i ] * ( k * 3 + 1 ) / 2 ; return s ; }");
+    IrFunction& function = *module->functions.back();
+    ValueNumbering().run(function);
+    EXPECT_TRUE(LoopInvariantCodeMotion().run(function));
+    EXPECT_EQ(function.verify(), "");
+    EXPECT_EQ(ir_str(function),
+        "function i32 f(i64, i32, i32)\n"
+        "b0:\n"
+        "    %0 = param i64 0\n"
+        "    %1 = param i32 1\n"
+        "    %2 = param i32 2\n"
+        "    %3 = const i32 0\n"
+        "    %10 = const i64 4\n"
+        "    %14 = const i32 3\n"
+        "    %15 = mul i32 %2, %14\n"
+        "    %16 = const i32 1\n"
+        "    %17 = add i32 %15, %16\n"
+        "    %19 = const i32 2\n"
+        "    jump b1\n"
+        "b1 <- b0 b3:\n"
+        "    %5 = phi i32 %3, %21\n"
+        "    %6 = phi i32 %3, %23\n"
+        "    %7 = slt i32 %6, %1\n"
+        "    branch %7, b2, b4\n"
+        "b2 <- b1:\n"
+        "    %9 = sext i64 %6\n"
+        "    %11 = mul i64 %9, %10\n"
+        "    %12 = add i64 %0, %11\n"
+        "    %13 = load i32 %12\n"
+        "    %18 = mul i32 %13, %17\n"
+        "    %20 = sdiv i32 %18, %19\n"
+        "    %21 = add i32 %5, %20\n"
+        "    jump b3\n"
+        "b3 <- b2:\n"
+        "    %23 = add i32 %6, %16\n"
+        "    jump b1\n"
+        "b4 <- b1:\n"
+        "    ret %5\n"
+    );
+    EXPECT_FALSE(LoopInvariantCodeMotion().run(function));
+
+    // A division which might trap stays in the loop.
+    module = build_ssa(
+        "int f ( int n , int k ) { int s = 0 ; for ( int i = 0 ; i < n ; i ++ ) s += 100 / k ; return s ; }");
+    IrFunction& division = *module->functions.back();
+    LoopInvariantCodeMotion().run(division);
+    EXPECT_NE(ir_str(division).find("b2 <- b1:\n    %12 = sdiv i32 %11, %1\n"), std::string::npos);
+}
+
+TEST(OptSuite, StrengthReduction)
+{
+    // Each address in the loop is a pointer which is incremented with 'i'. 'a [ m ]' is
+    // invariant, and 'a [ i + 1 ]' starts at 'a + 4'.
+    auto module = build_ssa(
+        "int f ( int * a , int n , int m ) { int s = 0 ; "
+        "for ( int i = 0 ; i < n ; i ++ ) { s += a [ i ] + a [ i + 1 ] ; s += a [ m ] ; } return s ; }");
+    IrFunction& function = *module->functions.back();
+    ValueNumbering().run(function);
+    LoopInvariantCodeMotion().run(function);
+    EXPECT_TRUE(StrengthReduction().run(function));
+    EXPECT_EQ(function.verify(), "");
+    clean_up(function);
+    EXPECT_EQ(ir_str(function),
+        "function i32 f(i64, i32, i32)\n"
+        "b0:\n"
+        "    %0 = param i64 0\n"
+        "    %1 = param i32 1\n"
+        "    %2 = param i32 2\n"
+        "    %3 = const i32 0\n"
+        "    %4 = const i64 4\n"
+        "    %5 = const i32 1\n"
+        "    %6 = sext i64 %2\n"
+        "    %7 = mul i64 %6, %4\n"
+        "    %8 = add i64 %0, %7\n"
+        "    %9 = const i64 4\n"
+        "    %10 = add i64 %0, %9\n"
+        "    jump b1\n"
+        "b1 <- b0 b2:\n"
+        "    %12 = phi i64 %10, %28\n"
+        "    %13 = phi i64 %0, %26\n"
+        "    %14 = phi i32 %3, %24\n"
+        "    %15 = phi i32 %3, %19\n"
+        "    %16 = slt i32 %15, %1\n"
+        "    branch %16, b2, b3\n"
+        "b2 <- b1:\n"
+        "    %18 = load i32 %13\n"
+        "    %19 = add i32 %15, %5\n"
+        "    %20 = load i32 %12\n"
+        "    %21 = add i32 %18, %20\n"
+        "    %22 = add i32 %14, %21\n"
+        "    %23 = load i32 %8\n"
+        "    %24 = add i32 %22, %23\n"
+        "    %25 = const i64 4\n"
+        "    %26 = add i64 %13, %25\n"
+        "    %27 = const i64 4\n"
+        "    %28 = add i64 %12, %27\n"
+        "    jump b1\n"
+        "b3 <- b1:\n"
+        "    ret %14\n"
+    );
+
+    // Unsigned indexes are zero-extended, and may wrap, so they are left alone.
+    module = build_ssa(
+        "int f ( int * a , unsigned n ) { int s = 0 ; for ( unsigned i = 0 ; i < n ; i ++ ) s += a [ i ] ; return s ; }");
+    ValueNumbering().run(*module->functions.back());
+    EXPECT_FALSE(StrengthReduction().run(*module->functions.back()));
+}
+
+TEST(OptSuite, Vectorize)
+{
+    auto vectorize = [](const std::string& src, std::string& ir)
+    {
+        auto module = build_ssa(src);
+        IrFunction& function = *module->functions.back();
+        clean_up(function);
+        ValueNumbering().run(function);
+        LoopInvariantCodeMotion().run(function);
+        bool changed = LoopVectorizer().run(function);
+        EXPECT_EQ(function.verify(), "");
+        ir = ir_str(function);
+        return changed;
+    };
+    std::string ir;
+
+    // 'c [ i ] = a [ i ] + b [ i ] ^ k': the sum goes to a temporary, and the result straight
+    // to c. The invariant 'k' is splatted once, and the arrays are checked for overlap.
+    EXPECT_TRUE(vectorize(
+        "void f ( int * a , int * b , int * c , int n , int k ) { "
+        "for ( int i = 0 ; i < n ; i ++ ) c [ i ] = a [ i ] + b [ i ] ^ k ; }", ir));
+    EXPECT_NE(ir.find("vadd i32 %"), std::string::npos);
+    EXPECT_NE(ir.find("vxor i32 %"), std::string::npos);
+    EXPECT_EQ(ir.find("vor"), std::string::npos);
+    EXPECT_NE(ir.find(" uge i32 "), std::string::npos);
+
+    // chars, 16 at a time, with the constant splatted at compile time (0x0505...).
+    EXPECT_TRUE(vectorize(
+        "void f ( char * a , int n ) { for ( int i = 1 ; i < n ; i ++ ) a [ i ] = a [ i ] - 5 ; }", ir));
+    EXPECT_NE(ir.find("const i64 361700864190383365"), std::string::npos);
+    EXPECT_NE(ir.find("vsub i8 %"), std::string::npos);
+    EXPECT_NE(ir.find("const i32 16"), std::string::npos);
+
+    // A copy.
+    EXPECT_TRUE(vectorize(
+        "short g [ 100 ] ; void f ( short * a ) { for ( int i = 0 ; i < 100 ; i ++ ) g [ i ] = a [ i ] ; }", ir));
+    EXPECT_NE(ir.find("vor i16 %"), std::string::npos);
+
+    // Not vectorized: elements which are too close, a product, a call, and a read of the
+    // element after the one stored.
+    EXPECT_FALSE(vectorize(
+        "void f ( int * a , int n ) { for ( int i = 0 ; i < n ; i ++ ) a [ i + 1 ] = a [ i ] ; }", ir));
+    EXPECT_FALSE(vectorize(
+        "void f ( int * a , int n ) { for ( int i = 0 ; i < n ; i ++ ) a [ i ] = a [ i ] * 3 ; }", ir));
+    EXPECT_FALSE(vectorize(
+        "int g ( int x ) ; void f ( int * a , int n ) { for ( int i = 0 ; i < n ; i ++ ) a [ i ] = g ( i ) ; }", ir));
+    EXPECT_FALSE(vectorize(
+        "void f ( int * a , int * b , int n ) { for ( int i = 0 ; i < n ; i ++ ) { a [ i ] = 1 ; b [ i ] = a [ i + 1 ] ; } }",
+        ir));
+}
+
+TEST(OptSuite, IfConvert)
+{
+    auto convert = [](const std::string& src, std::string& ir)
+    {
+        auto module = build_ssa(src);
+        IrFunction& function = *module->functions.back();
+        clean_up(function);
+        bool changed = IfConverter().run(function);
+        EXPECT_EQ(function.verify(), "");
+        clean_up(function);
+        ir = ir_str(function);
+        return changed;
+    };
+    std::string ir;
+
+    EXPECT_TRUE(convert("int f ( int a , int b ) { return a < b ? a : b ; }", ir));
+    EXPECT_EQ(ir,
+        "function i32 f(i32, i32)\n"
+        "b0:\n"
+        "    %0 = param i32 0\n"
+        "    %1 = param i32 1\n"
+        "    %2 = slt i32 %0, %1\n"
+        "    %3 = const i32 0\n"
+        "    %4 = ne i32 %2, %3\n"
+        "    %5 = select i32 %4, %0, %1\n"
+        "    ret %5\n"
+    );
+
+    // '&&' and '||' of comparisons are an and and an or.
+    EXPECT_TRUE(convert("int f ( int a , int b , int c ) { return a < b && b < c ; }", ir));
+    EXPECT_NE(ir.find("= and i32 "), std::string::npos);
+    EXPECT_EQ(ir.find("branch"), std::string::npos);
+    EXPECT_TRUE(convert("int f ( int a , int b , int c ) { return a < b || b < c ; }", ir));
+    EXPECT_NE(ir.find("= or i32 "), std::string::npos);
+    EXPECT_EQ(ir.find("select"), std::string::npos);
+
+    // The inner diamond is converted first, and becomes part of the outer one's arm.
+    EXPECT_TRUE(convert("int f ( int a , int b , int c ) { return a < b ? ( b < c ? a + 1 : 2 ) : 3 ; }", ir));
+    EXPECT_EQ(ir.find("branch"), std::string::npos);
+    EXPECT_NE(ir.find("%12 = select i32 %8, %10, %11\n    %13 = const i32 3\n    %14 = select i32 %5, %12, %13\n"),
+        std::string::npos);
+
+    // A chain of diamonds is converted from the top, each join merged into the first header.
+    std::string chain = "int f ( int x ) { ";
+    for(int i = 0;i < 50;i++) chain += "x = x < " + std::to_string(i) + " ? x + 3 : x - 1 ; ";
+    EXPECT_TRUE(convert(chain + "return x ; }", ir));
+    EXPECT_EQ(ir.find("branch"), std::string::npos);
+    EXPECT_EQ(ir.find("\nb1:"), std::string::npos);
+
+    // Not converted: a division (which may trap), and an arm which costs too much.
+    EXPECT_FALSE(convert("int f ( int a , int b ) { return b ? a / b : 0 ; }", ir));
+    EXPECT_FALSE(convert("int f ( int a , int b ) { return b ? a * b * b * b : 0 ; }", ir));
+    EXPECT_FALSE(convert("int f ( int a , int b ) { return b ? a << b : 0 ; }", ir));
+}
+
+TEST(OptSuite, PassManager)
+{
+    auto names = [](const PassManager& passes)
+    {
+        std::vector<std::string> result;
+        for(const auto& stats : passes.stats()) result.push_back(stats.name);
+        return result;
+    };
+    EXPECT_TRUE(PassManager(0).stats().empty());
+    EXPECT_EQ(names(PassManager(1)), std::vector<std::string>({"mem2reg", "sccp", "clean-up"}));
+    EXPECT_EQ(names(PassManager(2)), std::vector<std::string>(
+        {"mem2reg", "sccp", "clean-up", "inline", "sccp", "gvn", "licm", "vectorize", "strength-reduction",
+         "if-convert", "clean-up"}));
+
+    // The loop already has a preheader, and nothing before LICM changes the CFG, so the
+    // dominator tree and the loops are computed once, and shared by GVN, LICM, the
+    // vectorizer (which finds no stores to vectorize) and strength reduction.
+    auto module = build_ssa(
+        "int f ( int * a , int n , int k ) { int s = 0 ; "
+        "for ( int i = 0 ; i < n ; i ++ ) s += a [ i ] * ( k + 1 ) ; return s ; }");
+    IrFunction& function = *module->functions.back();
+    size_t instrs = 0;
+    for(const auto& block : function.blocks) instrs += block.code.size();
+
+    PassManager passes(2);
+    EXPECT_TRUE(passes.run(function));
+    EXPECT_EQ(function.verify(), "");
+    EXPECT_EQ(passes.computed(Analysis::DOMINATORS), 1);
+    EXPECT_EQ(passes.computed(Analysis::FRONTIERS), 0);
+    EXPECT_EQ(passes.computed(Analysis::LOOPS), 1);
+
+    const auto& stats = passes.stats();
+    EXPECT_EQ(stats[0].runs, 1);
+    EXPECT_EQ(stats[0].changed, 0);
+    EXPECT_EQ(stats[0].instrs_before, instrs);
+    // (The inliner is a module pass, so it is skipped.)
+    EXPECT_EQ(stats[3].runs, 0);
+    for(size_t i = 1, last = 0;i < stats.size();i++)
+    {
+        if(stats[i].runs == 0) continue;
+        EXPECT_EQ(stats[i].instrs_before, stats[last].instrs_after);
+        EXPECT_EQ(stats[i].blocks_before, stats[last].blocks_after);
+        last = i;
+    }
+    EXPECT_EQ(stats[6].changed, 1);
+    EXPECT_EQ(stats[7].changed, 0);
+    EXPECT_EQ(stats[8].changed, 1);
+
+    std::stringstream report;
+    passes.report(report);
+    EXPECT_NE(report.str().find(" strength-reduction "), std::string::npos);
+    EXPECT_NE(report.str().find(" dominators "), std::string::npos);
+
+    // A pass which may change the CFG invalidates the cache, if it changes the function.
+    PassManager custom(0);
+    custom.add("split", [](IrFunction& f, AnalysisCache& cache)
+        {
+            cache.dominators();
+            return f.split_critical_edges();
+        }, false);
+    custom.add("dominators", [](IrFunction&, AnalysisCache& cache)
+        {
+            cache.dominators();
+            return false;
+        }, true);
+    module = build_ssa("int f ( int a , int b ) { return a && b ; }");
+    EXPECT_TRUE(custom.run(*module->functions.back()));
+    EXPECT_EQ(custom.computed(Analysis::DOMINATORS), 2);
+    EXPECT_FALSE(custom.run(*module->functions.back()));
+    EXPECT_EQ(custom.computed(Analysis::DOMINATORS), 3);
+    EXPECT_EQ(custom.stats()[0].runs, 2);
+    EXPECT_EQ(custom.stats()[0].changed, 1);
+}
+
+TEST(OptSuite, Inline)
+{
+    auto calls = [](const IrFunction& function)
+    {
+        int count = 0;
+        for(const auto& block : function.blocks)
+        {
+            for(IrValue value : block.code) count += function.instrs[value].op == IrOp::CALL;
+        }
+        return count;
+    };
+
+    // Accessors are inlined, with their parameters replaced by the arguments.
+    auto module = build_ssa(
+        "int get ( int * p , int i ) { return p [ i ] ; }"
+        "int f ( int * a ) { return get ( a , 1 ) + get ( a + 2 , 3 ) ; }");
+    EXPECT_TRUE(Inliner().run(*module));
+    IrFunction& f = *module->functions.back();
+    EXPECT_EQ(f.verify(), "");
+    EXPECT_EQ(calls(f), 0);
+    clean_up(f);
+    EXPECT_EQ(ir_str(f, module.get()),
+        "function i32 f(i64)\n"
+        "b0:\n"
+        "    %0 = param i64 0\n"
+        "    %1 = const i32 1\n"
+        "    %2 = sext i64 %1\n"
+        "    %3 = const i64 4\n"
+        "    %4 = mul i64 %2, %3\n"
+        "    %5 = add i64 %0, %4\n"
+        "    %6 = load i32 %5\n"
+        "    %7 = const i32 2\n"
+        "    %8 = sext i64 %7\n"
+        "    %9 = const i64 4\n"
+        "    %10 = mul i64 %8, %9\n"
+        "    %11 = add i64 %0, %10\n"
+        "    %12 = const i32 3\n"
+        "    %13 = sext i64 %12\n"
+        "    %14 = const i64 4\n"
+        "    %15 = mul i64 %13, %14\n"
+        "    %16 = add i64 %11, %15\n"
+        "    %17 = load i32 %16\n"
+        "    %18 = add i32 %6, %17\n"
+        "    ret %18\n"
+    );
+
+    // Several returns are merged by a phi. A recursive function is inlined into its callers,
+    // but not into itself.
+    module = build_ssa(
+        "int sign ( int x ) { while ( x < 0 ) return - 1 ; return x > 0 ; }"
+        "int fact ( int n ) { return n < 2 ? 1 : n * fact ( n - 1 ) ; }"
+        "int g ( int x ) { return sign ( x ) + fact ( x ) ; }");
+    EXPECT_TRUE(Inliner().run(*module));
+    for(auto& function : module->functions) EXPECT_EQ(function->verify(), "");
+    EXPECT_EQ(calls(*module->functions[1]), 1);
+    EXPECT_EQ(calls(*module->functions[2]), 1);
+    bool phi = false;
+    for(const auto& instr : module->functions[2]->instrs) phi = phi || instr.op == IrOp::PHI;
+    EXPECT_TRUE(phi);
+
+    // A large function is only inlined at its only call site.
+    std::string body = "int big ( int x ) { int s = 0 ;";
+    for(int i = 0;i < 30;i++) body += " s = s * x + " + std::to_string(i) + " ;";
+    body += " return s ; }";
+    module = build_ssa(body + "int h ( int x ) { return big ( x ) + big ( x + 1 ) ; }");
+    EXPECT_FALSE(Inliner().run(*module));
+    module = build_ssa(body + "int h ( int x ) { return big ( x ) ; }");
+    EXPECT_TRUE(Inliner().run(*module));
+    EXPECT_EQ(calls(*module->functions.back()), 0);
+    InlineParams params;
+    params.single_call_threshold = 0;
+    module = build_ssa(body + "int h ( int x ) { return big ( x ) ; }");
+    EXPECT_FALSE(Inliner(params).run(*module));
+}
@@ -87,4 +87,138 @@ TEST(ParserSuite, Assign)
     expect_ast("1 &= 1", "(A (P CONSTANT), &, (P CONSTANT))");
     expect_ast("1 ^= 1", "(A (P CONSTANT), ^, (P CONSTANT))");
     expect_ast("1 |= 1", "(A (P CONSTANT), |, (P CONSTANT))");
-}
\ No newline at end of file
+}
+
+TEST(ParserSuite, Declarations)
+{
+    expect_ast("int a ;", "(TU (D IDENTIFIER, [signed int]))");
+    expect_ast(
+        "static const int * const * p , b [ 2 ] [ 3 ] = 4 ;",
+        "(TU (D IDENTIFIER, [*, [const *, [static const signed int]]]), "
+        "(D IDENTIFIER, [[2], [[3], [static const signed int]]], (P CONSTANT)))");
+
+    // Array and function parameters are adjusted to pointers.
+    expect_ast(
+        "int f ( int a , char * , int b [ 3 ] , int g ( void ) ) ;",
+        "(TU (D IDENTIFIER, [([signed int], [*, [char]], [*, [signed int]], [*, [(), [signed int]]]), [signed int]]))");
+}
+
+TEST(ParserSuite, Statements)
+{
+    expect_ast(
+        "int f ( void ) { int a = 1 ; { a ; ; } return a + 1 ; }",
+        "(TU (F (D IDENTIFIER, [(), [signed int]]), (C (D IDENTIFIER, [signed int], (P CONSTANT)), "
+        "(C (ES (P IDENTIFIER)), (ES)), (R (B (P IDENTIFIER), +, (P CONSTANT))))))");
+    expect_ast(
+        "int f ( int a ) { return ; } int b ;",
+        "(TU (F (D IDENTIFIER, [([signed int]), [signed int]]), (D IDENTIFIER, [signed int]), (C (R))), "
+        "(D IDENTIFIER, [signed int]))");
+}
+
+TEST(ParserSuite, Loops)
+{
+    expect_ast(
+        "void f ( int n ) { while ( n ) n -- ; do { break ; } while ( 0 ) ; }",
+        "(TU (F (D IDENTIFIER, [([signed int]), [void]]), (D IDENTIFIER, [signed int]), "
+        "(C (WHILE (P IDENTIFIER), (ES (PF --, (P IDENTIFIER)))), (DO (C (BREAK)), (P CONSTANT)))))");
+    expect_ast(
+        "void f ( ) { for ( int i = 0 , j ; i < 2 ; i ++ ) continue ; for ( ; ; ) ; }",
+        "(TU (F (D IDENTIFIER, [(), [void]]), (C "
+        "(FOR (D IDENTIFIER, [signed int], (P CONSTANT)), (D IDENTIFIER, [signed int]); "
+        "(B (P IDENTIFIER), <, (P CONSTANT)); (PF ++, (P IDENTIFIER)); (CONTINUE)), "
+        "(FOR (ES); ; ; (ES)))))");
+
+    // 'break' and 'continue' must be in a loop.
+    for(const char * src : {"void f ( ) { break ; }", "void f ( ) { { continue ; } }"})
+    {
+        ErrorReporter err;
+        std::vector<std::shared_ptr<Token>> tokens = Lexer(src, err).get_tokens();
+        auto parse_root = Parser().parse(tokens);
+        EXPECT_THROW(AstBuilder().build(*parse_root), AstError) << src;
+    }
+}
+
+TEST(ParserSuite, Switch)
+{
+    expect_ast(
+        "void f ( int n ) { switch ( n ) { case 1 : n ++ ; case 2 : break ; default : { n = 0 ; } } }",
+        "(TU (F (D IDENTIFIER, [([signed int]), [void]]), (D IDENTIFIER, [signed int]), (C (SWITCH (P IDENTIFIER), "
+        "(C (CASE (P CONSTANT), (ES (PF ++, (P IDENTIFIER)))), (CASE (P CONSTANT), (BREAK)), "
+        "(DEFAULT (C (ES (A (P IDENTIFIER), =, (P CONSTANT))))))))))");
+    expect_ast(
+        "void f ( int n ) { while ( n ) switch ( n ) default : continue ; }",
+        "(TU (F (D IDENTIFIER, [([signed int]), [void]]), (D IDENTIFIER, [signed int]), "
+        "(C (WHILE (P IDENTIFIER), (SWITCH (P IDENTIFIER), (DEFAULT (CONTINUE)))))))");
+
+    // Labels must be in a switch, and 'continue' in a loop ('break' may be in either).
+    for(const char * src : {
+        "void f ( ) { case 1 : ; }", "void f ( ) { default : ; }", "void f ( int n ) { switch ( n ) { continue ; } }",
+        "void f ( int n ) { switch ( n ) ; case 2 : ; }"})
+    {
+        ErrorReporter err;
+        std::vector<std::shared_ptr<Token>> tokens = Lexer(src, err).get_tokens();
+        auto parse_root = Parser().parse(tokens);
+        EXPECT_THROW(AstBuilder().build(*parse_root), AstError) << src;
+    }
+}
+
+TEST(ParserSuite, DeclarationErrors)
+{
+    const char * invalid[] = {
+        "int x { }",
+        "int f ( int ) { }",
+        "int a [ 0 ] ;",
+        "void a [ 2 ] ;",
+        "int f ( ) [ 2 ] ;",
+        "int int a ;"
+    };
+    for(const char * src : invalid)
+    {
+        ErrorReporter err;
+        std::vector<std::shared_ptr<Token>> tokens = Lexer(src, err).get_tokens();
+        auto parse_root = Parser().parse(tokens);
+        EXPECT_THROW(AstBuilder().build(*parse_root), AstError) << src;
+    }
+}
+
+std::string nested(int depth, const std::string& left, const std::string& middle, const std::string& right)
+{
+    std::string src;
+    for(int i = 0;i < depth;i++) src += left;
+    src += middle;
+    for(int i = 0;i < depth;i++) src += right;
+    return src;
+}
+
+TEST(ParserSuite, DeepNesting)
+{
+    // Deeply nested parentheses do not add AST depth.
+    expect_ast(nested(20000, "( ", "1", " )").c_str(), "(P CONSTANT)");
+
+    // Long left-associative chains, and deep right-nested expressions.
+    std::string expected = nested(5000, "(B ", "(P IDENTIFIER)", ", +, (P IDENTIFIER))");
+    expect_ast(("a" + nested(5000, "", "", " + a")).c_str(), expected.c_str());
+
+    expected = nested(5000, "(U -, ", "(P IDENTIFIER)", ")");
+    expect_ast(nested(5000, "- ( ", "a", " )").c_str(), expected.c_str());
+}
+
+TEST(ParserSuite, DepthLimit)
+{
+    ErrorReporter err;
+    std::string src = "a" + nested(100, "", "", " + a");
+    std::vector<std::shared_ptr<Token>> tokens = Lexer(src, err).get_tokens();
+    auto parse_root = Parser().parse(tokens);
+
+    EXPECT_THROW(AstBuilder(50).build(*parse_root), AstError);
+    EXPECT_NO_THROW(AstBuilder(100).build(*parse_root));
+
+    src = nested(60, "- ", "a", "");
+    tokens = Lexer(src, err).get_tokens();
+    parse_root = Parser().parse(tokens);
+    EXPECT_THROW(AstBuilder(50).build(*parse_root), AstError);
+
+    auto ast = AstBuilder().build(*parse_root);
+    PrinterVisitor printer;
+    EXPECT_THROW(AstWalker(50).walk(ast, printer), AstError);
+}
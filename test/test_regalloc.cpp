@@ -0,0 +1,137 @@
+#include <chrono>
+#include <sstream>
+#include <gtest/gtest.h>
+
+#include "ir.h"
+#include "simplifycfg.h"
+#include "regalloc.h"
+
+// (test_opt.cpp)
+std::unique_ptr<IrModule> build_ssa(const std::string& src);
+
+// Check that no two values are in the same register or stack slot at once, and that no
+// value is in a caller-saved register across a call.
+static void check_allocation(const IrFunction& function, const LinearScan& allocation)
+{
+    const auto& intervals = allocation.all_intervals();
+    for(size_t i = 0;i < intervals.size();i++)
+    {
+        const LiveInterval& a = intervals[i];
+        ASSERT_NE(a.location.kind, Location::Kind::NONE) << "%" << a.value;
+        for(size_t j = i + 1;j < intervals.size();j++)
+        {
+            const LiveInterval& b = intervals[j];
+            if(a.location != b.location) continue;
+            EXPECT_EQ(a.intersection(b), UINT32_MAX) << "%" << a.value << " and %" << b.value;
+        }
+        if(a.location.kind != Location::Kind::REGISTER || is_callee_saved(a.location.reg)) continue;
+        for(IrValue value = 0;value < function.instrs.size();value++)
+        {
+            if(function.instrs[value].op == IrOp::CALL)
+            {
+                EXPECT_FALSE(a.covers(4 * value + 1)) << "%" << a.value << " across call %" << value;
+            }
+        }
+    }
+}
+
+TEST(RegAllocSuite, Parameters)
+{
+    // Arguments stay in the registers they are passed in, and the sum goes where 'a' was.
+    auto module = build_ssa("int f ( int a , int b ) { return a + b * 2 ; }");
+    IrFunction& function = *module->functions.back();
+    LinearScan allocation(function);
+    check_allocation(function, allocation);
+
+    EXPECT_EQ(allocation.result(0), Location::in(Register::RDI));
+    EXPECT_EQ(allocation.result(1), Location::in(Register::RSI));
+    IrValue ret = function.terminator(0);
+    EXPECT_EQ(allocation.operand(ret, 0), Location::in(Register::RDI));
+    EXPECT_EQ(allocation.spill_slots(), 0u);
+    EXPECT_FALSE(allocation.used(Register::RBX));
+}
+
+TEST(RegAllocSuite, AcrossCalls)
+{
+    // 'a' lives across the call, so it goes in a callee-saved register (the parameter
+    // instruction copies it there from rdi).
+    auto module = build_ssa("int g ( ) ; int f ( int a ) { return g ( ) + a ; }");
+    IrFunction& function = *module->functions.back();
+    LinearScan allocation(function);
+    check_allocation(function, allocation);
+
+    IrValue ret = function.terminator(0);
+    IrValue add = function.operand(ret, 0);
+    EXPECT_EQ(allocation.result(0), Location::in(Register::RBX));
+    EXPECT_EQ(allocation.operand(add, 1), Location::in(Register::RBX));
+    EXPECT_TRUE(allocation.used(Register::RBX));
+
+    // The call's result is not live across a call, so it gets a caller-saved register.
+    EXPECT_FALSE(is_callee_saved(allocation.operand(add, 0).reg));
+    EXPECT_EQ(allocation.operand(ret, 0), allocation.operand(add, 0));
+}
+
+TEST(RegAllocSuite, Pressure)
+{
+    // More live values than registers: some are spilled, and the slots are shared by
+    // values which are not live at the same time.
+    std::ostringstream src;
+    src << "int g ( ) ; int f ( int p ) { ";
+    for(int i = 0;i < 20;i++) src << "int a" << i << " = g ( ) + p ; ";
+    src << "int s = 0 ";
+    for(int i = 0;i < 20;i++) src << "+ a" << i << " ";
+    src << "; ";
+    for(int i = 0;i < 20;i++) src << "int b" << i << " = g ( ) * s ; ";
+    src << "return s ";
+    for(int i = 0;i < 20;i++) src << "+ b" << i << " ";
+    src << "; }";
+
+    auto module = build_ssa(src.str());
+    IrFunction& function = *module->functions.back();
+    LinearScan allocation(function);
+    check_allocation(function, allocation);
+    EXPECT_GT(allocation.spill_slots(), 0u);
+    EXPECT_LT(allocation.spill_slots(), 40u);
+    EXPECT_EQ(function.verify(), "");
+}
+
+TEST(RegAllocSuite, Branches)
+{
+    // Phis and values live across '&&' and '?:' edges; critical edges are split.
+    auto module = build_ssa(
+        "int g ( int x ) ; "
+        "int f ( int a , int b , int c ) "
+        "{ int x = a && g ( b ) ; int y = c ? x + a : b / c ; return x + y << a ; }"
+    );
+    IrFunction& function = *module->functions.back();
+    clean_up(function);
+    LinearScan allocation(function);
+    EXPECT_EQ(function.verify(), "");
+    check_allocation(function, allocation);
+
+    for(IrBlockId b = 0;b < function.blocks.size();b++)
+    {
+        const IrBlock& block = function.blocks[b];
+        for(IrBlockId succ : block.succs)
+        {
+            EXPECT_FALSE(block.succs.size() > 1 && function.blocks[succ].preds.size() > 1);
+        }
+    }
+}
+
+TEST(RegAllocSuite, LargeFunction)
+{
+    // Allocation time is linear in the size of the function.
+    std::ostringstream src;
+    src << "int g ( int x ) ; int f ( int a , int b ) { int x = a ; ";
+    for(int i = 0;i < 5000;i++) src << "x = x + b * " << i << " ; x = x ? g ( x ) : a ; ";
+    src << "return x ; }";
+    auto module = build_ssa(src.str());
+    IrFunction& function = *module->functions.back();
+
+    auto start = std::chrono::steady_clock::now();
+    LinearScan allocation(function);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_LT(std::chrono::duration_cast<std::chrono::seconds>(elapsed).count(), 2);
+    EXPECT_EQ(function.verify(), "");
+}
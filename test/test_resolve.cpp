@@ -0,0 +1,125 @@
+#include <iostream>
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "error.h"
+#include "lexer.h"
+#include "parser.h"
+#include "ast.h"
+#include "symbol.h"
+#include "resolve.h"
+
+class MockErrorReporter : public ErrorReporter
+{
+    public:
+        MOCK_METHOD(void, report_error, (int line, const std::string& error), (override));
+};
+
+std::shared_ptr<TranslationUnitAstNode> resolve(const std::string& src, ErrorReporter& err)
+{
+    std::vector<std::shared_ptr<Token>> tokens = Lexer(src, err).get_tokens();
+    auto ast = std::dynamic_pointer_cast<TranslationUnitAstNode>(AstBuilder().build(*Parser().parse(tokens)));
+    NameResolver(err).resolve(*ast);
+    return ast;
+}
+
+template<typename T>
+std::shared_ptr<T> item(const std::list<std::shared_ptr<AstNode>>& items, int index)
+{
+    auto it = items.begin();
+    std::advance(it, index);
+    return std::dynamic_pointer_cast<T>(*it);
+}
+
+DeclAstNode * resolved(const std::shared_ptr<ExprAstNode>& expr)
+{
+    return std::dynamic_pointer_cast<PrimaryExprAstNode>(expr)->declaration;
+}
+
+TEST(ResolveSuite, IdentifierTable)
+{
+    IdentifierTable identifiers;
+    EXPECT_EQ(identifiers.intern("a"), 0);
+    EXPECT_EQ(identifiers.intern("b"), 1);
+    EXPECT_EQ(identifiers.intern("a"), 0);
+    EXPECT_EQ(identifiers.name(1), "b");
+    EXPECT_EQ(identifiers.size(), 2);
+}
+
+TEST(ResolveSuite, SymbolTable)
+{
+    DeclAstNode a(nullptr, nullptr), b(nullptr, nullptr), c(nullptr, nullptr);
+    SymbolTable symbols;
+
+    EXPECT_EQ(symbols.declare(1, &a), nullptr);
+    symbols.push_scope();
+    EXPECT_EQ(symbols.lookup(1), &a);
+    EXPECT_EQ(symbols.declare(1, &b), nullptr);
+    EXPECT_EQ(symbols.declare(2, &c), nullptr);
+    EXPECT_EQ(symbols.declare(2, &b), &c);
+    EXPECT_EQ(symbols.lookup(1), &b);
+    EXPECT_EQ(symbols.depth(), 1);
+    symbols.pop_scope();
+
+    EXPECT_EQ(symbols.lookup(1), &a);
+    EXPECT_EQ(symbols.lookup(2), nullptr);
+    EXPECT_EQ(symbols.lookup(3), nullptr);
+
+    // Rehashing keeps all bindings, including shadowed ones.
+    symbols.push_scope();
+    for(int id = 0;id < 1000;id++) symbols.declare(id, &c);
+    EXPECT_EQ(symbols.lookup(999), &c);
+    symbols.pop_scope();
+    EXPECT_EQ(symbols.lookup(1), &a);
+    EXPECT_EQ(symbols.lookup(999), nullptr);
+}
+
+TEST(ResolveSuite, Scopes)
+{
+    MockErrorReporter err;
+    EXPECT_CALL(err, report_error).Times(0);
+
+    auto ast = resolve("int a ; int f ( int a ) { { int a = a ; a ; } return a ; } int g ( ) { return a ; }", err);
+    auto global = item<DeclAstNode>(ast->items, 0);
+    auto f = item<FunctionDefAstNode>(ast->items, 1);
+    auto g = item<FunctionDefAstNode>(ast->items, 2);
+
+    auto block = item<CompoundStmtAstNode>(f->body->items, 0);
+    auto local = item<DeclAstNode>(block->items, 0);
+    EXPECT_EQ(resolved(local->initializer), local.get());
+    EXPECT_EQ(resolved(item<ExprStmtAstNode>(block->items, 1)->expr), local.get());
+    EXPECT_EQ(resolved(item<ReturnStmtAstNode>(f->body->items, 1)->expr), f->parameters.front().get());
+    EXPECT_EQ(resolved(item<ReturnStmtAstNode>(g->body->items, 0)->expr), global.get());
+}
+
+TEST(ResolveSuite, Errors)
+{
+    MockErrorReporter err;
+    EXPECT_CALL(err, report_error(0, "Undeclared identifier 'b'"));
+    EXPECT_CALL(err, report_error(0, "Redeclaration of 'a'")).Times(2);
+    EXPECT_CALL(err, report_error(0, "Redefinition of 'c'"));
+    EXPECT_CALL(err, report_error(0, "Undeclared identifier 'x'"));
+
+    // File-scope declarations with the same type are allowed.
+    resolve("int c ; int c = 1 ; int c ; int c = 2 ;", err);
+    resolve("int a ; char a ; int f ( int a ) { int a ; return b ; }", err);
+    resolve("int f ( ) { { int x ; } return x ; }", err);
+}
+
+TEST(ResolveSuite, ManySymbols)
+{
+    MockErrorReporter err;
+    EXPECT_CALL(err, report_error).Times(0);
+
+    // Many locals in one scope, and many nested scopes.
+    std::string src = "int f ( ) { ";
+    for(int i = 0;i < 30000;i++) src += "int a" + std::to_string(i) + " = a" + std::to_string(i / 2) + " ; ";
+    for(int i = 0;i < 5000;i++) src += "{ int b = a1 ; b ; ";
+    for(int i = 0;i < 5000;i++) src += "} ";
+    src += "return a29999 ; }";
+
+    auto ast = resolve(src, err);
+    auto f = item<FunctionDefAstNode>(ast->items, 0);
+    auto ret = std::dynamic_pointer_cast<ReturnStmtAstNode>(f->body->items.back());
+    EXPECT_EQ(resolved(ret->expr), item<DeclAstNode>(f->body->items, 29999).get());
+}
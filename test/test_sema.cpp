@@ -0,0 +1,155 @@
+#include <atomic>
+#include <iostream>
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "error.h"
+#include "lexer.h"
+#include "parser.h"
+#include "ast.h"
+#include "fold.h"
+#include "sema.h"
+#include "thread_pool.h"
+
+using ::testing::InSequence;
+
+class MockErrorReporter : public ErrorReporter
+{
+    public:
+        MOCK_METHOD(void, report_error, (int line, const std::string& error), (override));
+};
+
+std::shared_ptr<TranslationUnitAstNode> analyse(const std::string& src, ErrorReporter& err, int threads = 4)
+{
+    TypeContext context;
+    std::vector<std::shared_ptr<Token>> tokens = Lexer(src, err).get_tokens();
+    auto ast = ConstantFolder().fold(AstBuilder(context).build(*Parser().parse(tokens)));
+    auto tu = std::dynamic_pointer_cast<TranslationUnitAstNode>(ast);
+    SemanticAnalyser(err, context, threads).analyse(*tu);
+    return tu;
+}
+
+// Type of the expression in the last statement of the last function.
+std::string last_expr_type(const std::string& src)
+{
+    MockErrorReporter err;
+    EXPECT_CALL(err, report_error).Times(0);
+
+    auto tu = analyse(src, err);
+    auto f = std::dynamic_pointer_cast<FunctionDefAstNode>(tu->items.back());
+    auto stmt = std::dynamic_pointer_cast<ExprStmtAstNode>(f->body->items.back());
+    return stmt->expr->ctype ? static_cast<std::string>(*stmt->expr->ctype) : "";
+}
+
+void expect_error(const std::string& src, const std::string& error)
+{
+    MockErrorReporter err;
+    EXPECT_CALL(err, report_error(0, error));
+    analyse(src, err);
+}
+
+TEST(SemaSuite, ThreadPool)
+{
+    ThreadPool pool(4);
+    EXPECT_EQ(pool.size(), 4);
+
+    std::vector<std::atomic<int>> counts(1000);
+    pool.run(counts.size(), [&](size_t i) { counts[i]++; });
+    pool.run(counts.size(), [&](size_t i) { counts[i]++; });
+    for(auto& count : counts) EXPECT_EQ(count, 2);
+
+    EXPECT_THROW(pool.run(10, [](size_t i) { if(i == 7) throw std::runtime_error("task"); }), std::runtime_error);
+    EXPECT_NO_THROW(pool.run(0, [](size_t) {}));
+}
+
+TEST(SemaSuite, Types)
+{
+    EXPECT_EQ(last_expr_type("int f ( ) { 1 ; }"), "[signed int]");
+    EXPECT_EQ(last_expr_type("int f ( ) { 0xFFFFFFFF ; }"), "[unsigned int]");
+    EXPECT_EQ(last_expr_type("int f ( char c , unsigned short s ) { c + s ; }"), "[signed int]");
+    EXPECT_EQ(last_expr_type("int f ( int i , unsigned u ) { i * u ; }"), "[unsigned int]");
+    EXPECT_EQ(last_expr_type("int f ( char c , unsigned short i ) { c << i ; }"), "[signed int]");
+    EXPECT_EQ(last_expr_type("int f ( int * p ) { p + 1 ; }"), "[*, [signed int]]");
+    EXPECT_EQ(last_expr_type("int f ( int * p , int * q ) { p - q ; }"), "[signed int]");
+    EXPECT_EQ(last_expr_type("int a [ 3 ] ; int f ( ) { & a ; }"), "[*, [[3], [signed int]]]");
+    EXPECT_EQ(last_expr_type("int a [ 3 ] [ 2 ] ; int f ( ) { a [ 1 ] ; }"), "[[2], [signed int]]");
+    EXPECT_EQ(last_expr_type("const int k ; int f ( ) { k ; }"), "[const signed int]");
+    EXPECT_EQ(last_expr_type("char g ( int ) ; int f ( ) { g ( 1 ) ; }"), "[char]");
+    EXPECT_EQ(last_expr_type("int f ( int * p ) { p ? p : 0 ; }"), "[*, [signed int]]");
+    EXPECT_EQ(last_expr_type("int f ( ) { \"abc\" ; }"), "[[4], [char]]");
+    EXPECT_EQ(last_expr_type("int f ( int a ) { a += 1 ; }"), "[signed int]");
+
+    // Folding keeps the types of simplified expressions and conditionals.
+    EXPECT_EQ(last_expr_type("int f ( char c ) { c * 1 ; }"), "[signed int]");
+    EXPECT_EQ(last_expr_type("int a [ 3 ] ; int f ( ) { a + 0 ; }"), "[*, [signed int]]");
+    EXPECT_EQ(last_expr_type("int f ( int i , unsigned u ) { 1 ? i : u ; }"), "[unsigned int]");
+    EXPECT_EQ(last_expr_type("int f ( int i , char c ) { 0 ? i : c ; }"), "[signed int]");
+}
+
+TEST(SemaSuite, Errors)
+{
+    expect_error("int x = 1 ; int y = x ;", "Initializer element is not constant");
+    expect_error("int f ( int y ) { static int n = y ; return n ; }", "Initializer element is not constant");
+    expect_error("int f ( int y ) { static int * p = & y ; return 0 ; }", "Initializer element is not constant");
+    expect_error("int f ( ) { int a [ 2 ] ; static int * p = a ; return 0 ; }", "Initializer element is not constant");
+    expect_error("int x ; int * p = & * & x ;", "Initializer element is not constant");
+    expect_error("void v ;", "Variable declared void");
+    expect_error("int * p = 1 ;", "Incompatible types in initialization");
+    expect_error("const int k = 1 ; int f ( ) { k = 2 ; return 0 ; }", "Expression is not assignable");
+    expect_error("int f ( int * q ) { q = 3 ; return 0 ; }", "Incompatible types in assignment");
+    expect_error("int f ( ) { return ; }", "Non-void function should return a value");
+    expect_error("void f ( ) { return 1 ; }", "Void function should not return a value");
+    expect_error("int f ( int a ) { return f ( ) ; }", "Wrong number of arguments in function call");
+    expect_error("int f ( int a ) { return f ( & a ) ; }", "Incompatible argument type in function call");
+    expect_error("int f ( int a ) { return a ( ) ; }", "Called object is not a function");
+    expect_error("int f ( int * p , int * q ) { return p + q ; }", "Invalid operands to binary operator");
+    expect_error("int f ( int * p ) { return ~ p ; }", "Invalid operand to unary operator");
+    expect_error("int f ( register int r ) { & r ; return 0 ; }", "Address of register variable requested");
+    expect_error("int f ( int a ) { return a [ 1 ] ; }", "Subscripted value is not an array or pointer");
+    expect_error("int f ( ) { return 1 ++ ; }", "Expression is not assignable");
+    expect_error("int f ( int x ) { ( x + 0 ) = 5 ; return x ; }", "Expression is not assignable");
+    expect_error("int f ( int x ) { ( x * 1 ) = 5 ; return x ; }", "Expression is not assignable");
+    expect_error("int f ( int x , int y ) { ( 1 ? x : y ) = 5 ; return x ; }", "Expression is not assignable");
+    expect_error("void g ( ) ; void f ( ) { while ( g ( ) ) ; }", "Loop condition requires a scalar type");
+    expect_error("void f ( int * p ) { switch ( p ) ; }", "Switch condition requires an integer type");
+    expect_error("void f ( int n , int k ) { switch ( n ) case k : ; }", "Case label requires an integer constant expression");
+    expect_error("void f ( int n ) { switch ( n ) { case 3 : case 1 + 2 : ; } }", "Duplicate case value");
+    expect_error("void f ( int n ) { switch ( n ) { default : ; default : ; } }", "Multiple default labels in one switch");
+}
+
+TEST(SemaSuite, Scopes)
+{
+    // Functions only see file-scope declarations which precede them.
+    expect_error("int f ( ) { return g ; } int g ;", "Undeclared identifier 'g'");
+
+    // A declaration in a 'for' is only in scope in the loop.
+    expect_error("int f ( ) { for ( int i = 0 ; i < 2 ; i ++ ) ; return i ; }", "Undeclared identifier 'i'");
+
+    MockErrorReporter err;
+    EXPECT_CALL(err, report_error).Times(0);
+    analyse("int g ; int f ( ) { return g + f ( ) ; } int g = 1 ; int h ( ) { return g ; }", err);
+}
+
+TEST(SemaSuite, ParallelErrors)
+{
+    // Errors are reported in source order, whichever thread found them.
+    std::string src;
+    for(int i = 0;i < 200;i++)
+    {
+        src += "int f" + std::to_string(i) + " ( int a ) {\n";
+        src += (i % 3 == 0) ? "return b ;\n" : "return a ;\n";
+        src += "}\n";
+        src += (i % 5 == 0) ? "int x" + std::to_string(i) + " = f0 ( 1 ) ;\n" : "\n";
+    }
+
+    MockErrorReporter err;
+    {
+        InSequence sequence;
+        for(int i = 0;i < 200;i++)
+        {
+            if(i % 3 == 0) EXPECT_CALL(err, report_error(i * 4 + 1, "Undeclared identifier 'b'"));
+            if(i % 5 == 0) EXPECT_CALL(err, report_error(i * 4 + 3, "Initializer element is not constant"));
+        }
+    }
+    analyse(src, err, 8);
+}
@@ -0,0 +1,226 @@
+#include <iostream>
+#include <random>
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "error.h"
+#include "lexer.h"
+#include "parser.h"
+#include "ast.h"
+#include "fold.h"
+#include "sema.h"
+#include "ir.h"
+#include "irgen.h"
+#include "dominators.h"
+#include "mem2reg.h"
+
+class MockErrorReporter : public ErrorReporter
+{
+    public:
+        MOCK_METHOD(void, report_error, (int line, const std::string& error), (override));
+};
+
+// IR of the last function in a translation unit, after mem2reg.
+std::string promote(const std::string& src)
+{
+    MockErrorReporter err;
+    EXPECT_CALL(err, report_error).Times(0);
+
+    TypeContext context;
+    std::vector<std::shared_ptr<Token>> tokens = Lexer(src, err).get_tokens();
+    auto ast = ConstantFolder().fold(AstBuilder(context).build(*Parser().parse(tokens)));
+    auto tu = std::dynamic_pointer_cast<TranslationUnitAstNode>(ast);
+    SemanticAnalyser(err, context, 1).analyse(*tu);
+
+    IrModule module;
+    IrGenerator(module).generate(*tu);
+    IrFunction& function = *module.functions.back();
+    Mem2Reg().run(function);
+    EXPECT_EQ(function.verify(), "");
+    return ir_str(function, &module);
+}
+
+// CFG only (each block ends with a terminator matching its successors).
+void terminate_blocks(IrFunction& f)
+{
+    IrValue c = f.append(0, IrOp::CONST, IrType::I32, {}, 0);
+    for(IrBlockId b = 0;b < f.blocks.size();b++)
+    {
+        size_t succs = f.blocks[b].succs.size();
+        IrOp op = succs == 0 ? IrOp::RET : succs == 1 ? IrOp::JUMP : IrOp::BRANCH;
+        f.append(b, op, IrType::VOID, op == IrOp::BRANCH ? std::vector<IrValue>{c} : std::vector<IrValue>{});
+    }
+}
+
+TEST(SsaSuite, Dominators)
+{
+    // b0 -> b1 -> {b2, b3} -> b4 -> b1 (loop), b4 -> b5; b6 is unreachable.
+    IrFunction f;
+    for(int i = 0;i < 7;i++) f.add_block();
+    f.add_edge(0, 1);
+    f.add_edge(1, 2);
+    f.add_edge(1, 3);
+    f.add_edge(2, 4);
+    f.add_edge(3, 4);
+    f.add_edge(4, 1);
+    f.add_edge(4, 5);
+    f.add_edge(6, 5);
+    terminate_blocks(f);
+
+    for(auto algorithm : {DominatorTree::Algorithm::ITERATIVE, DominatorTree::Algorithm::LENGAUER_TARJAN})
+    {
+        DominatorTree tree(f, algorithm);
+        EXPECT_EQ(tree.idom(0), 0u);
+        EXPECT_EQ(tree.idom(1), 0u);
+        EXPECT_EQ(tree.idom(2), 1u);
+        EXPECT_EQ(tree.idom(3), 1u);
+        EXPECT_EQ(tree.idom(4), 1u);
+        EXPECT_EQ(tree.idom(5), 4u);
+        EXPECT_FALSE(tree.reachable(6));
+
+        EXPECT_TRUE(tree.dominates(1, 5));
+        EXPECT_TRUE(tree.dominates(4, 4));
+        EXPECT_FALSE(tree.dominates(2, 4));
+        EXPECT_FALSE(tree.dominates(5, 1));
+        EXPECT_FALSE(tree.dominates(6, 5));
+        EXPECT_EQ(tree.preorder().size(), 6u);
+
+        DominanceFrontiers frontiers(f, tree);
+        EXPECT_EQ(frontiers.frontier(0), std::vector<IrBlockId>{});
+        EXPECT_EQ(frontiers.frontier(1), std::vector<IrBlockId>{1});
+        EXPECT_EQ(frontiers.frontier(2), std::vector<IrBlockId>{4});
+        EXPECT_EQ(frontiers.frontier(3), std::vector<IrBlockId>{4});
+        EXPECT_EQ(frontiers.frontier(4), std::vector<IrBlockId>{1});
+        EXPECT_EQ(frontiers.frontier(5), std::vector<IrBlockId>{});
+    }
+}
+
+TEST(SsaSuite, DominatorAlgorithmsAgree)
+{
+    std::mt19937 random(35);
+    for(int n = 0;n < 50;n++)
+    {
+        IrFunction f;
+        size_t blocks = 2 + random() % 60;
+        for(size_t b = 0;b < blocks;b++) f.add_block();
+        for(IrBlockId b = 0;b < blocks;b++)
+        {
+            size_t succs = random() % 3;
+            for(size_t i = 0;i < succs;i++) f.add_edge(b, 1 + random() % (blocks - 1));
+        }
+        terminate_blocks(f);
+
+        DominatorTree iterative(f, DominatorTree::Algorithm::ITERATIVE);
+        DominatorTree lengauer_tarjan(f, DominatorTree::Algorithm::LENGAUER_TARJAN);
+        for(IrBlockId b = 0;b < blocks;b++)
+        {
+            EXPECT_EQ(iterative.idom(b), lengauer_tarjan.idom(b));
+        }
+    }
+}
+
+TEST(SsaSuite, DeepCfg)
+{
+    // A long chain of diamonds. Neither the dominator tree nor renaming recurses.
+    IrFunction f;
+    f.add_block();
+    IrValue slot = f.append(0, IrOp::ALLOCA, IrType::I64, {}, 4);
+    IrValue c = f.append(0, IrOp::CONST, IrType::I32, {}, 1);
+    f.append(0, IrOp::STORE, IrType::VOID, {slot, c});
+    IrBlockId last = 0;
+    for(int i = 0;i < 20000;i++)
+    {
+        IrBlockId left = f.add_block(), right = f.add_block(), join = f.add_block();
+        f.append(last, IrOp::BRANCH, IrType::VOID, {c});
+        f.add_edge(last, left);
+        f.add_edge(last, right);
+        f.append(left, IrOp::STORE, IrType::VOID, {slot, c});
+        f.append(left, IrOp::JUMP, IrType::VOID);
+        f.add_edge(left, join);
+        f.append(right, IrOp::JUMP, IrType::VOID);
+        f.add_edge(right, join);
+        IrValue v = f.append(join, IrOp::LOAD, IrType::I32, {slot});
+        f.append(join, IrOp::STORE, IrType::VOID, {slot, v});
+        last = join;
+    }
+    f.append(last, IrOp::RET, IrType::VOID, {f.append(last, IrOp::LOAD, IrType::I32, {slot})});
+    ASSERT_EQ(f.verify(), "");
+
+    EXPECT_TRUE(Mem2Reg().run(f));
+    EXPECT_EQ(f.verify(), "");
+    size_t phis = 0;
+    for(auto& instr : f.instrs)
+    {
+        EXPECT_NE(instr.op, IrOp::LOAD);
+        phis += instr.op == IrOp::PHI;
+    }
+    EXPECT_EQ(phis, 20000u);
+}
+
+TEST(SsaSuite, Promote)
+{
+    EXPECT_EQ(promote("int f ( int a , int b ) { a = a + b ; return a * 2 ; }"),
+        "function i32 f(i32, i32)\n"
+        "b0:\n"
+        "    %0 = param i32 0\n"
+        "    %1 = param i32 1\n"
+        "    %2 = add i32 %0, %1\n"
+        "    %3 = const i32 2\n"
+        "    %4 = mul i32 %2, %3\n"
+        "    ret %4\n"
+    );
+
+    // The value of 'x' at the join point needs a phi.
+    EXPECT_EQ(promote("int f ( int a ) { int x = 1 ; a && ( x = 2 ) ; return x ; }"),
+        "function i32 f(i32)\n"
+        "b0:\n"
+        "    %0 = param i32 0\n"
+        "    %1 = const i32 1\n"
+        "    %2 = const i32 0\n"
+        "    %3 = ne i32 %0, %2\n"
+        "    %4 = const i32 0\n"
+        "    branch %3, b1, b2\n"
+        "b1 <- b0:\n"
+        "    %6 = const i32 2\n"
+        "    %7 = const i32 0\n"
+        "    %8 = ne i32 %6, %7\n"
+        "    jump b2\n"
+        "b2 <- b0 b1:\n"
+        "    %10 = phi i32 %1, %6\n"
+        "    %11 = phi i32 %4, %8\n"
+        "    ret %10\n"
+    );
+}
+
+TEST(SsaSuite, PrunedPlacement)
+{
+    // 'x' is assigned on one side, but is not live at the join, so it gets no phi.
+    std::string ir = promote("int f ( int a ) { int x = 1 ; a && ( x = 2 ) ; x = 3 ; return x ; }");
+    EXPECT_EQ(ir.find("phi i32 %1"), std::string::npos);
+    EXPECT_NE(ir.find("phi"), std::string::npos);
+
+    // An uninitialised variable reads zero.
+    EXPECT_EQ(promote("int f ( ) { int x ; return x ; }"),
+        "function i32 f()\n"
+        "b0:\n"
+        "    %0 = const i32 0\n"
+        "    ret %0\n"
+    );
+}
+
+TEST(SsaSuite, AddressTaken)
+{
+    // 'x' has its address taken, so it stays in memory; 'y' is promoted.
+    EXPECT_EQ(promote("int g ( int * p ) ; int f ( int y ) { int x = y ; g ( & x ) ; return x + y ; }"),
+        "function i32 f(i32)\n"
+        "b0:\n"
+        "    %0 = alloca i64 4\n"
+        "    %1 = param i32 0\n"
+        "    store %0, %1\n"
+        "    %3 = global i64 @g\n"
+        "    %4 = call i32 %3, %0\n"
+        "    %5 = load i32 %0\n"
+        "    %6 = add i32 %5, %1\n"
+        "    ret %6\n"
+    );
+}
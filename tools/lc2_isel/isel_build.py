@@ -0,0 +1,225 @@
+"""Tree-pattern instruction selector generator (BURS).
+
+Generate the tables of a bottom-up rewrite system (BURS) instruction selector from a tree
+grammar. The grammar is a Python dictionary: keys are nonterminals, values are lists of
+rules. Each rule is a string:
+
+    PATTERN  cost  [predicate]  = ACTION
+
+* Patterns:
+  * `ALL_CAPS` - an IR operator (`IrOp`), optionally applied to patterns: `ADD(reg, imm)`.
+  * `snake_case` - a nonterminal. A rule whose pattern is a nonterminal is a chain rule.
+  * `*` - the rest of an operator's operands, each a `reg` (last).
+* The cost is a non-negative integer.
+* The predicate (optional) names a member function of `InstructionSelector`, which is
+  called with the node and the rule's leaves.
+* The action names what the code generator does for the rule (`IselAction`).
+
+Rules using commutative operators are expanded to one rule for each order of their
+operands. The selector labels each node with the cheapest rule for each nonterminal (and
+its cost), from its operands' labels; `IselGrammar` supplies what the code generators need.
+"""
+
+# pylint: disable=too-few-public-methods
+
+import re
+
+# Rule 0: a value computed by another tile (the label of a leaf).
+LEAF_ACTION = "LEAF"
+GOAL = "reg"
+
+class IselGrammarError(Exception):
+    """Malformed grammar."""
+
+class Pattern:
+    """Pattern tree: an operator applied to patterns, or a nonterminal."""
+
+    def __init__(self, name:str, children:list=None, rest:bool=False):
+        self.name = name
+        self.children = children or []
+        self.rest = rest
+
+    @property
+    def is_nonterminal(self) -> bool:
+        """Is this a nonterminal (a leaf of the pattern)?"""
+        return self.name[0].islower()
+
+    @property
+    def arity(self) -> int:
+        """Number of operands matched explicitly."""
+        return len(self.children)
+
+    def __str__(self) -> str:
+        if not self.children and not self.rest:
+            return self.name
+        operands = [str(child) for child in self.children] + (["*"] if self.rest else [])
+        return f"{self.name}({', '.join(operands)})"
+
+def tokenize(text:str) -> list:
+    """Split a pattern into names and punctuation."""
+    tokens = re.findall(r"[A-Za-z_][A-Za-z0-9_]*|[(),*]|\S", text)
+    for token in tokens:
+        if not re.match(r"^([A-Za-z_][A-Za-z0-9_]*|[(),*])$", token):
+            raise IselGrammarError(f"Unexpected '{token}' in pattern {text}")
+    return tokens
+
+def parse_pattern(text:str) -> Pattern:
+    """Parse a pattern."""
+    tokens = tokenize(text)
+    position = 0
+
+    def expect(token):
+        nonlocal position
+        if position >= len(tokens) or tokens[position] != token:
+            raise IselGrammarError(f"Expected '{token}' in pattern {text}")
+        position += 1
+
+    def pattern() -> Pattern:
+        nonlocal position
+        if position >= len(tokens) or not re.match(r"^[A-Za-z_]", tokens[position]):
+            raise IselGrammarError(f"Expected a name in pattern {text}")
+        node = Pattern(tokens[position])
+        position += 1
+        if position < len(tokens) and tokens[position] == "(":
+            if node.is_nonterminal:
+                raise IselGrammarError(f"Nonterminal {node.name} has operands in pattern {text}")
+            position += 1
+            while True:
+                if tokens[position] == "*":
+                    node.rest = True
+                    position += 1
+                    expect(")")
+                    break
+                node.children.append(pattern())
+                if tokens[position] == ")":
+                    position += 1
+                    break
+                expect(",")
+        return node
+
+    root = pattern()
+    if position != len(tokens):
+        raise IselGrammarError(f"Unexpected '{tokens[position]}' in pattern {text}")
+    return root
+
+def variants(pattern:Pattern, commutative:set) -> list:
+    """The pattern, and (for commutative operators) its operands swapped, without duplicates."""
+    if pattern.is_nonterminal:
+        return [pattern]
+
+    results = [[]]
+    for child in pattern.children:
+        results = [prefix + [option] for prefix in results for option in variants(child, commutative)]
+    expanded = [Pattern(pattern.name, children, pattern.rest) for children in results]
+    if pattern.name in commutative and pattern.arity == 2 and not pattern.rest:
+        expanded += [Pattern(pattern.name, [p.children[1], p.children[0]]) for p in list(expanded)]
+
+    unique = {}
+    for variant in expanded:
+        unique.setdefault(str(variant), variant)
+    return list(unique.values())
+
+class Rule:
+    """Grammar rule (after expansion): lhs <- pattern, at a cost."""
+
+    def __init__(self, index:int, lhs:str, pattern:Pattern, cost:int, predicate:str, action:str):
+        self.index = index
+        self.lhs = lhs
+        self.pattern = pattern
+        self.cost = cost
+        self.predicate = predicate
+        self.action = action
+
+    @property
+    def is_chain(self) -> bool:
+        """Is this a chain rule (nonterminal <- nonterminal)?"""
+        return self.pattern.is_nonterminal
+
+    @property
+    def text(self) -> str:
+        """The rule as text (for comments and debugging)."""
+        predicate = f" [{self.predicate}]" if self.predicate else ""
+        return f"{self.lhs}: {self.pattern}{predicate}"
+
+    def leaves(self, node:str) -> list:
+        """C++ expressions for the leaves of the pattern (and their nonterminals), in operand
+        order, and the start of the rest of the root's operands (or None)."""
+        found = []
+
+        def walk(pattern, expression):
+            if pattern.is_nonterminal:
+                found.append((expression, pattern.name))
+                return
+            for i, child in enumerate(pattern.children):
+                walk(child, f"operand({expression}, {i})")
+
+        walk(self.pattern, node)
+        return found, (self.pattern.arity if self.pattern.rest else None)
+
+    def interior(self, node:str) -> list:
+        """C++ expressions for the operator nodes of the pattern below its root, and the
+        operator and arity each must have."""
+        found = []
+
+        def walk(pattern, expression):
+            for i, child in enumerate(pattern.children):
+                if child.is_nonterminal:
+                    continue
+                if child.rest:
+                    raise IselGrammarError(f"'*' must be at the root of a pattern: {self.text}")
+                child_expression = f"operand({expression}, {i})"
+                found.append((child_expression, child.name, child.arity))
+                walk(child, child_expression)
+
+        if not self.pattern.is_nonterminal:
+            walk(self.pattern, node)
+        return found
+
+class IselGrammar:
+    """Instruction selection grammar: nonterminals, actions and (expanded) rules."""
+
+    def __init__(self, grammar:dict, commutative:set):
+        self.nonterminals = list(grammar.keys())
+        if GOAL not in self.nonterminals:
+            raise IselGrammarError(f"The grammar has no '{GOAL}' nonterminal")
+        self.actions = [LEAF_ACTION, "GENERIC"]
+        self.rules = [Rule(0, GOAL, Pattern("(computed elsewhere)"), 0, None, LEAF_ACTION)]
+
+        for lhs, texts in grammar.items():
+            for text in texts:
+                match = re.match(r"^(.*?)\s+(\d+)\s*(?:\[\s*(\w+)\s*\])?\s*=\s*(\w+)\s*$", text)
+                if not match:
+                    raise IselGrammarError(f"Malformed rule for {lhs}: {text}")
+                pattern = parse_pattern(match.group(1))
+                self._check(pattern, text)
+                if match.group(4) not in self.actions:
+                    self.actions.append(match.group(4))
+                for variant in variants(pattern, commutative):
+                    self.rules.append(Rule(
+                        len(self.rules), lhs, variant, int(match.group(2)), match.group(3), match.group(4)
+                    ))
+
+    def _check(self, pattern:Pattern, text:str):
+        if pattern.is_nonterminal and pattern.name not in self.nonterminals:
+            raise IselGrammarError(f"Unknown nonterminal {pattern.name} in rule {text}")
+        for child in pattern.children:
+            self._check(child, text)
+
+    @staticmethod
+    def enum(nonterminal:str) -> str:
+        """C++ enumerator of a nonterminal."""
+        return f"ISEL_{nonterminal.upper()}"
+
+    @property
+    def chain_rules(self) -> list:
+        """Chain rules (applied by the closure)."""
+        return [rule for rule in self.rules[1:] if rule.is_chain]
+
+    def operators(self) -> dict:
+        """Rules which are not chain rules, by the operator at their root (in order of first
+        use)."""
+        by_operator = {}
+        for rule in self.rules[1:]:
+            if not rule.is_chain:
+                by_operator.setdefault(rule.pattern.name, []).append(rule)
+        return by_operator
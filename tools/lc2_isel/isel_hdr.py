@@ -0,0 +1,95 @@
+"""Tree-pattern instruction selector generator (.h header file).
+
+This module builds the `isel.h` header file: the nonterminals, actions and rules of the
+instruction selection grammar (see `InstructionSelector`).
+"""
+
+import datetime
+
+from lc2_isel import isel_build
+from lc2_isel import x86_64
+
+HEADER_TEMPLATE = """
+#ifndef ISEL_H_
+#define ISEL_H_
+
+// {name} instruction selection tables (tree-pattern matching).
+//
+// This code was auto-generated on {timestamp}. Do not edit.
+
+#include <cstdint>
+
+#include "ir.h"
+
+enum IselNonTerminal : uint8_t
+{{
+    {nonterminal_definitions},
+    ISEL_NONTERMINALS
+}};
+
+enum class IselAction : uint8_t
+{{
+    {action_definitions}
+}};
+
+struct IselRule
+{{
+    IselNonTerminal lhs;
+    IselAction action;
+
+    // Right-hand side of a chain rule, or ISEL_NONTERMINALS.
+    IselNonTerminal chain;
+    uint16_t cost;
+    const char * text;
+}};
+
+// Rules (rule 0: a value computed by another tile, in a register).
+extern const IselRule IselRules[{rule_count}];
+
+// Cheapest rule for each nonterminal at a node, and its cost (the cost of the tiles which
+// cover the node's tree), or IselInfinity.
+const uint16_t IselInfinity = UINT16_MAX;
+struct IselState
+{{
+    uint16_t cost[ISEL_NONTERMINALS];
+    uint16_t rule[ISEL_NONTERMINALS];
+}};
+
+// Leaf of a rule's pattern: a value, and the nonterminal it is matched as.
+struct IselKid
+{{
+    IrValue value;
+    IselNonTerminal nt;
+}};
+
+#endif
+"""
+
+class HdrIselBuilder:
+    """Instruction selector header file."""
+
+    # pylint: disable=too-few-public-methods
+
+    def __init__(self, name:str, grammar:isel_build.IselGrammar):
+        self._name = name
+        self._grammar = grammar
+
+    def build(self) -> str:
+        """Build the header file (which must be called `isel.h`)."""
+        return HEADER_TEMPLATE.format(
+            name=self._name,
+            timestamp=datetime.datetime.now().isoformat(),
+            nonterminal_definitions=",\n    ".join(
+                isel_build.IselGrammar.enum(nt) for nt in self._grammar.nonterminals
+            ),
+            action_definitions=",\n    ".join(self._grammar.actions),
+            rule_count=len(self._grammar.rules),
+        )
+
+def main():
+    """Entrypoint."""
+    builder = HdrIselBuilder(
+        x86_64.NAME,
+        isel_build.IselGrammar(x86_64.GRAMMAR, x86_64.COMMUTATIVE)
+    )
+    print(builder.build())
@@ -0,0 +1,170 @@
+"""Tree-pattern instruction selector generator (.cpp source file).
+
+This module builds the `isel.cpp` source file: the rule table, and the members of
+`InstructionSelector` which match the grammar's patterns (label, close and kids).
+"""
+
+# pylint: disable=line-too-long
+
+import datetime
+
+from lc2_isel import isel_build
+from lc2_isel import x86_64
+
+IMPLEMENTATION_TEMPLATE = """
+#include "select.h"
+
+// {name} instruction selection tables (tree-pattern matching).
+//
+// This code was auto-generated on {timestamp}. Do not edit.
+
+const IselRule IselRules[{rule_count}] =
+{{
+{rules}
+}};
+
+void InstructionSelector::label(IrValue node)
+{{
+    IselState& s = states[node];
+    const IrInstr& instr = function.instrs[node];
+    switch(instr.op)
+    {{
+{label_cases}
+        default:
+            break;
+    }}
+    close(s);
+}}
+
+void InstructionSelector::close(IselState& s)
+{{
+    // Chain rules, to a fixed point.
+    bool changed = true;
+    while(changed)
+    {{
+        changed = false;
+{chain_rules}
+    }}
+}}
+
+void InstructionSelector::kids(IrValue node, int rule, std::vector<IselKid>& out, std::vector<IrValue> * covered) const
+{{
+    (void)covered;
+    switch(rule)
+    {{
+{kid_cases}
+        default:
+            break;
+    }}
+}}
+"""
+
+class ImplIselBuilder:
+    """Instruction selector C++ source file."""
+
+    # pylint: disable=too-few-public-methods
+
+    def __init__(self, name:str, grammar:isel_build.IselGrammar):
+        self._name = name
+        self._grammar = grammar
+
+    def build(self) -> str:
+        """Build the .cpp source file."""
+        return IMPLEMENTATION_TEMPLATE.format(
+            name=self._name,
+            timestamp=datetime.datetime.now().isoformat(),
+            rule_count=len(self._grammar.rules),
+            rules=self._build_rules(),
+            label_cases=self._build_label(),
+            chain_rules=self._build_chains(),
+            kid_cases=self._build_kids(),
+        ).rstrip()
+
+    def _build_rules(self) -> str:
+        enum = isel_build.IselGrammar.enum
+        lines = []
+        for rule in self._grammar.rules:
+            chain = enum(rule.pattern.name) if rule.is_chain else "ISEL_NONTERMINALS"
+            lines.append(
+                f"    {{{enum(rule.lhs)}, IselAction::{rule.action}, {chain}, {rule.cost}, \"{rule.text}\"}},"
+            )
+        return "\n".join(lines)
+
+    def _build_label(self) -> str:
+        enum = isel_build.IselGrammar.enum
+        code = ""
+        for operator, rules in self._grammar.operators().items():
+            code += f"        case IrOp::{operator}:\n"
+            for rule in rules:
+                leaves, rest = rule.leaves("node")
+                arity = rule.pattern.arity
+                # The operand count is unsigned, so a pattern which takes any number of them
+                # has no lower bound to check.
+                conditions = []
+                if rest is None:
+                    conditions.append(f"instr.count == {arity}")
+                elif arity > 0:
+                    conditions.append(f"instr.count >= {arity}")
+                conditions += [f"match({e}, IrOp::{op}, {n})" for e, op, n in rule.interior("node")]
+
+                cost = [f"{rule.cost}u"] + [f"cost(leaves[{i}])" for i in range(len(leaves))]
+                if rest is not None:
+                    cost.append(f"rest(node, {rest})")
+                record = f"record(s, {enum(rule.lhs)}, {rule.index}, {' + '.join(cost)});"
+                if rule.predicate:
+                    arguments = f"leaves, {len(leaves)}" if leaves else "nullptr, 0"
+                    record = f"if({rule.predicate}(node, {arguments})) {record}"
+
+                code += f"            // {rule.text}\n"
+                if conditions:
+                    code += f"            if({' && '.join(conditions)})\n"
+                code += "            {\n"
+                if leaves:
+                    kids = ", ".join(f"{{{e}, {enum(nt)}}}" for e, nt in leaves)
+                    code += f"                const IselKid leaves[] = {{{kids}}};\n"
+                code += f"                {record}\n"
+                code += "            }\n"
+            code += "            break;\n"
+        return code.rstrip("\n")
+
+    def _build_chains(self) -> str:
+        enum = isel_build.IselGrammar.enum
+        lines = []
+        for rule in self._grammar.chain_rules:
+            lines.append(
+                f"        // {rule.text}\n"
+                f"        changed |= record(s, {enum(rule.lhs)}, {rule.index}, s.cost[{enum(rule.pattern.name)}] + {rule.cost}u);"
+            )
+        return "\n".join(lines)
+
+    def _build_kids(self) -> str:
+        enum = isel_build.IselGrammar.enum
+
+        # Rules with the same leaves share a case.
+        bodies = {}
+        for rule in self._grammar.rules[1:]:
+            leaves, rest = rule.leaves("node")
+            body = ""
+            for expression, _, _ in rule.interior("node"):
+                body += f"            if(covered) covered->push_back({expression});\n"
+            for expression, nt in leaves:
+                body += f"            out.push_back({{{expression}, {enum(nt)}}});\n"
+            if rest is not None:
+                body += f"            for(uint32_t i = {rest};i < function.instrs[node].count;i++) out.push_back({{operand(node, i), ISEL_REG}});\n"
+            if body:
+                bodies.setdefault(body, []).append(rule)
+
+        code = ""
+        for body, rules in bodies.items():
+            for rule in rules:
+                code += f"        case {rule.index}: // {rule.text}\n"
+            code += body + "            break;\n"
+        return code.rstrip("\n")
+
+def main():
+    """Entrypoint."""
+    builder = ImplIselBuilder(
+        x86_64.NAME,
+        isel_build.IselGrammar(x86_64.GRAMMAR, x86_64.COMMUTATIVE)
+    )
+    print(builder.build())
@@ -0,0 +1,175 @@
+"""x86-64 instruction selection grammar.
+
+Each rule covers a tree of IR instructions (a pattern) with a nonterminal, at a cost:
+
+    nonterminal: [ "PATTERN  cost  [predicate]  = ACTION", ... ]
+
+Patterns are IR operators (`ADD`, as in `IrOp`) applied to patterns, or nonterminals
+(`reg`). `*` matches the rest of an instruction's operands, each as a `reg`. A pattern
+which is a single nonterminal is a chain rule. A predicate is a member function of
+`InstructionSelector`, called with the node and the rule's leaves (in pattern order). The
+action names what the emitter does for a tile rooted at the node (`GENERIC`: the
+instruction's own expansion, with its operands in registers).
+
+Costs are roughly instructions; the selector picks the cheapest cover of each tree.
+"""
+
+NAME = "x86-64"
+
+# Operators whose operands can be swapped (each rule using one also matches with them
+# swapped; the leaves are still listed in pattern order).
+COMMUTATIVE = {"ADD", "MUL", "AND", "OR", "XOR", "EQ", "NE"}
+
+GRAMMAR = {
+    # Instructions without a result.
+    "stmt": [
+        "STORE(addr, reg)                               1           = STORE",
+
+        # Read-modify-write: the load and the store are of the same address.
+        "STORE(addr, ADD(loaded, reg))                  1   [rmw]   = UPDATE",
+        "STORE(addr, SUB(loaded, reg))                  1   [rmw]   = UPDATE",
+        "STORE(addr, AND(loaded, reg))                  1   [rmw]   = UPDATE",
+        "STORE(addr, OR(loaded, reg))                   1   [rmw]   = UPDATE",
+        "STORE(addr, XOR(loaded, reg))                  1   [rmw]   = UPDATE",
+        "STORE(addr, TRUNC(ADD(loaded, reg)))           1   [rmw]   = UPDATE",
+        "STORE(addr, TRUNC(SUB(loaded, reg)))           1   [rmw]   = UPDATE",
+        "STORE(addr, TRUNC(AND(loaded, reg)))           1   [rmw]   = UPDATE",
+        "STORE(addr, TRUNC(OR(loaded, reg)))            1   [rmw]   = UPDATE",
+        "STORE(addr, TRUNC(XOR(loaded, reg)))           1   [rmw]   = UPDATE",
+
+        # Compare (or test) and branch.
+        "BRANCH(cond)                                   1           = BRANCH",
+        "BRANCH(reg)                                    2           = GENERIC",
+
+        "JUMP                                           1           = GENERIC",
+        "SWITCH(*)                                      3           = GENERIC",
+        "RET(*)                                         1           = GENERIC",
+        "VADD(*)                                        4           = GENERIC",
+        "VSUB(*)                                        4           = GENERIC",
+        "VAND(*)                                        4           = GENERIC",
+        "VOR(*)                                         4           = GENERIC",
+        "VXOR(*)                                        4           = GENERIC",
+        "CALL(callee, *)                                5           = GENERIC",
+    ],
+
+    # A value in a register (or a spill slot: any location the allocator gives it).
+    "reg": [
+        "CONST                                          0           = GENERIC",
+        "ALLOCA                                         0           = GENERIC",
+        "PARAM                                          1           = GENERIC",
+        "PHI(*)                                         0           = GENERIC",
+        "COPY(*)                                        1           = GENERIC",
+
+        "LOAD(addr)                                     1           = LOAD",
+        "SEXT(LOAD(addr))                               1           = LOAD",
+        "ZEXT(LOAD(addr))                               1           = LOAD",
+
+        # Two-address arithmetic, with either operand in memory.
+        "ADD(operand, operand)                          1           = BINARY",
+        "SUB(operand, operand)                          1           = BINARY",
+        "MUL(operand, operand)                          3           = BINARY",
+        "AND(operand, operand)                          1           = BINARY",
+        "OR(operand, operand)                           1           = BINARY",
+        "XOR(operand, operand)                          1           = BINARY",
+
+        "SDIV(*)                                        20          = GENERIC",
+        "UDIV(*)                                        20          = GENERIC",
+        "SREM(*)                                        20          = GENERIC",
+        "UREM(*)                                        20          = GENERIC",
+        "SHL(*)                                         1           = GENERIC",
+        "SAR(*)                                         1           = GENERIC",
+        "SHR(*)                                         1           = GENERIC",
+        "NEG(*)                                         1           = GENERIC",
+        "NOT(*)                                         1           = GENERIC",
+        "SEXT(*)                                        1           = GENERIC",
+        "ZEXT(*)                                        1           = GENERIC",
+        "TRUNC(*)                                       1           = GENERIC",
+        "CALL(callee, *)                                5           = GENERIC",
+
+        # lea (three-address addition, and scaling by 2, 3, 4, 5, 8 or 9).
+        "addr                                           1           = LEA",
+
+        # setcc.
+        "cond                                           2           = SET",
+
+        # cmov (on the flags of the condition, or after testing it).
+        "SELECT(cond, reg, reg)                         2           = SELECT",
+        "SELECT(*)                                      3           = GENERIC",
+    ],
+
+    # Flags for a condition code.
+    "cond": [
+        "EQ(operand, operand)                           1           = COMPARE",
+        "NE(operand, operand)                           1           = COMPARE",
+        "SLT(operand, operand)                          1           = COMPARE",
+        "SLE(operand, operand)                          1           = COMPARE",
+        "SGT(operand, operand)                          1           = COMPARE",
+        "SGE(operand, operand)                          1           = COMPARE",
+        "ULT(operand, operand)                          1           = COMPARE",
+        "ULE(operand, operand)                          1           = COMPARE",
+        "UGT(operand, operand)                          1           = COMPARE",
+        "UGE(operand, operand)                          1           = COMPARE",
+        "EQ(AND(reg, reg), zero)                        1           = TEST",
+        "NE(AND(reg, reg), zero)                        1           = TEST",
+    ],
+
+    # Memory address: base + index * scale + displacement, or symbol + displacement.
+    "addr": [
+        "reg                                            0           = ADDRESS",
+        "symbol                                         0           = ADDRESS",
+        "index                                          0           = ADDRESS",
+        "ADD(symbol, imm)                               0           = ADDRESS",
+        "ADD(reg, imm)                                  0           = ADDRESS",
+        "ADD(reg, index)                                0           = ADDRESS",
+        "ADD(index, imm)                                0           = ADDRESS",
+        "ADD(ADD(reg, index), imm)                      0           = ADDRESS",
+        "ADD(ADD(reg, imm), index)                      0           = ADDRESS",
+        "MUL(reg, factor)                               0           = ADDRESS",
+    ],
+    "index": [
+        "reg                                            0           = INDEX",
+        "MUL(reg, scale)                                0           = INDEX",
+        "SHL(reg, shift)                                0           = INDEX",
+    ],
+
+    # Operand of arithmetic or a comparison: a register, or memory (of the same width).
+    "operand": [
+        "reg                                            0           = OPERAND",
+        "mem                                            0           = OPERAND",
+    ],
+    "mem": [
+        "LOAD(addr)                                     0   [wide]  = MEMORY",
+    ],
+
+    # Value loaded by a read-modify-write (at the width it is stored).
+    "loaded": [
+        "LOAD(addr)                                     0           = MEMORY",
+        "SEXT(LOAD(addr))                               0           = MEMORY",
+        "ZEXT(LOAD(addr))                               0           = MEMORY",
+    ],
+
+    "callee": [
+        "GLOBAL                                         0   [direct] = CALLEE",
+        "reg                                            0           = CALLEE",
+    ],
+
+    # Constants.
+    "imm": [
+        "CONST                                          0   [imm32]  = CONSTANT",
+    ],
+    "zero": [
+        "CONST                                          0   [zero]   = CONSTANT",
+    ],
+    "scale": [
+        "CONST                                          0   [scale]  = CONSTANT",
+    ],
+    "shift": [
+        "CONST                                          0   [shift]  = CONSTANT",
+    ],
+    "factor": [
+        "CONST                                          0   [factor] = CONSTANT",
+    ],
+    "symbol": [
+        "GLOBAL                                         0           = CONSTANT",
+    ],
+}
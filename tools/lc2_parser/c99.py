@@ -15,6 +15,9 @@ START = "Root"
 #  - sizeof unary-expr (p90)
 # expressions:
 #  - expression , assignment-expression (p106)
+# statements:
+#  - identifier : statement (p131)
+#  - if ( expression ) statement [else statement] (p133)
 
 GRAMMAR = {
     "Primary": [
@@ -168,15 +171,26 @@ GRAMMAR = {
         "DeclarationSpecifiers InitDeclaratorList",
     ],
     "DeclarationSpecifiers": [
-        "TOK_STATIC DeclarationSpecifiers",
-        "TOK_REGISTER DeclarationSpecifiers",
-        "TOK_VOID DeclarationSpecifiers",
-        "TOK_CHAR DeclarationSpecifiers",
-        "TOK_SHORT DeclarationSpecifiers",
-        "TOK_INT DeclarationSpecifiers",
-        "TOK_SIGNED DeclarationSpecifiers",
-        "TOK_UNSIGNED DeclarationSpecifiers",
-        "TOK_CONST DeclarationSpecifiers",
+        "TOK_STATIC DeclarationSpecifiers_End",
+        "TOK_REGISTER DeclarationSpecifiers_End",
+        "TOK_VOID DeclarationSpecifiers_End",
+        "TOK_CHAR DeclarationSpecifiers_End",
+        "TOK_SHORT DeclarationSpecifiers_End",
+        "TOK_INT DeclarationSpecifiers_End",
+        "TOK_SIGNED DeclarationSpecifiers_End",
+        "TOK_UNSIGNED DeclarationSpecifiers_End",
+        "TOK_CONST DeclarationSpecifiers_End",
+    ],
+    "DeclarationSpecifiers_End": [
+        "TOK_STATIC DeclarationSpecifiers_End",
+        "TOK_REGISTER DeclarationSpecifiers_End",
+        "TOK_VOID DeclarationSpecifiers_End",
+        "TOK_CHAR DeclarationSpecifiers_End",
+        "TOK_SHORT DeclarationSpecifiers_End",
+        "TOK_INT DeclarationSpecifiers_End",
+        "TOK_SIGNED DeclarationSpecifiers_End",
+        "TOK_UNSIGNED DeclarationSpecifiers_End",
+        "TOK_CONST DeclarationSpecifiers_End",
         "$"
     ],
     "InitDeclaratorList": [
@@ -195,11 +209,108 @@ GRAMMAR = {
         "$"
     ],
     "Declarator": [
-        #TODO P126
-        "TOK_IDENTIFIER"
+        "Pointer DirectDeclarator"
+    ],
+    "Pointer": [
+        "* TypeQualifierList Pointer",
+        "$"
+    ],
+    "TypeQualifierList": [
+        "TOK_CONST TypeQualifierList",
+        "$"
+    ],
+    "DirectDeclarator": [
+        # TODO: handle '( declarator )' (p114)
+        "TOK_IDENTIFIER DirectDeclarator_End"
+    ],
+    "DirectDeclarator_End": [
+        "[ TOK_INTEGER_CONSTANT ] DirectDeclarator_End",
+        "( ParameterList ) DirectDeclarator_End",
+        "$"
+    ],
+    "ParameterList": [
+        "ParameterDeclaration ParameterList_End",
+        "$"
+    ],
+    "ParameterList_End": [
+        ", ParameterDeclaration ParameterList_End",
+        "$"
+    ],
+    "ParameterDeclaration": [
+        # Parameters may be abstract declarators, without an identifier.
+        "DeclarationSpecifiers Pointer ParameterDeclaration_End"
+    ],
+    "ParameterDeclaration_End": [
+        "DirectDeclarator",
+        "$"
+    ],
+    "Statement": [
+        "LabeledStatement",
+        "CompoundStatement",
+        "ExpressionStatement",
+        "SelectionStatement",
+        "IterationStatement",
+        "JumpStatement"
+    ],
+    "LabeledStatement": [
+        # (Only the labels of a 'switch'; the constant expression is checked by semantic
+        # analysis.)
+        "TOK_CASE Conditional : Statement",
+        "TOK_DEFAULT : Statement"
+    ],
+    "CompoundStatement": [
+        "{ BlockItemList }"
+    ],
+    "BlockItemList": [
+        "BlockItem BlockItemList",
+        "$"
+    ],
+    "BlockItem": [
+        "Declaration ;",
+        "Statement"
+    ],
+    "ExpressionStatement": [
+        "OptionalExpression ;"
+    ],
+    "OptionalExpression": [
+        "Expression",
+        "$"
+    ],
+    "SelectionStatement": [
+        "TOK_SWITCH ( Expression ) Statement"
+    ],
+    "IterationStatement": [
+        "TOK_WHILE ( Expression ) Statement",
+        "TOK_DO Statement TOK_WHILE ( Expression ) ;",
+        "TOK_FOR ( ForInit OptionalExpression ; OptionalExpression ) Statement"
+    ],
+    "ForInit": [
+        # The first clause of a 'for' may be a declaration (6.8.5, 3).
+        "Declaration ;",
+        "ExpressionStatement"
+    ],
+    "JumpStatement": [
+        "TOK_CONTINUE ;",
+        "TOK_BREAK ;",
+        "TOK_RETURN OptionalExpression ;"
+    ],
+    "TranslationUnit": [
+        "ExternalDeclaration TranslationUnit_End"
+    ],
+    "TranslationUnit_End": [
+        "ExternalDeclaration TranslationUnit_End",
+        "$"
+    ],
+    "ExternalDeclaration": [
+        # Function definition, or declaration.
+        "DeclarationSpecifiers Declarator ExternalDeclaration_End"
+    ],
+    "ExternalDeclaration_End": [
+        "CompoundStatement",
+        "InitDeclarator_End InitDeclaratorList_End ;"
     ],
     "Root": [
         "Expression TOK_EOF",
-        "Declaration TOK_EOF"
+        "TranslationUnit TOK_EOF"
     ]
 }
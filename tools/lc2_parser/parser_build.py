@@ -41,6 +41,12 @@ class Terminal:
     def __init__(self, token:str):
         self.name = token
 
+    def __eq__(self, other) -> bool:
+        return isinstance(other, Terminal) and self.name == other.name
+
+    def __hash__(self) -> int:
+        return hash(self.name)
+
     @property
     def cdef(self) -> str:
         """C++ representation for this Terminal.
@@ -120,55 +126,64 @@ class ParserTable:
         """
         return self._table
 
+    @staticmethod
+    def _sequence_first(elements) -> set:
+        """FIRST set of a sequence of grammar symbols.
+
+        The result contains '$' only if every element in the sequence can derive the empty string.
+        """
+        first = set()
+        for element in elements:
+            if isinstance(element, NonTerminal):
+                symbols = element.first
+            else:
+                symbols = {element}
+
+            first = first.union(t for t in symbols if str(t) != '$')
+            if '$' not in [str(t) for t in symbols]:
+                return first
+        return first.union({Terminal('$')})
+
     def _build_first_sets(self):
         prior = list()
 
-        while prior != [nt.first for nt in self._nonterminals.values()]:
-            prior = [nt.first for nt in self._nonterminals.values()]
+        while prior != [len(nt.first) for nt in self._nonterminals.values()]:
+            prior = [len(nt.first) for nt in self._nonterminals.values()]
 
             for p in self._productions:
-                for element in p.elements:
-                    if element == p:
-                        raise Exception("Left recursion.")
-                    
-                    if isinstance(element, NonTerminal):
-                        first = element.first
-                    elif isinstance(element, Terminal):
-                        first = {element}
-                    
-                    p.head.first = p.head.first.union(first)
-
-                    if '$' not in [str(p) for p in first]:
-                        break
+                if p.elements[0] == p.head:
+                    raise Exception("Left recursion.")
+
+                first = self._sequence_first(p.elements)
+                if '$' in [str(t) for t in p.head.first]:
+                    first = {t for t in first if str(t) != '$'}
+                p.head.first = p.head.first.union(first)
 
     def _build_follow_sets(self):
         prior = list()
 
-        while prior != [nt.follow for nt in self._nonterminals.values()]:
-            prior = [nt.follow for nt in self._nonterminals.values()]
+        while prior != [len(nt.follow) for nt in self._nonterminals.values()]:
+            prior = [len(nt.follow) for nt in self._nonterminals.values()]
 
             for production in self._productions:
                 trailer = production.head.follow
 
                 for element in production.elements[::-1]:
                     if isinstance(element, Terminal):
-                        trailer = {element}
+                        trailer = set() if element.name == '$' else {element}
                         continue
 
                     nt = element
                     nt.follow = nt.follow.union(trailer)
 
                     if '$' in [str(t) for t in nt.first]:
-                        trailer = {t for t in nt.first if str(t) != '$'}.union(nt.follow)
+                        trailer = {t for t in nt.first if str(t) != '$'}.union(trailer)
                     else:
                         trailer = nt.first
 
     def _build_augmented_first_sets(self):
         for production in self._productions:
-            if isinstance(production.elements[0], NonTerminal):
-                production.first = production.first.union(production.elements[0].first)
-            else:
-                production.first.add(production.elements[0])
+            production.first = self._sequence_first(production.elements)
 
             if '$' in [str(t) for t in production.first]:
                 production.first = {e for e in production.first if e.name != '$'}
@@ -177,5 +192,6 @@ class ParserTable:
     def _build_table(self):
         self._table = {p.head:dict() for p in self._productions}
         for production in self._productions:
+            # On a conflict the earlier production wins (e.g., 'else' binds to the nearest 'if').
             for terminal in production.first:
-                self._table[production.head][terminal] = production
+                self._table[production.head].setdefault(terminal, production)
@@ -52,6 +52,22 @@ struct ParseNode
     bool empty;
     std::vector<std::unique_ptr<ParseNode>> children;
     std::vector<std::shared_ptr<Token>> terminals;
+
+    // Destroy descendants iteratively, so that deep parse trees cannot overflow the stack.
+    ~ParseNode()
+    {{
+        std::vector<std::unique_ptr<ParseNode>> pending = std::move(children);
+        while(!pending.empty())
+        {{
+            auto node = std::move(pending.back());
+            pending.pop_back();
+            for(auto& child : node->children)
+            {{
+                pending.push_back(std::move(child));
+            }}
+            node->children.clear();
+        }}
+    }}
 }};
 
 class ParserError : public std::runtime_error
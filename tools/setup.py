@@ -10,7 +10,9 @@ setuptools.setup(
     entry_points={
         "console_scripts": [
             "gen-parser-h=lc2_parser.parser_hdr:main",
-            "gen-parser-cpp=lc2_parser.parser_impl:main"
+            "gen-parser-cpp=lc2_parser.parser_impl:main",
+            "gen-isel-h=lc2_isel.isel_hdr:main",
+            "gen-isel-cpp=lc2_isel.isel_impl:main"
         ]
     }
 )
\ No newline at end of file